@@ -0,0 +1,268 @@
+#include "hklua/allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+using namespace hklua;
+
+Allocator::~Allocator() noexcept {}
+
+void *Allocator::LuaAlloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  auto self = static_cast<Allocator *>(ud);
+  /* If ptr is NULL, osize is the type of object(see lua_Alloc) */
+  if (!ptr) osize = 0;
+
+  if (nsize == 0) {
+    if (ptr) {
+      self->Deallocate(ptr, osize);
+      self->bytes_ -= osize;
+    }
+    return nullptr;
+  }
+
+  /* The limit is not checked for the shrink, which never fails */
+  if (self->limit_ != 0 && nsize > osize &&
+      self->bytes_ - osize + nsize > self->limit_)
+  {
+    ++self->failure_count_;
+    return nullptr;
+  }
+
+  auto ret = self->Reallocate(ptr, osize, nsize);
+  if (!ret) {
+    ++self->failure_count_;
+    return nullptr;
+  }
+
+  self->bytes_ = self->bytes_ - osize + nsize;
+  if (nsize > osize) self->allocated_bytes_ += nsize - osize;
+  if (self->bytes_ > self->peak_bytes_) self->peak_bytes_ = self->bytes_;
+  return ret;
+}
+
+/*--------------------------------------------------*/
+/* SystemAllocator                                  */
+/*--------------------------------------------------*/
+
+void *SystemAllocator::Reallocate(void *ptr, size_t osize, size_t nsize)
+{
+  auto ret = realloc(ptr, nsize);
+  /* The block is still valid if it can't be shrunk */
+  return !ret && nsize <= osize ? ptr : ret;
+}
+
+void SystemAllocator::Deallocate(void *ptr, size_t osize)
+{
+  free(ptr);
+}
+
+/*--------------------------------------------------*/
+/* PoolAllocator                                    */
+/*--------------------------------------------------*/
+
+constexpr size_t PoolAllocator::kAlignment;
+constexpr size_t PoolAllocator::kMaxSmallSize;
+constexpr size_t PoolAllocator::kClassNum;
+constexpr size_t PoolAllocator::kDefaultChunkSize;
+
+PoolAllocator::PoolAllocator(size_t limit, size_t chunk_size)
+  : Allocator(limit)
+  , chunk_size_(std::max(chunk_size, kMaxSmallSize))
+  , adopted_num_(0)
+{
+  memset(free_lists_, 0, sizeof free_lists_);
+}
+
+PoolAllocator::~PoolAllocator() noexcept
+{
+  if (adopted_num_ != 0) FreeAdopted();
+  for (auto chunk : chunks_)
+    free(chunk);
+}
+
+/* The adopted blocks are the nodes of the free lists out of the chunks */
+void PoolAllocator::FreeAdopted() noexcept
+{
+  std::sort(chunks_.begin(), chunks_.end());
+  for (auto &head : free_lists_) {
+    for (auto node = head; node;) {
+      auto next = node->next;
+      auto p = reinterpret_cast<char *>(node);
+      auto iter = std::upper_bound(chunks_.begin(), chunks_.end(),
+                                   static_cast<void *>(p), std::less<void *>());
+      if (iter == chunks_.begin() ||
+          p >= static_cast<char *>(*(iter - 1)) + chunk_size_)
+      {
+        free(node);
+      }
+      node = next;
+    }
+    head = nullptr;
+  }
+}
+
+bool PoolAllocator::Refill(size_t cls)
+{
+  auto chunk = static_cast<char *>(malloc(chunk_size_));
+  if (!chunk) return false;
+  chunks_.push_back(chunk);
+
+  const auto obj_size = (cls + 1) * kAlignment;
+  const auto obj_num = chunk_size_ / obj_size;
+
+  /* Link the objects in address order */
+  FreeNode *head = nullptr;
+  for (size_t i = obj_num; i > 0; --i) {
+    auto node = reinterpret_cast<FreeNode *>(chunk + (i - 1) * obj_size);
+    node->next = head;
+    head = node;
+  }
+  free_lists_[cls] = head;
+  return true;
+}
+
+void *PoolAllocator::AllocateSmall(size_t cls)
+{
+  if (!free_lists_[cls] && !Refill(cls)) return nullptr;
+
+  auto node = free_lists_[cls];
+  free_lists_[cls] = node->next;
+  return node;
+}
+
+void PoolAllocator::DeallocateSmall(void *ptr, size_t cls) noexcept
+{
+  auto node = static_cast<FreeNode *>(ptr);
+  node->next = free_lists_[cls];
+  free_lists_[cls] = node;
+}
+
+void *PoolAllocator::Reallocate(void *ptr, size_t osize, size_t nsize)
+{
+  const bool old_small = ptr && osize <= kMaxSmallSize;
+  const bool new_small = nsize <= kMaxSmallSize;
+
+  if (ptr && !old_small && !new_small) {
+    auto ret = realloc(ptr, nsize);
+    return !ret && nsize <= osize ? ptr : ret;
+  }
+
+  if (old_small && new_small && SizeClass(osize) == SizeClass(nsize)) {
+    return ptr;
+  }
+
+  void *ret = new_small ? AllocateSmall(SizeClass(nsize)) : malloc(nsize);
+  if (!ret) {
+    if (!ptr || nsize > osize) return nullptr;
+    /* The shrink must not fail(see lua_Alloc), keep the block. The small
+     * one is freed to the smaller class, which wastes the tail only */
+    if (old_small) return ptr;
+
+    /* The large one is adopted by the pool when it is freed */
+    const auto size = (SizeClass(nsize) + 1) * kAlignment;
+    ret = realloc(ptr, size);
+    ++adopted_num_;
+    return ret ? ret : ptr;
+  }
+
+  if (ptr) {
+    memcpy(ret, ptr, std::min(osize, nsize));
+    Deallocate(ptr, osize);
+  }
+  return ret;
+}
+
+void PoolAllocator::Deallocate(void *ptr, size_t osize)
+{
+  if (osize <= kMaxSmallSize)
+    DeallocateSmall(ptr, SizeClass(osize));
+  else
+    free(ptr);
+}
+
+/*--------------------------------------------------*/
+/* ArenaAllocator                                   */
+/*--------------------------------------------------*/
+
+constexpr size_t ArenaAllocator::kAlignment;
+constexpr size_t ArenaAllocator::kDefaultBlockSize;
+
+ArenaAllocator::ArenaAllocator(size_t limit, size_t block_size)
+  : Allocator(limit)
+  , block_size_(block_size)
+  , block_bytes_(0)
+  , cur_(nullptr)
+  , end_(nullptr)
+{
+}
+
+ArenaAllocator::~ArenaAllocator() noexcept
+{
+  for (auto block : blocks_)
+    free(block);
+}
+
+void *ArenaAllocator::Allocate(size_t n)
+{
+  n = Align(n);
+  if (static_cast<size_t>(end_ - cur_) < n) {
+    /* The rest of current block is discarded */
+    const auto size = std::max(block_size_, n);
+    auto block = static_cast<char *>(malloc(size));
+    if (!block) return nullptr;
+    blocks_.push_back(block);
+    block_bytes_ += size;
+    cur_ = block;
+    end_ = block + size;
+  }
+
+  auto ret = cur_;
+  cur_ += n;
+  return ret;
+}
+
+void *ArenaAllocator::Reallocate(void *ptr, size_t osize, size_t nsize)
+{
+  if (ptr) {
+    if (Align(nsize) <= Align(osize)) {
+      if (IsLast(ptr, osize)) cur_ = static_cast<char *>(ptr) + Align(nsize);
+      return ptr;
+    }
+
+    /* Grow in place if it is the last object */
+    if (IsLast(ptr, osize) &&
+        static_cast<size_t>(end_ - static_cast<char *>(ptr)) >= Align(nsize))
+    {
+      cur_ = static_cast<char *>(ptr) + Align(nsize);
+      return ptr;
+    }
+  }
+
+  auto ret = Allocate(nsize);
+  if (ret && ptr) {
+    memcpy(ret, ptr, osize);
+  }
+  return ret;
+}
+
+void ArenaAllocator::Deallocate(void *ptr, size_t osize)
+{
+  if (IsLast(ptr, osize)) cur_ = static_cast<char *>(ptr);
+}
+
+/*--------------------------------------------------*/
+/* UserAllocator                                    */
+/*--------------------------------------------------*/
+
+void *UserAllocator::Reallocate(void *ptr, size_t osize, size_t nsize)
+{
+  return alloc_(ud_, ptr, osize, nsize);
+}
+
+void UserAllocator::Deallocate(void *ptr, size_t osize)
+{
+  alloc_(ud_, ptr, osize, 0);
+}
@@ -0,0 +1,230 @@
+#ifndef HKLUA_ALLOCATOR_H__
+#define HKLUA_ALLOCATOR_H__
+
+#include <lua.hpp>
+
+#include <stddef.h>
+#include <vector>
+
+namespace hklua {
+
+/**
+ * \brief Memory allocation policy of a Lua environment
+ *
+ * The base class does the byte accounting and the memory cap checking,
+ * the derived class just implement the Reallocate() and Deallocate().
+ *
+ * If the allocation exceeds the limit, return NULL to Lua, then
+ * the Lua raises a memory error, i.e. HKLUA_ERRMEM is returned
+ * from the protected call(e.g. DoString(), CallFunction()).
+ *
+ * \note
+ * A Lua environment is not thread-safe, the allocator is also.
+ * Each Env should own its allocator, then there is no contention.
+ */
+class Allocator {
+ public:
+  /**
+   * \param limit The maximum bytes used by Lua(0 indicates no limit)
+   */
+  explicit Allocator(size_t limit = 0) noexcept
+    : limit_(limit)
+    , bytes_(0)
+    , peak_bytes_(0)
+    , allocated_bytes_(0)
+    , failure_count_(0)
+  {
+  }
+
+  virtual ~Allocator() noexcept;
+
+  Allocator(Allocator const &) = delete;
+  Allocator &operator=(Allocator const &) = delete;
+
+  /**
+   * The lua_Alloc entry, the \p ud must be pointer to Allocator
+   */
+  static void *LuaAlloc(void *ud, void *ptr, size_t osize, size_t nsize);
+
+  void SetLimit(size_t limit) noexcept { limit_ = limit; }
+
+  size_t limit() const noexcept { return limit_; }
+  /** The bytes used by Lua currently */
+  size_t bytes() const noexcept { return bytes_; }
+  size_t peak_bytes() const noexcept { return peak_bytes_; }
+  /** The total bytes allocated(including the growth of reallocation),
+   *  it never decreases */
+  size_t allocated_bytes() const noexcept { return allocated_bytes_; }
+  /** The count of the allocations rejected due to the limit */
+  size_t failure_count() const noexcept { return failure_count_; }
+
+ protected:
+  /**
+   * \param ptr NULL indicates a new allocation
+   * \param osize 0 if \p ptr is NULL
+   * \param nsize Must not be 0
+   * \return NULL if failed to allocate, and \p ptr is not modified.
+   *         It must not fail if \p nsize <= \p osize(see lua_Alloc)
+   */
+  virtual void *Reallocate(void *ptr, size_t osize, size_t nsize) = 0;
+
+  /**
+   * \param ptr Not NULL
+   */
+  virtual void Deallocate(void *ptr, size_t osize) = 0;
+
+ private:
+  size_t limit_;
+  size_t bytes_;
+  size_t peak_bytes_;
+  size_t allocated_bytes_;
+  size_t failure_count_;
+};
+
+/**
+ * \brief realloc() and free(), i.e. same as luaL_newstate()
+ *
+ * Useful if you just want the byte accounting and the memory cap.
+ */
+class SystemAllocator : public Allocator {
+ public:
+  explicit SystemAllocator(size_t limit = 0) noexcept
+    : Allocator(limit)
+  {
+  }
+
+ protected:
+  void *Reallocate(void *ptr, size_t osize, size_t nsize) override;
+  void Deallocate(void *ptr, size_t osize) override;
+};
+
+/**
+ * \brief Size-class pool
+ *
+ * The small objects(strings, tables, closures, etc.) are allocated from
+ * the free list of its size class, the free list is refilled by
+ * carving a large chunk. The object is put back to the free list
+ * when it is freed, so it can be reused quickly without calling malloc().
+ *
+ * The large objects(> kMaxSmallSize) are allocated by the realloc().
+ *
+ * The memory of chunks is returned to the system when the pool is destroyed.
+ * If the shrink can't get a block of the new class, the block is kept
+ * (the large one is shrunk by realloc() and adopted by the pool).
+ */
+class PoolAllocator : public Allocator {
+ public:
+  static constexpr size_t kAlignment = 16;
+  static constexpr size_t kMaxSmallSize = 512;
+  static constexpr size_t kClassNum = kMaxSmallSize / kAlignment;
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  explicit PoolAllocator(size_t limit = 0,
+                         size_t chunk_size = kDefaultChunkSize);
+  ~PoolAllocator() noexcept override;
+
+  /** The bytes of chunks allocated from the system */
+  size_t chunk_bytes() const noexcept { return chunks_.size() * chunk_size_; }
+
+ protected:
+  void *Reallocate(void *ptr, size_t osize, size_t nsize) override;
+  void Deallocate(void *ptr, size_t osize) override;
+
+  /** Carve a chunk into the free list of \p cls */
+  virtual bool Refill(size_t cls);
+
+ private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  static size_t SizeClass(size_t n) noexcept
+  {
+    return (n + kAlignment - 1) / kAlignment - 1;
+  }
+
+  void *AllocateSmall(size_t cls);
+  void DeallocateSmall(void *ptr, size_t cls) noexcept;
+  void FreeAdopted() noexcept;
+
+  size_t chunk_size_;
+  FreeNode *free_lists_[kClassNum];
+  std::vector<void *> chunks_;
+  /* The large blocks shrunk into the small classes */
+  size_t adopted_num_;
+};
+
+/**
+ * \brief Per-Env bump-pointer arena
+ *
+ * The allocation just bumps the pointer in the current block.
+ * The free is no-op except the last allocated object, the memory is
+ * reclaimed only when the arena is destroyed.
+ *
+ * Suitable for the short-lived Env which runs a script then is destroyed.
+ * For long-lived Env, use PoolAllocator instead, or set a limit to
+ * avoid memory growing unbounded.
+ *
+ * \note The limit is applied to the bytes used by Lua, not the blocks.
+ */
+class ArenaAllocator : public Allocator {
+ public:
+  static constexpr size_t kAlignment = 16;
+  static constexpr size_t kDefaultBlockSize = 256 * 1024;
+
+  explicit ArenaAllocator(size_t limit = 0,
+                          size_t block_size = kDefaultBlockSize);
+  ~ArenaAllocator() noexcept override;
+
+  /** The bytes of blocks allocated from the system */
+  size_t block_bytes() const noexcept { return block_bytes_; }
+
+ protected:
+  void *Reallocate(void *ptr, size_t osize, size_t nsize) override;
+  void Deallocate(void *ptr, size_t osize) override;
+
+ private:
+  static size_t Align(size_t n) noexcept
+  {
+    return (n + kAlignment - 1) & ~(kAlignment - 1);
+  }
+
+  void *Allocate(size_t n);
+  bool IsLast(void *ptr, size_t osize) const noexcept
+  {
+    return static_cast<char *>(ptr) + Align(osize) == cur_;
+  }
+
+  size_t block_size_;
+  size_t block_bytes_;
+  char *cur_;
+  char *end_;
+  std::vector<void *> blocks_;
+};
+
+/**
+ * \brief Wrapper of user lua_Alloc
+ *
+ * The \p alloc must follow the contract of lua_Alloc.
+ */
+class UserAllocator : public Allocator {
+ public:
+  UserAllocator(lua_Alloc alloc, void *ud, size_t limit = 0) noexcept
+    : Allocator(limit)
+    , alloc_(alloc)
+    , ud_(ud)
+  {
+  }
+
+ protected:
+  void *Reallocate(void *ptr, size_t osize, size_t nsize) override;
+  void Deallocate(void *ptr, size_t osize) override;
+
+ private:
+  lua_Alloc alloc_;
+  void *ud_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_ALLOCATOR_H__
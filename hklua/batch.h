@@ -0,0 +1,255 @@
+#ifndef HKLUA_BATCH_H__
+#define HKLUA_BATCH_H__
+
+#include <lua.hpp>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "hklua/bind.h"
+#include "hklua/function.h"
+#include "hklua/result.h"
+
+namespace hklua {
+
+namespace detail {
+
+/* The number of results of the handler, std::tuple is multiple results */
+template <typename R>
+struct ResultNum {
+  static constexpr int value = 1;
+};
+
+/* The results are discarded */
+struct NoResult {
+};
+
+template <>
+struct ResultNum<NoResult> {
+  static constexpr int value = 0;
+};
+
+template <typename... Rets>
+struct ResultNum<std::tuple<Rets...>> {
+  static constexpr int value = (int)sizeof...(Rets);
+};
+
+/* Push the arguments of a call, std::tuple is multiple arguments */
+template <typename T>
+inline int PushArguments(lua_State *env, T const &arg)
+{
+  StackPush(env, arg);
+  return 1;
+}
+
+template <typename... Args>
+inline int PushArguments(lua_State *env, std::tuple<Args...> const &args)
+{
+  PushTuple(env, args, std::index_sequence_for<Args...>());
+  return (int)sizeof...(Args);
+}
+
+/* \p index is the index of the last result */
+template <typename R>
+inline bool ConvResults(lua_State *env, int index, R &ret)
+{
+  return StackConv(env, index, ret);
+}
+
+template <typename... Rets>
+inline bool ConvResults(lua_State *env, int index, std::tuple<Rets...> &ret)
+{
+  return StackConvMultiple(env, index, ret);
+}
+
+inline bool ConvResults(lua_State *, int, NoResult &)
+{
+  return true;
+}
+
+inline Error BatchError(Error const &err, size_t i)
+{
+  return Error(err.code(), "call " + std::to_string(i) + ": " + err.message(),
+               err.traceback());
+}
+
+/**
+ * Call the function on the top once per element of [first, last)
+ *
+ * The function is looked up once and kept in its slot, each call just
+ * copies it(lua_pushvalue()) and pushes the arguments.
+ * The results are appended to \p rets(NULL indicates no result).
+ * It stops at the first failure, the stack is always restored.
+ *
+ * \pre The function object is on the top of the stack
+ */
+template <typename R, typename Iter>
+Result<void> CallEachOnTop(lua_State *env, bool traceback, Iter first,
+                           Iter last, std::vector<R> *rets)
+{
+  const int top = lua_gettop(env) - 1;
+  const int func = top + 1;
+  const int nrets = rets ? ResultNum<R>::value : 0;
+  int msgh = 0;
+  if (traceback) {
+    lua_pushcfunction(env, &TracebackHandler);
+    msgh = lua_gettop(env);
+  }
+  if (rets) rets->reserve(rets->size() + std::distance(first, last));
+
+  for (size_t i = 0; first != last; ++first, ++i) {
+    lua_pushvalue(env, func);
+    const auto nargs = PushArguments(env, *first);
+    const auto status = (HKLuaError)lua_pcall(env, nargs, nrets, msgh);
+    if (status != HKLUA_OK) {
+      auto err = ErrorFromStack(env, status);
+      lua_settop(env, top);
+      return BatchError(err, i);
+    }
+
+    if (rets) {
+      R ret;
+      if (!ConvResults(env, lua_gettop(env), ret)) {
+        lua_settop(env, top);
+        return Error(HKLUA_ERRTYPE, "call " + std::to_string(i) +
+                                        ": the results can't be converted");
+      }
+      rets->push_back(std::move(ret));
+      lua_pop(env, nrets);
+    }
+  }
+
+  lua_settop(env, top);
+  return {};
+}
+
+/**
+ * Call the function on the top once with an array of [first, last),
+ * the function returns an array of the results in the same order.
+ *
+ * \pre The function object is on the top of the stack
+ */
+template <typename R, typename Iter>
+Result<void> CallBatchOnTop(lua_State *env, bool traceback, Iter first,
+                            Iter last, std::vector<R> *rets)
+{
+  const int top = lua_gettop(env) - 1;
+  const auto n = std::distance(first, last);
+
+  lua_createtable(env, (int)n, 0);
+  for (lua_Integer i = 1; first != last; ++first, ++i) {
+    StackPush(env, *first);
+    lua_rawseti(env, -2, i);
+  }
+
+  auto err = PCallOnTop(env, 1, rets ? 1 : 0, traceback);
+  if (!err.ok()) return err;
+  if (!rets) return {};
+
+  if (!lua_istable(env, -1)) {
+    lua_settop(env, top);
+    return Error(HKLUA_ERRTYPE, "the batch handler must return an array");
+  }
+
+  rets->reserve(rets->size() + n);
+  const int results = lua_gettop(env);
+  for (lua_Integer i = 1; i <= (lua_Integer)n; ++i) {
+    lua_rawgeti(env, results, i);
+    R ret;
+    if (!ConvResults(env, results + 1, ret)) {
+      lua_settop(env, top);
+      return Error(HKLUA_ERRTYPE, "result " + std::to_string(i) +
+                                      " can't be converted");
+    }
+    rets->push_back(std::move(ret));
+    lua_pop(env, 1);
+  }
+
+  lua_settop(env, top);
+  return {};
+}
+
+} // namespace detail
+
+/**
+ * Call \p func once per element of \p args, the results are appended
+ * to \p rets.
+ * Compared with calling CallFunction() in a loop, the function is
+ * looked up once and the stack slots are reused.
+ * The element is the argument, or std::tuple of the arguments.
+ * R is the result, or std::tuple of the results.
+ * e.g.
+ * std::vector<std::tuple<Integer, std::string>> events;
+ * std::vector<bool> handled;
+ * auto ret = TryCallEach(handler, events, handled);
+ *
+ * \return The error of the first failed call, its index is in the
+ *         message, and \p rets contains the results before it
+ * \see Env::TryCallEach()
+ */
+template <typename R, typename Range>
+Result<void> TryCallEach(FunctionRef const &func, Range const &args,
+                         std::vector<R> &rets)
+{
+  if (!func.IsValid()) return Error(HKLUA_ERRTYPE, "invalid function reference");
+  func.Push();
+  return detail::CallEachOnTop(func.env(), false, std::begin(args),
+                               std::end(args), &rets);
+}
+
+/**
+ * Like TryCallEach() but the results are discarded
+ */
+template <typename Range>
+Result<void> TryCallEach(FunctionRef const &func, Range const &args)
+{
+  if (!func.IsValid()) return Error(HKLUA_ERRTYPE, "invalid function reference");
+  func.Push();
+  return detail::CallEachOnTop<detail::NoResult>(
+      func.env(), false, std::begin(args), std::end(args), nullptr);
+}
+
+/**
+ * Call \p func once with the array of \p args(pre-sized), i.e. the
+ * handler processes the batch in Lua:
+ * function handler(events)
+ *   local results = {}
+ *   for i, e in ipairs(events) do results[i] = ... end
+ *   return results
+ * end
+ * The element is pushed by StackPush(), e.g. a struct(see HKLUA_STRUCT).
+ * The results in the returned array are appended to \p rets.
+ *
+ * There is only one lua_pcall(), but the array of arguments and the
+ * array of results are created per call, so it is not cheaper than
+ * TryCallEach() unless the batch is large. Use it if the handler needs
+ * the whole batch, e.g. aggregation.
+ * \see Env::TryCallBatch()
+ */
+template <typename R, typename Range>
+Result<void> TryCallBatch(FunctionRef const &func, Range const &args,
+                          std::vector<R> &rets)
+{
+  if (!func.IsValid()) return Error(HKLUA_ERRTYPE, "invalid function reference");
+  func.Push();
+  return detail::CallBatchOnTop(func.env(), false, std::begin(args),
+                                std::end(args), &rets);
+}
+
+/**
+ * Like TryCallBatch() but the handler returns nothing
+ */
+template <typename Range>
+Result<void> TryCallBatch(FunctionRef const &func, Range const &args)
+{
+  if (!func.IsValid()) return Error(HKLUA_ERRTYPE, "invalid function reference");
+  func.Push();
+  return detail::CallBatchOnTop<detail::NoResult>(
+      func.env(), false, std::begin(args), std::end(args), nullptr);
+}
+
+} // namespace hklua
+
+#endif // HKLUA_BATCH_H__
@@ -0,0 +1,232 @@
+#ifndef HKLUA_BIND_H__
+#define HKLUA_BIND_H__
+
+/*
+ * The common facilities of binding C++ functions to Lua.
+ * The arguments are converted by StackConv() and the return values
+ * are pushed by StackPush(), i.e. the existing overload set.
+ */
+
+#include <lua.hpp>
+
+#include <exception>
+#include <stdio.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "hklua/stack.h"
+
+namespace hklua {
+namespace detail {
+
+/* Same as LUAI_MAXALIGN, the alignment of userdata */
+union MaxAlign {
+  lua_Number n;
+  double u;
+  void *s;
+  lua_Integer i;
+  long l;
+};
+
+template <typename T>
+using ArgType = typename std::decay<T>::type;
+
+/** The error raised by the native call */
+struct NativeError {
+  char msg[256];
+};
+
+/*
+ * The flags or-ed to the number of results returned by InvokeNative(),
+ * which indicate the results are yielded instead of returned.
+ */
+enum : int {
+  kNativeYield = 1 << 16,  /* lua_yield() */
+  kNativeYieldK = 1 << 17, /* lua_yieldk(), see YieldThen */
+};
+
+/**
+ * The header of the userdata which stores the continuation,
+ * the continuation itself is placed at sizeof(MaxAlign).
+ * The userdata is below the yielded values.
+ */
+struct ContinuationHeader {
+  lua_KFunction k;
+};
+
+} // namespace detail
+
+/**
+ * Return it from the bound C++ function to yield the running coroutine,
+ * the \p values are passed to the resumer.
+ * When the coroutine is resumed, the arguments of resume are the results
+ * of the function call in Lua.
+ * e.g.
+ * env.Register("wait", [](Integer id) { return MakeYield(id); });
+ *
+ * \see YieldThen, Coroutine
+ */
+template <typename... Rets>
+struct Yield {
+  std::tuple<Rets...> values;
+};
+
+template <typename... Rets>
+inline Yield<typename std::decay<Rets>::type...> MakeYield(Rets &&...values)
+{
+  return { std::make_tuple(std::forward<Rets>(values)...) };
+}
+
+namespace detail {
+
+/**
+ * \return The index of the first bad argument, 0 if all are converted
+ */
+template <typename Tuple, size_t... I>
+inline int ConvArgs(lua_State *env, int first, Tuple &args,
+                    std::index_sequence<I...>)
+{
+  int bad = 0;
+  /* Convert in order and stop at the first failure */
+  int dummy[] = { 0, (bad == 0 && !StackConv(env, first + (int)I,
+                                             std::get<I>(args))
+                          ? (bad = first + (int)I)
+                          : 0)... };
+  (void)dummy;
+  /* Avoid unused warning if no argument */
+  (void)env;
+  (void)first;
+  (void)args;
+  return bad;
+}
+
+template <typename F, typename Tuple, size_t... I>
+inline auto Apply(F &&f, Tuple &args, std::index_sequence<I...>)
+    -> decltype(std::forward<F>(f)(std::move(std::get<I>(args))...))
+{
+  return std::forward<F>(f)(std::move(std::get<I>(args))...);
+}
+
+template <typename Tuple, size_t... I>
+inline void PushTuple(lua_State *env, Tuple const &t,
+                      std::index_sequence<I...>)
+{
+  int dummy[] = { 0, (StackPush(env, std::get<I>(t)), 0)... };
+  (void)dummy;
+  (void)env;
+  (void)t;
+}
+
+/**
+ * Push the result of f(), return the number of results
+ */
+template <typename R>
+struct ResultPusher {
+  template <typename F>
+  static int Call(lua_State *env, F &&f)
+  {
+    StackPush(env, f());
+    return 1;
+  }
+};
+
+template <>
+struct ResultPusher<void> {
+  template <typename F>
+  static int Call(lua_State *env, F &&f)
+  {
+    f();
+    return 0;
+  }
+};
+
+/* Multiple returns */
+template <typename... Rets>
+struct ResultPusher<std::tuple<Rets...>> {
+  template <typename F>
+  static int Call(lua_State *env, F &&f)
+  {
+    PushTuple(env, f(), std::index_sequence_for<Rets...>());
+    return (int)sizeof...(Rets);
+  }
+};
+
+/* Yield the results, see Yield */
+template <typename... Rets>
+struct ResultPusher<Yield<Rets...>> {
+  template <typename F>
+  static int Call(lua_State *env, F &&f)
+  {
+    PushTuple(env, f().values, std::index_sequence_for<Rets...>());
+    return (int)sizeof...(Rets) | kNativeYield;
+  }
+};
+
+/**
+ * Convert the arguments from \p first, call f(args...), then push results.
+ *
+ * The Lua error is not raised here since lua_error() is implemented
+ * by longjmp() and the destructors of C++ objects would be skipped.
+ *
+ * \return The number of results, or -1 if failed and \p err is set
+ */
+template <typename R, typename... Args, typename F>
+inline int InvokeNative(lua_State *env, int first, F &&f, NativeError &err)
+{
+  try {
+    std::tuple<ArgType<Args>...> args;
+    const int bad =
+        ConvArgs(env, first, args, std::index_sequence_for<Args...>());
+    if (bad != 0) {
+      snprintf(err.msg, sizeof err.msg, "bad argument #%d (got %s)", bad,
+               luaL_typename(env, bad));
+      return -1;
+    }
+
+    return ResultPusher<R>::Call(env, [&f, &args]() -> R {
+      return Apply(f, args, std::index_sequence_for<Args...>());
+    });
+  }
+  catch (std::exception const &e) {
+    snprintf(err.msg, sizeof err.msg, "%s", e.what());
+  }
+  catch (...) {
+    snprintf(err.msg, sizeof err.msg, "unknown C++ exception");
+  }
+  return -1;
+}
+
+/**
+ * Raise the Lua error if \p nret < 0, or yield the results
+ * if \p nret has yield flag.
+ * Must be called in the frame without C++ objects to be destroyed,
+ * and the result must be returned by the C function.
+ */
+inline int FinishNative(lua_State *env, int nret, NativeError const &err)
+{
+  if (nret < 0) {
+    /* Same as luaL_error(), add the position information */
+    luaL_where(env, 1);
+    lua_pushstring(env, err.msg);
+    lua_concat(env, 2);
+    return lua_error(env);
+  }
+
+  if (nret & kNativeYieldK) {
+    nret &= ~kNativeYieldK;
+    const int ctx = lua_gettop(env) - nret;
+    auto header = static_cast<ContinuationHeader *>(lua_touserdata(env, ctx));
+    return lua_yieldk(env, nret, ctx, header->k);
+  }
+
+  if (nret & kNativeYield) {
+    return lua_yield(env, nret & ~kNativeYield);
+  }
+  return nret;
+}
+
+} // namespace detail
+} // namespace hklua
+
+#endif // HKLUA_BIND_H__
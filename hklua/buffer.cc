@@ -0,0 +1,226 @@
+#include "hklua/buffer.h"
+
+#include <limits.h>
+#include <new>
+
+using namespace hklua;
+
+/* The address is the registry key of the metatable */
+static char const kBufferMetaKey = 0;
+
+namespace {
+
+/*
+ * The user value is the buffer keeping the bytes alive(the slices only),
+ * i.e. the owner or the borrowed buffer sliced
+ */
+struct BufferData {
+  char const *data;
+  size_t size;
+  bool owner;
+};
+
+struct OwnedBuffer {
+  BufferData view;
+  std::string data;
+};
+
+} // namespace
+
+static BufferData *GetBuffer(lua_State *env, int index)
+{
+  auto p = lua_touserdata(env, index);
+  if (!p || !lua_getmetatable(env, index)) return nullptr;
+  lua_rawgetp(env, LUA_REGISTRYINDEX, &kBufferMetaKey);
+  const bool is_buffer = lua_rawequal(env, -1, -2);
+  lua_pop(env, 2);
+  if (!is_buffer) return nullptr;
+
+  /* The slice of the destroyed owner(see BufferGc()) is empty too */
+  auto buffer = static_cast<BufferData *>(p);
+  if (buffer->data && !buffer->owner) {
+    if (lua_getiuservalue(env, index, 1) == LUA_TUSERDATA &&
+        !static_cast<BufferData *>(lua_touserdata(env, -1))->data) {
+      buffer->data = nullptr;
+      buffer->size = 0;
+    }
+    lua_pop(env, 1);
+  }
+  return buffer;
+}
+
+static BufferData *CheckBuffer(lua_State *env)
+{
+  auto buffer = GetBuffer(env, 1);
+  if (!buffer) luaL_typeerror(env, 1, "buffer");
+  return buffer;
+}
+
+/* The same as string.sub() and string.byte() of lstrlib.c */
+static size_t StartPosition(lua_Integer pos, size_t len)
+{
+  if (pos > 0) return (size_t)pos;
+  if (pos == 0) return 1;
+  if (pos < -(lua_Integer)len) return 1;
+  return len + (size_t)pos + 1;
+}
+
+static size_t EndPosition(lua_State *env, int arg, lua_Integer def, size_t len)
+{
+  const auto pos = luaL_optinteger(env, arg, def);
+  if (pos > (lua_Integer)len) return len;
+  if (pos >= 0) return (size_t)pos;
+  if (pos < -(lua_Integer)len) return 0;
+  return len + (size_t)pos + 1;
+}
+
+static int BufferLen(lua_State *env)
+{
+  lua_pushinteger(env, (lua_Integer)CheckBuffer(env)->size);
+  return 1;
+}
+
+static int BufferByte(lua_State *env)
+{
+  auto buffer = CheckBuffer(env);
+  const auto start =
+      StartPosition(luaL_optinteger(env, 2, 1), buffer->size);
+  const auto end = EndPosition(env, 3, (lua_Integer)start, buffer->size);
+  if (start > end) return 0;
+  if (end - start >= (size_t)INT_MAX) {
+    return luaL_error(env, "buffer slice too long");
+  }
+
+  const int n = (int)(end - start) + 1;
+  luaL_checkstack(env, n, "buffer slice too long");
+  auto p = reinterpret_cast<unsigned char const *>(buffer->data) + start - 1;
+  for (int i = 0; i < n; ++i) {
+    lua_pushinteger(env, p[i]);
+  }
+  return n;
+}
+
+static void SetBufferMetatable(lua_State *env);
+
+static int BufferSub(lua_State *env)
+{
+  auto buffer = CheckBuffer(env);
+  const auto start =
+      StartPosition(luaL_checkinteger(env, 2), buffer->size);
+  const auto end = EndPosition(env, 3, -1, buffer->size);
+
+  auto slice =
+      static_cast<BufferData *>(lua_newuserdatauv(env, sizeof(BufferData), 1));
+  slice->data = buffer->data;
+  slice->size = 0;
+  slice->owner = false;
+  if (start <= end) {
+    slice->data += start - 1;
+    slice->size = end - start + 1;
+  }
+  SetBufferMetatable(env);
+
+  /* The slice of a slice is kept alive by the same one */
+  if (lua_getiuservalue(env, 1, 1) == LUA_TNIL) {
+    lua_pop(env, 1);
+    lua_pushvalue(env, 1);
+  }
+  lua_setiuservalue(env, -2, 1);
+  return 1;
+}
+
+static int BufferToString(lua_State *env)
+{
+  auto buffer = CheckBuffer(env);
+  lua_pushlstring(env, buffer->data, buffer->size);
+  return 1;
+}
+
+/* It may be called by the script(e.g. through debug.getmetatable()),
+ * the destroyed buffer is empty */
+static int BufferGc(lua_State *env)
+{
+  auto buffer = GetBuffer(env, 1);
+  if (buffer && buffer->owner) {
+    using std::string;
+    reinterpret_cast<OwnedBuffer *>(buffer)->data.~string();
+    buffer->data = nullptr;
+    buffer->size = 0;
+    buffer->owner = false;
+  }
+  return 0;
+}
+
+static void SetBufferMetatable(lua_State *env)
+{
+  if (lua_rawgetp(env, LUA_REGISTRYINDEX, &kBufferMetaKey) == LUA_TNIL) {
+    lua_pop(env, 1);
+    luaL_Reg const methods[] = {
+      { "len", &BufferLen },
+      { "byte", &BufferByte },
+      { "sub", &BufferSub },
+      { "tostring", &BufferToString },
+      { nullptr, nullptr },
+    };
+
+    lua_createtable(env, 0, 6);
+    lua_createtable(env, 0, 4);
+    luaL_setfuncs(env, methods, 0);
+    lua_setfield(env, -2, "__index");
+    lua_pushcfunction(env, &BufferLen);
+    lua_setfield(env, -2, "__len");
+    lua_pushcfunction(env, &BufferToString);
+    lua_setfield(env, -2, "__tostring");
+    lua_pushcfunction(env, &BufferGc);
+    lua_setfield(env, -2, "__gc");
+    /* The type name in the error messages */
+    lua_pushliteral(env, "buffer");
+    lua_setfield(env, -2, "__name");
+    /* Hide the metatable(and __gc) from getmetatable() */
+    lua_pushliteral(env, "buffer");
+    lua_setfield(env, -2, "__metatable");
+
+    lua_pushvalue(env, -1);
+    lua_rawsetp(env, LUA_REGISTRYINDEX, &kBufferMetaKey);
+  }
+  lua_setmetatable(env, -2);
+}
+
+namespace hklua {
+
+void PushBuffer(lua_State *env, StringView view)
+{
+  auto buffer =
+      static_cast<BufferData *>(lua_newuserdatauv(env, sizeof(BufferData), 1));
+  buffer->data = view.data;
+  buffer->size = view.size;
+  buffer->owner = false;
+  SetBufferMetatable(env);
+}
+
+void PushBuffer(lua_State *env, std::string &&data)
+{
+  auto buffer = static_cast<OwnedBuffer *>(
+      lua_newuserdatauv(env, sizeof(OwnedBuffer), 1));
+  buffer->view.data = nullptr;
+  buffer->view.size = 0;
+  buffer->view.owner = false;
+  /* Move after setting the metatable(may raise an error), so the string
+   * is always destroyed by __gc */
+  SetBufferMetatable(env);
+
+  new (&buffer->data) std::string(std::move(data));
+  buffer->view.data = buffer->data.data();
+  buffer->view.size = buffer->data.size();
+  buffer->view.owner = true;
+}
+
+bool ToBuffer(lua_State *env, int index, StringView &view)
+{
+  auto buffer = GetBuffer(env, index);
+  if (!buffer) return false;
+  view = StringView(buffer->data, buffer->size);
+  return true;
+}
+
+} // namespace hklua
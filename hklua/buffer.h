@@ -0,0 +1,69 @@
+#ifndef HKLUA_BUFFER_H__
+#define HKLUA_BUFFER_H__
+
+#include <lua.hpp>
+#include <string>
+
+#include "hklua/util/string_view.h"
+
+namespace hklua {
+
+/**
+ * \brief Pass the bytes to Lua without copy
+ *
+ * lua_pushlstring() copies(and hashes the short strings) the bytes,
+ * for a large payload, a buffer is a userdata of the pointer and
+ * the size instead, its methods are like the functions of string:
+ * #buf, buf:len()
+ * buf:byte([i [, j]])
+ * buf:sub(i [, j])     -- A buffer of the range, no copy
+ * buf:tostring(), tostring(buf) -- Copy into a Lua string
+ *
+ * StackConv() into StringView accepts the buffers, so the C++ functions
+ * taking StringView read them without copy too.
+ *
+ * \note
+ * The bytes of PushBuffer(StringView) are borrowed, they must be valid
+ * as long as the buffer(and its slices) is used by Lua.
+ * Prefer PushBuffer(std::string&&) if the lifetime is not clear.
+ */
+void PushBuffer(lua_State *env, StringView view);
+
+/**
+ * Move \p data into the buffer, the buffer owns it and the slices
+ * keep it alive
+ */
+void PushBuffer(lua_State *env, std::string &&data);
+
+/** Get the bytes of the buffer at \p index */
+bool ToBuffer(lua_State *env, int index, StringView &view);
+
+inline bool IsBuffer(lua_State *env, int index)
+{
+  StringView view;
+  return ToBuffer(env, index, view);
+}
+
+/**
+ * \brief Pushed as a buffer which borrows the bytes by StackPush()
+ *
+ * e.g. the return value of the registered function, or
+ * env.SetGlobal("payload", BufferView(payload));
+ */
+struct BufferView {
+  explicit BufferView(StringView v) noexcept
+    : view(v)
+  {
+  }
+
+  StringView view;
+};
+
+inline void StackPush(lua_State *env, BufferView buffer)
+{
+  PushBuffer(env, buffer.view);
+}
+
+} // namespace hklua
+
+#endif // HKLUA_BUFFER_H__
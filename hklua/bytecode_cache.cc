@@ -0,0 +1,230 @@
+#include "bytecode_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace hklua;
+
+static constexpr char kPersistMagic[4] = { 'H', 'K', 'L', 'C' };
+
+static int BytecodeWriter(lua_State *env, void const *p, size_t sz, void *ud)
+{
+  static_cast<std::string *>(ud)->append(static_cast<char const *>(p), sz);
+  return 0;
+}
+
+static uint64_t Fnv1a(std::string const &str) noexcept
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+BytecodeCache::BytecodeCache(std::string persist_dir, bool strip)
+  : persist_dir_(std::move(persist_dir))
+  , strip_(strip)
+  , hits_(0)
+  , misses_(0)
+{
+  if (!persist_dir_.empty() && persist_dir_.back() != '/') {
+    persist_dir_ += '/';
+  }
+}
+
+BytecodeCache::~BytecodeCache() noexcept {}
+
+HKLuaError BytecodeCache::LoadFile(lua_State *env, char const *filename)
+{
+  struct stat st;
+  if (::stat(filename, &st) != 0) {
+    /* Let luaL_loadfile() push the error message */
+    return (HKLuaError)luaL_loadfile(env, filename);
+  }
+
+  const int64_t mtime =
+      int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+  const int64_t size = st.st_size;
+
+  auto entry = Lookup(filename, mtime, size);
+  if (entry) {
+    std::string chunkname = "@";
+    chunkname += filename;
+    const auto ret = (HKLuaError)luaL_loadbufferx(
+        env, entry->bytecode.data(), entry->bytecode.size(),
+        chunkname.c_str(), "b");
+    if (ret == HKLUA_OK) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return ret;
+    }
+
+    /* The bytecode can't be loaded(e.g. the persisted file is corrupted
+     * or dumped by another Lua build), compile the file instead */
+    lua_pop(env, 1);
+    Drop(filename, entry);
+  }
+
+  HKLuaError err;
+  misses_.fetch_add(1, std::memory_order_relaxed);
+  /* The compiled chunk has been pushed */
+  Compile(env, filename, mtime, size, err);
+  return err;
+}
+
+auto BytecodeCache::Lookup(std::string const &filename, int64_t mtime,
+                           int64_t size) -> EntryPtr
+{
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto iter = entries_.find(filename);
+    if (iter != entries_.end() && iter->second->mtime == mtime &&
+        iter->second->size == size)
+    {
+      return iter->second;
+    }
+  }
+
+  if (persist_dir_.empty()) return nullptr;
+
+  auto entry = ReadPersisted(filename, mtime, size);
+  if (entry) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    entries_[filename] = entry;
+  }
+  return entry;
+}
+
+auto BytecodeCache::Compile(lua_State *env, char const *filename,
+                            int64_t mtime, int64_t size, HKLuaError &err)
+    -> EntryPtr
+{
+  err = (HKLuaError)luaL_loadfile(env, filename);
+  if (err != HKLUA_OK) return nullptr;
+
+  std::shared_ptr<Entry> entry(new Entry{ mtime, size, std::string() });
+  if (lua_dump(env, &BytecodeWriter, &entry->bytecode, strip_) != 0) {
+    /* The chunk is still usable even though it can't be cached */
+    return nullptr;
+  }
+
+  if (!persist_dir_.empty()) WritePersisted(filename, *entry);
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  entries_[filename] = entry;
+  return entry;
+}
+
+void BytecodeCache::Drop(std::string const &filename, EntryPtr const &entry)
+{
+  if (!persist_dir_.empty()) unlink(PersistPath(filename).c_str());
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto iter = entries_.find(filename);
+  if (iter != entries_.end() && iter->second == entry) entries_.erase(iter);
+}
+
+void BytecodeCache::Clear()
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  entries_.clear();
+}
+
+size_t BytecodeCache::size() const
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return entries_.size();
+}
+
+/*--------------------------------------------------*/
+/* Persistence                                      */
+/*--------------------------------------------------*/
+
+/*
+ * Format:
+ * | magic(4) | mtime(8) | size(8) | path length(4) | path | bytecode |
+ */
+
+std::string BytecodeCache::PersistPath(std::string const &filename) const
+{
+  char name[32];
+  snprintf(name, sizeof name, "%016llx.luac",
+           (unsigned long long)Fnv1a(filename));
+  return persist_dir_ + name;
+}
+
+auto BytecodeCache::ReadPersisted(std::string const &filename, int64_t mtime,
+                                  int64_t size) const -> EntryPtr
+{
+  auto fp = fopen(PersistPath(filename).c_str(), "rb");
+  if (!fp) return nullptr;
+
+  EntryPtr ret;
+  char magic[sizeof kPersistMagic];
+  int64_t file_mtime;
+  int64_t file_size;
+  uint32_t path_len;
+  std::string path;
+
+  if (fread(magic, sizeof magic, 1, fp) != 1 ||
+      memcmp(magic, kPersistMagic, sizeof magic) != 0 ||
+      fread(&file_mtime, sizeof file_mtime, 1, fp) != 1 ||
+      fread(&file_size, sizeof file_size, 1, fp) != 1 ||
+      fread(&path_len, sizeof path_len, 1, fp) != 1 ||
+      file_mtime != mtime || file_size != size || path_len != filename.size())
+  {
+    goto out;
+  }
+
+  path.resize(path_len);
+  if (fread(&path[0], 1, path_len, fp) != path_len || path != filename) {
+    goto out;
+  }
+
+  {
+    std::shared_ptr<Entry> entry(new Entry{ mtime, size, std::string() });
+    char buf[BUFSIZ];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, fp)) > 0) {
+      entry->bytecode.append(buf, n);
+    }
+    if (!ferror(fp) && !entry->bytecode.empty()) ret = std::move(entry);
+  }
+
+out:
+  fclose(fp);
+  return ret;
+}
+
+void BytecodeCache::WritePersisted(std::string const &filename,
+                                   Entry const &entry) const
+{
+  const auto path = PersistPath(filename);
+  /* Write to temporary file then rename it,
+   * the reader never see an incomplete file */
+  char tmp_path[64];
+  snprintf(tmp_path, sizeof tmp_path, ".tmp.%d.%p", (int)getpid(),
+           (void const *)&entry);
+  const auto full_tmp_path = persist_dir_ + tmp_path;
+
+  auto fp = fopen(full_tmp_path.c_str(), "wb");
+  if (!fp) return;
+
+  const uint32_t path_len = filename.size();
+  const bool ok =
+      fwrite(kPersistMagic, sizeof kPersistMagic, 1, fp) == 1 &&
+      fwrite(&entry.mtime, sizeof entry.mtime, 1, fp) == 1 &&
+      fwrite(&entry.size, sizeof entry.size, 1, fp) == 1 &&
+      fwrite(&path_len, sizeof path_len, 1, fp) == 1 &&
+      fwrite(filename.data(), 1, path_len, fp) == path_len &&
+      fwrite(entry.bytecode.data(), 1, entry.bytecode.size(), fp) ==
+          entry.bytecode.size();
+
+  if (fclose(fp) != 0 || !ok || rename(full_tmp_path.c_str(), path.c_str()))
+  {
+    unlink(full_tmp_path.c_str());
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef HKLUA_BYTECODE_CACHE_H__
+#define HKLUA_BYTECODE_CACHE_H__
+
+#include <lua.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "hklua/type.h"
+
+namespace hklua {
+
+/**
+ * \brief Cache of the precompiled chunks of Lua files
+ *
+ * The first load of a file compiles it by luaL_loadfile() and saves
+ * the bytecode by lua_dump(), the later loads(in any Env) just
+ * undump the bytecode, i.e. skip the lexer and parser.
+ *
+ * The entry is keyed by the path and validated by the modification
+ * time and size of file, so a modified file is compiled again.
+ *
+ * If the persistent directory is given, the bytecode is also saved
+ * to the directory, and a new process can reuse it.
+ *
+ * The cache is thread-safe, so it can be shared by the Envs
+ * in different threads(e.g. EnvPool).
+ */
+class BytecodeCache {
+ public:
+  /**
+   * \param persist_dir Empty indicates no persistence
+   * \param strip Strip the debug information(e.g. line number of error)
+   */
+  explicit BytecodeCache(std::string persist_dir = std::string(),
+                         bool strip = false);
+  ~BytecodeCache() noexcept;
+
+  BytecodeCache(BytecodeCache const &) = delete;
+  BytecodeCache &operator=(BytecodeCache const &) = delete;
+
+  /**
+   * Like luaL_loadfile(), the loaded chunk is pushed onto the stack
+   * if success, otherwise the error message is pushed.
+   */
+  HKLuaError LoadFile(lua_State *env, char const *filename);
+
+  /**
+   * Remove all entries in the memory(the persistent files are kept)
+   */
+  void Clear();
+
+  size_t size() const;
+  uint64_t hits() const noexcept { return hits_.load(); }
+  uint64_t misses() const noexcept { return misses_.load(); }
+
+ private:
+  struct Entry {
+    int64_t mtime;
+    int64_t size;
+    std::string bytecode;
+  };
+
+  using EntryPtr = std::shared_ptr<Entry const>;
+
+  EntryPtr Lookup(std::string const &filename, int64_t mtime, int64_t size);
+  EntryPtr Compile(lua_State *env, char const *filename, int64_t mtime,
+                   int64_t size, HKLuaError &err);
+  /* Remove the entry(and the persisted file) if it is not replaced */
+  void Drop(std::string const &filename, EntryPtr const &entry);
+
+  std::string PersistPath(std::string const &filename) const;
+  EntryPtr ReadPersisted(std::string const &filename, int64_t mtime,
+                         int64_t size) const;
+  void WritePersisted(std::string const &filename, Entry const &entry) const;
+
+  std::string persist_dir_;
+  bool strip_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, EntryPtr> entries_;
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_BYTECODE_CACHE_H__
@@ -0,0 +1,37 @@
+#include "class.h"
+
+namespace hklua {
+namespace detail {
+
+int ClassIndex(lua_State *env)
+{
+  /* Method first */
+  lua_pushvalue(env, 2);
+  if (lua_rawget(env, lua_upvalueindex(1)) != LUA_TNIL) return 1;
+  lua_pop(env, 1);
+
+  lua_pushvalue(env, 2);
+  if (lua_rawget(env, lua_upvalueindex(2)) == LUA_TNIL) return 1;
+
+  /* getter(self) */
+  lua_pushvalue(env, 1);
+  lua_call(env, 1, 1);
+  return 1;
+}
+
+int ClassNewIndex(lua_State *env)
+{
+  lua_pushvalue(env, 2);
+  if (lua_rawget(env, lua_upvalueindex(1)) == LUA_TNIL) {
+    return luaL_error(env, "no writable property '%s'", lua_tostring(env, 2));
+  }
+
+  /* setter(self, value) */
+  lua_pushvalue(env, 1);
+  lua_pushvalue(env, 3);
+  lua_call(env, 2, 0);
+  return 0;
+}
+
+} // namespace detail
+} // namespace hklua
@@ -0,0 +1,444 @@
+#ifndef HKLUA_CLASS_H__
+#define HKLUA_CLASS_H__
+
+#include <lua.hpp>
+
+#include <new>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+#include "hklua/bind.h"
+#include "hklua/env.h"
+
+namespace hklua {
+
+/* The hidden fields of metatable */
+#define HKLUA_CLASS_METHODS "__hklua_methods"
+#define HKLUA_CLASS_GETTERS "__hklua_getters"
+#define HKLUA_CLASS_SETTERS "__hklua_setters"
+
+namespace detail {
+
+/**
+ * The address is the registry key of the metatable of T
+ */
+template <typename T>
+struct ClassKey {
+  static char const key;
+};
+
+template <typename T>
+char const ClassKey<T>::key = 0;
+
+/**
+ * Get the object in the userdata at \p index whose metatable is
+ * the first upvalue, i.e. just compare with the cached metatable
+ */
+template <typename T>
+inline T *ToSelf(lua_State *env, int index)
+{
+  void *p = lua_touserdata(env, index);
+  if (!p || !lua_getmetatable(env, index)) return nullptr;
+  const bool same = lua_rawequal(env, -1, lua_upvalueindex(1));
+  lua_pop(env, 1);
+  return same ? static_cast<T *>(p) : nullptr;
+}
+
+inline int RaiseBadSelf(lua_State *env)
+{
+  lua_getfield(env, lua_upvalueindex(1), "__name");
+  return luaL_error(env, "bad self (%s expected, got %s)",
+                    lua_tostring(env, -1), luaL_typename(env, 1));
+}
+
+template <typename T, typename M, typename R, typename... Args>
+inline int InvokeMethod(lua_State *env, T *self, M mfp, NativeError &err)
+{
+  return InvokeNative<R, Args...>(
+      env, 2,
+      [self, mfp](ArgType<Args> &&...args) -> R {
+        return (self->*mfp)(std::forward<ArgType<Args>>(args)...);
+      },
+      err);
+}
+
+template <typename T, typename M>
+struct MethodInvoker;
+
+template <typename T, typename R, typename C, typename... Args>
+struct MethodInvoker<T, R (C::*)(Args...)> {
+  static int Call(lua_State *env, T *self, R (C::*mfp)(Args...),
+                  NativeError &err)
+  {
+    return InvokeMethod<T, decltype(mfp), R, Args...>(env, self, mfp, err);
+  }
+};
+
+template <typename T, typename R, typename C, typename... Args>
+struct MethodInvoker<T, R (C::*)(Args...) const> {
+  static int Call(lua_State *env, T *self, R (C::*mfp)(Args...) const,
+                  NativeError &err)
+  {
+    return InvokeMethod<T, decltype(mfp), R, Args...>(env, self, mfp, err);
+  }
+};
+
+/**
+ * upvalue 1: metatable
+ * upvalue 2: userdata of member function pointer
+ */
+template <typename T, typename M>
+int MethodTrampoline(lua_State *env)
+{
+  auto self = ToSelf<T>(env, 1);
+  if (!self) return RaiseBadSelf(env);
+
+  auto mfp = *static_cast<M *>(lua_touserdata(env, lua_upvalueindex(2)));
+  NativeError err;
+  const auto nret = MethodInvoker<T, M>::Call(env, self, mfp, err);
+  return FinishNative(env, nret, err);
+}
+
+/**
+ * The member function pointer is a constant, the call can be inlined
+ * upvalue 1: metatable
+ */
+template <typename T, typename M, M mfp>
+int ConstMethodTrampoline(lua_State *env)
+{
+  auto self = ToSelf<T>(env, 1);
+  if (!self) return RaiseBadSelf(env);
+
+  NativeError err;
+  const auto nret = MethodInvoker<T, M>::Call(env, self, mfp, err);
+  return FinishNative(env, nret, err);
+}
+
+template <typename T, typename... Args>
+int ConstructorTrampoline(lua_State *env)
+{
+  NativeError err;
+  const auto nret = InvokeNative<void, Args...>(
+      env, 1,
+      [env](ArgType<Args> &&...args) {
+        auto p = lua_newuserdatauv(env, sizeof(T), 0);
+        new (p) T(std::forward<ArgType<Args>>(args)...);
+        lua_pushvalue(env, lua_upvalueindex(1));
+        lua_setmetatable(env, -2);
+      },
+      err);
+  return FinishNative(env, nret < 0 ? nret : 1, err);
+}
+
+/**
+ * It may be called by the script(e.g. through debug.getmetatable()),
+ * the metatable is removed after destruction, so the object can't be
+ * used or destroyed again.
+ * upvalue 1: metatable
+ */
+template <typename T>
+int DestructorTrampoline(lua_State *env)
+{
+  auto self = ToSelf<T>(env, 1);
+  if (!self) return 0;
+  self->~T();
+  lua_pushnil(env);
+  lua_setmetatable(env, 1);
+  return 0;
+}
+
+/**
+ * upvalue 1: metatable
+ * upvalue 2: userdata of data member pointer
+ */
+template <typename T, typename V>
+int FieldGetter(lua_State *env)
+{
+  auto self = ToSelf<T>(env, 1);
+  if (!self) return RaiseBadSelf(env);
+  auto member =
+      *static_cast<V T::**>(lua_touserdata(env, lua_upvalueindex(2)));
+  StackPush(env, self->*member);
+  return 1;
+}
+
+template <typename T, typename V>
+int FieldSetter(lua_State *env)
+{
+  auto self = ToSelf<T>(env, 1);
+  if (!self) return RaiseBadSelf(env);
+  auto member =
+      *static_cast<V T::**>(lua_touserdata(env, lua_upvalueindex(2)));
+  if (!StackConv(env, 2, self->*member)) {
+    return luaL_error(env, "bad property value (got %s)",
+                      luaL_typename(env, 2));
+  }
+  return 0;
+}
+
+/**
+ * __index when there are properties
+ * upvalue 1: methods table
+ * upvalue 2: getters table
+ */
+int ClassIndex(lua_State *env);
+
+/**
+ * __newindex
+ * upvalue 1: setters table
+ */
+int ClassNewIndex(lua_State *env);
+
+} // namespace detail
+
+/**
+ * \brief Binding builder of C++ class
+ *
+ * e.g.
+ * Class<Point>(env, "Point")
+ *   .Constructor<double, double>()    // Point.new(x, y)
+ *   .Method("length", &Point::Length) // p:length()
+ *   .Property("x", &Point::x);        // p.x, p.x = 1
+ *
+ * The object is stored in the full userdata directly(no heap allocation),
+ * and destroyed by __gc.
+ *
+ * All methods and properties are registered into one metatable per
+ * Lua environment, which is cached in the registry and the upvalue of
+ * each method, i.e. the type check of self just compares the metatable.
+ * Each method is a template generated C function, there is no runtime
+ * dispatch except the conversion of arguments.
+ *
+ * \note
+ * The parameter of method can't be non-const lvalue reference.
+ */
+template <typename T>
+class Class {
+  static_assert(alignof(T) <= alignof(detail::MaxAlign),
+                "The userdata of Lua can't satisfy the alignment");
+
+ public:
+  /**
+   * Create the metatable if it is not created, and
+   * set the class table(contains constructor) to global \p name
+   */
+  Class(Env &env, char const *name)
+    : env_(env.env())
+  {
+    lua_rawgetp(env_, LUA_REGISTRYINDEX, &detail::ClassKey<T>::key);
+    if (lua_isnil(env_, -1)) {
+      lua_pop(env_, 1);
+      CreateMetatable(name);
+    }
+    lua_pop(env_, 1);
+
+    lua_getglobal(env_, name);
+    if (!lua_istable(env_, -1)) {
+      lua_pop(env_, 1);
+      lua_newtable(env_);
+      lua_pushvalue(env_, -1);
+      lua_setglobal(env_, name);
+    }
+    class_table_ = luaL_ref(env_, LUA_REGISTRYINDEX);
+  }
+
+  ~Class() noexcept { luaL_unref(env_, LUA_REGISTRYINDEX, class_table_); }
+
+  Class(Class const &) = delete;
+  Class &operator=(Class const &) = delete;
+
+  /**
+   * Register <name>.new(args...)
+   */
+  template <typename... Args>
+  Class &Constructor(char const *name = "new")
+  {
+    lua_rawgeti(env_, LUA_REGISTRYINDEX, class_table_);
+    PushMetatable(env_);
+    lua_pushcclosure(env_, &detail::ConstructorTrampoline<T, Args...>, 1);
+    lua_setfield(env_, -2, name);
+    lua_pop(env_, 1);
+    return *this;
+  }
+
+  /**
+   * The member function pointer is stored in the upvalue
+   */
+  template <typename M>
+  Class &Method(char const *name, M mfp)
+  {
+    PushMetatable(env_);
+    lua_getfield(env_, -1, HKLUA_CLASS_METHODS);
+    lua_pushvalue(env_, -2);
+    PushPointerToMember(mfp);
+    lua_pushcclosure(env_, &detail::MethodTrampoline<T, M>, 2);
+    lua_setfield(env_, -2, name);
+    lua_pop(env_, 2);
+    return *this;
+  }
+
+  /**
+   * The member function pointer is a template argument, e.g.
+   * cls.Method<decltype(&Point::Length), &Point::Length>("length");
+   */
+  template <typename M, M mfp>
+  Class &Method(char const *name)
+  {
+    PushMetatable(env_);
+    lua_getfield(env_, -1, HKLUA_CLASS_METHODS);
+    lua_pushvalue(env_, -2);
+    lua_pushcclosure(env_, &detail::ConstMethodTrampoline<T, M, mfp>, 1);
+    lua_setfield(env_, -2, name);
+    lua_pop(env_, 2);
+    return *this;
+  }
+
+  /**
+   * Readable and writable data member
+   */
+  template <typename V, typename = typename std::enable_if<
+                            !std::is_function<V>::value>::type>
+  Class &Property(char const *name, V T::*member)
+  {
+    AddAccessor(HKLUA_CLASS_GETTERS, name, member,
+                &detail::FieldGetter<T, V>);
+    AddAccessor(HKLUA_CLASS_SETTERS, name, member,
+                &detail::FieldSetter<T, V>);
+    return *this;
+  }
+
+  /**
+   * Property by getter and setter(optional) member functions
+   * e.g. R (T::*)() const and void (T::*)(V)
+   */
+  template <typename G, typename S = std::nullptr_t>
+  Class &Property(char const *name, G getter, S setter = nullptr)
+  {
+    AddAccessor(HKLUA_CLASS_GETTERS, name, getter,
+                &detail::MethodTrampoline<T, G>);
+    AddSetter(name, setter);
+    return *this;
+  }
+
+  /**
+   * Push the \p obj as the userdata of T
+   * \pre The Class<T> has been created in the \p env
+   */
+  template <typename U>
+  static void Push(lua_State *env, U &&obj)
+  {
+    auto p = lua_newuserdatauv(env, sizeof(T), 0);
+    new (p) T(std::forward<U>(obj));
+    PushMetatable(env);
+    lua_setmetatable(env, -2);
+  }
+
+  /**
+   * \return NULL if the value at \p index is not the userdata of T
+   */
+  static T *To(lua_State *env, int index)
+  {
+    void *p = lua_touserdata(env, index);
+    if (!p || !lua_getmetatable(env, index)) return nullptr;
+    PushMetatable(env);
+    const bool same = lua_rawequal(env, -1, -2);
+    lua_pop(env, 2);
+    return same ? static_cast<T *>(p) : nullptr;
+  }
+
+ private:
+  static void PushMetatable(lua_State *env)
+  {
+    lua_rawgetp(env, LUA_REGISTRYINDEX, &detail::ClassKey<T>::key);
+  }
+
+  void CreateMetatable(char const *name)
+  {
+    lua_newtable(env_);
+    lua_pushstring(env_, name);
+    lua_setfield(env_, -2, "__name");
+
+    /* Hide the metatable(and __gc) from getmetatable() */
+    lua_pushstring(env_, name);
+    lua_setfield(env_, -2, "__metatable");
+
+    if (!std::is_trivially_destructible<T>::value) {
+      lua_pushvalue(env_, -1);
+      lua_pushcclosure(env_, &detail::DestructorTrampoline<T>, 1);
+      lua_setfield(env_, -2, "__gc");
+    }
+
+    /* Methods are looked up by the VM directly if no property */
+    lua_newtable(env_);
+    lua_pushvalue(env_, -1);
+    lua_setfield(env_, -3, HKLUA_CLASS_METHODS);
+    lua_setfield(env_, -2, "__index");
+
+    lua_pushvalue(env_, -1);
+    lua_rawsetp(env_, LUA_REGISTRYINDEX, &detail::ClassKey<T>::key);
+  }
+
+  template <typename P>
+  void PushPointerToMember(P ptr)
+  {
+    auto p = lua_newuserdatauv(env_, sizeof(P), 0);
+    new (p) P(ptr);
+  }
+
+  /**
+   * Create the accessor table if it isn't created, then
+   * install the __index or __newindex closure
+   */
+  void PushAccessorTable(char const *field)
+  {
+    PushMetatable(env_);
+    if (lua_getfield(env_, -1, field) != LUA_TTABLE) {
+      lua_pop(env_, 1);
+      lua_newtable(env_);
+      lua_pushvalue(env_, -1);
+      lua_setfield(env_, -3, field);
+
+      if (strcmp(field, HKLUA_CLASS_GETTERS) == 0) {
+        lua_getfield(env_, -2, HKLUA_CLASS_METHODS);
+        lua_pushvalue(env_, -2);
+        lua_pushcclosure(env_, &detail::ClassIndex, 2);
+        lua_setfield(env_, -3, "__index");
+      } else {
+        lua_pushvalue(env_, -1);
+        lua_pushcclosure(env_, &detail::ClassNewIndex, 1);
+        lua_setfield(env_, -3, "__newindex");
+      }
+    }
+    lua_remove(env_, -2);
+  }
+
+  template <typename P>
+  void AddAccessor(char const *field, char const *name, P ptr,
+                   lua_CFunction accessor)
+  {
+    PushAccessorTable(field);
+    PushMetatable(env_);
+    PushPointerToMember(ptr);
+    lua_pushcclosure(env_, accessor, 2);
+    lua_setfield(env_, -2, name);
+    lua_pop(env_, 1);
+  }
+
+  void AddSetter(char const *name, std::nullptr_t) {}
+
+  template <typename S>
+  void AddSetter(char const *name, S setter)
+  {
+    AddAccessor(HKLUA_CLASS_SETTERS, name, setter,
+                &detail::MethodTrampoline<T, S>);
+  }
+
+  lua_State *env_;
+  /* Reference of the class table in registry */
+  int class_table_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_CLASS_H__
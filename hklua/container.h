@@ -0,0 +1,193 @@
+#ifndef HKLUA_CONTAINER_H__
+#define HKLUA_CONTAINER_H__
+
+/*
+ * Bulk conversion between the Lua table and C++ containers.
+ * The table is pre-sized by lua_createtable(), and the elements are
+ * accessed by lua_rawseti()/lua_rawgeti(), i.e. no metamethod.
+ *
+ * \note Don't include this header directly, include stack.h instead
+ */
+
+#include "hklua/stack.h"
+
+namespace hklua {
+
+namespace detail {
+
+template <typename K>
+inline bool StackConvKey(lua_State *env, int index, K &key)
+{
+  return StackConv(env, index, key);
+}
+
+/*
+ * lua_tolstring() converts the number key to string in place,
+ * that confuses lua_next(), so only the string key is accepted.
+ */
+inline bool StackConvKey(lua_State *env, int index, std::string &key)
+{
+  if (lua_type(env, index) != LUA_TSTRING) return false;
+  return StackConv(env, index, key);
+}
+
+inline bool StackConvKey(lua_State *env, int index, char const *&key)
+{
+  if (lua_type(env, index) != LUA_TSTRING) return false;
+  return StackConv(env, index, key);
+}
+
+/* The buffer key is also accepted(see buffer.h) */
+inline bool StackConvKey(lua_State *env, int index, StringView &key)
+{
+  if (lua_type(env, index) == LUA_TNUMBER) return false;
+  return StackConv(env, index, key);
+}
+
+template <typename Iter>
+inline void StackPushArray(lua_State *env, Iter first, size_t n)
+{
+  lua_createtable(env, (int)n, 0);
+  for (size_t i = 1; i <= n; ++i, ++first) {
+    StackPush(env, *first);
+    lua_rawseti(env, -2, (Integer)i);
+  }
+}
+
+/**
+ * Convert t[1..n] to the elements in [first, first+n)
+ */
+template <typename Iter>
+inline bool StackConvArray(lua_State *env, int index, Iter first, size_t n)
+{
+  for (size_t i = 1; i <= n; ++i, ++first) {
+    lua_rawgeti(env, index, (Integer)i);
+    const auto success = StackConv(env, lua_gettop(env), *first);
+    lua_pop(env, 1);
+    if (!success) return false;
+  }
+  return true;
+}
+
+} // namespace detail
+
+/*--------------------------------------------------*/
+/* StackPush()                                      */
+/*--------------------------------------------------*/
+
+template <typename T, typename A>
+inline void StackPush(lua_State *env, std::vector<T, A> const &vec)
+{
+  detail::StackPushArray(env, vec.begin(), vec.size());
+}
+
+template <typename T, size_t N>
+inline void StackPush(lua_State *env, std::array<T, N> const &arr)
+{
+  detail::StackPushArray(env, arr.begin(), N);
+}
+
+template <typename T>
+inline void StackPush(lua_State *env, Span<T> span)
+{
+  detail::StackPushArray(env, span.data, span.size);
+}
+
+template <typename K, typename V, typename H, typename E, typename A>
+inline void StackPush(lua_State *env,
+                      std::unordered_map<K, V, H, E, A> const &map)
+{
+  lua_createtable(env, 0, (int)map.size());
+  for (auto const &kv : map) {
+    StackPush(env, kv.first);
+    StackPush(env, kv.second);
+    lua_rawset(env, -3);
+  }
+}
+
+/*--------------------------------------------------*/
+/* StackConv()                                      */
+/*--------------------------------------------------*/
+
+/**
+ * The array part(t[1..#t]) is converted, the original content is dropped.
+ */
+template <typename T, typename A>
+inline bool StackConv(lua_State *env, int index, std::vector<T, A> &vec)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  const auto n = lua_rawlen(env, index);
+  vec.clear();
+  vec.reserve(n);
+
+  /* Use temporary element, e.g. std::vector<bool> */
+  T elem;
+  for (size_t i = 1; i <= n; ++i) {
+    lua_rawgeti(env, index, (Integer)i);
+    const auto success = StackConv(env, lua_gettop(env), elem);
+    lua_pop(env, 1);
+    if (!success) return false;
+    vec.push_back(std::move(elem));
+  }
+  return true;
+}
+
+/**
+ * The length of the table must be N
+ */
+template <typename T, size_t N>
+inline bool StackConv(lua_State *env, int index, std::array<T, N> &arr)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  if (lua_rawlen(env, index) != N) return false;
+  return detail::StackConvArray(env, index, arr.begin(), N);
+}
+
+/**
+ * Fill the existing storage, the length of the table must be span.size
+ */
+template <typename T>
+inline bool StackConv(lua_State *env, int index, Span<T> span)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  if (lua_rawlen(env, index) != span.size) return false;
+  return detail::StackConvArray(env, index, span.data, span.size);
+}
+
+/**
+ * All key-value pairs are converted, the original content is dropped.
+ */
+template <typename K, typename V, typename H, typename E, typename A>
+inline bool StackConv(lua_State *env, int index,
+                      std::unordered_map<K, V, H, E, A> &map)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  map.clear();
+  K key;
+  V value;
+  lua_pushnil(env);
+  while (lua_next(env, index)) {
+    const auto top = lua_gettop(env);
+    if (!detail::StackConvKey(env, top - 1, key) ||
+        !StackConv(env, top, value))
+    {
+      lua_pop(env, 2);
+      return false;
+    }
+    map.emplace(std::move(key), std::move(value));
+    lua_pop(env, 1);
+  }
+  return true;
+}
+
+} // namespace hklua
+
+#endif // HKLUA_CONTAINER_H__
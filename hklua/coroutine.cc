@@ -0,0 +1,49 @@
+#include "hklua/coroutine.h"
+#include "hklua/count_hook.h"
+
+using namespace hklua;
+
+HKLuaError Coroutine::ResumeOnTop(int nargs)
+{
+  /* The thread may be created before the InstructionBudget or Profiler */
+  detail::SyncCountHook(thread_);
+
+  started_ = true;
+  nres_ = 0;
+  status_ = (HKLuaError)lua_resume(thread_, env_, nargs, &nres_);
+  /* The error object is the only result */
+  if (status_ != HKLUA_OK && status_ != HKLUA_YIELD) nres_ = 1;
+
+  preempted_ = false;
+  if (time_slice_ > 0 && status_ == HKLUA_YIELD && nres_ == 0) {
+    /* The hook yields in the Lua function, but coroutine.yield() and
+     * the native yield are C functions */
+    lua_Debug ar;
+    if (lua_getstack(thread_, 0, &ar) && lua_getinfo(thread_, "S", &ar))
+      preempted_ = ar.what[0] != 'C';
+  }
+  return status_;
+}
+
+void Coroutine::Reset() noexcept
+{
+#if LUA_VERSION_RELEASE_NUM >= 50406
+  lua_closethread(thread_, env_);
+#else
+  lua_resetthread(thread_);
+#endif
+  /* The error object may be left if closing fails */
+  lua_settop(thread_, 0);
+  nres_ = 0;
+  status_ = HKLUA_OK;
+  started_ = false;
+  preempted_ = false;
+}
+
+void Coroutine::SetTimeSlice(int instructions) noexcept
+{
+  time_slice_ = instructions > 0 ? instructions : 0;
+  /* The threads created by the body inherit the hook but are not sliced,
+   * since their resumer is the Lua code */
+  detail::SetTimeSlice(env_, thread_, time_slice_);
+}
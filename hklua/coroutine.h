@@ -0,0 +1,224 @@
+#ifndef HKLUA_COROUTINE_H__
+#define HKLUA_COROUTINE_H__
+
+#include <lua.hpp>
+#include <tuple>
+#include <utility> // swap, forward
+
+#include "hklua/function.h"
+#include "hklua/type.h"
+
+namespace hklua {
+
+/**
+ * \brief Represents a Lua thread(coroutine) created in a Lua environment
+ *
+ * The thread is anchored in the registry, so it is not collected
+ * until the coroutine is destroyed.
+ * e.g.
+ * auto co = env.CreateCoroutine();
+ * co.SetFunction("producer");
+ * while (co.Resume() == HKLUA_YIELD) {
+ *   Integer x;
+ *   std::tie(x) = co.Results<Integer>();
+ * }
+ *
+ * The body can yield by coroutine.yield() in Lua, or the bound
+ * C++ function returns Yield/YieldThen(see hklua/bind.h).
+ *
+ * \warning The coroutine must not outlive the Env that creates it
+ */
+class Coroutine {
+ public:
+  Coroutine() noexcept
+    : env_(nullptr)
+    , thread_(nullptr)
+    , ref_(LUA_NOREF)
+    , nres_(0)
+    , status_(HKLUA_OK)
+    , started_(false)
+    , preempted_(false)
+    , time_slice_(0)
+  {
+  }
+
+  /**
+   * Create a new thread in \p env
+   */
+  explicit Coroutine(lua_State *env)
+    : env_(env)
+    , thread_(lua_newthread(env))
+    , nres_(0)
+    , status_(HKLUA_OK)
+    , started_(false)
+    , preempted_(false)
+    , time_slice_(0)
+  {
+    ref_ = luaL_ref(env_, LUA_REGISTRYINDEX);
+  }
+
+  ~Coroutine() noexcept
+  {
+    if (!env_) return;
+    /* Remove it from the set of the time-sliced threads */
+    if (time_slice_ > 0) SetTimeSlice(0);
+    luaL_unref(env_, LUA_REGISTRYINDEX, ref_);
+  }
+
+  Coroutine(Coroutine const &) = delete;
+  Coroutine &operator=(Coroutine const &) = delete;
+
+  Coroutine(Coroutine &&rhs) noexcept
+    : Coroutine()
+  {
+    swap(rhs);
+  }
+
+  Coroutine &operator=(Coroutine &&rhs) noexcept
+  {
+    swap(rhs);
+    return *this;
+  }
+
+  /**
+   * Set the global function \p name as the body
+   * \return false if it is not a function
+   * \pre The coroutine is not started or has been reset
+   */
+  bool SetFunction(char const *name)
+  {
+    if (lua_getglobal(thread_, name) != LUA_TFUNCTION) {
+      lua_pop(thread_, 1);
+      return false;
+    }
+    return true;
+  }
+
+  bool SetFunction(FunctionRef const &func)
+  {
+    if (!func.IsValid()) return false;
+    lua_rawgeti(thread_, LUA_REGISTRYINDEX, func.ref());
+    return true;
+  }
+
+  /**
+   * Start or resume the coroutine with \p args
+   *
+   * \return
+   * HKLUA_YIELD: the coroutine is suspended, the yielded values are results
+   * HKLUA_OK: the body returns, the returned values are results
+   * otherwise: the error object is on the top of thread(), see ErrorMessage()
+   */
+  template <typename... Args>
+  HKLuaError Resume(Args &&...args)
+  {
+    PopResults();
+    detail::StackPushMultiple(thread_, std::forward<Args>(args)...);
+    return ResumeOnTop((int)sizeof...(args));
+  }
+
+  /**
+   * Resume the coroutine whose arguments have been pushed to thread()
+   * \pre The results of the last Resume() are poped, see PopResults()
+   */
+  HKLuaError ResumeOnTop(int nargs);
+
+  /**
+   * Pop the results of the last Resume()
+   */
+  void PopResults() noexcept
+  {
+    lua_pop(thread_, nres_);
+    nres_ = 0;
+  }
+
+  /**
+   * Convert the results of the last Resume()
+   * \param success false if the number of results is less than Rets
+   *                or some result can't be converted
+   */
+  template <typename... Rets>
+  std::tuple<Rets...> Results(bool *success = nullptr) const
+  {
+    std::tuple<Rets...> ret;
+    const auto result = nres_ >= (int)sizeof...(Rets) &&
+                        detail::StackConvMultiple(
+                            thread_, lua_gettop(thread_) - nres_ +
+                                         (int)sizeof...(Rets),
+                            ret);
+    if (success) *success = result;
+    return ret;
+  }
+
+  /**
+   * \pre Resume() returns error
+   */
+  char const *ErrorMessage() const noexcept
+  {
+    auto msg = lua_tostring(thread_, -1);
+    return msg ? msg : "error object is not a string";
+  }
+
+  /**
+   * Reset the thread so that it can run a new body, the stack is cleared
+   * and the pending to-be-closed variables are closed.
+   * Reuse the coroutine is cheaper than create a new one.
+   */
+  void Reset() noexcept;
+
+  /**
+   * Preempt the body every \p instructions VM instructions, i.e. Resume()
+   * returns HKLUA_YIELD without results and IsPreempted() is true.
+   * The next Resume() continues the body.
+   *
+   * The body is not preempted where it can't yield, e.g. in the metamethod
+   * called by the C function, it is checked again after next slice.
+   *
+   * 0 removes the count hook, so there is no overhead if not set.
+   * The hook is shared with InstructionBudget and Profiler(see
+   * hklua/count_hook.h), i.e. the budget still counts the body.
+   */
+  void SetTimeSlice(int instructions) noexcept;
+
+  /** The last Resume() returns since the time slice is used up */
+  bool IsPreempted() const noexcept { return preempted_; }
+  int time_slice() const noexcept { return time_slice_; }
+
+  void swap(Coroutine &rhs) noexcept
+  {
+    std::swap(env_, rhs.env_);
+    std::swap(thread_, rhs.thread_);
+    std::swap(ref_, rhs.ref_);
+    std::swap(nres_, rhs.nres_);
+    std::swap(status_, rhs.status_);
+    std::swap(started_, rhs.started_);
+    std::swap(preempted_, rhs.preempted_);
+    std::swap(time_slice_, rhs.time_slice_);
+  }
+
+  bool IsValid() const noexcept { return thread_ != nullptr; }
+  bool IsSuspended() const noexcept { return status_ == HKLUA_YIELD; }
+  /** The body returns or fails */
+  bool IsDone() const noexcept { return started_ && status_ != HKLUA_YIELD; }
+
+  /** The status of the last Resume() */
+  HKLuaError status() const noexcept { return status_; }
+  /** The number of results of the last Resume() */
+  int nresults() const noexcept { return nres_; }
+  lua_State *thread() const noexcept { return thread_; }
+  lua_State *env() const noexcept { return env_; }
+
+ private:
+  lua_State *env_;
+  lua_State *thread_;
+  int ref_;
+  int nres_;
+  HKLuaError status_;
+  bool started_;
+  bool preempted_;
+  int time_slice_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_COROUTINE_H__
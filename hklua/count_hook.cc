@@ -0,0 +1,226 @@
+#include "hklua/count_hook.h"
+
+#include <limits.h>
+#include <string.h>
+
+using namespace hklua;
+using namespace hklua::detail;
+
+/* The address is the registry key of the CountHookState of the Env */
+static char const kCountHookKey = 0;
+
+namespace {
+
+struct Client {
+  CountHookFunc func;
+  void *ud;
+  int period;
+  /* The instructions until the next call */
+  int left;
+};
+
+/*
+ * The user value is the table of the time-sliced threads,
+ * i.e. thread -> userdata of TimeSlice
+ */
+struct CountHookState {
+  Client clients[kCountHookClientNum];
+  int client_num;
+  int slice_num;
+
+  /* The hook replaced by the first client */
+  lua_Hook prev_hook;
+  int prev_mask;
+  int prev_count;
+};
+
+struct TimeSlice {
+  int slice;
+  int left;
+};
+
+} // namespace
+
+static CountHookState *GetState(lua_State *env) noexcept
+{
+  lua_rawgetp(env, LUA_REGISTRYINDEX, &kCountHookKey);
+  auto state = static_cast<CountHookState *>(lua_touserdata(env, -1));
+  lua_pop(env, 1);
+  return state;
+}
+
+static CountHookState *GetOrCreateState(lua_State *env)
+{
+  auto state = GetState(env);
+  if (state) return state;
+
+  state = static_cast<CountHookState *>(
+      lua_newuserdatauv(env, sizeof(CountHookState), 1));
+  memset(state, 0, sizeof *state);
+  lua_newtable(env);
+  lua_setiuservalue(env, -2, 1);
+  lua_rawsetp(env, LUA_REGISTRYINDEX, &kCountHookKey);
+  return state;
+}
+
+/* NULL if the thread is not time-sliced */
+static TimeSlice *GetTimeSlice(lua_State *thread, CountHookState *state)
+{
+  if (state->slice_num == 0) return nullptr;
+
+  lua_rawgetp(thread, LUA_REGISTRYINDEX, &kCountHookKey);
+  lua_getiuservalue(thread, -1, 1);
+  lua_pushthread(thread);
+  lua_rawget(thread, -2);
+  auto slice = static_cast<TimeSlice *>(lua_touserdata(thread, -1));
+  lua_pop(thread, 3);
+  return slice;
+}
+
+static void CountHook(lua_State *thread, lua_Debug *ar);
+
+/* The count is the earliest one of the clients and the time slice */
+static void Rearm(lua_State *thread, CountHookState *state, TimeSlice *slice)
+{
+  int count = INT_MAX;
+  for (auto const &client : state->clients) {
+    if (client.func && client.left < count) count = client.left;
+  }
+  if (slice && slice->left < count) count = slice->left;
+
+  const auto hook = lua_gethook(thread);
+  if (count == INT_MAX) {
+    if (hook == &CountHook) lua_sethook(thread, nullptr, 0, 0);
+    return;
+  }
+
+  if (count < 1) count = 1;
+  if (hook != &CountHook || lua_gethookcount(thread) != count)
+    lua_sethook(thread, &CountHook, LUA_MASKCOUNT, count);
+}
+
+static void CountHook(lua_State *thread, lua_Debug *ar)
+{
+  auto state = GetState(thread);
+  if (!state) {
+    lua_sethook(thread, nullptr, 0, 0);
+    return;
+  }
+
+  /* The instructions since the last call of this thread */
+  const int count = lua_gethookcount(thread);
+  bool due[kCountHookClientNum] = {};
+  for (int i = 0; i < kCountHookClientNum; ++i) {
+    auto &client = state->clients[i];
+    if (!client.func) continue;
+    client.left -= count;
+    if (client.left <= 0) {
+      client.left = client.period;
+      due[i] = true;
+    }
+  }
+
+  bool preempt = false;
+  auto slice = GetTimeSlice(thread, state);
+  if (slice) {
+    slice->left -= count;
+    if (slice->left <= 0) {
+      slice->left = slice->slice;
+      preempt = true;
+    }
+  }
+  Rearm(thread, state, slice);
+
+  for (int i = 0; i < kCountHookClientNum; ++i) {
+    /* The client may remove or replace the others */
+    auto const &client = state->clients[i];
+    if (due[i] && client.func) client.func(thread, client.ud);
+  }
+
+  /* Only the count and line hook can yield */
+  if (preempt && lua_isyieldable(thread)) lua_yield(thread, 0);
+}
+
+namespace hklua {
+namespace detail {
+
+void *GetCountHook(lua_State *env, CountHookClient client) noexcept
+{
+  auto state = GetState(env);
+  return state ? state->clients[client].ud : nullptr;
+}
+
+void SetCountHook(lua_State *env, CountHookClient client, CountHookFunc func,
+                  void *ud, int period)
+{
+  auto state = func ? GetOrCreateState(env) : GetState(env);
+  if (!state) return;
+
+  auto &c = state->clients[client];
+  if (!c.func && func && state->client_num++ == 0) {
+    const auto hook = lua_gethook(env);
+    if (hook != &CountHook) {
+      state->prev_hook = hook;
+      state->prev_mask = lua_gethookmask(env);
+      state->prev_count = lua_gethookcount(env);
+    }
+  } else if (c.func && !func) {
+    --state->client_num;
+  }
+
+  c.func = func;
+  c.ud = func ? ud : nullptr;
+  c.period = period > 0 ? period : 1;
+  c.left = c.period;
+
+  auto slice = GetTimeSlice(env, state);
+  if (state->client_num == 0 && !slice) {
+    if (lua_gethook(env) == &CountHook) {
+      lua_sethook(env, state->prev_hook, state->prev_mask, state->prev_count);
+    }
+    state->prev_hook = nullptr;
+    state->prev_mask = 0;
+    state->prev_count = 0;
+    return;
+  }
+  Rearm(env, state, slice);
+}
+
+void SetTimeSlice(lua_State *env, lua_State *thread, int slice)
+{
+  auto state = slice > 0 ? GetOrCreateState(env) : GetState(env);
+  if (!state) return;
+
+  lua_rawgetp(env, LUA_REGISTRYINDEX, &kCountHookKey);
+  lua_getiuservalue(env, -1, 1);
+  lua_pushthread(thread);
+  lua_xmove(thread, env, 1);
+  lua_pushvalue(env, -1);
+  const bool sliced = lua_rawget(env, -3) != LUA_TNIL;
+  lua_pop(env, 1);
+
+  if (slice > 0) {
+    auto ts = static_cast<TimeSlice *>(
+        lua_newuserdatauv(env, sizeof(TimeSlice), 0));
+    ts->slice = slice;
+    ts->left = slice;
+    if (!sliced) ++state->slice_num;
+  } else {
+    lua_pushnil(env);
+    if (sliced) --state->slice_num;
+  }
+  /* The entry is removed by the owner, the table needn't be weak */
+  lua_rawset(env, -3);
+  lua_pop(env, 2);
+
+  Rearm(thread, state, GetTimeSlice(thread, state));
+}
+
+void SyncCountHook(lua_State *thread)
+{
+  auto state = GetState(thread);
+  if (state) Rearm(thread, state, GetTimeSlice(thread, state));
+}
+
+} // namespace detail
+} // namespace hklua
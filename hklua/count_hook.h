@@ -0,0 +1,59 @@
+#ifndef HKLUA_COUNT_HOOK_H__
+#define HKLUA_COUNT_HOOK_H__
+
+#include <lua.hpp>
+
+namespace hklua {
+namespace detail {
+
+/*
+ * The count hook shared by InstructionBudget, Profiler and the time slice
+ * of Coroutine. Lua has only one hook per thread, so CountHook() dispatches
+ * to them instead of they replacing each other.
+ *
+ * The clients count the instructions of all threads in the Env, the time
+ * slice counts the instructions of its thread only.
+ * The threads created after a client is set inherit the hook, the others
+ * are synchronized by SyncCountHook()(e.g. before resumed by Coroutine).
+ *
+ * The hook set by lua_sethook() directly is suspended while any client
+ * is set, and restored after all clients are removed.
+ */
+
+/* The due clients are called in this order, the last may raise an error */
+enum CountHookClient {
+  kProfilerHook,
+  kBudgetHook,
+  kCountHookClientNum,
+};
+
+/* Called every period instructions, thread is the running one */
+using CountHookFunc = void (*)(lua_State *thread, void *ud);
+
+/** The ud of \p client, NULL if it is not set */
+void *GetCountHook(lua_State *env, CountHookClient client) noexcept;
+
+/**
+ * Set(or replace) \p client, NULL \p func removes it.
+ * The hook of \p env is updated, the other threads are updated when
+ * their hook is called.
+ */
+void SetCountHook(lua_State *env, CountHookClient client, CountHookFunc func,
+                  void *ud, int period);
+
+/**
+ * \p thread yields every \p slice instructions(where it can yield),
+ * 0 removes the time slice
+ */
+void SetTimeSlice(lua_State *env, lua_State *thread, int slice);
+
+/**
+ * Install, update or remove the hook of \p thread according to
+ * the clients and its time slice
+ */
+void SyncCountHook(lua_State *thread);
+
+} // namespace detail
+} // namespace hklua
+
+#endif // HKLUA_COUNT_HOOK_H__
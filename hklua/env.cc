@@ -0,0 +1,123 @@
+#include "env.h"
+
+#include <stdio.h>
+#include <chrono>
+
+using namespace hklua;
+
+/* Same as the panic function of luaL_newstate() */
+static int EnvPanic(lua_State *env)
+{
+  char const *msg = lua_tostring(env, -1);
+  if (!msg) msg = "error object is not a string";
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", msg);
+  return 0;
+}
+
+Env::Env(std::string name, std::unique_ptr<Allocator> allocator)
+  : env_(nullptr)
+  , name_(std::move(name))
+  , allocator_(std::move(allocator))
+  , traceback_(false)
+{
+  if (!allocator_) {
+    throw EnvException("The allocator of Lua environment is NULL");
+  }
+
+  env_ = lua_newstate(&Allocator::LuaAlloc, allocator_.get());
+  if (!env_) {
+    throw EnvException("Failed to create a Lua environment");
+  }
+  lua_atpanic(env_, &EnvPanic);
+  detail::InstallGcSentinel(env_);
+}
+
+void Env::OpenLibs(unsigned libs)
+{
+  /* The same order as luaL_openlibs() */
+  static struct {
+    HKLuaLib lib;
+    char const *name;
+    lua_CFunction open;
+  } const kLibs[] = {
+    { HKLUA_LIB_BASE, LUA_GNAME, &luaopen_base },
+    { HKLUA_LIB_PACKAGE, LUA_LOADLIBNAME, &luaopen_package },
+    { HKLUA_LIB_COROUTINE, LUA_COLIBNAME, &luaopen_coroutine },
+    { HKLUA_LIB_TABLE, LUA_TABLIBNAME, &luaopen_table },
+    { HKLUA_LIB_IO, LUA_IOLIBNAME, &luaopen_io },
+    { HKLUA_LIB_OS, LUA_OSLIBNAME, &luaopen_os },
+    { HKLUA_LIB_STRING, LUA_STRLIBNAME, &luaopen_string },
+    { HKLUA_LIB_MATH, LUA_MATHLIBNAME, &luaopen_math },
+    { HKLUA_LIB_UTF8, LUA_UTF8LIBNAME, &luaopen_utf8 },
+    { HKLUA_LIB_DEBUG, LUA_DBLIBNAME, &luaopen_debug },
+  };
+
+  for (auto const &lib : kLibs) {
+    if (!(libs & lib.lib)) continue;
+    luaL_requiref(env_, lib.name, lib.open, 1);
+    lua_pop(env_, 1);
+  }
+}
+
+template <typename D>
+static void AccountGcTime(D d, uint64_t &num,
+                          std::chrono::nanoseconds &total,
+                          std::chrono::nanoseconds &max)
+{
+  const auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+  ++num;
+  total += t;
+  if (t > max) max = t;
+}
+
+void Env::GcCollect()
+{
+  const auto start = std::chrono::steady_clock::now();
+  lua_gc(env_, LUA_GCCOLLECT);
+  AccountGcTime(std::chrono::steady_clock::now() - start,
+                gc_stats_.collect_num, gc_stats_.collect_time,
+                gc_stats_.max_collect_time);
+}
+
+bool Env::GcStep(int step_kb)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto ret = lua_gc(env_, LUA_GCSTEP, step_kb);
+  AccountGcTime(std::chrono::steady_clock::now() - start,
+                gc_stats_.step_num, gc_stats_.step_time,
+                gc_stats_.max_step_time);
+  return ret != 0;
+}
+
+bool Env::GcStepFor(std::chrono::nanoseconds budget)
+{
+  using namespace std::chrono;
+
+  const auto start = steady_clock::now();
+  /* In generational mode, the step never ends in the pause state */
+  const auto cycles = detail::GcCycles(env_);
+  bool done = false;
+  nanoseconds elapsed(0);
+  for (int n = 1;; ++n) {
+    done = lua_gc(env_, LUA_GCSTEP, 0) != 0 ||
+           detail::GcCycles(env_) != cycles;
+    elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+    if (done || elapsed + elapsed / n > budget) break;
+  }
+
+  AccountGcTime(elapsed, gc_stats_.step_num, gc_stats_.step_time,
+                gc_stats_.max_step_time);
+  return done;
+}
+
+GcStats Env::GcStatistics() const
+{
+  auto stats = gc_stats_;
+  stats.heap_bytes = GcCountBytes();
+  stats.cycles = detail::GcCycles(env_);
+  if (allocator_) {
+    stats.allocated_bytes =
+        allocator_->allocated_bytes() - detail::GcCycleMark(env_);
+  }
+  return stats;
+}
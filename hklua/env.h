@@ -5,8 +5,18 @@
 
 #include <string>
 #include <exception>
+#include <memory>
 
+#include "hklua/allocator.h"
+#include "hklua/batch.h"
+#include "hklua/buffer.h"
+#include "hklua/bytecode_cache.h"
+#include "hklua/coroutine.h"
 #include "hklua/function.h"
+#include "hklua/gc.h"
+#include "hklua/native_function.h"
+#include "hklua/result.h"
+#include "hklua/stack_scope.h"
 #include "hklua/table.h"
 
 namespace hklua {
@@ -46,11 +56,22 @@ class Env {
   explicit Env(std::string name)
    : env_(luaL_newstate())
    , name_(std::move(name))
+   , traceback_(false)
   {
     if (!env_) {
       throw EnvException("Failed to create a Lua environment");
     }
+    detail::InstallGcSentinel(env_);
   }
+
+  /**
+   * Create a Lua environment whose memory is managed by \p allocator
+   * e.g.
+   * Env env("pooled", std::unique_ptr<Allocator>(new PoolAllocator(limit)));
+   *
+   * \see hklua/allocator.h
+   */
+  Env(std::string name, std::unique_ptr<Allocator> allocator);
   
   ~Env() noexcept
   {
@@ -64,6 +85,9 @@ class Env {
   Env(Env &&rhs) noexcept
     : env_(rhs.env_)
     , name_(std::move(rhs.name_))
+    , allocator_(std::move(rhs.allocator_))
+    , traceback_(rhs.traceback_)
+    , gc_stats_(rhs.gc_stats_)
   {
     rhs.env_ = nullptr;
   }
@@ -72,6 +96,9 @@ class Env {
   {
     std::swap(env_, rhs.env_);
     std::swap(name_, rhs.name_);
+    std::swap(allocator_, rhs.allocator_);
+    std::swap(traceback_, rhs.traceback_);
+    std::swap(gc_stats_, rhs.gc_stats_);
     return *this;
   }
 
@@ -79,6 +106,12 @@ class Env {
   {
     luaL_openlibs(env_);
   }
+
+  /**
+   * Open the libraries in \p libs(HKLuaLib flags) only,
+   * e.g. env.OpenLibs(HKLUA_LIB_SAFE | HKLUA_LIB_OS)
+   */
+  void OpenLibs(unsigned libs);
   
   /*--------------------------------------------------*/
   /* Load Module                                      */
@@ -89,9 +122,14 @@ class Env {
     return (HKLuaError)luaL_loadstring(env_, chunk);
   }
   
+  /**
+   * luaL_dostring() returns 1 instead of the error code if failed
+   */
   HKLuaError DoString(char const *chunk)
   {
-    return (HKLuaError)luaL_dostring(env_, chunk);
+    auto ret = LoadString(chunk);
+    if (ret != HKLUA_OK) return ret;
+    return (HKLuaError)lua_pcall(env_, 0, LUA_MULTRET, 0);
   }
 
   HKLuaError LoadFile(char const *filename)
@@ -101,21 +139,66 @@ class Env {
   
   HKLuaError DoFile(char const *filename)
   {
-    return (HKLuaError)luaL_dofile(env_, filename);
+    auto ret = LoadFile(filename);
+    if (ret != HKLUA_OK) return ret;
+    return (HKLuaError)lua_pcall(env_, 0, LUA_MULTRET, 0);
+  }
+
+  /**
+   * Like DoString() but returns the error(see hklua/result.h),
+   * the results of chunk are discarded and the stack is always restored
+   */
+  HKLUA_STACK_CHECKED
+  Result<void> TryDoString(char const *chunk)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto ret = LoadString(chunk);
+    return ret == HKLUA_OK ? TryDoOnTop() : PopError(ret);
+  }
+
+  HKLUA_STACK_CHECKED
+  Result<void> TryDoFile(char const *filename)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto ret = LoadFile(filename);
+    return ret == HKLUA_OK ? TryDoOnTop() : PopError(ret);
+  }
+
+  /**
+   * Load the precompiled chunk in \p cache if it is valid
+   */
+  HKLuaError LoadFile(char const *filename, BytecodeCache &cache)
+  {
+    return cache.LoadFile(env_, filename);
+  }
+
+  HKLuaError DoFile(char const *filename, BytecodeCache &cache)
+  {
+    auto ret = LoadFile(filename, cache);
+    if (ret != HKLUA_OK) return ret;
+    return (HKLuaError)lua_pcall(env_, 0, LUA_MULTRET, 0);
   }
   
   /*--------------------------------------------------*/
   /* GC Module                                        */
   /*--------------------------------------------------*/
   
-  void GcCollect()
+  /**
+   * Do a full collection, the time is accounted in GcStatistics()
+   */
+  void GcCollect();
+
+  /** The memory in use by Lua in KB */
+  int GcCount() const
   {
-    lua_gc(env_, LUA_GCCOLLECT);
+    return lua_gc(env_, LUA_GCCOUNT);
   }
 
-  void GcCount() const
+  /** The memory in use by Lua in bytes */
+  size_t GcCountBytes() const
   {
-    lua_gc(env_, LUA_GCCOUNT);
+    return (size_t)lua_gc(env_, LUA_GCCOUNT) * 1024 +
+           (size_t)lua_gc(env_, LUA_GCCOUNTB);
   }
 
   void GcStop()
@@ -128,10 +211,42 @@ class Env {
     lua_gc(env_, LUA_GCRESTART);
   }
 
-  bool GcStep()
-  {
-    return lua_gc(env_, LUA_GCSTEP);
-  }
+  /**
+   * Do a step of the collection, the time is accounted in GcStatistics()
+   *
+   * \param step_kb 0 indicates a basic step, otherwise the collector does
+   *                the work as if \p step_kb KB were allocated
+   * \return true if the step finishes a cycle(always false in
+   *         generational mode)
+   * \note The step is done even if the collector is stopped
+   */
+  bool GcStep(int step_kb = 0);
+
+  /**
+   * Do the basic steps until \p budget is used up or a collection is
+   * finished, it stops before the budget if the next step(estimated by
+   * the average) would exceed it.
+   * It is the whole work of an idle gap, e.g.
+   * env.GcStop();
+   * // between the requests
+   * env.GcStepFor(std::chrono::microseconds(500));
+   *
+   * The size of the basic step is the step size of incremental mode,
+   * rather than lua_gc(LUA_GCSTEP) with a large size(see GcController).
+   * In generational mode, a basic step is a minor collection.
+   *
+   * \return true if a collection is finished
+   * \note It is accounted as a GcStep() call in GcStatistics()
+   * \see IdleGc
+   */
+  bool GcStepFor(std::chrono::nanoseconds budget);
+
+  /**
+   * \return The statistics, the collections and the bytes allocated since
+   *         the last collection are counted even if they are automatic
+   * \see hklua/gc.h
+   */
+  GcStats GcStatistics() const;
 
   bool GcIsRunning() const
   {
@@ -156,6 +271,176 @@ class Env {
   std::tuple<Rets...> CallFunction(char const *name, int msgh,
                                    bool *success, bool pop, Args &&...args);
   
+  /**
+   * Like CallFunction() but returns the results or the error,
+   * the stack is always restored.
+   * e.g.
+   * auto ret = env.TryCallFunction<Integer>("add", 1, 2);
+   * if (!ret) puts(ret.error().ToString().c_str());
+   *
+   * \see SetTraceback()
+   */
+  template <typename... Rets, typename... Args>
+  HKLUA_STACK_CHECKED
+  Result<std::tuple<Rets...>> TryCallFunction(char const *name,
+                                              Args &&...args)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    if (lua_getglobal(env_, name) != LUA_TFUNCTION) {
+      lua_pop(env_, 1);
+      return Error(HKLUA_ERRTYPE,
+                   std::string("global '") + name + "' is not a function");
+    }
+    return detail::TryCallOnTop<Rets...>(env_, traceback_,
+                                         std::forward<Args>(args)...);
+  }
+
+  template <typename... Rets, typename... Args>
+  HKLUA_STACK_CHECKED
+  Result<std::tuple<Rets...>> TryCallFunction(FunctionRef const &func,
+                                              Args &&...args)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    if (!func.IsValid())
+      return Error(HKLUA_ERRTYPE, "invalid function reference");
+    func.Push();
+    return detail::TryCallOnTop<Rets...>(env_, traceback_,
+                                         std::forward<Args>(args)...);
+  }
+
+  /**
+   * Call the function \p func(global name or FunctionRef) once per
+   * element of \p args, the function is looked up once.
+   * \see hklua/batch.h
+   */
+  template <typename R, typename F, typename Range>
+  HKLUA_STACK_CHECKED
+  Result<void> TryCallEach(F const &func, Range const &args,
+                           std::vector<R> &rets)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto err = PushFunction(func);
+    if (!err.ok()) return err;
+    return detail::CallEachOnTop(env_, traceback_, std::begin(args),
+                                 std::end(args), &rets);
+  }
+
+  template <typename F, typename Range>
+  HKLUA_STACK_CHECKED
+  Result<void> TryCallEach(F const &func, Range const &args)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto err = PushFunction(func);
+    if (!err.ok()) return err;
+    return detail::CallEachOnTop<detail::NoResult>(
+        env_, traceback_, std::begin(args), std::end(args), nullptr);
+  }
+
+  /**
+   * Call the function \p func once with the array of \p args
+   * \see hklua/batch.h
+   */
+  template <typename R, typename F, typename Range>
+  HKLUA_STACK_CHECKED
+  Result<void> TryCallBatch(F const &func, Range const &args,
+                            std::vector<R> &rets)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto err = PushFunction(func);
+    if (!err.ok()) return err;
+    return detail::CallBatchOnTop(env_, traceback_, std::begin(args),
+                                  std::end(args), &rets);
+  }
+
+  template <typename F, typename Range>
+  HKLUA_STACK_CHECKED
+  Result<void> TryCallBatch(F const &func, Range const &args)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    auto err = PushFunction(func);
+    if (!err.ok()) return err;
+    return detail::CallBatchOnTop<detail::NoResult>(
+        env_, traceback_, std::begin(args), std::end(args), nullptr);
+  }
+
+  /**
+   * Append the traceback to the error of Try*() calls,
+   * see Error::traceback().
+   * It is disabled by default since luaL_traceback() is expensive.
+   */
+  void SetTraceback(bool on) noexcept { traceback_ = on; }
+  bool traceback() const noexcept { return traceback_; }
+
+  /**
+   * Resolve the global function once and pin it in the registry.
+   * Prefer this to CallFunction() if the function is called frequently.
+   */
+  HKLUA_STACK_CHECKED
+  FunctionRef GetFunctionRef(char const *name, bool *success=nullptr)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    if (success) *success = false;
+    lua_getglobal(env_, name);
+    if (!lua_isfunction(env_, -1)) {
+      lua_pop(env_, 1);
+      return {};
+    }
+
+    FunctionRef ret(env_, -1);
+    lua_pop(env_, 1);
+    if (success) *success = true;
+    return ret;
+  }
+
+  /**
+   * Intern \p name once and pin it in the registry.
+   * Prefer this to the string key if the field is accessed frequently.
+   * \see hklua/key.h
+   */
+  Key CreateKey(char const *name)
+  {
+    return Key(env_, name);
+  }
+
+  Key CreateKey(std::string const &name)
+  {
+    return Key(env_, name);
+  }
+
+  /**
+   * Create a coroutine(Lua thread) in this environment
+   * \see hklua/coroutine.h
+   */
+  Coroutine CreateCoroutine()
+  {
+    return Coroutine(env_);
+  }
+
+  /**
+   * Set the C++ callable to global function \p name
+   * \see PushNativeFunction()
+   */
+  template <typename F>
+  HKLUA_STACK_CHECKED
+  void Register(char const *name, F &&f)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    PushNativeFunction(env_, std::forward<F>(f));
+    lua_setglobal(env_, name);
+  }
+
+  /**
+   * Set the member function bound to \p obj to global function \p name
+   */
+  template <typename C, typename M>
+  HKLUA_STACK_CHECKED
+  void Register(char const *name, M mfp, C *obj)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    PushNativeFunction(env_, mfp, obj);
+    lua_setglobal(env_, name);
+  }
+
   char const *ToCString(int index=-1) const
   {
     return lua_tostring(env_, index);
@@ -173,32 +458,42 @@ class Env {
   }
   
   /**
+   * Convert the error object on the top to Error(not poped)
    * \pre Error occurs
    */
-  void CheckError()
-  {
-    // FIXME
-    bool success;
-    auto msg = ToString(&success);
-    if (!success) {
-      printf("No error message\n");
-    } else {
-      printf("Reason: %s\n", msg.c_str());
-    }
+  Error CheckError(HKLuaError code = HKLUA_ERRRUN) const
+  {
+    return detail::ErrorFromStack(env_, code);
+  }
+
+  /**
+   * Like CheckError() but the error object is poped
+   */
+  HKLUA_STACK_CHECKED
+  Error PopError(HKLuaError code = HKLUA_ERRRUN)
+  {
+    HKLUA_STACK_CONTRACT(env_, -1);
+    auto ret = detail::ErrorFromStack(env_, code);
+    lua_pop(env_, 1);
+    return ret;
   }
    
   /*--------------------------------------------------*/
   /* Global Variable Module                           */
   /*--------------------------------------------------*/
   
+  HKLUA_STACK_CHECKED
   void GetGlobal(char const *name)
   {
+    HKLUA_STACK_CONTRACT(env_, 1);
     lua_getglobal(env_, name);
   }
   
   template <typename T>
+  HKLUA_STACK_CHECKED
   bool GetGlobal(char const *name, T &var, bool pop=true)
   {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
     lua_getglobal(env_, name);
     auto ret = StackConv(env_, lua_gettop(env_), var);
     if (pop) StackPop();
@@ -210,14 +505,29 @@ class Env {
     return GetGlobalTable(name, var, pop);
   }
   
+  HKLUA_STACK_CHECKED
   bool GetGlobalTable(char const *name, Table &var, bool pop=false)
   {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
     lua_getglobal(env_, name);
     auto ret = StackConv(env_, lua_gettop(env_), var);
     if (pop) StackPop();
     return ret;
   }
 
+  /**
+   * Convert the global variable, the stack is always restored
+   * \note T can't be Table since the table is poped
+   */
+  template <typename T>
+  HKLUA_STACK_CHECKED
+  Result<T> TryGetGlobal(char const *name)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    lua_getglobal(env_, name);
+    return detail::PopConv<T>(env_, "global", name);
+  }
+
   /**
    * 'R' is the abbreviation of "Return"
    */
@@ -239,9 +549,11 @@ class Env {
   }
 
   template <typename T>
-  void SetGlobal(char const *name, T value)
+  HKLUA_STACK_CHECKED
+  void SetGlobal(char const *name, T &&value)
   {
-    StackPush(value);
+    HKLUA_STACK_CONTRACT(env_, 0);
+    StackPush(std::forward<T>(value));
     lua_setglobal(env_, name);
   }
 
@@ -347,8 +659,10 @@ class Env {
   /* Table Module                                     */
   /*--------------------------------------------------*/
 
+  HKLUA_STACK_CHECKED
   Table CreateTable(int narr = 0, int nrec = 0)
   {
+    HKLUA_STACK_CONTRACT(env_, 1);
     return ::hklua::CreateTable(env_, narr, nrec);
   }
   
@@ -368,8 +682,10 @@ class Env {
 
   // }
   
+  HKLUA_STACK_CHECKED
   Integer GetLen(int index) const noexcept
   {
+    HKLUA_STACK_CONTRACT(env_, 0);
     Integer ret = 0;
     lua_len(env_, index);
     StackConv(env_, -1, ret);
@@ -383,17 +699,48 @@ class Env {
 
   std::string const& name() const noexcept { return name_; }
   lua_State *env() const noexcept { return env_; }
+  /** NULL if the Env is created by luaL_newstate() */
+  Allocator *allocator() const noexcept { return allocator_.get(); }
 
  private:
+  /* Push the function if success */
+  Error PushFunction(char const *name)
+  {
+    if (lua_getglobal(env_, name) != LUA_TFUNCTION) {
+      lua_pop(env_, 1);
+      return Error(HKLUA_ERRTYPE,
+                   std::string("global '") + name + "' is not a function");
+    }
+    return Error();
+  }
+
+  Error PushFunction(FunctionRef const &func)
+  {
+    if (!func.IsValid())
+      return Error(HKLUA_ERRTYPE, "invalid function reference");
+    func.Push();
+    return Error();
+  }
+
+  /* The function is on the top */
+  Result<void> TryDoOnTop()
+  {
+    return detail::PCallOnTop(env_, 0, 0, traceback_);
+  }
+
   lua_State *env_;
   std::string name_;
+  /* Must be destroyed after lua_close() */
+  std::unique_ptr<Allocator> allocator_;
+  bool traceback_;
+  /* The time of GcStep()/GcCollect() */
+  GcStats gc_stats_;
 };
 
 template <typename... Rets, typename... Args>
 std::tuple<Rets...> Env::CallFunction(char const *name, int msgh,
                                  bool *success, bool pop, Args &&...args)
 {
-  using RetType = std::tuple<Rets...>;
   if (success) *success = false;
 
   lua_getglobal(env_, name);
@@ -401,21 +748,8 @@ std::tuple<Rets...> Env::CallFunction(char const *name, int msgh,
     return {};
   }
 
-  detail::StackPushMultiple(env_, std::forward<Args>(args)...);
-  if (LUA_OK != lua_pcall(env_, sizeof...(args), sizeof...(Rets), msgh)) {
-    return {};
-  }
-
-  RetType retval;
-  if (!detail::StackConvMultiple(env_, lua_gettop(env_), retval)) {
-    return {};
-  }
-
-  if (success) *success = true;
-  if (pop)
-    lua_pop(env_, (int)sizeof...(Rets));
-
-  return retval;
+  return detail::CallFunctionOnTop<Rets...>(env_, msgh, success, pop,
+                                            std::forward<Args>(args)...);
 }
 
 } // namespace hklua
@@ -0,0 +1,246 @@
+#include "env_pool.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <thread>
+
+using namespace hklua;
+
+struct EnvLease::Slot {
+  explicit Slot(std::string name)
+    : env(std::move(name))
+    , base_top(0)
+    , shard(0)
+  {
+  }
+
+  Env env;
+  /* The stack top after setup */
+  int base_top;
+  /* The shard which the slot is returned to */
+  size_t shard;
+};
+
+struct EnvPool::Shard {
+  std::mutex mutex;
+  std::vector<Slot *> free_slots;
+
+  std::atomic<uint64_t> checkouts{0};
+  std::atomic<uint64_t> waits{0};
+  std::atomic<uint64_t> timeouts{0};
+  std::atomic<uint64_t> latency_buckets[EnvPoolStats::kBucketNum];
+
+  /* Avoid false sharing between shards.
+   * alignas(64) requires the aligned new of C++17. */
+  char padding[64];
+
+  Shard()
+  {
+    for (auto &bucket : latency_buckets)
+      bucket.store(0, std::memory_order_relaxed);
+  }
+};
+
+static inline int LatencyBucket(uint64_t ns) noexcept
+{
+  if (ns == 0) return 0;
+  const int bucket = 64 - __builtin_clzll(ns);
+  return std::min(bucket, EnvPoolStats::kBucketNum - 1);
+}
+
+constexpr int EnvPoolStats::kBucketNum;
+
+uint64_t EnvPoolStats::LatencyPercentile(double p) const noexcept
+{
+  uint64_t total = 0;
+  for (auto count : latency_buckets)
+    total += count;
+  if (total == 0) return 0;
+
+  const auto target = static_cast<uint64_t>(p * total);
+  uint64_t accumulated = 0;
+  for (int i = 0; i < kBucketNum; ++i) {
+    accumulated += latency_buckets[i];
+    if (accumulated > target || accumulated == total) {
+      return i == 0 ? 0 : (uint64_t(1) << i);
+    }
+  }
+  return uint64_t(1) << (kBucketNum - 1);
+}
+
+/*--------------------------------------------------*/
+/* EnvLease                                         */
+/*--------------------------------------------------*/
+
+void EnvLease::Release() noexcept
+{
+  if (!slot_) return;
+  pool_->Push(slot_);
+  pool_ = nullptr;
+  slot_ = nullptr;
+}
+
+Env &EnvLease::operator*() const noexcept
+{
+  return slot_->env;
+}
+
+/*--------------------------------------------------*/
+/* EnvPool                                          */
+/*--------------------------------------------------*/
+
+EnvPool::EnvPool(size_t n, SetupCallback const &setup, size_t shard_num)
+  : shard_num_(shard_num)
+  , available_(0)
+  , waiters_(0)
+{
+  if (shard_num_ == 0) shard_num_ = std::thread::hardware_concurrency();
+  shard_num_ = std::max<size_t>(1, std::min(shard_num_, n));
+  shards_.reset(new Shard[shard_num_]);
+
+  slots_.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    std::unique_ptr<Slot> slot(new Slot("pool-" + std::to_string(i)));
+    if (setup) setup(slot->env);
+    slot->base_top = slot->env.StackGetTop();
+    slot->shard = i % shard_num_;
+    shards_[slot->shard].free_slots.push_back(slot.get());
+    slots_.push_back(std::move(slot));
+  }
+  available_.store(n);
+}
+
+EnvPool::~EnvPool() noexcept
+{
+  assert(available_.load() == slots_.size() &&
+         "All leases must be returned before the pool is destroyed");
+}
+
+size_t EnvPool::HomeShard() const noexcept
+{
+  return std::hash<std::thread::id>()(std::this_thread::get_id()) %
+         shard_num_;
+}
+
+auto EnvPool::TryPop(size_t home) noexcept -> Slot *
+{
+  /* Fast path: no Env is free */
+  if (available_.load() == 0) return nullptr;
+
+  for (size_t i = 0; i < shard_num_; ++i) {
+    auto &shard = shards_[(home + i) % shard_num_];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    if (!shard.free_slots.empty()) {
+      auto slot = shard.free_slots.back();
+      shard.free_slots.pop_back();
+      available_.fetch_sub(1);
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+void EnvPool::Push(Slot *slot) noexcept
+{
+  slot->env.StackSetTop(slot->base_top);
+  {
+    auto &shard = shards_[slot->shard];
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    shard.free_slots.push_back(slot);
+  }
+  available_.fetch_add(1);
+
+  if (waiters_.load() != 0) {
+    std::lock_guard<std::mutex> guard(wait_mutex_);
+    wait_cond_.notify_one();
+  }
+}
+
+EnvLease EnvPool::Checkout(bool wait, std::chrono::nanoseconds timeout)
+{
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  const auto home = HomeShard();
+  auto &stat_shard = shards_[home];
+
+  auto slot = TryPop(home);
+  if (!slot && wait) {
+    stat_shard.waits.fetch_add(1, std::memory_order_relaxed);
+    const auto forever = timeout == std::chrono::nanoseconds::max();
+    const auto deadline =
+        forever ? Clock::time_point::max() : start + timeout;
+
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    waiters_.fetch_add(1);
+    for (;;) {
+      lock.unlock();
+      slot = TryPop(home);
+      lock.lock();
+      if (slot) break;
+
+      auto has_available = [this]() { return available_.load() != 0; };
+      if (forever) {
+        wait_cond_.wait(lock, has_available);
+      } else if (!wait_cond_.wait_until(lock, deadline, has_available)) {
+        break;
+      }
+    }
+    waiters_.fetch_sub(1);
+  }
+
+  if (!slot) {
+    stat_shard.timeouts.fetch_add(1, std::memory_order_relaxed);
+    return EnvLease();
+  }
+
+  const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - start)
+                           .count();
+  stat_shard.checkouts.fetch_add(1, std::memory_order_relaxed);
+  stat_shard.latency_buckets[LatencyBucket(latency)].fetch_add(
+      1, std::memory_order_relaxed);
+  return EnvLease(this, slot);
+}
+
+EnvLease EnvPool::Acquire()
+{
+  return Checkout(true, std::chrono::nanoseconds::max());
+}
+
+EnvLease EnvPool::TryAcquire()
+{
+  return Checkout(false, std::chrono::nanoseconds::zero());
+}
+
+EnvLease EnvPool::AcquireFor(std::chrono::nanoseconds timeout)
+{
+  return Checkout(true, timeout);
+}
+
+EnvPoolStats EnvPool::GetStats() const noexcept
+{
+  EnvPoolStats stats;
+  for (size_t i = 0; i < shard_num_; ++i) {
+    auto &shard = shards_[i];
+    stats.checkouts += shard.checkouts.load(std::memory_order_relaxed);
+    stats.waits += shard.waits.load(std::memory_order_relaxed);
+    stats.timeouts += shard.timeouts.load(std::memory_order_relaxed);
+    for (int j = 0; j < EnvPoolStats::kBucketNum; ++j) {
+      stats.latency_buckets[j] +=
+          shard.latency_buckets[j].load(std::memory_order_relaxed);
+    }
+  }
+  return stats;
+}
+
+void EnvPool::ResetStats() noexcept
+{
+  for (size_t i = 0; i < shard_num_; ++i) {
+    auto &shard = shards_[i];
+    shard.checkouts.store(0, std::memory_order_relaxed);
+    shard.waits.store(0, std::memory_order_relaxed);
+    shard.timeouts.store(0, std::memory_order_relaxed);
+    for (auto &bucket : shard.latency_buckets)
+      bucket.store(0, std::memory_order_relaxed);
+  }
+}
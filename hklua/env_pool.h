@@ -0,0 +1,176 @@
+#ifndef HKLUA_ENV_POOL_H__
+#define HKLUA_ENV_POOL_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "hklua/env.h"
+
+namespace hklua {
+
+class EnvPool;
+
+/**
+ * \brief Snapshot of the statistics of EnvPool
+ */
+struct EnvPoolStats {
+  /**
+   * The bucket i counts the checkouts whose latency is in
+   * [2^(i-1), 2^i) nanoseconds(the bucket 0 is for 0ns).
+   * The last bucket also counts the larger ones.
+   */
+  static constexpr int kBucketNum = 40;
+
+  uint64_t checkouts = 0;
+  /** The count of checkouts that must wait for returning */
+  uint64_t waits = 0;
+  /** The count of checkouts that failed due to timeout(or no wait) */
+  uint64_t timeouts = 0;
+  uint64_t latency_buckets[kBucketNum] = {};
+
+  /**
+   * \param p in [0, 1], e.g. 0.99
+   * \return The upper bound of the bucket in nanoseconds
+   */
+  uint64_t LatencyPercentile(double p) const noexcept;
+};
+
+/**
+ * \brief RAII handle of Env checked out from EnvPool
+ *
+ * The Env is returned to the pool when the lease is destroyed.
+ *
+ * \warning The lease must not outlive the pool
+ */
+class EnvLease {
+  friend class EnvPool;
+  struct Slot;
+
+ public:
+  EnvLease() noexcept
+    : pool_(nullptr)
+    , slot_(nullptr)
+  {
+  }
+
+  ~EnvLease() noexcept { Release(); }
+
+  EnvLease(EnvLease const &) = delete;
+  EnvLease &operator=(EnvLease const &) = delete;
+
+  EnvLease(EnvLease &&rhs) noexcept
+    : pool_(rhs.pool_)
+    , slot_(rhs.slot_)
+  {
+    rhs.pool_ = nullptr;
+    rhs.slot_ = nullptr;
+  }
+
+  EnvLease &operator=(EnvLease &&rhs) noexcept
+  {
+    std::swap(pool_, rhs.pool_);
+    std::swap(slot_, rhs.slot_);
+    return *this;
+  }
+
+  /**
+   * Return the Env to the pool in advance
+   */
+  void Release() noexcept;
+
+  Env &operator*() const noexcept;
+  Env *operator->() const noexcept { return &**this; }
+
+  explicit operator bool() const noexcept { return slot_ != nullptr; }
+
+ private:
+  EnvLease(EnvPool *pool, Slot *slot) noexcept
+    : pool_(pool)
+    , slot_(slot)
+  {
+  }
+
+  EnvPool *pool_;
+  Slot *slot_;
+};
+
+/**
+ * \brief Pool of pre-warmed Envs shared by multiple threads
+ *
+ * All Envs are created and set up(e.g. OpenLibs(), DoFile()) in
+ * the constructor, then the worker threads check out them by Acquire().
+ *
+ * The free Envs are distributed in several shards, each thread
+ * prefers the shard determined by its thread id, and steal from
+ * other shards if its shard is empty, so the threads rarely contend
+ * on the same lock.
+ *
+ * When the Env is returned, the stack top is reset to the top after setup.
+ */
+class EnvPool {
+  friend class EnvLease;
+  using Slot = EnvLease::Slot;
+
+ public:
+  using SetupCallback = std::function<void(Env &)>;
+
+  /**
+   * \param n The number of Envs
+   * \param setup Called for each Env, the exception is propagated
+   * \param shard_num 0 indicates std::thread::hardware_concurrency()
+   */
+  EnvPool(size_t n, SetupCallback const &setup, size_t shard_num = 0);
+  ~EnvPool() noexcept;
+
+  EnvPool(EnvPool const &) = delete;
+  EnvPool &operator=(EnvPool const &) = delete;
+
+  /**
+   * Block until an Env is available
+   */
+  EnvLease Acquire();
+
+  /**
+   * Return empty lease if no Env is available
+   */
+  EnvLease TryAcquire();
+
+  /**
+   * Return empty lease if no Env is available after \p timeout
+   */
+  EnvLease AcquireFor(std::chrono::nanoseconds timeout);
+
+  size_t size() const noexcept { return slots_.size(); }
+  size_t available() const noexcept { return available_.load(); }
+
+  EnvPoolStats GetStats() const noexcept;
+  void ResetStats() noexcept;
+
+ private:
+  struct Shard;
+
+  Slot *TryPop(size_t home) noexcept;
+  void Push(Slot *slot) noexcept;
+  size_t HomeShard() const noexcept;
+
+  EnvLease Checkout(bool wait, std::chrono::nanoseconds timeout);
+
+  std::vector<std::unique_ptr<Slot>> slots_;
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_num_;
+
+  std::atomic<size_t> available_;
+  std::atomic<size_t> waiters_;
+  std::mutex wait_mutex_;
+  std::condition_variable wait_cond_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_ENV_POOL_H__
@@ -3,6 +3,7 @@
 
 #include <lua.hpp>
 #include <tuple>
+#include <utility> // swap, forward
 
 #include "hklua/stack.h"
 
@@ -50,8 +51,111 @@ inline bool StackConvMultiple(lua_State *env, int index,
                                                                  retval);
 }
 
+/**
+ * \pre The function object is on the top of the stack
+ */
+template <typename... Rets, typename... Args>
+std::tuple<Rets...> CallFunctionOnTop(lua_State *env, int msgh, bool *success,
+                                      bool pop, Args &&...args)
+{
+  using RetType = std::tuple<Rets...>;
+
+  StackPushMultiple(env, std::forward<Args>(args)...);
+  if (LUA_OK != lua_pcall(env, sizeof...(args), sizeof...(Rets), msgh)) {
+    return {};
+  }
+
+  RetType retval;
+  if (!StackConvMultiple(env, lua_gettop(env), retval)) {
+    return {};
+  }
+
+  if (success) *success = true;
+  if (pop) lua_pop(env, (int)sizeof...(Rets));
+
+  return retval;
+}
+
 } // namespace detail
 
+/**
+ * \brief Represents a Lua function pinned in the registry
+ *
+ * The function is resolved once when the reference is created,
+ * the call just fetch it from the registry by integer key(lua_rawgeti()),
+ * i.e. there is no global table lookup.
+ *
+ * \warning The reference must not outlive the Env that creates it
+ */
+class FunctionRef {
+ public:
+  FunctionRef() noexcept
+    : env_(nullptr)
+    , ref_(LUA_NOREF)
+  {
+  }
+
+  /**
+   * \param index The index of function in the stack(not poped)
+   */
+  FunctionRef(lua_State *env, int index)
+    : env_(env)
+  {
+    lua_pushvalue(env_, index);
+    ref_ = luaL_ref(env_, LUA_REGISTRYINDEX);
+  }
+
+  ~FunctionRef() noexcept
+  {
+    if (env_) luaL_unref(env_, LUA_REGISTRYINDEX, ref_);
+  }
+
+  FunctionRef(FunctionRef const &) = delete;
+  FunctionRef &operator=(FunctionRef const &) = delete;
+
+  FunctionRef(FunctionRef &&rhs) noexcept
+    : env_(rhs.env_)
+    , ref_(rhs.ref_)
+  {
+    rhs.env_ = nullptr;
+    rhs.ref_ = LUA_NOREF;
+  }
+
+  FunctionRef &operator=(FunctionRef &&rhs) noexcept
+  {
+    std::swap(env_, rhs.env_);
+    std::swap(ref_, rhs.ref_);
+    return *this;
+  }
+
+  /**
+   * The interface is same as Env::CallFunction() except the name
+   */
+  template <typename... Rets, typename... Args>
+  std::tuple<Rets...> Call(int msgh, bool *success, bool pop, Args &&...args)
+  {
+    if (success) *success = false;
+    if (!IsValid()) return {};
+
+    lua_rawgeti(env_, LUA_REGISTRYINDEX, ref_);
+    return detail::CallFunctionOnTop<Rets...>(env_, msgh, success, pop,
+                                              std::forward<Args>(args)...);
+  }
+
+  /**
+   * Push the function to the stack
+   */
+  void Push() const { lua_rawgeti(env_, LUA_REGISTRYINDEX, ref_); }
+
+  bool IsValid() const noexcept { return env_ && ref_ > 0; }
+
+  int ref() const noexcept { return ref_; }
+  lua_State *env() const noexcept { return env_; }
+
+ private:
+  lua_State *env_;
+  int ref_;
+};
 
 } // namespace hklua
 
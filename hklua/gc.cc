@@ -0,0 +1,336 @@
+#include "hklua/gc.h"
+#include "hklua/env.h"
+
+#include <algorithm>
+
+using namespace hklua;
+using namespace std::chrono;
+
+/* The addresses are the registry keys */
+static char const kGcCyclesKey = 0;
+static char const kGcMarkKey = 0;
+static char const kGcSentinelMetaKey = 0;
+
+constexpr int GcController::kWindow;
+constexpr int GcController::kAdaptInterval;
+constexpr int GcController::kMinPause;
+constexpr int GcController::kMaxPause;
+constexpr int GcController::kMinStepSize;
+constexpr int GcController::kMaxStepSize;
+constexpr int GcController::kDefaultStepSize;
+constexpr int IdleGc::kDefaultPause;
+
+static Allocator *GetAllocator(lua_State *env)
+{
+  void *ud = nullptr;
+  if (lua_getallocf(env, &ud) != &Allocator::LuaAlloc) return nullptr;
+  return static_cast<Allocator *>(ud);
+}
+
+static lua_Integer GetRegistryInteger(lua_State *env, void const *key)
+{
+  lua_rawgetp(env, LUA_REGISTRYINDEX, key);
+  auto ret = lua_tointeger(env, -1);
+  lua_pop(env, 1);
+  return ret;
+}
+
+/* The key exists, so the registry is not resized */
+static void SetRegistryInteger(lua_State *env, void const *key,
+                               lua_Integer value)
+{
+  lua_pushinteger(env, value);
+  lua_rawsetp(env, LUA_REGISTRYINDEX, key);
+}
+
+static int NewGcSentinel(lua_State *env);
+
+static int GcSentinelFinalizer(lua_State *env)
+{
+  SetRegistryInteger(env, &kGcCyclesKey,
+                     GetRegistryInteger(env, &kGcCyclesKey) + 1);
+  auto allocator = GetAllocator(env);
+  if (allocator) {
+    SetRegistryInteger(env, &kGcMarkKey,
+                       (lua_Integer)allocator->allocated_bytes());
+  }
+
+  lua_pushcfunction(env, &NewGcSentinel);
+  if (lua_pcall(env, 0, 0, 0) != LUA_OK) {
+    /* Out of memory, finalize this one again in the next collection */
+    lua_pop(env, 1);
+    lua_getmetatable(env, 1);
+    lua_setmetatable(env, 1);
+  }
+  return 0;
+}
+
+/* The sentinel is not referenced by anyone */
+static int NewGcSentinel(lua_State *env)
+{
+  lua_newuserdatauv(env, 0, 0);
+  lua_rawgetp(env, LUA_REGISTRYINDEX, &kGcSentinelMetaKey);
+  lua_setmetatable(env, -2);
+  lua_pop(env, 1);
+  return 0;
+}
+
+static int InstallGcSentinelUnprotected(lua_State *env)
+{
+  SetRegistryInteger(env, &kGcCyclesKey, 0);
+  auto allocator = GetAllocator(env);
+  SetRegistryInteger(env, &kGcMarkKey,
+                     allocator ? (lua_Integer)allocator->allocated_bytes() : 0);
+
+  lua_createtable(env, 0, 1);
+  lua_pushcfunction(env, &GcSentinelFinalizer);
+  lua_setfield(env, -2, "__gc");
+  lua_rawsetp(env, LUA_REGISTRYINDEX, &kGcSentinelMetaKey);
+
+  return NewGcSentinel(env);
+}
+
+void detail::InstallGcSentinel(lua_State *env)
+{
+  /* If the memory is exhausted, the collections are not counted */
+  lua_pushcfunction(env, &InstallGcSentinelUnprotected);
+  if (lua_pcall(env, 0, 0, 0) != LUA_OK) lua_pop(env, 1);
+}
+
+uint64_t detail::GcCycles(lua_State *env)
+{
+  return (uint64_t)GetRegistryInteger(env, &kGcCyclesKey);
+}
+
+size_t detail::GcCycleMark(lua_State *env)
+{
+  return (size_t)GetRegistryInteger(env, &kGcMarkKey);
+}
+
+GcController::GcController(Env &env, nanoseconds target, Mode mode)
+  : env_(env)
+  , target_(target)
+  , mode_(mode)
+  , step_size_(kDefaultStepSize)
+  , pause_(kMaxPause)
+  , step_num_(0)
+  , idle_(false)
+  , threshold_(0)
+  , trial_(false)
+  , settled_(false)
+  , prev_p99_(0)
+  , pause_next_(0)
+  , prev_running_(env.GcIsRunning())
+{
+  pauses_.reserve(kWindow);
+  sorted_.reserve(kWindow);
+  if (mode_ == kGenerational) {
+    prev_mode_ = lua_gc(env_.env(), LUA_GCGEN, 0, 0);
+  } else {
+    prev_mode_ = lua_gc(env_.env(), LUA_GCINC, 0, 0, step_size_);
+  }
+  env_.GcStop();
+}
+
+GcController::~GcController() noexcept
+{
+  /* Changing to the current mode is no-op */
+  if (mode_ == kIncremental) lua_gc(env_.env(), LUA_GCINC, 0, 0, kMaxStepSize);
+  if (prev_mode_ == LUA_GCGEN) {
+    lua_gc(env_.env(), LUA_GCGEN, 0, 0);
+  } else {
+    lua_gc(env_.env(), LUA_GCINC, 0, 0, 0);
+  }
+  if (prev_running_) env_.GcRestart();
+}
+
+bool GcController::Step()
+{
+  const auto start = steady_clock::now();
+  const auto done =
+      mode_ == kGenerational ? StepGenerational() : StepIncremental();
+  const auto pause = duration_cast<nanoseconds>(steady_clock::now() - start);
+
+  if (pauses_.size() < (size_t)kWindow) {
+    pauses_.push_back(pause);
+  } else {
+    pauses_[pause_next_] = pause;
+    pause_next_ = (pause_next_ + 1) % kWindow;
+  }
+  if (++step_num_ % kAdaptInterval == 0) Adapt();
+  return done;
+}
+
+bool GcController::StepGenerational()
+{
+  /* The size is added to the debt, so the collection is done only if
+   * the debt is paid off, i.e. the allocation reaches the threshold
+   * of minor(or major) collection */
+  const auto cycles = detail::GcCycles(env_.env());
+  env_.GcStep(1);
+  return detail::GcCycles(env_.env()) != cycles;
+}
+
+bool GcController::StepIncremental()
+{
+  if (idle_) {
+    if (env_.GcCountBytes() < threshold_) return false;
+    idle_ = false;
+  }
+
+  const auto done = env_.GcStepFor(target_);
+  if (done) {
+    idle_ = true;
+    threshold_ = env_.GcCountBytes() / 100 * pause_;
+  }
+  return done;
+}
+
+nanoseconds GcController::p99() const
+{
+  if (pauses_.empty()) return nanoseconds(0);
+  sorted_.assign(pauses_.begin(), pauses_.end());
+  auto nth = sorted_.begin() + (sorted_.size() * 99 - 1) / 100;
+  std::nth_element(sorted_.begin(), nth, sorted_.end());
+  return *nth;
+}
+
+nanoseconds GcController::max_pause() const
+{
+  if (pauses_.empty()) return nanoseconds(0);
+  return *std::max_element(pauses_.begin(), pauses_.end());
+}
+
+void GcController::SwitchMode(Mode mode)
+{
+  mode_ = mode;
+  if (mode_ == kGenerational) {
+    lua_gc(env_.env(), LUA_GCGEN, 0, 0);
+  } else {
+    lua_gc(env_.env(), LUA_GCINC, 0, 0, step_size_);
+    idle_ = false;
+  }
+  /* The pauses of the other mode are not relevant */
+  pauses_.clear();
+  pause_next_ = 0;
+}
+
+void GcController::Adapt()
+{
+  if (!settled_ && pauses_.size() == (size_t)kWindow) {
+    const auto pause = p99();
+    const auto other = mode_ == kGenerational ? kIncremental : kGenerational;
+    if (!trial_) {
+      if (pause > target_) {
+        trial_ = true;
+        prev_p99_ = pause;
+        SwitchMode(other);
+        return;
+      }
+    } else {
+      /* The trial is over, keep the better one */
+      settled_ = true;
+      if (pause > target_ && pause > prev_p99_) {
+        SwitchMode(other);
+        return;
+      }
+    }
+  }
+
+  if (mode_ == kIncremental) AdaptIncremental();
+}
+
+void GcController::AdaptIncremental()
+{
+  /* The p99 is the basic steps, and the max is the atomic step whose
+   * pause is proportional to the garbage created in the cycle */
+  const auto max = max_pause();
+  auto step_size = step_size_;
+  if (p99() > target_) {
+    step_size = std::max(kMinStepSize, step_size_ - 1);
+  }
+  if (max > target_) {
+    const auto ratio = (double)target_.count() / max.count();
+    pause_ = std::max(kMinPause, 100 + (int)((pause_ - 100) * ratio * 0.8));
+  } else if (max < target_ / 2) {
+    step_size = std::min(kMaxStepSize, step_size_ + 1);
+    pause_ = std::min(kMaxPause, pause_ + (pause_ - 100) / 2 + 1);
+  }
+
+  if (step_size != step_size_) {
+    step_size_ = step_size;
+    lua_gc(env_.env(), LUA_GCINC, 0, 0, step_size_);
+  }
+}
+
+IdleGc::IdleGc(Env &env, nanoseconds budget, size_t max_debt)
+  : env_(env)
+  , budget_(budget)
+  , max_debt_(max_debt)
+  , pause_(kDefaultPause)
+  , cycle_num_(0)
+  , running_(false)
+  , mark_(env.GcCountBytes())
+  , cycles_(detail::GcCycles(env.env()))
+  , prev_running_(env.GcIsRunning())
+  , prev_mode_(lua_gc(env.env(), LUA_GCINC, 0, 0,
+                      GcController::kDefaultStepSize))
+{
+  env_.GcStop();
+}
+
+IdleGc::~IdleGc() noexcept
+{
+  lua_gc(env_.env(), LUA_GCINC, 0, 0, GcController::kMaxStepSize);
+  if (prev_mode_ == LUA_GCGEN) lua_gc(env_.env(), LUA_GCGEN, 0, 0);
+  if (prev_running_) env_.GcRestart();
+}
+
+bool IdleGc::pending() const
+{
+  return running_ || env_.GcCountBytes() >= mark_ / 100 * pause_ ||
+         overdue();
+}
+
+bool IdleGc::OnIdle(nanoseconds budget)
+{
+  /* The cycle is finished by others, e.g. GcCollect() or an emergency
+   * collection when the memory cap is reached */
+  if (running_ && detail::GcCycles(env_.env()) != cycles_) {
+    Finish();
+    return false;
+  }
+  if (!pending()) return false;
+
+  running_ = true;
+  if (!env_.GcStepFor(budget)) return false;
+  Finish();
+  return true;
+}
+
+void IdleGc::RunUntil(steady_clock::time_point deadline)
+{
+  const auto now = steady_clock::now();
+  if (now < deadline) OnIdle(duration_cast<nanoseconds>(deadline - now));
+}
+
+void IdleGc::Force()
+{
+  running_ = true;
+  env_.GcStepFor(nanoseconds::max());
+  Finish();
+}
+
+size_t IdleGc::debt() const
+{
+  const auto heap = env_.GcCountBytes();
+  return heap > mark_ ? heap - mark_ : 0;
+}
+
+void IdleGc::Finish()
+{
+  running_ = false;
+  mark_ = env_.GcCountBytes();
+  cycles_ = detail::GcCycles(env_.env());
+  ++cycle_num_;
+}
@@ -0,0 +1,303 @@
+#ifndef HKLUA_GC_H__
+#define HKLUA_GC_H__
+
+#include <lua.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+namespace hklua {
+
+class Env;
+
+/**
+ * \brief Statistics of the garbage collector of an Env
+ * \see Env::GcStatistics()
+ */
+struct GcStats {
+  /* The memory in use by Lua(LUA_GCCOUNT and LUA_GCCOUNTB) */
+  size_t heap_bytes = 0;
+
+  /* The completed collections, including the automatic ones
+   * (in generational mode, the minor collections are also counted) */
+  uint64_t cycles = 0;
+
+  /* The bytes allocated since the last collection completed,
+   * 0 if the Env is not created with an Allocator */
+  size_t allocated_bytes = 0;
+
+  /* The calls of Env::GcStep()(or GcStepFor())/GcCollect() and the time
+   * spent in them */
+  uint64_t step_num = 0;
+  uint64_t collect_num = 0;
+  std::chrono::nanoseconds step_time{0};
+  std::chrono::nanoseconds collect_time{0};
+  /* The longest pause of single call */
+  std::chrono::nanoseconds max_step_time{0};
+  std::chrono::nanoseconds max_collect_time{0};
+};
+
+namespace detail {
+
+/**
+ * Count the completed collections by a sentinel userdata:
+ * it is garbage, so it is finalized at the end of every collection,
+ * the finalizer increments the counter and creates the next sentinel.
+ * There is no hook, the cost is an object per collection.
+ */
+void InstallGcSentinel(lua_State *env);
+
+uint64_t GcCycles(lua_State *env);
+
+/** Allocator::allocated_bytes() at the end of the last collection */
+size_t GcCycleMark(lua_State *env);
+
+} // namespace detail
+
+/**
+ * \brief Keep the GC pauses under a target by driving the collector
+ *        in the idle time of the host
+ *
+ * The unpredictable pauses are from the automatic collection in the
+ * allocations, e.g. a major(full) collection in generational mode.
+ * The controller stops the automatic collection, the collector only runs
+ * in Step() which is called by the host in its idle time(e.g. once per
+ * frame or per iteration of the event loop), then every pause is measured.
+ *
+ * The p99 is of all steps, i.e. the steps doing nothing are also counted
+ * like the frames without GC work.
+ * - generational mode: a step is a minor(or major) collection which can't
+ *   be split, it is done when Lua would do it(lua_gc(LUA_GCSTEP) with
+ *   a small size respects the debt).
+ * - incremental mode: a step does the basic steps until the target
+ *   is used up or the cycle is finished, then the next cycle starts once
+ *   the heap has grown to pause() percent.
+ *   Every kAdaptInterval steps, the granularity(the size of the basic
+ *   step) is halved if the p99 of the last kWindow steps misses the target.
+ *   The atomic step can't be split and it frees all the garbage created
+ *   since the last cycle(sweeptolive() in lgc.c), so the pause is
+ *   lowered if the max misses the target, i.e. the cycles are more
+ *   frequent but the garbage of each one is less.
+ *   Both are raised if the max is under half of the target.
+ * If the p99 of kWindow steps misses the target, the other mode is tried
+ * for kWindow steps, and the one with the lower p99 is kept for good.
+ *
+ * Don't use lua_gc(LUA_GCSTEP) with a large size in incremental mode
+ * for the same purpose: the sweep work is counted by objects rather than
+ * bytes, so a step of hundreds of KB can sweep the whole heap.
+ *
+ * e.g.
+ * GcController gc(env, std::chrono::microseconds(500));
+ * for (;;) {
+ *   HandleEvents();
+ *   gc.Step();
+ * }
+ *
+ * The mode and the running state of the collector are restored by
+ * the destructor, the step size parameter of incremental mode is
+ * restored to the default of Lua(kMaxStepSize).
+ *
+ * \note
+ * The collector can't keep up with the allocation if Step() is not
+ * called often enough, then the heap grows. GcStats::allocated_bytes
+ * shows it. If the memory cap of Allocator is reached, Lua still does
+ * an emergency full collection.
+ */
+class GcController {
+ public:
+  enum Mode : unsigned char {
+    kIncremental,
+    kGenerational,
+  };
+
+  static constexpr int kWindow = 1024;
+  static constexpr int kAdaptInterval = 64;
+  /* The range of the heap growth(in percent) to start the next cycle
+   * of incremental mode, the max is the default pause of Lua */
+  static constexpr int kMinPause = 105;
+  static constexpr int kMaxPause = 200;
+
+  /* The range of the step size parameter of incremental mode(LUA_GCINC),
+   * i.e. log2 of the bytes of a basic step */
+  static constexpr int kMinStepSize = 4;
+  static constexpr int kMaxStepSize = 13;
+  static constexpr int kDefaultStepSize = 10;
+
+  /**
+   * \param target The target of p99 pause of Step()
+   * \param mode The initial mode, generational mode is cheaper if its
+   *             pauses are short enough
+   */
+  GcController(Env &env, std::chrono::nanoseconds target,
+               Mode mode = kGenerational);
+  ~GcController() noexcept;
+
+  GcController(GcController const &) = delete;
+  GcController &operator=(GcController const &) = delete;
+
+  /**
+   * Do the collection work of a step and adapt the mode and the granularity
+   * \return true if a collection is finished
+   */
+  bool Step();
+
+  /** The p99 pause of the recent steps */
+  std::chrono::nanoseconds p99() const;
+  /** The max pause of the recent steps */
+  std::chrono::nanoseconds max_pause() const;
+
+  std::chrono::nanoseconds target() const noexcept { return target_; }
+  Mode mode() const noexcept { return mode_; }
+  int step_size() const noexcept { return step_size_; }
+  int pause() const noexcept { return pause_; }
+  uint64_t step_num() const noexcept { return step_num_; }
+
+ private:
+  bool StepGenerational();
+  bool StepIncremental();
+  void SwitchMode(Mode mode);
+  void Adapt();
+  void AdaptIncremental();
+
+  Env &env_;
+  std::chrono::nanoseconds target_;
+  Mode mode_;
+  int step_size_;
+  int pause_;
+  uint64_t step_num_;
+
+  /* Incremental mode: no cycle is running until the heap reaches threshold_ */
+  bool idle_;
+  size_t threshold_;
+
+  /* The other mode is tried since the initial mode misses the target,
+   * it goes back if the p99 is worse, then the mode is settled */
+  bool trial_;
+  bool settled_;
+  std::chrono::nanoseconds prev_p99_;
+
+  /* The ring of recent pauses */
+  std::vector<std::chrono::nanoseconds> pauses_;
+  int pause_next_;
+  /* Reserved, the malloc() after the sweep may consolidate the freed
+   * chunks(in glibc), which takes milliseconds */
+  mutable std::vector<std::chrono::nanoseconds> sorted_;
+
+  bool prev_running_;
+  int prev_mode_;
+};
+
+/**
+ * \brief Collect only in the idle gaps of the host, e.g. between requests
+ *
+ * The automatic collection is stopped and the collector is changed to
+ * incremental mode(a cycle can be split, the basic step is
+ * GcController::kDefaultStepSize so the budget is respected closely),
+ * so there is no GC pause in the request handling.
+ * A cycle starts once the heap has grown to pause() percent of the heap
+ * after the last cycle(like the pause of Lua), then OnIdle() does the
+ * basic steps of it within the budget.
+ *
+ * For an event loop(epoll or timer):
+ * IdleGc gc(env, std::chrono::microseconds(500), 64 * 1024 * 1024);
+ * for (;;) {
+ *   // Don't block if there is collection work
+ *   int n = epoll_wait(epfd, events, kMaxEvents, gc.PollTimeout(timeout));
+ *   if (n == 0) gc.OnIdle();
+ *   HandleEvents(events, n);
+ *   // No idle gap for a long time
+ *   if (gc.overdue()) gc.Force();
+ * }
+ *
+ * If the loop is always busy, the debt(the heap growth since the last
+ * cycle) is unbounded. The host should check overdue() or debt() and
+ * force the progress.
+ * The mode and the running state of the collector are restored by
+ * the destructor(the step size like GcController).
+ *
+ * \see Env::GcStepFor(), Scheduler::SetIdleGc()
+ */
+class IdleGc {
+ public:
+  /* The default of Lua, i.e. a cycle starts when the heap is doubled */
+  static constexpr int kDefaultPause = 200;
+
+  /**
+   * \param budget The time of collection in an OnIdle() call
+   * \param max_debt overdue() is true if the debt exceeds it(then a cycle
+   *                 starts even if the heap is not grown to pause()),
+   *                 0 indicates no limit
+   */
+  IdleGc(Env &env, std::chrono::nanoseconds budget, size_t max_debt = 0);
+  ~IdleGc() noexcept;
+
+  IdleGc(IdleGc const &) = delete;
+  IdleGc &operator=(IdleGc const &) = delete;
+
+  /**
+   * A cycle is running, or the heap has grown enough to start one
+   * (pause() percent or overdue())
+   */
+  bool pending() const;
+
+  /**
+   * The timeout of epoll_wait()(in milliseconds):
+   * 0 if there is collection work, otherwise \p timeout_ms
+   */
+  int PollTimeout(int timeout_ms) const
+  {
+    return pending() ? 0 : timeout_ms;
+  }
+
+  /**
+   * Do the collection work within the budget if it is pending
+   * \return true if a cycle is finished
+   */
+  bool OnIdle() { return OnIdle(budget_); }
+  bool OnIdle(std::chrono::nanoseconds budget);
+
+  /**
+   * Like OnIdle(), but the budget is the gap until \p deadline
+   * (e.g. the next timer) in which nothing else can be done
+   */
+  void RunUntil(std::chrono::steady_clock::time_point deadline);
+
+  /** Finish the running cycle(or a full cycle) regardless of the budget */
+  void Force();
+
+  /** The bytes the heap has grown since the last cycle finished */
+  size_t debt() const;
+  bool overdue() const { return max_debt_ != 0 && debt() > max_debt_; }
+
+  /** Set the heap growth(in percent) to start the next cycle */
+  void SetPause(int pause) noexcept { pause_ = pause > 100 ? pause : 100; }
+
+  std::chrono::nanoseconds budget() const noexcept { return budget_; }
+  size_t max_debt() const noexcept { return max_debt_; }
+  int pause() const noexcept { return pause_; }
+  /** The cycles finished by this(or by others during a cycle of this) */
+  uint64_t cycle_num() const noexcept { return cycle_num_; }
+
+ private:
+  void Finish();
+
+  Env &env_;
+  std::chrono::nanoseconds budget_;
+  size_t max_debt_;
+  int pause_;
+  uint64_t cycle_num_;
+
+  /* A cycle is running(started by OnIdle()) */
+  bool running_;
+  /* The heap and GcStats::cycles after the last cycle */
+  size_t mark_;
+  uint64_t cycles_;
+
+  bool prev_running_;
+  int prev_mode_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_GC_H__
@@ -0,0 +1,66 @@
+#include "hklua/instruction_budget.h"
+#include "hklua/count_hook.h"
+#include "hklua/env.h"
+
+using namespace hklua;
+
+constexpr int InstructionBudget::kDefaultGranularity;
+
+InstructionBudget::InstructionBudget(lua_State *env, uint64_t limit,
+                                     int granularity)
+  : env_(env)
+  , limit_(limit)
+  , used_(0)
+  , granularity_(granularity > 0 ? granularity : kDefaultGranularity)
+  , exceeded_(false)
+  , prev_budget_(detail::GetCountHook(env, detail::kBudgetHook))
+{
+  detail::SetCountHook(env_, detail::kBudgetHook, &InstructionBudget::Hook,
+                       this, granularity_);
+}
+
+InstructionBudget::InstructionBudget(Env &env, uint64_t limit, int granularity)
+  : InstructionBudget(env.env(), limit, granularity)
+{
+}
+
+void InstructionBudget::Reset() noexcept
+{
+  if (exceeded_) {
+    detail::SetCountHook(env_, detail::kBudgetHook, &InstructionBudget::Hook,
+                         this, granularity_);
+  }
+  used_ = 0;
+  exceeded_ = false;
+}
+
+InstructionBudget::~InstructionBudget() noexcept
+{
+  auto prev = static_cast<InstructionBudget *>(prev_budget_);
+  if (prev) {
+    detail::SetCountHook(env_, detail::kBudgetHook, &InstructionBudget::Hook,
+                         prev, prev->exceeded_ ? 1 : prev->granularity_);
+  } else {
+    detail::SetCountHook(env_, detail::kBudgetHook, nullptr, nullptr, 0);
+  }
+}
+
+void InstructionBudget::Hook(lua_State *thread, void *ud)
+{
+  auto self = static_cast<InstructionBudget *>(ud);
+  if (!self->exceeded_) {
+    self->used_ += (uint64_t)self->granularity_;
+    if (self->used_ <= self->limit_) return;
+    self->exceeded_ = true;
+    detail::SetCountHook(self->env_, detail::kBudgetHook,
+                         &InstructionBudget::Hook, self, 1);
+  }
+
+  /* Raise in every instruction from now on, so the error caught by
+   * pcall() is raised again in the caller rather than after the next
+   * granularity instructions(which may be in the pcall() again).
+   * Every thread(e.g. the other coroutines inheriting the hook) is
+   * rearmed when its hook is called */
+  detail::SyncCountHook(thread);
+  luaL_error(thread, "instruction limit exceeded");
+}
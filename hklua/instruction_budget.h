@@ -0,0 +1,79 @@
+#ifndef HKLUA_INSTRUCTION_BUDGET_H__
+#define HKLUA_INSTRUCTION_BUDGET_H__
+
+#include <lua.hpp>
+#include <stdint.h>
+
+namespace hklua {
+
+class Env;
+
+/**
+ * \brief Limit the VM instructions executed in its scope
+ *
+ * e.g.
+ * {
+ *   InstructionBudget budget(env, 1000000);
+ *   auto ret = env.DoString(untrusted); // HKLUA_ERRRUN if exceeded
+ *   if (budget.exceeded()) {}
+ * }
+ *
+ * The count hook(lua_sethook() with LUA_MASKCOUNT) is installed by the
+ * constructor and removed by the destructor, so there is no overhead
+ * out of the scope.
+ *
+ * The instructions are counted every \p granularity instructions, so
+ * the error is raised at most granularity-1 instructions late.
+ * Once it is exceeded, the error is raised in every instruction until
+ * Reset(), so the scripts can't go on by catching it with pcall().
+ * Larger granularity is cheaper.
+ *
+ * The coroutines created in the scope inherit the hook, their
+ * instructions are also counted. The coroutines created before are
+ * counted after resumed by Coroutine(e.g. the tasks of Scheduler).
+ * The hook is shared with Profiler and the time slice of Coroutine
+ * (see hklua/count_hook.h), so they can be used together.
+ *
+ * \note
+ * The budget is reentrant, the inner one restores the outer one.
+ * The budget must be destroyed in the reverse order of construction.
+ */
+class InstructionBudget {
+ public:
+  static constexpr int kDefaultGranularity = 1000;
+
+  InstructionBudget(lua_State *env, uint64_t limit,
+                    int granularity = kDefaultGranularity);
+  InstructionBudget(Env &env, uint64_t limit,
+                    int granularity = kDefaultGranularity);
+  ~InstructionBudget() noexcept;
+
+  InstructionBudget(InstructionBudget const &) = delete;
+  InstructionBudget &operator=(InstructionBudget const &) = delete;
+
+  /**
+   * Reset the used instructions, e.g. reuse it for the next call
+   */
+  void Reset() noexcept;
+
+  uint64_t limit() const noexcept { return limit_; }
+  /** The instructions executed(in granularity) */
+  uint64_t used() const noexcept { return used_; }
+  bool exceeded() const noexcept { return exceeded_; }
+
+ private:
+  static void Hook(lua_State *thread, void *ud);
+
+  lua_State *env_;
+  uint64_t limit_;
+  uint64_t used_;
+  int granularity_;
+  bool exceeded_;
+
+  /* The outer budget is restored */
+  void *prev_budget_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_INSTRUCTION_BUDGET_H__
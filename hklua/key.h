@@ -0,0 +1,115 @@
+#ifndef HKLUA_KEY_H__
+#define HKLUA_KEY_H__
+
+#include <lua.hpp>
+#include <string.h>
+#include <string>
+#include <utility> // swap
+
+namespace hklua {
+
+/**
+ * \brief Represents a Lua string pinned in the registry
+ *
+ * lua_getfield()/lua_setfield() intern the key(hash and look up the
+ * string table) on every call.
+ * The key is interned once when it is created, the access just fetch it
+ * from the registry by integer key(lua_rawgeti()), i.e. there is no
+ * rehash for the hot keys.
+ * e.g.
+ * auto x = env.CreateKey("x");
+ * for (auto &point : points) {
+ *   point.GetField(x, value);
+ * }
+ *
+ * It can be used in the threads(coroutines) of the Env since
+ * they share the registry.
+ *
+ * \warning The key must not outlive the Env that creates it
+ */
+class Key {
+ public:
+  Key() noexcept
+    : env_(nullptr)
+    , ref_(LUA_NOREF)
+    , name_(nullptr)
+    , len_(0)
+  {
+  }
+
+  Key(lua_State *env, char const *name, size_t len)
+    : env_(env)
+  {
+    name_ = lua_pushlstring(env_, name, len);
+    len_ = len;
+    ref_ = luaL_ref(env_, LUA_REGISTRYINDEX);
+  }
+
+  Key(lua_State *env, char const *name)
+    : Key(env, name, strlen(name))
+  {
+  }
+
+  Key(lua_State *env, std::string const &name)
+    : Key(env, name.data(), name.size())
+  {
+  }
+
+  ~Key() noexcept
+  {
+    if (env_) luaL_unref(env_, LUA_REGISTRYINDEX, ref_);
+  }
+
+  Key(Key const &) = delete;
+  Key &operator=(Key const &) = delete;
+
+  Key(Key &&rhs) noexcept
+    : Key()
+  {
+    swap(rhs);
+  }
+
+  Key &operator=(Key &&rhs) noexcept
+  {
+    swap(rhs);
+    return *this;
+  }
+
+  void swap(Key &rhs) noexcept
+  {
+    std::swap(env_, rhs.env_);
+    std::swap(ref_, rhs.ref_);
+    std::swap(name_, rhs.name_);
+    std::swap(len_, rhs.len_);
+  }
+
+  /**
+   * Push the string to the stack of \p env
+   * \pre \p env is the Env(or its thread) that creates the key
+   */
+  void Push(lua_State *env) const { lua_rawgeti(env, LUA_REGISTRYINDEX, ref_); }
+  void Push() const { Push(env_); }
+
+  bool IsValid() const noexcept { return env_ && ref_ > 0; }
+
+  /** The interned string, valid until the key is destroyed */
+  char const *name() const noexcept { return name_; }
+  size_t size() const noexcept { return len_; }
+  int ref() const noexcept { return ref_; }
+  lua_State *env() const noexcept { return env_; }
+
+ private:
+  lua_State *env_;
+  int ref_;
+  char const *name_;
+  size_t len_;
+};
+
+inline void StackPush(lua_State *env, Key const &key)
+{
+  key.Push(env);
+}
+
+} // namespace hklua
+
+#endif // HKLUA_KEY_H__
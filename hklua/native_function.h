@@ -0,0 +1,275 @@
+#ifndef HKLUA_NATIVE_FUNCTION_H__
+#define HKLUA_NATIVE_FUNCTION_H__
+
+#include <lua.hpp>
+
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "hklua/bind.h"
+
+namespace hklua {
+
+namespace detail {
+
+/**
+ * Deduce the signature R(Args...) of the callable F
+ */
+template <typename F>
+struct FunctionTraits : FunctionTraits<decltype(&F::operator())> {};
+
+template <typename R, typename... Args>
+struct FunctionTraits<R(Args...)> {
+  using Signature = R(Args...);
+};
+
+template <typename R, typename... Args>
+struct FunctionTraits<R (*)(Args...)> : FunctionTraits<R(Args...)> {};
+
+/* The operator() of functor or the member function */
+template <typename R, typename C, typename... Args>
+struct FunctionTraits<R (C::*)(Args...)> : FunctionTraits<R(Args...)> {};
+
+template <typename R, typename C, typename... Args>
+struct FunctionTraits<R (C::*)(Args...) const> : FunctionTraits<R(Args...)> {
+};
+
+/**
+ * Member function bound to the object
+ */
+template <typename C, typename M>
+struct BoundMethod {
+  template <typename... Args>
+  auto operator()(Args &&...args) const
+      -> decltype((std::declval<C *>()->*std::declval<M>())(
+          std::forward<Args>(args)...))
+  {
+    return (obj->*mfp)(std::forward<Args>(args)...);
+  }
+
+  C *obj;
+  M mfp;
+};
+
+template <typename C, typename M>
+struct FunctionTraits<BoundMethod<C, M>> : FunctionTraits<M> {};
+
+/**
+ * upvalue 1: userdata of F
+ */
+template <typename F, typename Sig>
+struct NativeTrampoline;
+
+template <typename F, typename R, typename... Args>
+struct NativeTrampoline<F, R(Args...)> {
+  static int Call(lua_State *env)
+  {
+    auto &f = *static_cast<F *>(lua_touserdata(env, lua_upvalueindex(1)));
+    NativeError err;
+    const auto nret = InvokeNative<R, Args...>(env, 1, f, err);
+    return FinishNative(env, nret, err);
+  }
+};
+
+/**
+ * The address is the registry key of the metatable which destroys F
+ */
+template <typename F>
+struct NativeKey {
+  static char const key;
+};
+
+template <typename F>
+char const NativeKey<F>::key = 0;
+
+template <typename F>
+int NativeDestructor(lua_State *env)
+{
+  static_cast<F *>(lua_touserdata(env, 1))->~F();
+  return 0;
+}
+
+/**
+ * Set the metatable with __gc to the userdata on the top
+ */
+template <typename F>
+inline void SetNativeMetatable(lua_State *env)
+{
+  if (lua_rawgetp(env, LUA_REGISTRYINDEX, &NativeKey<F>::key) == LUA_TNIL) {
+    lua_pop(env, 1);
+    lua_createtable(env, 0, 1);
+    lua_pushcfunction(env, &NativeDestructor<F>);
+    lua_setfield(env, -2, "__gc");
+    lua_pushvalue(env, -1);
+    lua_rawsetp(env, LUA_REGISTRYINDEX, &NativeKey<F>::key);
+  }
+  lua_setmetatable(env, -2);
+}
+
+/**
+ * The continuation is called when the coroutine is resumed,
+ * the arguments of resume start from ctx + 1.
+ */
+template <typename K, typename Sig>
+struct NativeContinuation;
+
+template <typename K, typename R, typename... Args>
+struct NativeContinuation<K, R(Args...)> {
+  static int Call(lua_State *env, int status, lua_KContext ctx)
+  {
+    auto p = static_cast<char *>(lua_touserdata(env, (int)ctx));
+    auto &k = *reinterpret_cast<K *>(p + sizeof(MaxAlign));
+    NativeError err;
+    const auto nret = InvokeNative<R, Args...>(env, (int)ctx + 1, k, err);
+    return FinishNative(env, nret, err);
+  }
+};
+
+template <typename K>
+struct ContinuationKey {
+  static char const key;
+};
+
+template <typename K>
+char const ContinuationKey<K>::key = 0;
+
+template <typename K>
+int ContinuationDestructor(lua_State *env)
+{
+  auto p = static_cast<char *>(lua_touserdata(env, 1));
+  reinterpret_cast<K *>(p + sizeof(MaxAlign))->~K();
+  return 0;
+}
+
+/**
+ * Push the userdata of continuation \p k, see ContinuationHeader
+ */
+template <typename K>
+inline void PushContinuation(lua_State *env, K &&k)
+{
+  using Kn = typename std::decay<K>::type;
+  static_assert(sizeof(ContinuationHeader) <= sizeof(MaxAlign),
+                "The continuation must be placed after the header");
+  static_assert(alignof(Kn) <= alignof(MaxAlign),
+                "The userdata of Lua can't satisfy the alignment");
+
+  auto p = static_cast<char *>(
+      lua_newuserdatauv(env, sizeof(MaxAlign) + sizeof(Kn), 0));
+  using Signature = typename FunctionTraits<Kn>::Signature;
+  reinterpret_cast<ContinuationHeader *>(p)->k =
+      &NativeContinuation<Kn, Signature>::Call;
+  new (p + sizeof(MaxAlign)) Kn(std::forward<K>(k));
+
+  if (!std::is_trivially_destructible<Kn>::value) {
+    if (lua_rawgetp(env, LUA_REGISTRYINDEX, &ContinuationKey<Kn>::key) ==
+        LUA_TNIL) {
+      lua_pop(env, 1);
+      lua_createtable(env, 0, 1);
+      lua_pushcfunction(env, &ContinuationDestructor<Kn>);
+      lua_setfield(env, -2, "__gc");
+      lua_pushvalue(env, -1);
+      lua_rawsetp(env, LUA_REGISTRYINDEX, &ContinuationKey<Kn>::key);
+    }
+    lua_setmetatable(env, -2);
+  }
+}
+
+} // namespace detail
+
+/**
+ * Like Yield, but the bound C++ function is continued by \p k
+ * when the coroutine is resumed(i.e. lua_yieldk()).
+ * The arguments of resume are converted to the parameters of \p k,
+ * and the results of \p k are the results of the function call in Lua.
+ * \p k can also return Yield or YieldThen to yield again.
+ * e.g.
+ * env.Register("recv", [](Integer fd) {
+ *   return MakeYieldThen([](std::string data) { return data.size(); }, fd);
+ * });
+ */
+template <typename K, typename... Rets>
+struct YieldThen {
+  K k;
+  std::tuple<Rets...> values;
+};
+
+template <typename K, typename... Rets>
+inline YieldThen<typename std::decay<K>::type,
+                 typename std::decay<Rets>::type...>
+MakeYieldThen(K &&k, Rets &&...values)
+{
+  return { std::forward<K>(k),
+           std::make_tuple(std::forward<Rets>(values)...) };
+}
+
+namespace detail {
+
+template <typename K, typename... Rets>
+struct ResultPusher<YieldThen<K, Rets...>> {
+  template <typename F>
+  static int Call(lua_State *env, F &&f)
+  {
+    auto y = f();
+    PushContinuation(env, std::move(y.k));
+    PushTuple(env, y.values, std::index_sequence_for<Rets...>());
+    return (int)sizeof...(Rets) | kNativeYieldK;
+  }
+};
+
+} // namespace detail
+
+/**
+ * Push the C++ callable as a Lua function, e.g.
+ * PushNativeFunction(env, [&sum](int x) { sum += x; });
+ *
+ * Supported callables:
+ * - free function(pointer)
+ * - lambda and functor whose operator() is not overloaded
+ *
+ * The arguments are converted by StackConv(), and the return value
+ * is pushed by StackPush(). std::tuple is returned as multiple results.
+ * Yield and YieldThen yield the running coroutine instead of returning.
+ * If the argument can't be converted or exception is thrown,
+ * the Lua error is raised.
+ *
+ * The callable is moved into the userdata in the upvalue of closure,
+ * and destroyed by __gc if it is not trivially destructible.
+ *
+ * \note
+ * The parameter can't be non-const lvalue reference.
+ */
+template <typename F>
+inline void PushNativeFunction(lua_State *env, F &&f)
+{
+  using Fn = typename std::decay<F>::type;
+  static_assert(!std::is_member_function_pointer<Fn>::value,
+                "Member function must be bound to an object");
+  static_assert(alignof(Fn) <= alignof(detail::MaxAlign),
+                "The userdata of Lua can't satisfy the alignment");
+
+  auto p = lua_newuserdatauv(env, sizeof(Fn), 0);
+  new (p) Fn(std::forward<F>(f));
+  if (!std::is_trivially_destructible<Fn>::value) {
+    detail::SetNativeMetatable<Fn>(env);
+  }
+
+  using Signature = typename detail::FunctionTraits<Fn>::Signature;
+  lua_pushcclosure(env, &detail::NativeTrampoline<Fn, Signature>::Call, 1);
+}
+
+/**
+ * Push the member function \p mfp bound to \p obj
+ * \warning The lifetime of \p obj must be longer than the function
+ */
+template <typename C, typename M>
+inline void PushNativeFunction(lua_State *env, M mfp, C *obj)
+{
+  static_assert(std::is_member_function_pointer<M>::value,
+                "M must be member function pointer");
+  PushNativeFunction(env, detail::BoundMethod<C, M>{ obj, mfp });
+}
+
+} // namespace hklua
+
+#endif // HKLUA_NATIVE_FUNCTION_H__
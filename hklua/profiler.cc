@@ -0,0 +1,171 @@
+#include "hklua/profiler.h"
+#include "hklua/count_hook.h"
+#include "hklua/env.h"
+
+#include <algorithm>
+
+using namespace hklua;
+
+/* The label of the truncated frames */
+static constexpr uint32_t kTruncatedFrame = 0;
+
+constexpr int Profiler::kDefaultPeriod;
+constexpr int Profiler::kMaxDepth;
+
+size_t Profiler::StackHash::operator()(
+    std::vector<uint32_t> const &stack) const noexcept
+{
+  /* FNV-1a */
+  size_t h = 14695981039346656037ULL;
+  for (auto id : stack) {
+    h ^= id;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+Profiler::Profiler(lua_State *env, int period)
+  : env_(env)
+  , period_(period > 0 ? period : kDefaultPeriod)
+  , running_(false)
+  , sample_num_(0)
+  , frame_labels_{ "..." }
+{
+  scratch_.reserve(kMaxDepth + 1);
+  label_.reserve(128);
+}
+
+Profiler::Profiler(Env &env, int period)
+  : Profiler(env.env(), period)
+{
+}
+
+bool Profiler::Start()
+{
+  if (running_) return true;
+
+  if (detail::GetCountHook(env_, detail::kProfilerHook)) return false;
+
+  detail::SetCountHook(env_, detail::kProfilerHook, &Profiler::Hook, this,
+                       period_);
+  running_ = true;
+  return true;
+}
+
+void Profiler::Stop() noexcept
+{
+  if (!running_) return;
+
+  detail::SetCountHook(env_, detail::kProfilerHook, nullptr, nullptr, 0);
+  running_ = false;
+}
+
+void Profiler::Clear() noexcept
+{
+  stacks_.clear();
+  sample_num_ = 0;
+  frame_ids_.clear();
+  frame_labels_.resize(1);
+}
+
+void Profiler::Hook(lua_State *thread, void *ud)
+{
+  static_cast<Profiler *>(ud)->Sample(thread);
+}
+
+void Profiler::Sample(lua_State *thread)
+{
+  lua_Debug ar;
+  int level = 0;
+
+  scratch_.clear();
+  for (; level < kMaxDepth && lua_getstack(thread, level, &ar); ++level) {
+    lua_getinfo(thread, "Sn", &ar);
+    scratch_.push_back(GetFrameId(ar));
+  }
+  if (level == kMaxDepth && lua_getstack(thread, level, &ar))
+    scratch_.push_back(kTruncatedFrame);
+  if (scratch_.empty()) return;
+
+  ++sample_num_;
+  auto iter = stacks_.find(scratch_);
+  if (iter != stacks_.end())
+    ++iter->second;
+  else
+    stacks_.emplace(scratch_, 1);
+}
+
+static void FormatLabel(lua_Debug const &ar, std::string &label)
+{
+  label.clear();
+  if (ar.what[0] == 'C') {
+    label = ar.name ? ar.name : "?";
+    label += " [C]";
+  } else if (ar.what[0] == 'm') {
+    label = "main chunk (";
+    label += ar.short_src;
+    label += ")";
+  } else {
+    char line[16];
+    snprintf(line, sizeof line, ":%d)", ar.linedefined);
+    label = ar.name ? ar.name : "?";
+    label += " (";
+    label += ar.short_src;
+    label += line;
+  }
+  /* ';' separates the frames in the folded-stack format */
+  std::replace(label.begin(), label.end(), ';', ':');
+}
+
+uint32_t Profiler::GetFrameId(lua_Debug const &ar)
+{
+  FormatLabel(ar, label_);
+  auto iter = frame_ids_.find(label_);
+  if (iter != frame_ids_.end()) return iter->second;
+
+  const auto id = (uint32_t)frame_labels_.size();
+  frame_labels_.push_back(label_);
+  frame_ids_.emplace(label_, id);
+  return id;
+}
+
+/*
+ * The different frames may have the same label,
+ * e.g. the closures created by the same expression.
+ * Merge them and sort the lines.
+ */
+std::map<std::string, uint64_t> Profiler::Fold() const
+{
+  std::map<std::string, uint64_t> ret;
+  std::string line;
+  for (auto const &stack : stacks_) {
+    line.clear();
+    for (auto iter = stack.first.rbegin(); iter != stack.first.rend();
+         ++iter) {
+      if (!line.empty()) line += ';';
+      line += frame_labels_[*iter];
+    }
+    ret[line] += stack.second;
+  }
+  return ret;
+}
+
+void Profiler::WriteFolded(FILE *fp) const
+{
+  for (auto const &stack : Fold()) {
+    fprintf(fp, "%s %llu\n", stack.first.c_str(),
+            (unsigned long long)stack.second);
+  }
+}
+
+std::string Profiler::FoldedStacks() const
+{
+  std::string ret;
+  for (auto const &stack : Fold()) {
+    ret += stack.first;
+    ret += ' ';
+    ret += std::to_string(stack.second);
+    ret += '\n';
+  }
+  return ret;
+}
@@ -0,0 +1,114 @@
+#ifndef HKLUA_PROFILER_H__
+#define HKLUA_PROFILER_H__
+
+#include <lua.hpp>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hklua {
+
+class Env;
+
+/**
+ * \brief Sampling profiler of the Lua code running in an Env
+ *
+ * The count hook samples the call stack(Lua and C functions) every
+ * \p period VM instructions, the samples are aggregated by stack.
+ * The result is in the folded-stack format, e.g.
+ * main chunk (init.lua);update (game.lua:10);pcall [C];step (game.lua:3) 42
+ * which can be consumed by flamegraph.pl, speedscope, etc.
+ *
+ * e.g.
+ * Profiler profiler(env);
+ * profiler.Start();
+ * env.DoString(...);
+ * profiler.Stop();
+ * profiler.WriteFolded(fp);
+ *
+ * The default period samples about 1000 times per second if the VM
+ * executes 100M instructions per second, larger period is cheaper.
+ * There is no overhead if the profiler is stopped since the hook is removed.
+ *
+ * \note
+ * The coroutines created after Start()(or resumed by Coroutine) are
+ * sampled too, without the frames of the resumer.
+ * The hook is shared with InstructionBudget and the time slice of
+ * Coroutine(see hklua/count_hook.h), so they can be used together.
+ */
+class Profiler {
+ public:
+  static constexpr int kDefaultPeriod = 100000;
+  /* The deeper frames(close to the root) are folded into "..." */
+  static constexpr int kMaxDepth = 64;
+
+  explicit Profiler(lua_State *env, int period = kDefaultPeriod);
+  explicit Profiler(Env &env, int period = kDefaultPeriod);
+  ~Profiler() noexcept { Stop(); }
+
+  Profiler(Profiler const &) = delete;
+  Profiler &operator=(Profiler const &) = delete;
+
+  /**
+   * Install the count hook
+   * \return false if another profiler is running in the Env
+   */
+  bool Start();
+
+  /**
+   * Remove the hook, the samples are kept
+   */
+  void Stop() noexcept;
+
+  /**
+   * Drop the samples
+   */
+  void Clear() noexcept;
+
+  /**
+   * Write the samples in folded-stack format, one stack per line
+   */
+  void WriteFolded(FILE *fp) const;
+  std::string FoldedStacks() const;
+
+  bool IsRunning() const noexcept { return running_; }
+  int period() const noexcept { return period_; }
+  uint64_t sample_num() const noexcept { return sample_num_; }
+  /** The number of distinct stacks */
+  size_t stack_num() const noexcept { return stacks_.size(); }
+
+ private:
+  struct StackHash {
+    size_t operator()(std::vector<uint32_t> const &stack) const noexcept;
+  };
+
+  static void Hook(lua_State *thread, void *ud);
+
+  void Sample(lua_State *thread);
+  uint32_t GetFrameId(lua_Debug const &ar);
+  /* The folded stack -> the number of samples */
+  std::map<std::string, uint64_t> Fold() const;
+
+  lua_State *env_;
+  int period_;
+  bool running_;
+  uint64_t sample_num_;
+
+  /* Keyed by the label rather than the addresses of the source and
+   * name, since the strings may be collected and the addresses reused.
+   * The frames with the same label are merged by Fold() anyway. */
+  std::unordered_map<std::string, uint32_t> frame_ids_;
+  std::vector<std::string> frame_labels_;
+  /* The frame ids from the innermost to the root */
+  std::unordered_map<std::vector<uint32_t>, uint64_t, StackHash> stacks_;
+  /* Reused by each sample to avoid allocation */
+  std::vector<uint32_t> scratch_;
+  std::string label_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_PROFILER_H__
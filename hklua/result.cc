@@ -0,0 +1,101 @@
+#include "hklua/result.h"
+
+using namespace hklua;
+
+/* Same as the message handler of lua.c */
+static char const kTracebackPrefix[] = "\nstack traceback:";
+
+Error::Error(HKLuaError code, std::string message, std::string traceback)
+  : code_(code)
+  , detail_(new Detail{ std::move(message), std::move(traceback) })
+{
+}
+
+Error::Error(Error const &rhs)
+  : code_(rhs.code_)
+  , detail_(rhs.detail_ ? new Detail(*rhs.detail_) : nullptr)
+{
+}
+
+Error &Error::operator=(Error const &rhs)
+{
+  Error(rhs).detail_.swap(detail_);
+  code_ = rhs.code_;
+  return *this;
+}
+
+static std::string const kEmptyString;
+
+std::string const &Error::message() const noexcept
+{
+  return detail_ ? detail_->message : kEmptyString;
+}
+
+std::string const &Error::traceback() const noexcept
+{
+  return detail_ ? detail_->traceback : kEmptyString;
+}
+
+std::string Error::ToString() const
+{
+  if (!detail_) return {};
+  if (detail_->traceback.empty()) return detail_->message;
+  return detail_->message + "\n" + detail_->traceback;
+}
+
+int detail::TracebackHandler(lua_State *env)
+{
+  char const *msg = lua_tostring(env, 1);
+  if (!msg) {
+    if (luaL_callmeta(env, 1, "__tostring") &&
+        lua_type(env, -1) == LUA_TSTRING)
+      msg = lua_tostring(env, -1);
+    else
+      msg = lua_pushfstring(env, "(error object is a %s value)",
+                            luaL_typename(env, 1));
+  }
+  luaL_traceback(env, env, msg, 1);
+  return 1;
+}
+
+Error detail::ErrorFromStack(lua_State *env, HKLuaError code)
+{
+  size_t len = 0;
+  /* Don't call __tostring here, it is unprotected */
+  char const *msg =
+      lua_isstring(env, -1) ? lua_tolstring(env, -1, &len) : nullptr;
+  if (!msg) {
+    return Error(code, std::string("(error object is a ") +
+                           luaL_typename(env, -1) + " value)");
+  }
+
+  std::string message(msg, len);
+  std::string traceback;
+  const auto pos = message.find(kTracebackPrefix);
+  if (pos != std::string::npos) {
+    traceback = message.substr(pos + 1);
+    message.resize(pos);
+  }
+  return Error(code, std::move(message), std::move(traceback));
+}
+
+Error detail::PCallOnTop(lua_State *env, int nargs, int nrets, bool traceback)
+{
+  const int top = lua_gettop(env) - nargs - 1;
+  int msgh = 0;
+  if (traceback) {
+    lua_pushcfunction(env, &TracebackHandler);
+    lua_insert(env, top + 1);
+    msgh = top + 1;
+  }
+
+  const auto status = (HKLuaError)lua_pcall(env, nargs, nrets, msgh);
+  if (status != HKLUA_OK) {
+    auto err = ErrorFromStack(env, status);
+    lua_settop(env, top);
+    return err;
+  }
+
+  if (traceback) lua_remove(env, msgh);
+  return Error();
+}
@@ -0,0 +1,249 @@
+#ifndef HKLUA_RESULT_H__
+#define HKLUA_RESULT_H__
+
+#include <lua.hpp>
+#include <assert.h>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility> // move, forward
+
+#include "hklua/function.h"
+#include "hklua/type.h"
+
+namespace hklua {
+
+class Table;
+
+/**
+ * \brief The error of the Lua call or the conversion
+ *
+ * The message and traceback are allocated only if failed,
+ * i.e. the Error of success is just a code.
+ */
+class Error {
+ public:
+  Error() noexcept
+    : code_(HKLUA_OK)
+  {
+  }
+
+  Error(HKLuaError code, std::string message,
+        std::string traceback = std::string());
+
+  Error(Error const &rhs);
+  Error &operator=(Error const &rhs);
+  Error(Error &&) noexcept = default;
+  Error &operator=(Error &&) noexcept = default;
+
+  bool ok() const noexcept { return code_ == HKLUA_OK; }
+  HKLuaError code() const noexcept { return code_; }
+
+  /** Empty if success */
+  std::string const &message() const noexcept;
+  /** "stack traceback:\n..." if the traceback is enabled, otherwise empty */
+  std::string const &traceback() const noexcept;
+
+  /** The message followed by the traceback */
+  std::string ToString() const;
+
+ private:
+  struct Detail {
+    std::string message;
+    std::string traceback;
+  };
+
+  HKLuaError code_;
+  std::unique_ptr<Detail> detail_;
+};
+
+/**
+ * \brief The value or the error
+ *
+ * e.g.
+ * auto ret = env.TryCallFunction<Integer>("add", 1, 2);
+ * if (!ret) {
+ *   fprintf(stderr, "%s\n", ret.error().ToString().c_str());
+ * }
+ * auto sum = std::get<0>(*ret);
+ *
+ * \note T must be default constructible like the argument of StackConv()
+ */
+template <typename T>
+class Result {
+ public:
+  Result(T value)
+    : value_(std::move(value))
+  {
+  }
+
+  Result(Error error)
+    : value_()
+    , error_(std::move(error))
+  {
+  }
+
+  bool ok() const noexcept { return error_.ok(); }
+  explicit operator bool() const noexcept { return ok(); }
+
+  /** \pre ok() */
+  T &value() & noexcept
+  {
+    assert(ok());
+    return value_;
+  }
+
+  T const &value() const & noexcept
+  {
+    assert(ok());
+    return value_;
+  }
+
+  T &&value() && noexcept
+  {
+    assert(ok());
+    return std::move(value_);
+  }
+
+  T &operator*() & noexcept { return value(); }
+  T const &operator*() const & noexcept { return value(); }
+  T *operator->() noexcept { return &value(); }
+  T const *operator->() const noexcept { return &value(); }
+
+  template <typename U>
+  T value_or(U &&default_value) const &
+  {
+    return ok() ? value_ : static_cast<T>(std::forward<U>(default_value));
+  }
+
+  Error const &error() const noexcept { return error_; }
+  HKLuaError code() const noexcept { return error_.code(); }
+
+ private:
+  T value_;
+  Error error_;
+};
+
+template <>
+class Result<void> {
+ public:
+  Result() = default;
+
+  Result(Error error)
+    : error_(std::move(error))
+  {
+  }
+
+  bool ok() const noexcept { return error_.ok(); }
+  explicit operator bool() const noexcept { return ok(); }
+
+  Error const &error() const noexcept { return error_; }
+  HKLuaError code() const noexcept { return error_.code(); }
+
+ private:
+  Error error_;
+};
+
+namespace detail {
+
+/**
+ * The message handler which appends the traceback(luaL_traceback())
+ * to the error message
+ */
+int TracebackHandler(lua_State *env);
+
+/**
+ * Convert the error object on the top to Error(not poped)
+ */
+Error ErrorFromStack(lua_State *env, HKLuaError code);
+
+/**
+ * Call the function below the \p nargs arguments by lua_pcall()
+ *
+ * \param traceback Use TracebackHandler() as the message handler
+ * \return
+ * If failed, the error and the stack is restored to the level before
+ * the function is pushed.
+ * Otherwise, the \p nrets results are on the top.
+ */
+Error PCallOnTop(lua_State *env, int nargs, int nrets, bool traceback);
+
+/**
+ * Convert and pop the value on the top
+ * \param what The description of the value, e.g. "field", "global"
+ * \param name The key of the value, NULL if it is not a string
+ */
+template <typename T>
+Result<T> PopConv(lua_State *env, char const *what, char const *name)
+{
+  static_assert(!std::is_same<T, Table>::value,
+                "The table is poped, use the bool version instead");
+  T ret;
+  /* The path of the mismatched field of struct, see hklua/struct.h */
+  std::string path;
+  if (!ConvField(env, -1, ret, &path)) {
+    std::string msg(what);
+    if (name) {
+      msg += " '";
+      msg += name;
+      msg += "'";
+    }
+    msg += " can't be converted(";
+    if (path.empty()) {
+      msg += luaL_typename(env, -1);
+      msg += " value)";
+    } else {
+      msg += "at ";
+      msg += path;
+      msg += ")";
+    }
+    lua_pop(env, 1);
+    return Error(HKLUA_ERRTYPE, std::move(msg));
+  }
+  lua_pop(env, 1);
+  return ret;
+}
+
+/**
+ * Like CallFunctionOnTop() but the stack is always restored
+ * \pre The function object is on the top of the stack
+ */
+template <typename... Rets, typename... Args>
+Result<std::tuple<Rets...>> TryCallOnTop(lua_State *env, bool traceback,
+                                         Args &&...args)
+{
+  const int top = lua_gettop(env) - 1;
+  StackPushMultiple(env, std::forward<Args>(args)...);
+  auto err = PCallOnTop(env, (int)sizeof...(args), (int)sizeof...(Rets),
+                        traceback);
+  if (!err.ok()) return err;
+
+  std::tuple<Rets...> ret;
+  const auto result = StackConvMultiple(env, lua_gettop(env), ret);
+  lua_settop(env, top);
+  if (!result) {
+    return Error(HKLUA_ERRTYPE, "the results can't be converted");
+  }
+  return ret;
+}
+
+} // namespace detail
+
+/**
+ * The interface is same as FunctionRef::Call() but returns Result,
+ * the stack is always restored.
+ * Env::TryCallFunction() supports the traceback.
+ */
+template <typename... Rets, typename... Args>
+Result<std::tuple<Rets...>> TryCall(FunctionRef const &func, Args &&...args)
+{
+  if (!func.IsValid()) return Error(HKLUA_ERRTYPE, "invalid function reference");
+  func.Push();
+  return detail::TryCallOnTop<Rets...>(func.env(), false,
+                                       std::forward<Args>(args)...);
+}
+
+} // namespace hklua
+
+#endif // HKLUA_RESULT_H__
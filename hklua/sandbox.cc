@@ -0,0 +1,128 @@
+#include "hklua/sandbox.h"
+
+#include <initializer_list>
+
+using namespace hklua;
+
+static std::unique_ptr<Allocator> MakeAllocator(
+    SandboxOptions const &options, std::unique_ptr<Allocator> allocator)
+{
+  if (!allocator) allocator.reset(new SystemAllocator());
+  if (options.memory_limit != 0) allocator->SetLimit(options.memory_limit);
+  return allocator;
+}
+
+static void RemoveFields(lua_State *env, int index,
+                         std::initializer_list<char const *> names)
+{
+  index = lua_absindex(env, index);
+  for (auto name : names) {
+    lua_pushnil(env);
+    lua_setfield(env, index, name);
+  }
+}
+
+/*
+ * setmetatable() rejecting __gc, the finalizers run without the hooks
+ * (i.e. the instruction limit) in any collection, even in lua_close()
+ * upvalue 1: the original setmetatable()
+ */
+static int SetMetatable(lua_State *env)
+{
+  /* Any value, the field may be assigned after the object is marked */
+  if (lua_type(env, 2) == LUA_TTABLE &&
+      lua_getfield(env, 2, "__gc") != LUA_TNIL)
+  {
+    return luaL_argerror(env, 2, "__gc is not allowed in the sandbox");
+  }
+  lua_settop(env, 2);
+
+  lua_pushvalue(env, lua_upvalueindex(1));
+  lua_insert(env, 1);
+  lua_call(env, 2, 1);
+  return 1;
+}
+
+/*
+ * upvalue 1: Env
+ * upvalue 2: SandboxOptions
+ */
+static int SetupSandbox(lua_State *env)
+{
+  auto self = static_cast<Env *>(lua_touserdata(env, lua_upvalueindex(1)));
+  auto options = static_cast<SandboxOptions const *>(
+      lua_touserdata(env, lua_upvalueindex(2)));
+
+  self->OpenLibs(options->libs);
+
+  if (options->strip_load) {
+    lua_pushglobaltable(env);
+    RemoveFields(env, -1, { "load", "loadfile", "dofile" });
+    lua_pop(env, 1);
+
+    if (lua_getglobal(env, LUA_LOADLIBNAME) == LUA_TTABLE) {
+      RemoveFields(env, -1, { "loadlib" });
+      /* The Lua and C searchers load the files */
+      if (lua_getfield(env, -1, "searchers") == LUA_TTABLE) {
+        for (auto i = luaL_len(env, -1); i > 1; --i) {
+          lua_pushnil(env);
+          lua_rawseti(env, -2, i);
+        }
+      }
+      lua_pop(env, 1);
+    }
+    lua_pop(env, 1);
+  }
+
+  if (options->strip_os) {
+    if (lua_getglobal(env, LUA_OSLIBNAME) == LUA_TTABLE) {
+      RemoveFields(env, -1, { "execute", "exit", "getenv", "remove", "rename",
+                              "setlocale", "tmpname" });
+    }
+    lua_pop(env, 1);
+  }
+
+  if (options->instruction_limit != 0) {
+    if (lua_getglobal(env, "setmetatable") == LUA_TFUNCTION) {
+      lua_pushcclosure(env, &SetMetatable, 1);
+      lua_setglobal(env, "setmetatable");
+    } else {
+      lua_pop(env, 1);
+    }
+  }
+  return 0;
+}
+
+Sandbox::Sandbox(SandboxOptions const &options, std::string name,
+                 std::unique_ptr<Allocator> allocator)
+  : env_(std::move(name), MakeAllocator(options, std::move(allocator)))
+  , options_(options)
+  , tripped_(kNoLimit)
+  , instructions_used_(0)
+{
+  /* The memory limit applies to the libraries too */
+  lua_pushlightuserdata(env_.env(), &env_);
+  lua_pushlightuserdata(env_.env(), &options_);
+  lua_pushcclosure(env_.env(), &SetupSandbox, 2);
+  if (lua_pcall(env_.env(), 0, 0, 0) != LUA_OK) {
+    std::string msg = "Failed to set up the sandbox: ";
+    auto err = lua_tostring(env_.env(), -1);
+    msg += err ? err : "unknown error";
+    lua_pop(env_.env(), 1);
+    throw EnvException(std::move(msg));
+  }
+}
+
+void Sandbox::Trip(HKLuaError code, size_t failures, bool exceeded) noexcept
+{
+  tripped_ = kNoLimit;
+  if (code == HKLUA_OK) return;
+
+  if (exceeded) {
+    tripped_ = kInstructionLimit;
+  } else if (code == HKLUA_ERRMEM ||
+             env_.allocator()->failure_count() != failures) {
+    /* The memory error may be caught and raised again as a string */
+    tripped_ = kMemoryLimit;
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef HKLUA_SANDBOX_H__
+#define HKLUA_SANDBOX_H__
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+#include "hklua/env.h"
+#include "hklua/instruction_budget.h"
+
+namespace hklua {
+
+/**
+ * \brief The configuration of Sandbox
+ */
+struct SandboxOptions {
+  /* The libraries opened(HKLuaLib flags), no io and os by default */
+  unsigned libs = HKLUA_LIB_SAFE;
+
+  /* Remove load, loadfile and dofile, and the searchers of the package
+   * library except the preload one(require the modules of the host only) */
+  bool strip_load = true;
+
+  /* Keep clock, date, difftime and time of the os library only */
+  bool strip_os = true;
+
+  /* The memory cap of the Env including the libraries(0 indicates no limit) */
+  size_t memory_limit = 0;
+
+  /* The instructions of a run(0 indicates no limit).
+   * If it is set, setmetatable() rejects __gc since the finalizers run
+   * without the hooks(and out of the runs, e.g. in ~Env()) */
+  uint64_t instruction_limit = 0;
+  int granularity = InstructionBudget::kDefaultGranularity;
+};
+
+/**
+ * \brief Env for the untrusted scripts of a tenant
+ *
+ * Only the whitelisted libraries are opened(luaL_requiref() per library),
+ * the memory is capped by the allocator and the instructions of each
+ * run(TryDoString(), TryCallFunction() or Run()) are limited by an
+ * InstructionBudget, so many tenants can be packed into a process
+ * instead of one process per tenant.
+ * If a run fails due to a limit, tripped() reports which one.
+ *
+ * e.g.
+ * SandboxOptions options;
+ * options.memory_limit = 16 * 1024 * 1024;
+ * options.instruction_limit = 1000000;
+ * Sandbox sandbox(options);
+ * auto ret = sandbox.TryDoString(script);
+ * if (!ret && sandbox.tripped() == Sandbox::kMemoryLimit) {}
+ *
+ * \note
+ * The memory cap is of the whole Env, it is not reset between runs.
+ * The error of the instruction limit is raised again after it is caught
+ * by pcall(), the memory error is not(Lua does an emergency collection
+ * first, then the script may free the memory), so the run may succeed
+ * after some allocations are rejected.
+ */
+class Sandbox {
+ public:
+  enum Limit : unsigned char {
+    kNoLimit,
+    kMemoryLimit,
+    kInstructionLimit,
+  };
+
+  /**
+   * \param allocator The limit is set to SandboxOptions::memory_limit if
+   *                  it is not 0, SystemAllocator is used if it is NULL
+   * \throw EnvException If the libraries can't be opened, e.g. the memory
+   *                     limit is too small
+   */
+  explicit Sandbox(SandboxOptions const &options = SandboxOptions(),
+                   std::string name = "sandbox",
+                   std::unique_ptr<Allocator> allocator = nullptr);
+
+  Env &env() noexcept { return env_; }
+  SandboxOptions const &options() const noexcept { return options_; }
+
+  /**
+   * Call \p f(env()) within the limits,
+   * f returns Result<T>(e.g. the Try*() API of Env)
+   */
+  template <typename F>
+  auto Run(F &&f) -> decltype(f(std::declval<Env &>()))
+  {
+    const auto failures = env_.allocator()->failure_count();
+    if (options_.instruction_limit == 0) {
+      auto ret = f(env_);
+      Trip(ret.ok() ? HKLUA_OK : ret.code(), failures, false);
+      return ret;
+    }
+
+    /* The hook is installed in the run only, see InstructionBudget */
+    InstructionBudget budget(env_, options_.instruction_limit,
+                             options_.granularity);
+    auto ret = f(env_);
+    instructions_used_ = budget.used();
+    Trip(ret.ok() ? HKLUA_OK : ret.code(), failures, budget.exceeded());
+    return ret;
+  }
+
+  Result<void> TryDoString(char const *chunk)
+  {
+    return Run([chunk](Env &env) { return env.TryDoString(chunk); });
+  }
+
+  template <typename... Rets, typename... Args>
+  Result<std::tuple<Rets...>> TryCallFunction(char const *name,
+                                              Args &&...args)
+  {
+    return Run([&](Env &env) {
+      return env.TryCallFunction<Rets...>(name, std::forward<Args>(args)...);
+    });
+  }
+
+  /** The limit which makes the last run fail */
+  Limit tripped() const noexcept { return tripped_; }
+
+  /** The bytes used by the Env */
+  size_t memory_used() const noexcept { return env_.allocator()->bytes(); }
+  /** The instructions of the last run(in granularity) */
+  uint64_t instructions_used() const noexcept { return instructions_used_; }
+
+ private:
+  void Trip(HKLuaError code, size_t failures, bool exceeded) noexcept;
+
+  Env env_;
+  SandboxOptions options_;
+  Limit tripped_;
+  uint64_t instructions_used_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_SANDBOX_H__
@@ -0,0 +1,152 @@
+#include "hklua/scheduler.h"
+
+#include <math.h>
+#include <thread>
+
+using namespace hklua;
+
+/* The address marks the values yielded by sleep() */
+static char const kSleepKey = 0;
+
+/* The number of coroutines kept for reuse */
+static constexpr size_t kMaxFreeTasks = 1024;
+
+constexpr Scheduler::TaskId Scheduler::kInvalidTask;
+
+Scheduler::Scheduler(Env &env, char const *sleep_name)
+  : env_(env)
+  , last_id_(kInvalidTask)
+  , timer_seq_(0)
+  , preemption_num_(0)
+  , time_slice_(0)
+  , idle_gc_(nullptr)
+{
+  if (sleep_name) {
+    lua_pushcfunction(env_.env(), &Scheduler::LuaSleep);
+    lua_setglobal(env_.env(), sleep_name);
+  }
+}
+
+Scheduler::~Scheduler() noexcept
+{
+  for (auto task : ready_)
+    delete task;
+
+  while (!timers_.empty()) {
+    delete timers_.top().task;
+    timers_.pop();
+  }
+}
+
+int Scheduler::LuaSleep(lua_State *env)
+{
+  const auto seconds = luaL_checknumber(env, 1);
+  luaL_argcheck(env, !isnan(seconds), 1, "NaN");
+  if (!lua_isyieldable(env)) {
+    return luaL_error(env, "sleep() must be called in the task");
+  }
+
+  lua_pushlightuserdata(env, const_cast<char *>(&kSleepKey));
+  lua_pushnumber(env, seconds);
+  return lua_yield(env, 2);
+}
+
+auto Scheduler::AllocTask() -> Task *
+{
+  Task *task;
+  if (!free_tasks_.empty()) {
+    task = free_tasks_.back().release();
+    free_tasks_.pop_back();
+  } else {
+    task = new Task{ kInvalidTask, 0, env_.CreateCoroutine() };
+  }
+
+  if (task->co.time_slice() != time_slice_)
+    task->co.SetTimeSlice(time_slice_);
+  return task;
+}
+
+void Scheduler::FreeTask(Task *task) noexcept
+{
+  if (free_tasks_.size() >= kMaxFreeTasks) {
+    delete task;
+    return;
+  }
+
+  task->co.Reset();
+  free_tasks_.emplace_back(task);
+}
+
+/* now + seconds without overflow, e.g. sleep(math.huge) sleeps forever */
+static Scheduler::Clock::time_point Deadline(Scheduler::Clock::time_point now,
+                                             double seconds) noexcept
+{
+  using Clock = Scheduler::Clock;
+  if (!(seconds > 0)) return now;
+
+  const auto left = Clock::time_point::max() - now;
+  const std::chrono::duration<double, Clock::period> d(
+      std::chrono::duration<double>{ seconds });
+  if (d.count() >= (double)left.count()) return Clock::time_point::max();
+  const Clock::duration delay((Clock::rep)d.count());
+  return delay >= left ? Clock::time_point::max() : now + delay;
+}
+
+void Scheduler::ResumeTask(Task *task, Clock::time_point now)
+{
+  auto &co = task->co;
+  const auto status = co.ResumeOnTop(task->nargs);
+  task->nargs = 0;
+
+  if (status == HKLUA_YIELD) {
+    auto thread = co.thread();
+    if (co.nresults() == 2 && lua_touserdata(thread, -2) == &kSleepKey) {
+      timers_.push(
+          Timer{ Deadline(now, lua_tonumber(thread, -1)), ++timer_seq_, task });
+    } else {
+      if (co.IsPreempted()) ++preemption_num_;
+      ready_.push_back(task);
+    }
+    /* sleep() and coroutine.yield() return nothing */
+    co.PopResults();
+    return;
+  }
+
+  if (done_cb_) done_cb_(task->id, co);
+  FreeTask(task);
+}
+
+size_t Scheduler::RunOnce()
+{
+  /* The sleep of the tasks resumed in this round starts from now */
+  const auto now = Clock::now();
+  while (!timers_.empty() && timers_.top().deadline <= now) {
+    ready_.push_back(timers_.top().task);
+    timers_.pop();
+  }
+
+  const auto n = ready_.size();
+  for (size_t i = 0; i < n; ++i) {
+    auto task = ready_.front();
+    ready_.pop_front();
+    ResumeTask(task, now);
+  }
+  return n;
+}
+
+void Scheduler::Run()
+{
+  while (task_num() != 0) {
+    RunOnce();
+    if (ready_.empty() && !timers_.empty()) {
+      const auto wakeup = NextWakeup();
+      if (idle_gc_) idle_gc_->RunUntil(wakeup);
+      std::this_thread::sleep_until(wakeup);
+    }
+  }
+}
+
+auto Scheduler::NextWakeup() const noexcept -> Clock::time_point
+{
+  return timers_.empty() ? Clock::time_point::max() : timers_.top().deadline;
+}
@@ -0,0 +1,195 @@
+#ifndef HKLUA_SCHEDULER_H__
+#define HKLUA_SCHEDULER_H__
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdint.h>
+#include <vector>
+
+#include "hklua/env.h"
+
+namespace hklua {
+
+/**
+ * \brief Run many script tasks as coroutines in one Env
+ *
+ * Each task is a Lua function running in its coroutine, it can
+ * - call sleep(seconds) to suspend itself until the timer expires
+ * - call coroutine.yield()(or the bound C++ function returns Yield)
+ *   to give up the CPU, then it is resumed in the next round
+ *
+ * If the time slice is set, the task which runs too long is preempted
+ * and moved to the tail of the ready queue, i.e. the tasks share the
+ * CPU in round-robin even if they never yield.
+ *
+ * The scheduler is callback-based:
+ * RunOnce() resumes the ready tasks once and returns, so it can be
+ * driven by the event loop of the host. Run() loops until all tasks
+ * are done.
+ *
+ * The done coroutines are reset and reused by later tasks,
+ * so spawning a task doesn't create a Lua thread in most cases.
+ *
+ * \note
+ * Like Env, the scheduler is not thread-safe.
+ * To multiplex the tasks on several threads, run an Env and its
+ * scheduler per thread(e.g. the Envs checked out from EnvPool).
+ */
+class Scheduler {
+ public:
+  using TaskId = uint64_t;
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * Called when the task returns or fails.
+   * The status and the results(or the error object) are in \p co.
+   */
+  using DoneCallback = std::function<void(TaskId id, Coroutine &co)>;
+
+  static constexpr TaskId kInvalidTask = 0;
+
+  /**
+   * \param sleep_name The name of global sleep function,
+   *                   NULL indicates it is not registered
+   */
+  explicit Scheduler(Env &env, char const *sleep_name = "sleep");
+  ~Scheduler() noexcept;
+
+  Scheduler(Scheduler const &) = delete;
+  Scheduler &operator=(Scheduler const &) = delete;
+
+  /**
+   * Spawn a task which calls global function \p name with \p args.
+   * The task is not run until RunOnce() or Run() is called.
+   *
+   * \return kInvalidTask if \p name is not a function
+   */
+  template <typename... Args>
+  TaskId Spawn(char const *name, Args &&...args)
+  {
+    auto task = AllocTask();
+    if (!task->co.SetFunction(name)) {
+      FreeTask(task);
+      return kInvalidTask;
+    }
+    return Ready(task, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  TaskId Spawn(FunctionRef const &func, Args &&...args)
+  {
+    auto task = AllocTask();
+    if (!task->co.SetFunction(func)) {
+      FreeTask(task);
+      return kInvalidTask;
+    }
+    return Ready(task, std::forward<Args>(args)...);
+  }
+
+  void SetDoneCallback(DoneCallback cb) { done_cb_ = std::move(cb); }
+
+  /**
+   * Preempt the task every \p instructions VM instructions.
+   * It applies to the tasks spawned later.
+   * 0 indicates the tasks are not preempted(default).
+   * \see Coroutine::SetTimeSlice()
+   */
+  void SetTimeSlice(int instructions) noexcept
+  {
+    time_slice_ = instructions > 0 ? instructions : 0;
+  }
+
+  /**
+   * Collect garbage in Run() while all tasks are sleeping,
+   * nullptr indicates no collection(default).
+   * \see IdleGc::RunUntil()
+   */
+  void SetIdleGc(IdleGc *gc) noexcept { idle_gc_ = gc; }
+
+  /**
+   * Resume the expired sleeping tasks and the ready tasks once.
+   * The tasks become ready during the round are resumed in the next round.
+   *
+   * \return The number of resumed tasks
+   */
+  size_t RunOnce();
+
+  /**
+   * Run until all tasks are done.
+   * If all tasks are sleeping, the thread sleeps until the earliest timer
+   * (after the collection work of the idle GC if it is set).
+   */
+  void Run();
+
+  /**
+   * The time point of the earliest timer, Clock::time_point::max()
+   * if there is no sleeping task
+   */
+  Clock::time_point NextWakeup() const noexcept;
+
+  /**
+   * The sleep(seconds) function of Lua, must be called in the task.
+   * The task sleeps forever if the timer overflows(e.g. math.huge)
+   */
+  static int LuaSleep(lua_State *env);
+
+  size_t task_num() const noexcept { return ready_.size() + timers_.size(); }
+  size_t ready_num() const noexcept { return ready_.size(); }
+  size_t sleeping_num() const noexcept { return timers_.size(); }
+  int time_slice() const noexcept { return time_slice_; }
+  /** The number of the preemptions since the scheduler is created */
+  uint64_t preemption_num() const noexcept { return preemption_num_; }
+
+ private:
+  struct Task {
+    TaskId id;
+    int nargs;
+    Coroutine co;
+  };
+
+  struct Timer {
+    Clock::time_point deadline;
+    /* Keep FIFO order if the deadlines are equal */
+    uint64_t seq;
+    Task *task;
+
+    bool operator>(Timer const &rhs) const noexcept
+    {
+      return deadline != rhs.deadline ? deadline > rhs.deadline
+                                      : seq > rhs.seq;
+    }
+  };
+
+  template <typename... Args>
+  TaskId Ready(Task *task, Args &&...args)
+  {
+    detail::StackPushMultiple(task->co.thread(), std::forward<Args>(args)...);
+    task->nargs = (int)sizeof...(args);
+    task->id = ++last_id_;
+    ready_.push_back(task);
+    return task->id;
+  }
+
+  Task *AllocTask();
+  void FreeTask(Task *task) noexcept;
+  void ResumeTask(Task *task, Clock::time_point now);
+
+  Env &env_;
+  TaskId last_id_;
+  uint64_t timer_seq_;
+  uint64_t preemption_num_;
+  int time_slice_;
+  std::deque<Task *> ready_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+  /* The done tasks whose coroutine can be reused */
+  std::vector<std::unique_ptr<Task>> free_tasks_;
+  DoneCallback done_cb_;
+  IdleGc *idle_gc_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_SCHEDULER_H__
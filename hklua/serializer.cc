@@ -0,0 +1,888 @@
+#include "hklua/serializer.h"
+#include "hklua/env.h"
+
+#include <algorithm>
+#include <float.h>
+#include <limits.h>
+#include <limits>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace hklua;
+
+/* The MessagePack tags, see https://github.com/msgpack/msgpack/blob/master/spec.md */
+enum : unsigned char {
+  kFixMap = 0x80,
+  kFixArray = 0x90,
+  kFixStr = 0xa0,
+  kNil = 0xc0,
+  kFalse = 0xc2,
+  kTrue = 0xc3,
+  kBin8 = 0xc4,
+  kBin32 = 0xc6,
+  kFloat32 = 0xca,
+  kFloat64 = 0xcb,
+  kUint8 = 0xcc,
+  kUint64 = 0xcf,
+  kInt8 = 0xd0,
+  kInt64 = 0xd3,
+  kStr8 = 0xd9,
+  kStr32 = 0xdb,
+  kArray16 = 0xdc,
+  kArray32 = 0xdd,
+  kMap16 = 0xde,
+  kMap32 = 0xdf,
+  kNegativeFixInt = 0xe0,
+};
+
+constexpr int Serializer::kMaxDepth;
+
+static inline void PutBigEndian(std::string &buffer, uint64_t value, int n)
+{
+  char bytes[8];
+  for (int i = n - 1; i >= 0; --i) {
+    bytes[i] = (char)(value & 0xff);
+    value >>= 8;
+  }
+  buffer.append(bytes, n);
+}
+
+static inline uint64_t GetBigEndian(unsigned char const *bytes, int n)
+{
+  uint64_t value = 0;
+  for (int i = 0; i < n; ++i)
+    value = (value << 8) | bytes[i];
+  return value;
+}
+
+static void PrependKeyPath(lua_State *env, int index, std::string &path)
+{
+  switch (lua_type(env, index)) {
+  case LUA_TSTRING:
+    detail::PrependPath(path, lua_tostring(env, index));
+    break;
+  case LUA_TNUMBER:
+    detail::PrependPath(path, "[" + (lua_isinteger(env, index)
+                                         ? std::to_string(lua_tointeger(env, index))
+                                         : std::to_string(lua_tonumber(env, index))) + "]");
+    break;
+  default:
+    detail::PrependPath(path, std::string("[") + luaL_typename(env, index) + "]");
+  }
+}
+
+static Error MakeError(HKLuaError code, std::string const &message,
+                       std::string const &path)
+{
+  if (path.empty()) return Error(code, message);
+  return Error(code, message + "(at " + path + ")");
+}
+
+/*--------------------------------------------------*/
+/* Serializer                                       */
+/*--------------------------------------------------*/
+
+Serializer::Serializer(lua_State *env)
+  : env_(env)
+{
+}
+
+Serializer::Serializer(Env &env)
+  : Serializer(env.env())
+{
+}
+
+Result<void> Serializer::Write(int index)
+{
+  index = lua_absindex(env_, index);
+  const auto top = lua_gettop(env_);
+  const auto size = buffer_.size();
+
+  if (WriteValue(index, 0)) return {};
+
+  lua_settop(env_, top);
+  buffer_.resize(size);
+  visiting_.clear();
+  auto error = MakeError(error_.code(), error_.message(), path_);
+  error_ = Error();
+  path_.clear();
+  return error;
+}
+
+std::string Serializer::Release() noexcept
+{
+  std::string ret;
+  ret.swap(buffer_);
+  return ret;
+}
+
+bool Serializer::WriteValue(int index, int depth)
+{
+  switch (lua_type(env_, index)) {
+  case LUA_TNIL:
+    buffer_.push_back((char)kNil);
+    return true;
+  case LUA_TBOOLEAN:
+    buffer_.push_back((char)(lua_toboolean(env_, index) ? kTrue : kFalse));
+    return true;
+  case LUA_TNUMBER:
+    if (lua_isinteger(env_, index))
+      WriteInteger(lua_tointeger(env_, index));
+    else
+      WriteNumber(lua_tonumber(env_, index));
+    return true;
+  case LUA_TSTRING: {
+    size_t len;
+    auto str = lua_tolstring(env_, index, &len);
+    WriteString(str, len);
+    return true;
+  }
+  case LUA_TTABLE:
+    return WriteTable(index, depth);
+  }
+
+  error_ = Error(HKLUA_ERRTYPE, std::string(luaL_typename(env_, index)) +
+                                    " value can't be serialized");
+  return false;
+}
+
+bool Serializer::WriteTable(int index, int depth)
+{
+  if (depth >= kMaxDepth) {
+    error_ = Error(HKLUA_ERRTYPE, "table is too deep");
+    return false;
+  }
+
+  if (!lua_checkstack(env_, 3)) {
+    error_ = Error(HKLUA_ERRMEM, "stack overflow");
+    return false;
+  }
+
+  auto table = lua_topointer(env_, index);
+  if (std::find(visiting_.begin(), visiting_.end(), table) != visiting_.end()) {
+    error_ = Error(HKLUA_ERRTYPE, "table is in a cycle");
+    return false;
+  }
+  visiting_.push_back(table);
+
+  /* It is an array if the keys are exactly 1..n */
+  const auto n = lua_rawlen(env_, index);
+  size_t count = 0;
+  bool is_array = true;
+  lua_pushnil(env_);
+  while (lua_next(env_, index)) {
+    ++count;
+    if (is_array) {
+      lua_Integer key;
+      is_array = lua_isinteger(env_, -2) &&
+                 (key = lua_tointeger(env_, -2)) >= 1 &&
+                 (lua_Unsigned)key <= n;
+    }
+    lua_pop(env_, 1);
+  }
+
+  if (is_array && count == n) {
+    WriteHeader(n, kFixArray, kArray16);
+    for (lua_Integer i = 1; i <= (lua_Integer)n; ++i) {
+      lua_rawgeti(env_, index, i);
+      if (!WriteValue(lua_gettop(env_), depth + 1)) {
+        detail::PrependPath(path_, "[" + std::to_string(i) + "]");
+        return false;
+      }
+      lua_pop(env_, 1);
+    }
+  } else {
+    WriteHeader(count, kFixMap, kMap16);
+    lua_pushnil(env_);
+    while (lua_next(env_, index)) {
+      const auto top = lua_gettop(env_);
+      if (!WriteValue(top - 1, depth + 1) || !WriteValue(top, depth + 1)) {
+        PrependKeyPath(env_, top - 1, path_);
+        return false;
+      }
+      lua_pop(env_, 1);
+    }
+  }
+
+  visiting_.pop_back();
+  return true;
+}
+
+void Serializer::WriteInteger(lua_Integer value)
+{
+  if (value >= 0) {
+    if (value < 0x80) {
+      buffer_.push_back((char)value);
+    } else if (value <= UINT8_MAX) {
+      buffer_.push_back((char)kUint8);
+      PutBigEndian(buffer_, value, 1);
+    } else if (value <= UINT16_MAX) {
+      buffer_.push_back((char)(kUint8 + 1));
+      PutBigEndian(buffer_, value, 2);
+    } else if (value <= UINT32_MAX) {
+      buffer_.push_back((char)(kUint8 + 2));
+      PutBigEndian(buffer_, value, 4);
+    } else {
+      buffer_.push_back((char)kUint64);
+      PutBigEndian(buffer_, value, 8);
+    }
+  } else {
+    if (value >= -32) {
+      buffer_.push_back((char)value);
+    } else if (value >= INT8_MIN) {
+      buffer_.push_back((char)kInt8);
+      PutBigEndian(buffer_, (uint64_t)value, 1);
+    } else if (value >= INT16_MIN) {
+      buffer_.push_back((char)(kInt8 + 1));
+      PutBigEndian(buffer_, (uint64_t)value, 2);
+    } else if (value >= INT32_MIN) {
+      buffer_.push_back((char)(kInt8 + 2));
+      PutBigEndian(buffer_, (uint64_t)value, 4);
+    } else {
+      buffer_.push_back((char)kInt64);
+      PutBigEndian(buffer_, (uint64_t)value, 8);
+    }
+  }
+}
+
+void Serializer::WriteNumber(lua_Number value)
+{
+  /* Casting the out-of-range value to float is undefined */
+  const auto fits = fabs(value) <= FLT_MAX || isinf(value);
+  const auto single = fits ? (float)value : 0.f;
+  if (fits && (lua_Number)single == value) {
+    uint32_t bits;
+    memcpy(&bits, &single, sizeof bits);
+    buffer_.push_back((char)kFloat32);
+    PutBigEndian(buffer_, bits, 4);
+  } else {
+    const auto dbl = (double)value;
+    uint64_t bits;
+    memcpy(&bits, &dbl, sizeof bits);
+    buffer_.push_back((char)kFloat64);
+    PutBigEndian(buffer_, bits, 8);
+  }
+}
+
+void Serializer::WriteString(char const *str, size_t len)
+{
+  if (len < 32) {
+    buffer_.push_back((char)(kFixStr | len));
+  } else if (len <= UINT8_MAX) {
+    buffer_.push_back((char)kStr8);
+    PutBigEndian(buffer_, len, 1);
+  } else if (len <= UINT16_MAX) {
+    buffer_.push_back((char)(kStr8 + 1));
+    PutBigEndian(buffer_, len, 2);
+  } else {
+    buffer_.push_back((char)kStr32);
+    PutBigEndian(buffer_, len, 4);
+  }
+  buffer_.append(str, len);
+}
+
+void Serializer::WriteHeader(size_t n, unsigned char fix, unsigned char tag16)
+{
+  if (n < 16) {
+    buffer_.push_back((char)(fix | n));
+  } else if (n <= UINT16_MAX) {
+    buffer_.push_back((char)tag16);
+    PutBigEndian(buffer_, n, 2);
+  } else {
+    buffer_.push_back((char)(tag16 + 1));
+    PutBigEndian(buffer_, n, 4);
+  }
+}
+
+/*--------------------------------------------------*/
+/* Deserializer                                     */
+/*--------------------------------------------------*/
+
+namespace {
+
+/*
+ * Decode the values from [cur, end), the decoded values are pushed
+ * and cur is advanced.
+ * If the data is incomplete, truncated is set and error is not.
+ */
+struct Reader {
+  lua_State *env;
+  unsigned char const *cur;
+  unsigned char const *end;
+  bool truncated;
+  HKLuaError code;
+  std::string message;
+  std::string path;
+
+  Reader(lua_State *e, char const *data, size_t len)
+    : env(e)
+    , cur(reinterpret_cast<unsigned char const *>(data))
+    , end(cur + len)
+    , truncated(false)
+    , code(HKLUA_OK)
+  {
+  }
+
+  bool Need(size_t n) noexcept
+  {
+    if ((size_t)(end - cur) >= n) return true;
+    truncated = true;
+    return false;
+  }
+
+  bool Fail(HKLuaError c, char const *msg)
+  {
+    code = c;
+    message = msg;
+    return false;
+  }
+
+  Error error() const { return MakeError(code, message, path); }
+
+  bool ReadValue(int depth);
+  bool ReadString(size_t len);
+  bool ReadArray(size_t n, int depth);
+  bool ReadMap(size_t n, int depth);
+};
+
+} // namespace
+
+bool Reader::ReadValue(int depth)
+{
+  if (!Need(1)) return false;
+  const auto tag = *cur++;
+
+  if (tag < kFixMap) {
+    lua_pushinteger(env, tag);
+    return true;
+  }
+  if (tag >= kNegativeFixInt) {
+    lua_pushinteger(env, (int8_t)tag);
+    return true;
+  }
+  if ((tag & 0xe0) == kFixStr) return ReadString(tag & 0x1f);
+  if ((tag & 0xf0) == kFixArray) return ReadArray(tag & 0x0f, depth);
+  if ((tag & 0xf0) == kFixMap) return ReadMap(tag & 0x0f, depth);
+
+  switch (tag) {
+  case kNil:
+    lua_pushnil(env);
+    return true;
+  case kFalse:
+  case kTrue:
+    lua_pushboolean(env, tag == kTrue);
+    return true;
+  case kFloat32: {
+    if (!Need(4)) return false;
+    const auto bits = (uint32_t)GetBigEndian(cur, 4);
+    float value;
+    memcpy(&value, &bits, sizeof value);
+    cur += 4;
+    lua_pushnumber(env, value);
+    return true;
+  }
+  case kFloat64: {
+    if (!Need(8)) return false;
+    const auto bits = GetBigEndian(cur, 8);
+    double value;
+    memcpy(&value, &bits, sizeof value);
+    cur += 8;
+    lua_pushnumber(env, (lua_Number)value);
+    return true;
+  }
+  case kUint8:
+  case kUint8 + 1:
+  case kUint8 + 2:
+  case kUint64: {
+    const int n = 1 << (tag - kUint8);
+    if (!Need(n)) return false;
+    const auto value = GetBigEndian(cur, n);
+    cur += n;
+    /* Out of the range of lua_Integer */
+    if (value > (uint64_t)std::numeric_limits<lua_Integer>::max())
+      lua_pushnumber(env, (lua_Number)value);
+    else
+      lua_pushinteger(env, (lua_Integer)value);
+    return true;
+  }
+  case kInt8:
+  case kInt8 + 1:
+  case kInt8 + 2:
+  case kInt64: {
+    const int n = 1 << (tag - kInt8);
+    if (!Need(n)) return false;
+    auto value = GetBigEndian(cur, n);
+    cur += n;
+    /* Sign extension */
+    const auto shift = 64 - n * 8;
+    lua_pushinteger(env, (lua_Integer)((int64_t)(value << shift) >> shift));
+    return true;
+  }
+  case kStr8:
+  case kStr8 + 1:
+  case kStr32:
+  case kBin8:
+  case kBin8 + 1:
+  case kBin32: {
+    const int n = 1 << (tag >= kStr8 ? tag - kStr8 : tag - kBin8);
+    if (!Need(n)) return false;
+    const auto len = GetBigEndian(cur, n);
+    cur += n;
+    return ReadString(len);
+  }
+  case kArray16:
+  case kArray32:
+  case kMap16:
+  case kMap32: {
+    const int n = (tag == kArray16 || tag == kMap16) ? 2 : 4;
+    if (!Need(n)) return false;
+    const auto size = GetBigEndian(cur, n);
+    cur += n;
+    return tag <= kArray32 ? ReadArray(size, depth) : ReadMap(size, depth);
+  }
+  }
+
+  return Fail(HKLUA_ERRSYNTAX, "unsupported MessagePack type");
+}
+
+bool Reader::ReadString(size_t len)
+{
+  if (!Need(len)) return false;
+  lua_pushlstring(env, reinterpret_cast<char const *>(cur), len);
+  cur += len;
+  return true;
+}
+
+bool Reader::ReadArray(size_t n, int depth)
+{
+  if (depth >= Serializer::kMaxDepth)
+    return Fail(HKLUA_ERRSYNTAX, "table is too deep");
+  /* Each element takes one byte at least, so don't allocate the table
+   * for the incomplete data */
+  if (!Need(n)) return false;
+  if (n > INT_MAX) return Fail(HKLUA_ERRSYNTAX, "array is too large");
+  if (!lua_checkstack(env, 3)) return Fail(HKLUA_ERRMEM, "stack overflow");
+
+  lua_createtable(env, (int)n, 0);
+  for (size_t i = 1; i <= n; ++i) {
+    if (!ReadValue(depth + 1)) {
+      detail::PrependPath(path, "[" + std::to_string(i) + "]");
+      return false;
+    }
+    lua_rawseti(env, -2, (lua_Integer)i);
+  }
+  return true;
+}
+
+bool Reader::ReadMap(size_t n, int depth)
+{
+  if (depth >= Serializer::kMaxDepth)
+    return Fail(HKLUA_ERRSYNTAX, "table is too deep");
+  if (n > (size_t)(end - cur) / 2) {
+    truncated = true;
+    return false;
+  }
+  if (n > INT_MAX) return Fail(HKLUA_ERRSYNTAX, "map is too large");
+  if (!lua_checkstack(env, 4)) return Fail(HKLUA_ERRMEM, "stack overflow");
+
+  lua_createtable(env, 0, (int)n);
+  for (size_t i = 0; i < n; ++i) {
+    if (!ReadValue(depth + 1)) return false;
+
+    const auto key = lua_gettop(env);
+    if (lua_isnil(env, key) ||
+        (lua_type(env, key) == LUA_TNUMBER && isnan(lua_tonumber(env, key))))
+      return Fail(HKLUA_ERRSYNTAX, "key is nil or NaN");
+
+    if (!ReadValue(depth + 1)) {
+      PrependKeyPath(env, key, path);
+      return false;
+    }
+    lua_rawset(env, -3);
+  }
+  return true;
+}
+
+Deserializer::Deserializer(lua_State *env)
+  : env_(env)
+  , offset_(0)
+  , scanned_(0)
+{
+}
+
+Deserializer::Deserializer(Env &env)
+  : Deserializer(env.env())
+{
+}
+
+void Deserializer::Feed(char const *data, size_t len)
+{
+  /* Drop the decoded data if it is the most part of the buffer */
+  if (offset_ > 0 && offset_ * 2 >= buffer_.size()) {
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+  }
+  buffer_.append(data, len);
+}
+
+Result<bool> Deserializer::Read()
+{
+  if (pending() == 0) return false;
+  if (!lua_checkstack(env_, 3)) return Error(HKLUA_ERRMEM, "stack overflow");
+
+  const auto top = lua_gettop(env_);
+  auto const data = buffer_.data() + offset_;
+  if (scanned_ == 0) {
+    /* Most values are complete, decode them directly */
+    Reader reader(env_, data, pending());
+    if (reader.ReadValue(0)) {
+      offset_ = reader.cur - reinterpret_cast<unsigned char const *>(buffer_.data());
+      return true;
+    }
+
+    lua_settop(env_, top);
+    if (!reader.truncated) {
+      Clear();
+      return reader.error();
+    }
+  }
+
+  auto ret = Scan();
+  if (!ret) {
+    Clear();
+    return ret;
+  }
+  if (!*ret) return false;
+
+  Reader reader(env_, data, scanned_);
+  if (!reader.ReadValue(0)) {
+    lua_settop(env_, top);
+    Clear();
+    return reader.error();
+  }
+  offset_ += scanned_;
+  scanned_ = 0;
+  return true;
+}
+
+/*
+ * Skip the complete items of the incomplete value without decoding them,
+ * the scan resumes from where the last one stopped, so every byte is
+ * scanned once however the value is split.
+ * true if the value ends at scanned_.
+ */
+Result<bool> Deserializer::Scan()
+{
+  auto const begin = reinterpret_cast<unsigned char const *>(buffer_.data()) + offset_;
+  auto const end = begin + pending();
+  auto cur = begin + scanned_;
+
+  while (cur < end) {
+    const auto tag = *cur;
+    /* The tag and the length */
+    size_t header = 1;
+    uint64_t size = 0;
+    bool container = false;
+    uint64_t items = 0;
+
+    if (tag < kFixMap || tag >= kNegativeFixInt) {
+    } else if ((tag & 0xe0) == kFixStr) {
+      size = tag & 0x1f;
+    } else if ((tag & 0xf0) == kFixArray) {
+      container = true;
+      items = tag & 0x0f;
+    } else if ((tag & 0xf0) == kFixMap) {
+      container = true;
+      items = (tag & 0x0f) * 2;
+    } else {
+      switch (tag) {
+      case kNil:
+      case kFalse:
+      case kTrue:
+        break;
+      case kFloat32:
+        size = 4;
+        break;
+      case kFloat64:
+        size = 8;
+        break;
+      case kUint8:
+      case kUint8 + 1:
+      case kUint8 + 2:
+      case kUint64:
+        size = 1 << (tag - kUint8);
+        break;
+      case kInt8:
+      case kInt8 + 1:
+      case kInt8 + 2:
+      case kInt64:
+        size = 1 << (tag - kInt8);
+        break;
+      case kStr8:
+      case kStr8 + 1:
+      case kStr32:
+      case kBin8:
+      case kBin8 + 1:
+      case kBin32:
+        header += 1 << (tag >= kStr8 ? tag - kStr8 : tag - kBin8);
+        break;
+      case kArray16:
+      case kArray32:
+      case kMap16:
+      case kMap32:
+        header += (tag == kArray16 || tag == kMap16) ? 2 : 4;
+        container = true;
+        break;
+      default:
+        return Error(HKLUA_ERRSYNTAX, "unsupported MessagePack type");
+      }
+    }
+
+    if ((size_t)(end - cur) < header) break;
+    if (header > 1) {
+      const auto n = GetBigEndian(cur + 1, (int)header - 1);
+      if (!container)
+        size = n;
+      else
+        items = tag >= kMap16 ? n * 2 : n;
+    }
+    if ((uint64_t)(end - cur) - header < size) break;
+    cur += header + size;
+
+    if (container && items > 0) {
+      if (frames_.size() >= (size_t)Serializer::kMaxDepth)
+        return Error(HKLUA_ERRSYNTAX, "table is too deep");
+      frames_.push_back(items);
+      continue;
+    }
+
+    /* The containers ending with the item are complete too */
+    while (!frames_.empty() && --frames_.back() == 0) frames_.pop_back();
+    if (frames_.empty()) {
+      scanned_ = cur - begin;
+      return true;
+    }
+  }
+
+  scanned_ = cur - begin;
+  return false;
+}
+
+void Deserializer::Clear() noexcept
+{
+  buffer_.clear();
+  offset_ = 0;
+  scanned_ = 0;
+  frames_.clear();
+}
+
+Result<void> hklua::Serialize(lua_State *env, int index, std::string &buffer)
+{
+  Serializer serializer(env);
+  serializer.buffer_.swap(buffer);
+  auto ret = serializer.Write(index);
+  serializer.buffer_.swap(buffer);
+  return ret;
+}
+
+Result<void> hklua::Deserialize(lua_State *env, char const *data, size_t len)
+{
+  if (!lua_checkstack(env, 3)) return Error(HKLUA_ERRMEM, "stack overflow");
+
+  const auto top = lua_gettop(env);
+  Reader reader(env, data, len);
+  if (!reader.ReadValue(0)) {
+    lua_settop(env, top);
+    if (reader.truncated) return Error(HKLUA_ERRSYNTAX, "data is truncated");
+    return reader.error();
+  }
+
+  if (reader.cur != reader.end) {
+    lua_settop(env, top);
+    return Error(HKLUA_ERRSYNTAX, "extra bytes after the value");
+  }
+  return {};
+}
+
+/*--------------------------------------------------*/
+/* CopyValue                                        */
+/*--------------------------------------------------*/
+
+namespace {
+
+/*
+ * Copy the values of from to the top of to.
+ * If from and to are the same state, the pushes of them are interleaved,
+ * so the value pushed to to is always consumed before the value of from
+ * is poped.
+ */
+struct Copier {
+  lua_State *from;
+  int index;
+  /* The source table -> the copy, the shared table is copied once */
+  int visited;
+  HKLuaError code;
+  std::string message;
+  std::string path;
+
+  Copier(lua_State *f, int i)
+    : from(f)
+    , index(i)
+    , visited(0)
+    , code(HKLUA_OK)
+  {
+  }
+
+  bool Fail(HKLuaError c, std::string msg)
+  {
+    code = c;
+    message = std::move(msg);
+    return false;
+  }
+
+  bool CopyValue(lua_State *to, int index, int depth);
+  bool CopyTable(lua_State *to, int index, int depth);
+};
+
+} // namespace
+
+static inline bool IsArrayKey(lua_State *env, int index, size_t n)
+{
+  if (!lua_isinteger(env, index)) return false;
+  const auto key = lua_tointeger(env, index);
+  return key >= 1 && (lua_Unsigned)key <= n;
+}
+
+bool Copier::CopyValue(lua_State *to, int index, int depth)
+{
+  switch (lua_type(from, index)) {
+  case LUA_TNIL:
+    lua_pushnil(to);
+    return true;
+  case LUA_TBOOLEAN:
+    lua_pushboolean(to, lua_toboolean(from, index));
+    return true;
+  case LUA_TNUMBER:
+    if (lua_isinteger(from, index))
+      lua_pushinteger(to, lua_tointeger(from, index));
+    else
+      lua_pushnumber(to, lua_tonumber(from, index));
+    return true;
+  case LUA_TSTRING: {
+    size_t len;
+    auto str = lua_tolstring(from, index, &len);
+    lua_pushlstring(to, str, len);
+    return true;
+  }
+  case LUA_TLIGHTUSERDATA:
+    lua_pushlightuserdata(to, lua_touserdata(from, index));
+    return true;
+  case LUA_TTABLE:
+    return CopyTable(to, index, depth);
+  }
+
+  return Fail(HKLUA_ERRTYPE, std::string(luaL_typename(from, index)) +
+                                 " value can't be copied");
+}
+
+bool Copier::CopyTable(lua_State *to, int index, int depth)
+{
+  if (depth >= Serializer::kMaxDepth)
+    return Fail(HKLUA_ERRTYPE, "table is too deep");
+  if (!lua_checkstack(from, 2) || !lua_checkstack(to, 4))
+    return Fail(HKLUA_ERRMEM, "stack overflow");
+
+  auto source = lua_topointer(from, index);
+  if (lua_rawgetp(to, visited, source) != LUA_TNIL) return true;
+  lua_pop(to, 1);
+
+  /* The array part is 1..n, count the rest to pre-size the hash part */
+  const auto n = lua_rawlen(from, index);
+  int nrec = 0;
+  lua_pushnil(from);
+  while (lua_next(from, index)) {
+    if (!IsArrayKey(from, -2, n)) ++nrec;
+    lua_pop(from, 1);
+  }
+
+  lua_createtable(to, (int)n, nrec);
+  const auto table = lua_gettop(to);
+  lua_pushvalue(to, table);
+  lua_rawsetp(to, visited, source);
+
+  for (lua_Integer i = 1; i <= (lua_Integer)n; ++i) {
+    lua_rawgeti(from, index, i);
+    if (!CopyValue(to, lua_gettop(from), depth + 1)) {
+      detail::PrependPath(path, "[" + std::to_string(i) + "]");
+      return false;
+    }
+    lua_rawseti(to, table, i);
+    lua_pop(from, 1);
+  }
+
+  if (nrec == 0) return true;
+
+  lua_pushnil(from);
+  while (lua_next(from, index)) {
+    const auto top = lua_gettop(from);
+    if (!IsArrayKey(from, top - 1, n)) {
+      if (!CopyValue(to, top - 1, depth + 1) ||
+          !CopyValue(to, top, depth + 1)) {
+        PrependKeyPath(from, top - 1, path);
+        return false;
+      }
+      lua_rawset(to, table);
+    }
+    lua_pop(from, 1);
+  }
+  return true;
+}
+
+/* Called by lua_pcall() of to: copier, [source value if from is to] */
+static int CopyValueProtected(lua_State *to)
+{
+  auto copier = static_cast<Copier *>(lua_touserdata(to, 1));
+  /* The index in the current frame */
+  if (copier->from == to) copier->index = 2;
+
+  lua_newtable(to);
+  copier->visited = lua_gettop(to);
+  if (!copier->CopyValue(to, copier->index, 0)) return 0;
+  return 1;
+}
+
+Result<void> hklua::CopyValue(lua_State *from, int index, lua_State *to)
+{
+  if (!lua_checkstack(to, 4)) return Error(HKLUA_ERRMEM, "stack overflow");
+
+  Copier copier(from, lua_absindex(from, index));
+  const auto from_top = lua_gettop(from);
+
+  lua_pushcfunction(to, &CopyValueProtected);
+  lua_pushlightuserdata(to, &copier);
+  int nargs = 1;
+  if (from == to) {
+    lua_pushvalue(to, copier.index);
+    ++nargs;
+  }
+
+  const auto status = lua_pcall(to, nargs, 1, 0);
+  if (from != to) lua_settop(from, from_top);
+
+  if (status != LUA_OK) {
+    auto error = detail::ErrorFromStack(to, (HKLuaError)status);
+    lua_pop(to, 1);
+    return error;
+  }
+  if (copier.code != HKLUA_OK) {
+    lua_pop(to, 1);
+    return MakeError(copier.code, copier.message, copier.path);
+  }
+  return {};
+}
+
+Result<void> hklua::CopyValue(Env &from, int index, Env &to)
+{
+  return CopyValue(from.env(), index, to.env());
+}
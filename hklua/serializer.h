@@ -0,0 +1,197 @@
+#ifndef HKLUA_SERIALIZER_H__
+#define HKLUA_SERIALIZER_H__
+
+#include <lua.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "hklua/result.h"
+
+namespace hklua {
+
+class Env;
+
+/**
+ * \brief Serialize Lua values to a compact binary buffer
+ *
+ * The format is a subset of MessagePack(https://msgpack.org):
+ * - nil, boolean
+ * - integer in the smallest encoding(fixint, int8~int64, uint8~uint64)
+ * - number as float32 if it is exact, otherwise float64
+ * - string as str(may contain '\0')
+ * - table whose keys are exactly 1..n as array, otherwise as map
+ * so the buffer can be consumed by other MessagePack libraries.
+ *
+ * The tables are walked by lua_next(), i.e. the metatables are ignored.
+ * A table referenced more than once(but not in a cycle) is written
+ * more than once.
+ *
+ * e.g.
+ * Serializer serializer(env);
+ * auto ret = serializer.Write(-1);
+ * if (!ret) fprintf(stderr, "%s\n", ret.error().message().c_str());
+ * send(fd, serializer.buffer().data(), serializer.buffer().size(), 0);
+ *
+ * Write() can be called several times, the values are concatenated
+ * and can be read by Deserializer one by one.
+ */
+class Serializer {
+  friend Result<void> Serialize(lua_State *env, int index, std::string &buffer);
+
+ public:
+  /* The nested tables deeper than it are rejected */
+  static constexpr int kMaxDepth = 200;
+
+  explicit Serializer(lua_State *env);
+  explicit Serializer(Env &env);
+
+  Serializer(Serializer const &) = delete;
+  Serializer &operator=(Serializer const &) = delete;
+
+  /**
+   * Append the value at \p index to the buffer
+   *
+   * \return
+   * HKLUA_ERRTYPE: the value(or its field) is function, userdata, thread,
+   *                in a cycle, or too deep, the message contains the
+   *                path of it, e.g. "function value can't be serialized(at a.b[2])"
+   * HKLUA_ERRMEM: the Lua stack can't grow
+   * If failed, the buffer and the stack are not changed.
+   */
+  Result<void> Write(int index);
+
+  std::string const &buffer() const noexcept { return buffer_; }
+  /** Move out the buffer, the serializer is empty */
+  std::string Release() noexcept;
+  void Clear() noexcept { buffer_.clear(); }
+
+ private:
+  bool WriteValue(int index, int depth);
+  bool WriteTable(int index, int depth);
+  void WriteInteger(lua_Integer value);
+  void WriteNumber(lua_Number value);
+  void WriteString(char const *str, size_t len);
+  void WriteHeader(size_t n, unsigned char fix, unsigned char tag16);
+
+  lua_State *env_;
+  std::string buffer_;
+  /* The tables from the root to the current one, it is short(kMaxDepth at most)
+   * so the linear search is cheaper than the hash set */
+  std::vector<void const *> visiting_;
+  std::string path_;
+  Error error_;
+};
+
+/**
+ * \brief Rebuild the values written by Serializer
+ *
+ * The data can be fed in chunks(e.g. read from the socket),
+ * Read() decodes the next value once it is complete.
+ * e.g.
+ * Deserializer deserializer(env);
+ * deserializer.Feed(data, n);
+ * for (;;) {
+ *   auto ret = deserializer.Read();
+ *   if (!ret) // malformed
+ *   if (!*ret) break; // need more data
+ *   // the value is on the top
+ * }
+ *
+ * The tables are created by lua_createtable() with the size in the
+ * header, so they are not rehashed when the fields are set.
+ */
+class Deserializer {
+ public:
+  explicit Deserializer(lua_State *env);
+  explicit Deserializer(Env &env);
+
+  Deserializer(Deserializer const &) = delete;
+  Deserializer &operator=(Deserializer const &) = delete;
+
+  /**
+   * Append \p data to the pending data
+   */
+  void Feed(char const *data, size_t len);
+  void Feed(std::string const &data) { Feed(data.data(), data.size()); }
+
+  /**
+   * Decode the next value and push it
+   *
+   * \return
+   * true: the value is pushed
+   * false: the pending data is not a complete value, nothing is pushed
+   * HKLUA_ERRSYNTAX: the data is malformed, the pending data is dropped
+   * HKLUA_ERRMEM: the Lua stack can't grow
+   */
+  Result<bool> Read();
+
+  /**
+   * The number of bytes fed but not decoded
+   * \note An incomplete value is not decoded, Read() scans the framing of
+   *       the new data only and decodes the value once it is complete,
+   *       so the chunk size doesn't matter
+   */
+  size_t pending() const noexcept { return buffer_.size() - offset_; }
+  void Clear() noexcept;
+
+ private:
+  Result<bool> Scan();
+
+  lua_State *env_;
+  std::string buffer_;
+  size_t offset_;
+  /* The bytes of the incomplete value whose framing is scanned */
+  size_t scanned_;
+  /* The elements left in the open containers of the incomplete value */
+  std::vector<uint64_t> frames_;
+};
+
+/**
+ * Serialize the value at \p index to \p buffer(appended)
+ * \see Serializer::Write()
+ */
+Result<void> Serialize(lua_State *env, int index, std::string &buffer);
+
+/**
+ * Decode exactly one value from \p data and push it, no copy of \p data
+ * \return HKLUA_ERRSYNTAX if the data is malformed, truncated or
+ *         followed by extra bytes
+ */
+Result<void> Deserialize(lua_State *env, char const *data, size_t len);
+
+inline Result<void> Deserialize(lua_State *env, std::string const &data)
+{
+  return Deserialize(env, data.data(), data.size());
+}
+
+/**
+ * Deep copy the value at \p index of \p from and push it to \p to,
+ * i.e. transfer the value between two Envs without serialization.
+ *
+ * The supported values are same as Serializer(and light userdata),
+ * but the tables referenced more than once(including the cycles) are
+ * copied once and shared like the source.
+ * The array part is copied by lua_rawgeti()/lua_rawseti() and the
+ * table is pre-sized by lua_createtable().
+ *
+ * The copy runs in protected mode of \p to, so it fails rather than
+ * panics if the memory of \p to is exhausted(e.g. the allocator limit).
+ *
+ * \return
+ * HKLUA_ERRTYPE: the value(or its field) can't be copied or too deep,
+ *                the message contains the path of it
+ * HKLUA_ERRMEM: the memory or the stack of \p to is exhausted
+ * If failed, both stacks are not changed.
+ *
+ * \note
+ * \p from and \p to can be the same Env.
+ * Both Envs must not be used by other threads during the copy.
+ */
+Result<void> CopyValue(lua_State *from, int index, lua_State *to);
+Result<void> CopyValue(Env &from, int index, Env &to);
+
+} // namespace hklua
+
+#endif // HKLUA_SERIALIZER_H__
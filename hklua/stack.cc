@@ -2,8 +2,21 @@
 
 #include <stdio.h>
 
+#include "hklua/buffer.h"
+
 namespace hklua {
 
+bool StackConv(lua_State *env, int index, StringView &str)
+{
+  if (lua_type(env, index) == LUA_TUSERDATA) return ToBuffer(env, index, str);
+
+  size_t len = 0;
+  auto ret = lua_tolstring(env, index, &len);
+  if (!ret) return false;
+  str = StringView(ret, len);
+  return true;
+}
+
 void StackDump(lua_State *env)
 {
   int top = lua_gettop(env);
@@ -2,11 +2,17 @@
 #define HKLUA_STACK_H__
 
 #include <lua.hpp>
+#include <array>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "hklua/type.h"
+#include "hklua/util/span.h"
+#include "hklua/util/string_view.h"
 #include "hklua/variable_indicator.h"
 
 namespace hklua {
@@ -14,6 +20,21 @@ namespace hklua {
 class Table;
 class Variant;
 
+namespace detail {
+
+/*
+ * The aggregate described by HKLUA_STRUCT(), which declares
+ * HKLuaStructFields() found by ADL, see hklua/struct.h
+ */
+template <typename T, typename = void>
+struct IsStruct : std::false_type {};
+
+template <typename T>
+struct IsStruct<T, decltype((void)HKLuaStructFields(
+                       static_cast<T const *>(nullptr)))> : std::true_type {};
+
+} // namespace detail
+
 #define STACKPUSH_INTEGER_DEFINE(type)                                         \
   inline void StackPush(lua_State *env, type i) { lua_pushinteger(env, i); }
 
@@ -47,9 +68,15 @@ inline void StackPush(lua_State *env, std::string const &str)
   lua_pushlstring(env, str.c_str(), str.size());
 }
 
+/* Copied, see BufferView in buffer.h for a large payload */
+inline void StackPush(lua_State *env, StringView str)
+{
+  lua_pushlstring(env, str.data, str.size);
+}
+
 inline void StackPush(lua_State *env, bool b)
 {
-  lua_pushboolean(env, b ? 0 : 1);
+  lua_pushboolean(env, b ? 1 : 0);
 }
 
 inline void StackPush(lua_State *env, lua_CFunction func)
@@ -58,7 +85,7 @@ inline void StackPush(lua_State *env, lua_CFunction func)
 }
 
 void StackPush(lua_State *env, Table tb);
-void StackPush(lua_State *env, Variant var);
+void StackPush(lua_State *env, Variant const &var);
 
 template <typename T>
 inline void StackPush(lua_State *env, VI<T> &vi)
@@ -66,7 +93,7 @@ inline void StackPush(lua_State *env, VI<T> &vi)
   if (vi.is_nil)
     lua_pushnil(env);
   else
-    StackPush(vi.data);
+    StackPush(env, vi.data);
 }
 
 inline void StackPush(lua_State *env, Nil nil)
@@ -74,6 +101,21 @@ inline void StackPush(lua_State *env, Nil nil)
   lua_pushnil(env);
 }
 
+/* Defined in container.h */
+template <typename T, typename A>
+void StackPush(lua_State *env, std::vector<T, A> const &vec);
+template <typename T, size_t N>
+void StackPush(lua_State *env, std::array<T, N> const &arr);
+template <typename T>
+void StackPush(lua_State *env, Span<T> span);
+template <typename K, typename V, typename H, typename E, typename A>
+void StackPush(lua_State *env, std::unordered_map<K, V, H, E, A> const &map);
+
+/* Defined in struct.h */
+template <typename T,
+          typename std::enable_if<detail::IsStruct<T>::value, int>::type = 0>
+void StackPush(lua_State *env, T const &value);
+
 #define STACKCONV_INTEGER_DEFINE(type)                                         \
   inline bool StackConv(lua_State *env, int index, type &i)                    \
   {                                                                            \
@@ -130,6 +172,12 @@ inline bool StackConv(lua_State *env, int index, std::string &str)
   return ret;
 }
 
+/**
+ * Borrow the bytes of the string(or the buffer, see buffer.h),
+ * they are valid while the value is referenced, e.g. on the stack
+ */
+bool StackConv(lua_State *env, int index, StringView &str);
+
 inline bool StackConv(lua_State *env, int index, lua_CFunction &func)
 {
   func = lua_tocfunction(env, index);
@@ -149,8 +197,27 @@ inline bool StackConv(lua_State *env, int index, VI<T>& var)
   return StackConv(env, index, var.data);
 }
 
+/* Defined in container.h */
+template <typename T, typename A>
+bool StackConv(lua_State *env, int index, std::vector<T, A> &vec);
+template <typename T, size_t N>
+bool StackConv(lua_State *env, int index, std::array<T, N> &arr);
+template <typename T>
+bool StackConv(lua_State *env, int index, Span<T> span);
+template <typename K, typename V, typename H, typename E, typename A>
+bool StackConv(lua_State *env, int index,
+               std::unordered_map<K, V, H, E, A> &map);
+
+/* Defined in struct.h */
+template <typename T,
+          typename std::enable_if<detail::IsStruct<T>::value, int>::type = 0>
+bool StackConv(lua_State *env, int index, T &value);
+
 void StackDump(lua_State *env);
 
 } // namespace hklua
 
+#include "hklua/container.h"
+#include "hklua/struct.h"
+
 #endif // HKLUA_STACK_H__
@@ -0,0 +1,49 @@
+#include "hklua/stack_scope.h"
+#include "hklua/env.h"
+
+#include <stdio.h>
+#ifdef __GLIBC__
+#include <execinfo.h>
+#include <stdlib.h>
+#endif
+
+using namespace hklua;
+
+static StackViolationHandler g_violation_handler = nullptr;
+
+StackScope::StackScope(Env &env) noexcept
+  : StackScope(env.env())
+{
+}
+
+void hklua::SetStackViolationHandler(StackViolationHandler handler) noexcept
+{
+  g_violation_handler = handler;
+}
+
+static void DefaultViolationHandler(StackViolation const &violation)
+{
+  fprintf(stderr,
+          "hklua: stack contract violated: %s, expected delta = %d, "
+          "actual delta = %d\n",
+          violation.func, violation.expected, violation.actual);
+#ifdef __GLIBC__
+  /* Resolve the symbol of the caller(link with -rdynamic) */
+  void *caller = const_cast<void *>(violation.caller);
+  char **symbols = backtrace_symbols(&caller, 1);
+  if (symbols) {
+    fprintf(stderr, "  called from %s\n", symbols[0]);
+    free(symbols);
+    return;
+  }
+#endif
+  fprintf(stderr, "  called from %p\n", violation.caller);
+}
+
+void detail::ReportStackViolation(StackViolation const &violation)
+{
+  if (g_violation_handler)
+    g_violation_handler(violation);
+  else
+    DefaultViolationHandler(violation);
+}
@@ -0,0 +1,160 @@
+#ifndef HKLUA_STACK_SCOPE_H__
+#define HKLUA_STACK_SCOPE_H__
+
+#include <lua.hpp>
+#include <assert.h>
+
+namespace hklua {
+
+class Env;
+
+/**
+ * \brief RAII restores the top of the stack on exit
+ *
+ * e.g.
+ * {
+ *   StackScope scope(env);
+ *   auto tb = env.GetGlobalTableR("t");
+ *   Integer x;
+ *   tb.GetField("x", x, false);
+ * } // x and t are poped
+ *
+ * The values pushed in the scope are poped even if the pop flag
+ * of API is forgotten.
+ */
+class StackScope {
+ public:
+  explicit StackScope(lua_State *env) noexcept
+    : env_(env)
+    , top_(lua_gettop(env))
+  {
+  }
+
+  explicit StackScope(Env &env) noexcept;
+
+  ~StackScope() noexcept
+  {
+    /* The values below the scope must not be poped in the scope */
+    assert(lua_gettop(env_) >= top_);
+    lua_settop(env_, top_);
+  }
+
+  StackScope(StackScope const &) = delete;
+  StackScope &operator=(StackScope const &) = delete;
+
+  /**
+   * Keep the \p n values on the top after exit, e.g. the results
+   */
+  void Keep(int n) noexcept
+  {
+    top_ = lua_gettop(env_) - n;
+    assert(top_ >= 0);
+  }
+
+  /** The top when the scope is entered */
+  int top() const noexcept { return top_; }
+  /** The number of values pushed in the scope */
+  int delta() const noexcept { return lua_gettop(env_) - top_; }
+
+ private:
+  lua_State *env_;
+  int top_;
+};
+
+/**
+ * The stack contract violated by an API call
+ */
+struct StackViolation {
+  /* The signature of API */
+  char const *func;
+  /* The return address in the caller, i.e. the call site
+   * (the API must be HKLUA_STACK_CHECKED) */
+  void const *caller;
+  int expected;
+  int actual;
+};
+
+using StackViolationHandler = void (*)(StackViolation const &violation);
+
+/**
+ * Set the handler called when the stack contract is violated.
+ * The default handler prints the API and the call site to stderr.
+ * NULL restores the default handler.
+ *
+ * \note Only works if HKLUA_STACK_CHECK is defined
+ */
+void SetStackViolationHandler(StackViolationHandler handler) noexcept;
+
+namespace detail {
+
+void ReportStackViolation(StackViolation const &violation);
+
+/**
+ * Check the stack delta of the API call on exit
+ */
+class StackContract {
+ public:
+  StackContract(lua_State *env, int expected, char const *func,
+                void const *caller) noexcept
+    : env_(env)
+    , top_(lua_gettop(env))
+    , expected_(expected)
+    , func_(func)
+    , caller_(caller)
+  {
+  }
+
+  ~StackContract() noexcept
+  {
+    const auto actual = lua_gettop(env_) - top_;
+    if (actual != expected_) {
+      ReportStackViolation(
+          StackViolation{ func_, caller_, expected_, actual });
+    }
+  }
+
+  StackContract(StackContract const &) = delete;
+  StackContract &operator=(StackContract const &) = delete;
+
+ private:
+  lua_State *env_;
+  int top_;
+  int expected_;
+  char const *func_;
+  void const *caller_;
+};
+
+} // namespace detail
+
+} // namespace hklua
+
+/**
+ * Declare the stack delta of the API in its body.
+ * It is checked on exit if HKLUA_STACK_CHECK is defined(the debug build
+ * defines it), otherwise it is a no-op.
+ * e.g.
+ * HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
+ */
+#ifdef HKLUA_STACK_CHECK
+#define HKLUA_STACK_CONTRACT(env, delta)                                       \
+  ::hklua::detail::StackContract hklua_stack_contract_(                        \
+      (env), (delta), __PRETTY_FUNCTION__, __builtin_return_address(0))
+#else
+#define HKLUA_STACK_CONTRACT(env, delta) ((void)0)
+#endif
+
+/**
+ * Mark the API declaring HKLUA_STACK_CONTRACT.
+ * The return address is the call site only if the API is not inlined,
+ * so it is noinline if HKLUA_STACK_CHECK is defined.
+ * e.g.
+ * HKLUA_STACK_CHECKED
+ * void GetGlobal(char const *name)
+ */
+#ifdef HKLUA_STACK_CHECK
+#define HKLUA_STACK_CHECKED __attribute__((noinline))
+#else
+#define HKLUA_STACK_CHECKED
+#endif
+
+#endif // HKLUA_STACK_SCOPE_H__
@@ -0,0 +1,308 @@
+#ifndef HKLUA_STRUCT_H__
+#define HKLUA_STRUCT_H__
+
+/*
+ * Conversion between the Lua table and the C++ aggregate whose fields
+ * are described by HKLUA_STRUCT(), e.g.
+ *
+ * struct Server {
+ *   std::string host;
+ *   int port;
+ * };
+ * HKLUA_STRUCT(Server, host, port)
+ *
+ * struct Config {
+ *   std::vector<Server> servers;
+ *   VI<int> timeout; // Optional field, nil is accepted
+ * };
+ * HKLUA_STRUCT(Config, servers, timeout)
+ *
+ * Then StackPush()/StackConv() convert the whole struct in one pass,
+ * nested structs, vectors and optionals included.
+ * The table is pre-sized and the field names are pinned in the registry,
+ * so the names are not hashed again for each conversion.
+ *
+ * \note Don't include this header directly, include stack.h instead
+ */
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility> // index_sequence
+
+#if __cplusplus >= 201703L
+#include <optional>
+#endif
+
+#include "hklua/stack.h"
+#include "hklua/util/preprocessor.h"
+
+namespace hklua {
+
+template <typename C, typename M>
+struct StructField {
+  char const *name;
+  M C::*ptr;
+};
+
+template <typename C, typename M>
+constexpr StructField<C, M> MakeStructField(char const *name, M C::*ptr)
+{
+  return StructField<C, M>{ name, ptr };
+}
+
+namespace detail {
+
+/* The address is the registry key of the field names of T */
+template <typename T>
+struct StructKeysTag {
+  static char const tag;
+};
+
+template <typename T>
+char const StructKeysTag<T>::tag = 0;
+
+template <typename T>
+using StructFields = decltype(HKLuaStructFields(static_cast<T const *>(nullptr)));
+
+template <typename Tuple, typename F, size_t... I>
+inline bool ForEachFieldUntil(Tuple const &fields, F &&f,
+                              std::index_sequence<I...>)
+{
+  bool ret = true;
+  int dummy[] = { 0, (ret = ret && f(std::get<I>(fields), (int)I + 1), 0)... };
+  (void)dummy;
+  return ret;
+}
+
+/**
+ * Call f(field, i) for each field until it returns false,
+ * i is the 1-based index of the field
+ */
+template <typename Tuple, typename F>
+inline bool ForEachFieldUntil(Tuple const &fields, F &&f)
+{
+  return ForEachFieldUntil(
+      fields, std::forward<F>(f),
+      std::make_index_sequence<std::tuple_size<Tuple>::value>());
+}
+
+/**
+ * Push the array of the field names of T, it is created once per Env
+ */
+template <typename T>
+void PushStructKeys(lua_State *env)
+{
+  if (lua_rawgetp(env, LUA_REGISTRYINDEX, &StructKeysTag<T>::tag) ==
+      LUA_TTABLE)
+    return;
+  lua_pop(env, 1);
+
+  const auto fields = HKLuaStructFields(static_cast<T const *>(nullptr));
+  lua_createtable(env, (int)std::tuple_size<StructFields<T>>::value, 0);
+  ForEachFieldUntil(fields, [env](auto const &field, int i) {
+    lua_pushstring(env, field.name);
+    lua_rawseti(env, -2, i);
+    return true;
+  });
+  lua_pushvalue(env, -1);
+  lua_rawsetp(env, LUA_REGISTRYINDEX, &StructKeysTag<T>::tag);
+}
+
+/*
+ * The nil optional field is not set
+ */
+template <typename T>
+inline bool IsNilField(T const &) noexcept
+{
+  return false;
+}
+
+template <typename T>
+inline bool IsNilField(VI<T> const &vi) noexcept
+{
+  return vi.is_nil;
+}
+
+template <typename T>
+inline void PushField(lua_State *env, T const &field)
+{
+  StackPush(env, field);
+}
+
+template <typename T>
+inline void PushField(lua_State *env, VI<T> const &vi)
+{
+  StackPush(env, vi.data);
+}
+
+#if __cplusplus >= 201703L
+template <typename T>
+inline bool IsNilField(std::optional<T> const &opt) noexcept
+{
+  return !opt.has_value();
+}
+
+template <typename T>
+inline void PushField(lua_State *env, std::optional<T> const &opt)
+{
+  StackPush(env, *opt);
+}
+#endif
+
+/*
+ * "[2]" + "port" -> "[2].port", "servers" + "[2].port" -> "servers[2].port"
+ */
+inline void PrependPath(std::string &path, std::string const &prefix)
+{
+  if (path.empty() || path[0] == '[')
+    path.insert(0, prefix);
+  else
+    path.insert(0, prefix + ".");
+}
+
+/*
+ * ConvField() is StackConv() which records the path of the
+ * first mismatched field in \p path(if not NULL)
+ */
+template <typename T,
+          typename std::enable_if<!IsStruct<T>::value, int>::type = 0>
+inline bool ConvField(lua_State *env, int index, T &field, std::string *path)
+{
+  return StackConv(env, index, field);
+}
+
+template <typename T,
+          typename std::enable_if<IsStruct<T>::value, int>::type = 0>
+bool ConvField(lua_State *env, int index, T &value, std::string *path);
+
+template <typename T, typename A>
+bool ConvField(lua_State *env, int index, std::vector<T, A> &vec,
+               std::string *path)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  const auto n = lua_rawlen(env, index);
+  vec.clear();
+  vec.reserve(n);
+
+  T elem;
+  for (size_t i = 1; i <= n; ++i) {
+    lua_rawgeti(env, index, (Integer)i);
+    const auto success = ConvField(env, lua_gettop(env), elem, path);
+    lua_pop(env, 1);
+    if (!success) {
+      if (path) PrependPath(*path, "[" + std::to_string(i) + "]");
+      return false;
+    }
+    vec.push_back(std::move(elem));
+  }
+  return true;
+}
+
+template <typename T>
+bool ConvField(lua_State *env, int index, VI<T> &vi, std::string *path)
+{
+  vi.is_nil = lua_isnil(env, index);
+  return vi.is_nil || ConvField(env, index, vi.data, path);
+}
+
+#if __cplusplus >= 201703L
+template <typename T>
+bool ConvField(lua_State *env, int index, std::optional<T> &opt,
+               std::string *path)
+{
+  if (lua_isnil(env, index)) {
+    opt.reset();
+    return true;
+  }
+  return ConvField(env, index, opt.emplace(), path);
+}
+#endif
+
+template <typename T,
+          typename std::enable_if<IsStruct<T>::value, int>::type>
+bool ConvField(lua_State *env, int index, T &value, std::string *path)
+{
+  if (!lua_istable(env, index)) return false;
+  index = lua_absindex(env, index);
+
+  PushStructKeys<T>(env);
+  const int keys = lua_gettop(env);
+  const auto ret = ForEachFieldUntil(
+      HKLuaStructFields(static_cast<T const *>(nullptr)),
+      [&](auto const &field, int i) {
+        lua_rawgeti(env, keys, i);
+        lua_rawget(env, index);
+        const auto success =
+            ConvField(env, keys + 1, value.*field.ptr, path);
+        lua_pop(env, 1);
+        if (!success && path) PrependPath(*path, field.name);
+        return success;
+      });
+  lua_pop(env, 1);
+  return ret;
+}
+
+} // namespace detail
+
+template <typename T,
+          typename std::enable_if<detail::IsStruct<T>::value, int>::type>
+void StackPush(lua_State *env, T const &value)
+{
+  lua_createtable(env, 0, (int)std::tuple_size<detail::StructFields<T>>::value);
+  detail::PushStructKeys<T>(env);
+  detail::ForEachFieldUntil(
+      HKLuaStructFields(static_cast<T const *>(nullptr)),
+      [env, &value](auto const &field, int i) {
+        auto const &member = value.*field.ptr;
+        if (detail::IsNilField(member)) return true;
+        lua_rawgeti(env, -1, i);
+        detail::PushField(env, member);
+        lua_rawset(env, -4);
+        return true;
+      });
+  lua_pop(env, 1);
+}
+
+/**
+ * The fields are read by lua_rawget(), i.e. no metamethod.
+ * The missing field is mismatched unless it is optional.
+ */
+template <typename T,
+          typename std::enable_if<detail::IsStruct<T>::value, int>::type>
+bool StackConv(lua_State *env, int index, T &value)
+{
+  return detail::ConvField(env, index, value, nullptr);
+}
+
+/**
+ * Like StackConv() but reports the path of the first mismatched field,
+ * e.g. "servers[2].port", it is empty if the value itself is mismatched.
+ */
+template <typename T>
+bool StackConvStruct(lua_State *env, int index, T &value, std::string *path)
+{
+  static_assert(detail::IsStruct<T>::value, "T is not described by HKLUA_STRUCT()");
+  if (path) path->clear();
+  return detail::ConvField(env, index, value, path);
+}
+
+} // namespace hklua
+
+#define HKLUA_STRUCT_FIELD_(type, field) ::hklua::MakeStructField(#field, &type::field)
+
+/**
+ * Describe the fields of the aggregate \p type, at most 32 fields.
+ * It must be used in the namespace of \p type since the description
+ * is found by ADL.
+ */
+#define HKLUA_STRUCT(type, ...)                                                \
+  inline auto HKLuaStructFields(type const *)                                  \
+  {                                                                            \
+    return std::make_tuple(                                                    \
+        HKLUA_PP_MAP(HKLUA_STRUCT_FIELD_, type, __VA_ARGS__));                 \
+  }
+
+#endif // HKLUA_STRUCT_H__
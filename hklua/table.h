@@ -4,10 +4,15 @@
 #include <lua.hpp>
 
 #include <string>
+#include <type_traits>
 #include <utility> // forward
 #include <assert.h>
 
+#include "hklua/key.h"
+#include "hklua/result.h"
 #include "hklua/stack.h"
+#include "hklua/stack_scope.h"
+#include "hklua/table_iterator.h"
 #include "hklua/util/type_traits.h"
 
 namespace hklua {
@@ -16,6 +21,9 @@ class Table;
 class TableGuard;
 class Env;
 
+template <typename Parent, typename K>
+class TableProxy;
+
 Table CreateTable(lua_State *env, int narr = 0, int nrec = 0);
 
 /**
@@ -26,12 +34,6 @@ Table CreateTable(lua_State *env, int narr = 0, int nrec = 0);
  * e.g. function arguments
  */
 class Table {
-  /**
-   * Used for implementing operator[]
-   */
-  class Proxy;
-
-  friend class Proxy;
   friend class TableGuard;
   friend Table CreateTable(lua_State *env, int narr, int nrec);
   friend bool StackConv(lua_State *env, int index, Table &tb);
@@ -86,17 +88,29 @@ class Table {
   /**
    * Like associated array
    * You can think this is a syntactic sugar
+   *
+   * The field is not read until the proxy is converted,
+   * and the assignment just writes the field once.
+   * e.g.
+   * double x = t["x"];
+   * t["y"] = 1;
+   * t["a"]["b"] = t["c"];
+   *
+   * \note Defined in variant.h
    */
   template <typename T>
-  Proxy operator[](T const &key);
+  TableProxy<Table, typename std::decay<T const>::type>
+  operator[](T const &key) const;
   
   /*--------------------------------------------------*/
   /* Field Module                                     */
   /*--------------------------------------------------*/
 
   template <typename K, typename F>
+  HKLUA_STACK_CHECKED
   void SetField(K &&key, F&& field)
   {
+    HKLUA_STACK_CONTRACT(env_, 0);
     StackPush(env_, key);
     StackPush(env_, field);
     SetTable();
@@ -118,8 +132,10 @@ class Table {
   }
   
   template <typename F, typename K>
+  HKLUA_STACK_CHECKED
   bool GetField(K const &key, F &field, bool pop=true)
   {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
     StackPush(env_, key);
     GetTable();
     const auto ret = StackConv(env_, lua_gettop(env_), field);
@@ -143,21 +159,65 @@ class Table {
    * Use lua_getfield to optimize
    */
   template <typename F>
+  HKLUA_STACK_CHECKED
   bool GetField(char const *key, F &field, bool pop=true)
   {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
     auto ret = GetStringField(key, field);
     if (pop) lua_pop(env_, 1);
     return ret;
   }
 
   template <typename F>
+  HKLUA_STACK_CHECKED
   bool GetField(std::string const &key, F &field, bool pop=true)
   {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
     auto ret = GetStringField(key, field);
     if (pop) lua_pop(env_, 1);
     return ret;
   }
   
+  /**
+   * Use the pinned key to avoid interning the string on every call.
+   * The access is raw(lua_rawget()/lua_rawset()), i.e. the metamethods
+   * are not called, like IPairs().
+   * \pre \p key is created in the same Env
+   */
+  template <typename F>
+  HKLUA_STACK_CHECKED
+  void SetField(Key const &key, F &&field)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    key.Push(env_);
+    StackPush(env_, field);
+    lua_rawset(env_, IndexAfterPush(2));
+  }
+
+  /* Prefer to SetField(K &&, F &&) */
+  template <typename F>
+  void SetField(Key &key, F &&field)
+  {
+    SetField(static_cast<Key const &>(key), std::forward<F>(field));
+  }
+
+  template <typename F>
+  HKLUA_STACK_CHECKED
+  bool GetField(Key const &key, F &field, bool pop=true)
+  {
+    HKLUA_STACK_CONTRACT(env_, pop ? 0 : 1);
+    key.Push(env_);
+    lua_rawget(env_, IndexAfterPush(1));
+    const auto ret = StackConv(env_, lua_gettop(env_), field);
+    if (pop) lua_pop(env_, 1);
+    return ret;
+  }
+
+  bool GetField(Key const &key, Table &field, bool pop=false)
+  {
+    return GetField<Table>(key, field, pop);
+  }
+
   template <typename F, typename K>
   F GetFieldR(K const &key, bool pop=true, bool *success=nullptr)
   {
@@ -173,10 +233,52 @@ class Table {
     return GetFieldR<Table, K>(key, pop, success);
   }
 
+  /**
+   * Like GetField() but returns the field or the error,
+   * the stack is always restored.
+   * \note F can't be Table since the field is poped
+   */
+  template <typename F, typename K>
+  HKLUA_STACK_CHECKED
+  Result<F> TryGetField(K const &key)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    StackPush(env_, key);
+    GetTable();
+    return detail::PopConv<F>(env_, "field", nullptr);
+  }
+
+  template <typename F>
+  HKLUA_STACK_CHECKED
+  Result<F> TryGetField(char const *key)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    lua_getfield(env_, index_, key);
+    return detail::PopConv<F>(env_, "field", key);
+  }
+
+  template <typename F>
+  Result<F> TryGetField(std::string const &key)
+  {
+    return TryGetField<F>(key.c_str());
+  }
+
+  template <typename F>
+  HKLUA_STACK_CHECKED
+  Result<F> TryGetField(Key const &key)
+  {
+    HKLUA_STACK_CONTRACT(env_, 0);
+    key.Push(env_);
+    lua_rawget(env_, IndexAfterPush(1));
+    return detail::PopConv<F>(env_, "field", key.name());
+  }
+
 
   template <typename T>
+  HKLUA_STACK_CHECKED
   void SetStringField(char const *key, T &&field)
   {
+    HKLUA_STACK_CONTRACT(env_, 0);
     StackPush(env_, field);
     lua_setfield(env_, index_, key);
   }
@@ -188,8 +290,10 @@ class Table {
   }
   
   template <typename T>
+  HKLUA_STACK_CHECKED
   bool GetStringField(char const *key, T &field)
   {
+    HKLUA_STACK_CONTRACT(env_, 1);
     lua_getfield(env_, index_, key);
     return StackConv(env_, lua_gettop(env_), field);
   }
@@ -197,7 +301,47 @@ class Table {
   template <typename T>
   bool GetStringField(std::string const &key, T &field)
   {
-    return GetStringField(key.c_str(), std::forward<T>(field));
+    return GetStringField(key.c_str(), field);
+  }
+
+  /*--------------------------------------------------*/
+  /* Iteration Module                                 */
+  /*--------------------------------------------------*/
+
+  /**
+   * Iterate all key-value pairs as Variant
+   * e.g.
+   * for (auto &kv : tb) {
+   *   kv.first.Dump();
+   *   kv.second.Dump();
+   * }
+   *
+   * \note Defined in variant.h
+   */
+  PairsIterator<Variant, Variant> begin() const;
+  PairsIterator<Variant, Variant> end() const noexcept;
+
+  /**
+   * Iterate the pairs whose key is K and value is V,
+   * no Variant is constructed.
+   * e.g.
+   * for (auto &kv : tb.Pairs<std::string, double>()) {}
+   */
+  template <typename K, typename V>
+  TableRange<PairsIterator<K, V>> Pairs() const noexcept
+  {
+    return TableRange<PairsIterator<K, V>>(env_, index_);
+  }
+
+  /**
+   * Iterate the array part by lua_rawgeti(), the key is Integer
+   * e.g.
+   * for (auto &kv : tb.IPairs<Integer>()) {}
+   */
+  template <typename V>
+  TableRange<IPairsIterator<V>> IPairs() const noexcept
+  {
+    return TableRange<IPairsIterator<V>>(env_, index_);
   }
 
   /*--------------------------------------------------*/
@@ -218,6 +362,12 @@ class Table {
  private:
   void SetIndex(int index) noexcept { index_ = index; }
 
+  /* The index of the table after \p n values are pushed */
+  int IndexAfterPush(int n) const noexcept
+  {
+    return index_ < 0 && index_ > LUA_REGISTRYINDEX ? index_ - n : index_;
+  }
+
   void SetTable()
   {
     lua_settable(env_, index_);
@@ -0,0 +1,212 @@
+#ifndef HKLUA_TABLE_ITERATOR_H__
+#define HKLUA_TABLE_ITERATOR_H__
+
+#include <lua.hpp>
+
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "hklua/stack.h"
+
+namespace hklua {
+
+/**
+ * \brief Iterator of all key-value pairs in a table by lua_next()
+ *
+ * The key and value are kept in the stack during the iteration,
+ * so the loop body must keep the stack balanced.
+ * The entries can't be converted to K and V are skipped.
+ *
+ * The iterator owns the iteration state, the stack top is restored
+ * when it is destroyed, i.e. break from loop is also OK.
+ *
+ * \warning Don't assign new field to the table during the iteration
+ *          (see lua_next())
+ */
+template <typename K, typename V>
+class PairsIterator {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::pair<K, V>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = value_type const *;
+  using reference = value_type const &;
+
+  /**
+   * End iterator
+   */
+  PairsIterator() noexcept
+    : env_(nullptr)
+    , index_(0)
+    , top_(0)
+  {
+  }
+
+  /**
+   * \param index The index of table in the stack
+   */
+  PairsIterator(lua_State *env, int index)
+    : env_(env)
+    , index_(lua_absindex(env, index))
+    , top_(lua_gettop(env))
+  {
+    lua_pushnil(env_);
+    Next();
+  }
+
+  ~PairsIterator() noexcept
+  {
+    if (env_) lua_settop(env_, top_);
+  }
+
+  PairsIterator(PairsIterator const &) = delete;
+  PairsIterator &operator=(PairsIterator const &) = delete;
+
+  PairsIterator(PairsIterator &&rhs) noexcept
+    : env_(rhs.env_)
+    , index_(rhs.index_)
+    , top_(rhs.top_)
+    , kv_(std::move(rhs.kv_))
+  {
+    rhs.env_ = nullptr;
+  }
+
+  PairsIterator &operator++()
+  {
+    lua_pop(env_, 1);
+    Next();
+    return *this;
+  }
+
+  reference operator*() const noexcept { return kv_; }
+  pointer operator->() const noexcept { return &kv_; }
+
+  bool operator==(PairsIterator const &rhs) const noexcept
+  {
+    return env_ == rhs.env_;
+  }
+
+  bool operator!=(PairsIterator const &rhs) const noexcept
+  {
+    return !(*this == rhs);
+  }
+
+ private:
+  void Next()
+  {
+    while (lua_next(env_, index_)) {
+      const auto top = lua_gettop(env_);
+      if (detail::StackConvKey(env_, top - 1, kv_.first) &&
+          StackConv(env_, top, kv_.second))
+      {
+        return;
+      }
+      lua_pop(env_, 1);
+    }
+
+    /* lua_next() has poped the key */
+    env_ = nullptr;
+  }
+
+  /* nullptr indicates the end */
+  lua_State *env_;
+  int index_;
+  int top_;
+  value_type kv_;
+};
+
+/**
+ * \brief Iterator of the array part(t[1], t[2], ...) by lua_rawgeti()
+ *
+ * Like ipairs(), stop at the first nil.
+ * The elements can't be converted to V are skipped.
+ * The stack is not changed during the iteration.
+ */
+template <typename V>
+class IPairsIterator {
+  static_assert(!std::is_same<V, Table>::value,
+                "The element is poped, use Pairs() to iterate tables");
+
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::pair<Integer, V>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = value_type const *;
+  using reference = value_type const &;
+
+  IPairsIterator() noexcept
+    : env_(nullptr)
+    , index_(0)
+  {
+  }
+
+  IPairsIterator(lua_State *env, int index)
+    : env_(env)
+    , index_(lua_absindex(env, index))
+  {
+    kv_.first = 0;
+    Next();
+  }
+
+  IPairsIterator &operator++()
+  {
+    Next();
+    return *this;
+  }
+
+  reference operator*() const noexcept { return kv_; }
+  pointer operator->() const noexcept { return &kv_; }
+
+  bool operator==(IPairsIterator const &rhs) const noexcept
+  {
+    return env_ == rhs.env_;
+  }
+
+  bool operator!=(IPairsIterator const &rhs) const noexcept
+  {
+    return !(*this == rhs);
+  }
+
+ private:
+  void Next()
+  {
+    while (lua_rawgeti(env_, index_, ++kv_.first) != LUA_TNIL) {
+      const auto success = StackConv(env_, lua_gettop(env_), kv_.second);
+      lua_pop(env_, 1);
+      if (success) return;
+    }
+
+    lua_pop(env_, 1);
+    env_ = nullptr;
+  }
+
+  lua_State *env_;
+  int index_;
+  value_type kv_;
+};
+
+/**
+ * Range returned by Table::Pairs() and Table::IPairs()
+ */
+template <typename Iterator>
+class TableRange {
+ public:
+  TableRange(lua_State *env, int index) noexcept
+    : env_(env)
+    , index_(index)
+  {
+  }
+
+  Iterator begin() const { return Iterator(env_, index_); }
+  Iterator end() const noexcept { return Iterator(); }
+
+ private:
+  lua_State *env_;
+  int index_;
+};
+
+} // namespace hklua
+
+#endif // HKLUA_TABLE_ITERATOR_H__
@@ -19,10 +19,32 @@ extern Nil lua_nil;
 /** Enumrator wrapper */
 enum HKLuaError { 
   HKLUA_OK = LUA_OK,
+  HKLUA_YIELD = LUA_YIELD,
   HKLUA_ERRMEM = LUA_ERRMEM,
   HKLUA_ERRSYNTAX = LUA_ERRSYNTAX,
   HKLUA_ERRFILE = LUA_ERRFILE,
   HKLUA_ERRRUN = LUA_ERRRUN,
+  HKLUA_ERRERR = LUA_ERRERR,
+  /* Not Lua status: the value can't be converted to the C++ type */
+  HKLUA_ERRTYPE = LUA_ERRERR + 1,
+};
+
+/** The standard libraries, see Env::OpenLibs(unsigned) */
+enum HKLuaLib : unsigned {
+  HKLUA_LIB_BASE = 1 << 0,
+  HKLUA_LIB_PACKAGE = 1 << 1,
+  HKLUA_LIB_COROUTINE = 1 << 2,
+  HKLUA_LIB_TABLE = 1 << 3,
+  HKLUA_LIB_IO = 1 << 4,
+  HKLUA_LIB_OS = 1 << 5,
+  HKLUA_LIB_STRING = 1 << 6,
+  HKLUA_LIB_MATH = 1 << 7,
+  HKLUA_LIB_UTF8 = 1 << 8,
+  HKLUA_LIB_DEBUG = 1 << 9,
+  /* No access to the files and the process */
+  HKLUA_LIB_SAFE = HKLUA_LIB_BASE | HKLUA_LIB_COROUTINE | HKLUA_LIB_TABLE |
+                   HKLUA_LIB_STRING | HKLUA_LIB_MATH | HKLUA_LIB_UTF8,
+  HKLUA_LIB_ALL = (1 << 10) - 1,
 };
 
 } // namespace hklua
@@ -0,0 +1,47 @@
+#ifndef HKLUA_UTIL_PREPROCESSOR_H__
+#define HKLUA_UTIL_PREPROCESSOR_H__
+
+/* The number of arguments, at most 32 */
+#define HKLUA_PP_NARG(...) HKLUA_PP_NARG_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define HKLUA_PP_NARG_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+
+#define HKLUA_PP_CAT(a, b) HKLUA_PP_CAT_(a, b)
+#define HKLUA_PP_CAT_(a, b) a##b
+
+/* Apply m(ctx, x) to each argument, separated by comma */
+#define HKLUA_PP_MAP(m, ctx, ...) \
+  HKLUA_PP_CAT(HKLUA_PP_MAP_, HKLUA_PP_NARG(__VA_ARGS__))(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_1(m, ctx, x) m(ctx, x)
+#define HKLUA_PP_MAP_2(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_1(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_3(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_2(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_4(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_3(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_5(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_4(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_6(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_5(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_7(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_6(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_8(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_7(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_9(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_8(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_10(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_9(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_11(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_10(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_12(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_11(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_13(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_12(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_14(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_13(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_15(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_14(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_16(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_15(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_17(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_16(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_18(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_17(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_19(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_18(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_20(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_19(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_21(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_20(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_22(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_21(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_23(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_22(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_24(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_23(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_25(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_24(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_26(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_25(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_27(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_26(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_28(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_27(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_29(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_28(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_30(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_29(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_31(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_30(m, ctx, __VA_ARGS__)
+#define HKLUA_PP_MAP_32(m, ctx, x, ...) m(ctx, x), HKLUA_PP_MAP_31(m, ctx, __VA_ARGS__)
+
+#endif // HKLUA_UTIL_PREPROCESSOR_H__
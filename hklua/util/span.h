@@ -0,0 +1,62 @@
+#ifndef HKLUA_UTIL_SPAN_H__
+#define HKLUA_UTIL_SPAN_H__
+
+#include <stddef.h>
+
+namespace hklua {
+
+/**
+ * \brief Non-owning view of contiguous elements
+ *
+ * std::span is not available in C++14.
+ */
+template <typename T>
+struct Span {
+  Span() noexcept
+    : data(nullptr)
+    , size(0)
+  {
+  }
+
+  Span(T *d, size_t n) noexcept
+    : data(d)
+    , size(n)
+  {
+  }
+
+  template <size_t N>
+  Span(T (&arr)[N]) noexcept
+    : data(arr)
+    , size(N)
+  {
+  }
+
+  T *begin() const noexcept { return data; }
+  T *end() const noexcept { return data + size; }
+
+  T *data;
+  size_t size;
+};
+
+template <typename T>
+inline Span<T> MakeSpan(T *data, size_t size) noexcept
+{
+  return Span<T>(data, size);
+}
+
+template <typename C>
+inline auto MakeSpan(C &c) noexcept -> Span<typename C::value_type>
+{
+  return Span<typename C::value_type>(c.data(), c.size());
+}
+
+template <typename C>
+inline auto MakeSpan(C const &c) noexcept
+    -> Span<typename C::value_type const>
+{
+  return Span<typename C::value_type const>(c.data(), c.size());
+}
+
+} // namespace hklua
+
+#endif // HKLUA_UTIL_SPAN_H__
@@ -0,0 +1,62 @@
+#ifndef HKLUA_UTIL_STRING_VIEW_H__
+#define HKLUA_UTIL_STRING_VIEW_H__
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+namespace hklua {
+
+/**
+ * \brief Non-owning view of characters(may contain '\0')
+ *
+ * std::string_view is not available in C++14.
+ */
+struct StringView {
+  StringView() noexcept
+    : data(nullptr)
+    , size(0)
+  {
+  }
+
+  StringView(char const *d, size_t n) noexcept
+    : data(d)
+    , size(n)
+  {
+  }
+
+  StringView(char const *str) noexcept
+    : data(str)
+    , size(strlen(str))
+  {
+  }
+
+  StringView(std::string const &str) noexcept
+    : data(str.data())
+    , size(str.size())
+  {
+  }
+
+  char const *begin() const noexcept { return data; }
+  char const *end() const noexcept { return data + size; }
+  bool empty() const noexcept { return size == 0; }
+
+  std::string ToString() const { return std::string(data, size); }
+
+  char const *data;
+  size_t size;
+};
+
+inline bool operator==(StringView x, StringView y) noexcept
+{
+  return x.size == y.size && (x.size == 0 || memcmp(x.data, y.data, x.size) == 0);
+}
+
+inline bool operator!=(StringView x, StringView y) noexcept
+{
+  return !(x == y);
+}
+
+} // namespace hklua
+
+#endif // HKLUA_UTIL_STRING_VIEW_H__
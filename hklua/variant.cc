@@ -4,6 +4,8 @@
 
 using namespace hklua;
 
+constexpr size_t Variant::kSmallStringCapacity;
+
 void Variant::Dump() const noexcept
 {
   switch (type_) {
@@ -22,6 +24,9 @@ void Variant::Dump() const noexcept
     case HK_CSTRING:
       printf("(string): %s\n", cstr_);
       break;
+    case HK_STRING:
+      printf("(string): %.*s\n", (int)StringSize(), StringData());
+      break;
     case HK_FUNCTION:
       printf("(function): %p\n", func_);
       break;
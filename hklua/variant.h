@@ -8,6 +8,7 @@
 #include "hklua/type.h"
 #include "hklua/stack.h"
 #include "hklua/table.h"
+#include "hklua/util/string_view.h"
 
 namespace hklua {
 
@@ -25,8 +26,32 @@ enum HKVariantType : unsigned char {
   HK_NIL,
 };
 
+/**
+ * The storage of HK_STRING
+ */
+enum HKStringMode : unsigned char {
+  HK_STRING_SMALL = 0, /* Inline, no allocation */
+  HK_STRING_HEAP,      /* Owning, allocated by new[] */
+  HK_STRING_BORROWED,  /* Non-owning */
+};
+
+/**
+ * \brief Dynamic-typed value of Lua
+ *
+ * The string is stored as HK_STRING, it carries the length,
+ * so the embedded '\0' is kept and the push is lua_pushlstring().
+ * - The short string(<= kSmallStringCapacity) is stored inline.
+ * - The long string is copied to the heap.
+ * - The borrowed string just refers to the characters,
+ *   e.g. StackConvBorrowed() refers to the string in the Lua stack,
+ *   which is valid while the value is not poped.
+ *
+ * HK_CSTRING is the raw pointer specified by user, it is not copied.
+ */
 class Variant {
  public:
+  static constexpr size_t kSmallStringCapacity = 15;
+
   Variant()
     : type_(HK_UNSET)
   {
@@ -36,7 +61,7 @@ class Variant {
     : type_(HK_NIL)
   {
   }
-  
+
   Variant(bool b)
     : type_(HK_BOOLEAN)
     , bool_(b)
@@ -61,6 +86,31 @@ class Variant {
   {
   }
 
+  /**
+   * Owning string, i.e. HK_STRING
+   */
+  Variant(char const *str, size_t len)
+    : type_(HK_UNSET)
+  {
+    SetString(str, len);
+  }
+
+  Variant(std::string const &str)
+    : Variant(str.data(), str.size())
+  {
+  }
+
+  /**
+   * Borrowed string, the \p view must outlive the variant
+   */
+  Variant(StringView view)
+    : type_(HK_STRING)
+    , str_mode_(HK_STRING_BORROWED)
+  {
+    str_.data = view.data;
+    str_.size = view.size;
+  }
+
   Variant(lua_CFunction func)
     : type_(HK_FUNCTION)
     , func_(func)
@@ -75,12 +125,18 @@ class Variant {
 
   Variant(Variant const &rhs)
     : type_(rhs.type_)
+    , str_mode_(rhs.str_mode_)
   {
     // FIXME
     static_assert(sizeof(Variant) == sizeof(Table) + PADDING,
                   "The size of Variant must be the sum of Table and PADDING(8)");
-    memcpy(reinterpret_cast<char *>(this) + PADDING, 
-           reinterpret_cast<char const*>(&rhs) + PADDING, 
+    if (IsHeapString()) {
+      type_ = HK_UNSET;
+      SetString(rhs.str_.data, rhs.str_.size);
+      return;
+    }
+    memcpy(reinterpret_cast<char *>(this) + PADDING,
+           reinterpret_cast<char const*>(&rhs) + PADDING,
            sizeof(Variant)-PADDING);
   }
 
@@ -99,9 +155,9 @@ class Variant {
     //               "The size of HKVariantType must be 1");
     // static_assert(sizeof(Variant) == sizeof(Table) + PADDING,
     //               "The size of Variant must be the sum of Table and type_");
-    // memcpy(reinterpret_cast<char *>(this) + PADDING, &rhs + PADDING, 
+    // memcpy(reinterpret_cast<char *>(this) + PADDING, &rhs + PADDING,
     //        sizeof(Variant)-PADDING);
-  
+
     Variant(rhs).swap(*this);
     return *this;
   }
@@ -115,7 +171,7 @@ class Variant {
 
   Variant &operator=(Integer i)
   {
-    // FIXME free resources
+    Clear();
     type_ = HK_INT;
     integer_ = i;
     return *this;
@@ -123,6 +179,7 @@ class Variant {
 
   Variant &operator=(bool b)
   {
+    Clear();
     type_ = HK_BOOLEAN;
     bool_ = b;
     return *this;
@@ -130,6 +187,7 @@ class Variant {
 
   Variant &operator=(Number n)
   {
+    Clear();
     type_ = HK_NUMBER;
     number_ = n;
     return *this;
@@ -137,13 +195,27 @@ class Variant {
 
   Variant &operator=(char const *str)
   {
+    Clear();
     type_ = HK_CSTRING;
     cstr_ = str;
     return *this;
   }
 
+  Variant &operator=(std::string const &str)
+  {
+    SetString(str.data(), str.size());
+    return *this;
+  }
+
+  Variant &operator=(StringView view)
+  {
+    BorrowString(view.data, view.size);
+    return *this;
+  }
+
   Variant &operator=(lua_CFunction func)
   {
+    Clear();
     type_ = HK_FUNCTION;
     func_ = func;
     return *this;
@@ -151,6 +223,7 @@ class Variant {
 
   Variant &operator=(Table tb)
   {
+    Clear();
     type_ = HK_TABLE;
     table_ = tb;
     return *this;
@@ -158,12 +231,14 @@ class Variant {
 
   Variant &operator=(Nil nil)
   {
+    Clear();
     type_ = HK_NIL;
     return *this;
   }
 
   ~Variant() noexcept
   {
+    Clear();
 #if 0
     if (type_ == HK_TABLE) {
       table_.~Table();
@@ -176,7 +251,7 @@ class Variant {
     assert(HK_INT == type_);
     return integer_;
   }
-  
+
   bool &ToBoolean() noexcept
   {
     assert(HK_BOOLEAN == type_);
@@ -189,10 +264,28 @@ class Variant {
     return number_;
   }
 
-  char const *&ToCString() noexcept
+  /**
+   * \note
+   * The string of HK_STRING is terminated by '\0' unless it is
+   * borrowed from the characters that is not terminated.
+   * Use ToStringView() if the string may contain '\0'.
+   */
+  char const *ToCString() const noexcept
+  {
+    assert(HK_CSTRING == type_ || HK_STRING == type_);
+    return type_ == HK_CSTRING ? cstr_ : StringData();
+  }
+
+  StringView ToStringView() const noexcept
   {
-    assert(HK_CSTRING == type_);
-    return cstr_;
+    assert(HK_CSTRING == type_ || HK_STRING == type_);
+    if (type_ == HK_CSTRING) return StringView(cstr_);
+    return StringView(StringData(), StringSize());
+  }
+
+  std::string ToString() const
+  {
+    return ToStringView().ToString();
   }
 
   lua_CFunction &ToCFunction() noexcept
@@ -213,11 +306,52 @@ class Variant {
     return lua_nil;
   }
 
+  /**
+   * Copy the characters, i.e. HK_STRING
+   */
+  void SetString(char const *str, size_t len)
+  {
+    /* Copy before Clear() since the str may refer to the old one */
+    if (len <= kSmallStringCapacity) {
+      char buf[kSmallStringCapacity + 1];
+      memcpy(buf, str, len);
+      Clear();
+      type_ = HK_STRING;
+      str_mode_ = HK_STRING_SMALL;
+      memcpy(small_, buf, len);
+      small_[len] = '\0';
+      small_[kSmallStringCapacity] = (char)(kSmallStringCapacity - len);
+      return;
+    }
+
+    auto buf = new char[len + 1];
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+    Clear();
+    type_ = HK_STRING;
+    str_mode_ = HK_STRING_HEAP;
+    str_.data = buf;
+    str_.size = len;
+  }
+
+  /**
+   * Refer to the characters, i.e. HK_STRING but not owned
+   */
+  void BorrowString(char const *str, size_t len) noexcept
+  {
+    Clear();
+    type_ = HK_STRING;
+    str_mode_ = HK_STRING_BORROWED;
+    str_.data = str;
+    str_.size = len;
+  }
+
   void swap(Variant &rhs) noexcept
   {
     static_assert(sizeof(Variant) == sizeof(Table) + PADDING,
                   "The size of Variant must be the sum of Table and PADDING");
     std::swap(type_, rhs.type_);
+    std::swap(str_mode_, rhs.str_mode_);
     char buf[sizeof(Variant) - PADDING];
     char *self = reinterpret_cast<char *>(this) + PADDING;
     char *other = reinterpret_cast<char *>(&rhs) + PADDING;
@@ -227,12 +361,57 @@ class Variant {
   }
 
   HKVariantType type() const noexcept { return type_; }
-  
+
+  /** Only meaningful if type() is HK_STRING */
+  HKStringMode string_mode() const noexcept { return str_mode_; }
+
   void Dump() const noexcept;
  private:
+  friend void StackPush(lua_State *env, Variant const &);
   friend bool StackConv(lua_State *env, int index, Variant &);
+  friend bool StackConvBorrowed(lua_State *env, int index, Variant &);
+
+  struct StringRep {
+    char const *data;
+    size_t size;
+  };
+
+  bool IsHeapString() const noexcept
+  {
+    return type_ == HK_STRING && str_mode_ == HK_STRING_HEAP;
+  }
+
+  char const *StringData() const noexcept
+  {
+    return str_mode_ == HK_STRING_SMALL ? small_ : str_.data;
+  }
+
+  /*
+   * The last byte of small string stores the remaining capacity,
+   * so it is also the terminator if the string is full.
+   */
+  size_t StringSize() const noexcept
+  {
+    return str_mode_ == HK_STRING_SMALL
+               ? kSmallStringCapacity -
+                     (unsigned char)small_[kSmallStringCapacity]
+               : str_.size;
+  }
+
+  /**
+   * Free the owned string
+   * \note type_ is not reset
+   */
+  void Clear() noexcept
+  {
+    if (IsHeapString()) {
+      delete[] str_.data;
+      type_ = HK_UNSET;
+    }
+  }
 
   HKVariantType type_;
+  HKStringMode str_mode_ = HK_STRING_SMALL;
   union {
     Integer integer_;
     bool bool_;
@@ -240,6 +419,8 @@ class Variant {
     char const *cstr_;
     lua_CFunction func_;
     Table table_;
+    StringRep str_;
+    char small_[kSmallStringCapacity + 1];
   };
 };
 
@@ -259,32 +440,39 @@ inline void swap(hklua::Variant &lhs,
 
 namespace hklua {
 
-inline void StackPush(lua_State *env, Variant var)
+inline void StackPush(lua_State *env, Variant const &var)
 {
-  switch (var.type()) {
+  switch (var.type_) {
     case HK_INT:
-      StackPush(env, var.ToInteger());
+      lua_pushinteger(env, var.integer_);
       break;
     case HK_NUMBER:
-      StackPush(env, var.ToNumber());
+      lua_pushnumber(env, var.number_);
+      break;
+    case HK_BOOLEAN:
+      lua_pushboolean(env, var.bool_);
       break;
     case HK_CSTRING:
-      StackPush(env, var.ToCString());
+      lua_pushstring(env, var.cstr_);
+      break;
+    case HK_STRING:
+      lua_pushlstring(env, var.StringData(), var.StringSize());
       break;
     case HK_FUNCTION:
-      StackPush(env, var.ToCFunction());
+      lua_pushcfunction(env, var.func_);
       break;
     case HK_TABLE:
-      StackPush(env, var.ToTable());
+      StackPush(env, var.table_);
       break;
     case HK_NIL:
-      StackPush(env, var.ToNil());
+      lua_pushnil(env);
       break;
   }
 }
 
 inline bool StackConv(lua_State *env, int index, Variant &var)
 {
+  var.Clear();
   switch (lua_type(env, index)) {
     case LUA_TNUMBER:
     {
@@ -301,11 +489,13 @@ inline bool StackConv(lua_State *env, int index, Variant &var)
       var.type_ = HK_BOOLEAN;
       return StackConv(env, index, var.bool_);
     }
-    
+
     case LUA_TSTRING:
     {
-      var.type_ = HK_CSTRING;
-      return StackConv(env, index, var.cstr_);
+      size_t len;
+      auto str = lua_tolstring(env, index, &len);
+      var.SetString(str, len);
+      return true;
     }
 
     case LUA_TFUNCTION:
@@ -327,68 +517,247 @@ inline bool StackConv(lua_State *env, int index, Variant &var)
       return true;
     }
   }
-  
+
   assert(false);
   return false;
 }
 
+/**
+ * Same as StackConv() except the string is borrowed from the Lua,
+ * i.e. no copy and allocation.
+ *
+ * \warning
+ * The string is valid while the value is in the stack(or anchored by
+ * other objects), e.g. the argument of the C function.
+ */
+inline bool StackConvBorrowed(lua_State *env, int index, Variant &var)
+{
+  if (lua_type(env, index) != LUA_TSTRING) return StackConv(env, index, var);
+
+  size_t len;
+  auto str = lua_tolstring(env, index, &len);
+  var.BorrowString(str, len);
+  return true;
+}
+
 #undef PADDING
 
-class Table::Proxy {
-  friend class Table;
+namespace detail {
+
+/* t[key] where t is at the absolute index */
+
+template <typename K>
+inline void ProxyGetField(lua_State *env, int index, K const &key)
+{
+  StackPush(env, key);
+  lua_gettable(env, index);
+}
+
+inline void ProxyGetField(lua_State *env, int index, char const *key)
+{
+  lua_getfield(env, index, key);
+}
+
+inline void ProxyGetField(lua_State *env, int index, std::string const &key)
+{
+  lua_getfield(env, index, key.c_str());
+}
+
+/* t[key] = value where t is at the absolute index */
+
+template <typename K, typename V>
+inline void ProxySetField(lua_State *env, int index, K const &key,
+                          V const &value)
+{
+  StackPush(env, key);
+  StackPush(env, value);
+  lua_settable(env, index);
+}
+
+template <typename V>
+inline void ProxySetField(lua_State *env, int index, char const *key,
+                          V const &value)
+{
+  StackPush(env, value);
+  lua_setfield(env, index, key);
+}
+
+template <typename V>
+inline void ProxySetField(lua_State *env, int index, std::string const &key,
+                          V const &value)
+{
+  ProxySetField(env, index, key.c_str(), value);
+}
+
+/*
+ * Push the table which the proxy indexes
+ * return the number of pushed values(0 or 1)
+ */
+
+inline int ProxyPushTable(Table const &tb, int &index)
+{
+  index = lua_absindex(tb.env(), tb.index());
+  return 0;
+}
+
+template <typename Parent, typename K>
+inline int ProxyPushTable(TableProxy<Parent, K> const &proxy, int &index)
+{
+  proxy.Push();
+  index = lua_gettop(proxy.env());
+  return 1;
+}
 
-  using KeyValue = std::pair<Variant, Variant>;
+} // namespace detail
+
+/**
+ * \brief Lazy reference to t[key]
+ *
+ * The proxy just stores the parent(Table or the proxy of upper level)
+ * and the key, no field is read until it is converted,
+ * and the assignment writes through without reading.
+ *
+ * The chained proxy(e.g. t["a"]["b"]) pushes the intermediate table
+ * temporarily, no Variant is constructed.
+ * If the intermediate value is not a table, the value is nil
+ * and the assignment is ignored.
+ *
+ * The stack is balanced after each operation.
+ */
+template <typename Parent, typename K>
+class TableProxy {
  public:
-  explicit Proxy(Table *table, KeyValue kv)
-    : table_(table)
-    , kv_(kv)
+  TableProxy(Parent const &parent, K const &key)
+    : parent_(parent)
+    , key_(key)
   {
   }
-  
-  // Proxy(Proxy const &) = default;
-  Proxy(Proxy &&) = default;
 
-  template <typename T, typename = typename std::enable_if<!AmbigiousCond<Proxy, T>::value>::type>
-  Proxy &operator=(T const &v);
-  /* std::pair<> requires the type must be complete type */
-  
-  Proxy &operator=(Proxy &&rhs)
+  TableProxy(TableProxy const &) = default;
+  TableProxy(TableProxy &&) = default;
+
+  /**
+   * Reference semantics, i.e. assign the value of \p rhs
+   */
+  TableProxy &operator=(TableProxy const &rhs)
   {
-    std::swap(table_, rhs.table_);
-    std::swap(kv_, rhs.kv_);
+    Set(rhs);
     return *this;
   }
-  
-  Variant &key() noexcept;
-  Variant &value() noexcept;
+
+  template <typename T, typename = typename std::enable_if<
+                            !AmbigiousCond<TableProxy, T>::value>::type>
+  TableProxy &operator=(T const &v)
+  {
+    Set(v);
+    return *this;
+  }
+
+  template <typename T>
+  TableProxy<TableProxy, typename std::decay<T const>::type>
+  operator[](T const &key) const
+  {
+    return TableProxy<TableProxy, typename std::decay<T const>::type>(*this,
+                                                                      key);
+  }
+
+  /**
+   * \return false if the parent is not a table
+   */
+  template <typename T>
+  bool Set(T const &v)
+  {
+    int index;
+    const auto pushed = detail::ProxyPushTable(parent_, index);
+    const auto is_table = lua_istable(env(), index);
+    if (is_table) detail::ProxySetField(env(), index, key_, v);
+    lua_pop(env(), pushed);
+    return is_table;
+  }
+
+  template <typename T>
+  bool Get(T &v) const
+  {
+    static_assert(!std::is_same<T, Table>::value,
+                  "The field is poped, use Table::GetField() instead");
+    Push();
+    const auto ret = StackConv(env(), lua_gettop(env()), v);
+    lua_pop(env(), 1);
+    return ret;
+  }
+
+  template <typename T>
+  T As(bool *success = nullptr) const
+  {
+    T ret;
+    const auto result = Get(ret);
+    if (success) *success = result;
+    return ret;
+  }
+
+  template <typename T, typename = typename std::enable_if<
+                            !std::is_same<T, Table>::value>::type>
+  operator T() const
+  {
+    return As<T>();
+  }
+
+  /**
+   * Push the value of the field
+   */
+  void Push() const
+  {
+    int index;
+    const auto pushed = detail::ProxyPushTable(parent_, index);
+    if (lua_istable(env(), index))
+      detail::ProxyGetField(env(), index, key_);
+    else
+      lua_pushnil(env());
+    if (pushed) lua_remove(env(), -2);
+  }
+
+  int Type() const
+  {
+    Push();
+    const auto ret = lua_type(env(), -1);
+    lua_pop(env(), 1);
+    return ret;
+  }
+
+  bool IsNil() const { return Type() == LUA_TNIL; }
+
+  Variant value() const { return As<Variant>(); }
+  K const &key() const noexcept { return key_; }
+
+  lua_State *env() const noexcept { return parent_.env(); }
 
  private:
-  Table *table_;
-  /* FIXME Reduce dynamic allocation */
-  // std::unique_ptr<KeyValue> kv_;
-  KeyValue kv_;
+  Parent parent_;
+  K key_;
 };
 
-template <typename T, typename >
-inline auto Table::Proxy::operator=(T const &v) -> Proxy&
+template <typename Parent, typename K>
+inline void StackPush(lua_State *env, TableProxy<Parent, K> const &proxy)
 {
-  // assert(kv_);
-  table_->SetField(kv_.first, v);
-  table_->GetField(kv_.first, kv_.second);
-
-  return *this;
+  proxy.Push();
 }
 
 template <typename T>
-inline auto Table::operator[](T const &key) -> Proxy
+inline auto Table::operator[](T const &key) const
+    -> TableProxy<Table, typename std::decay<T const>::type>
 {
-  Variant tmp;
-  GetField(key, tmp);
-  return Proxy(this, Proxy::KeyValue(key, std::move(tmp)));
+  return TableProxy<Table, typename std::decay<T const>::type>(*this, key);
 }
 
-inline Variant &Table::Proxy::key() noexcept { return kv_.first; }
-inline Variant &Table::Proxy::value() noexcept { return kv_.second; }
+inline PairsIterator<Variant, Variant> Table::begin() const
+{
+  return PairsIterator<Variant, Variant>(env_, index_);
+}
+
+inline PairsIterator<Variant, Variant> Table::end() const noexcept
+{
+  return PairsIterator<Variant, Variant>();
+}
 
 } // namespace hklua
 
@@ -0,0 +1,117 @@
+#include "hklua/allocator.h"
+#include "hklua/env.h"
+
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+static void ChurnScript(Env &env)
+{
+  auto ret = env.DoString(
+    "local t = {}\n"
+    "for i = 1, 10000 do\n"
+    "  t[i] = { name = 'item' .. i, value = i * 1.5 }\n"
+    "end\n"
+    "total = 0\n"
+    "for i = 1, #t do total = total + t[i].value end\n");
+  EXPECT_EQ(ret, HKLUA_OK);
+  EXPECT_EQ(env.GetGlobalR<Integer>("total"), 75007500);
+}
+
+TEST (allocator_test, pool) {
+  Env env("pool", std::unique_ptr<Allocator>(new PoolAllocator()));
+  env.OpenLibs();
+  ChurnScript(env);
+
+  auto alloc = env.allocator();
+  ASSERT_NE(alloc, nullptr);
+  EXPECT_GT(alloc->bytes(), 0u);
+  EXPECT_GE(alloc->peak_bytes(), alloc->bytes());
+  env.GcCollect();
+  EXPECT_LT(alloc->bytes(), alloc->peak_bytes());
+}
+
+/* Refill() fails after fail is set, i.e. no more chunks */
+struct FailingPool : PoolAllocator {
+  bool fail = false;
+
+  bool Refill(size_t cls) override
+  {
+    return !fail && PoolAllocator::Refill(cls);
+  }
+};
+
+TEST (allocator_test, pool_shrink) {
+  FailingPool pool;
+  auto small = Allocator::LuaAlloc(&pool, nullptr, LUA_TSTRING, 256);
+  ASSERT_NE(small, nullptr);
+  memset(small, 'x', 256);
+  auto large = Allocator::LuaAlloc(&pool, nullptr, LUA_TTABLE, 4096);
+  ASSERT_NE(large, nullptr);
+  memset(large, 'y', 4096);
+  pool.fail = true;
+
+  /* The grow fails, but the shrink never fails(see lua_Alloc) */
+  EXPECT_EQ(Allocator::LuaAlloc(&pool, small, 256, 300), nullptr);
+  auto p = Allocator::LuaAlloc(&pool, small, 256, 16);
+  EXPECT_EQ(p, small);
+  auto q = Allocator::LuaAlloc(&pool, large, 4096, 100);
+  ASSERT_NE(q, nullptr);
+  EXPECT_EQ(static_cast<char *>(q)[99], 'y');
+  EXPECT_EQ(pool.bytes(), 116u);
+  EXPECT_EQ(pool.failure_count(), 1u);
+
+  Allocator::LuaAlloc(&pool, p, 16, 0);
+  Allocator::LuaAlloc(&pool, q, 100, 0);
+  EXPECT_EQ(pool.bytes(), 0u);
+
+  /* The shrunk large block is adopted by the pool */
+  EXPECT_EQ(Allocator::LuaAlloc(&pool, nullptr, LUA_TSTRING, 112), q);
+  Allocator::LuaAlloc(&pool, q, 112, 0);
+}
+
+TEST (allocator_test, arena) {
+  Env env("arena", std::unique_ptr<Allocator>(new ArenaAllocator()));
+  env.OpenLibs();
+  ChurnScript(env);
+  EXPECT_GT(env.allocator()->bytes(), 0u);
+}
+
+static void *CountingAlloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+  ++*static_cast<int *>(ud);
+  if (nsize == 0) {
+    free(ptr);
+    return nullptr;
+  }
+  return realloc(ptr, nsize);
+}
+
+TEST (allocator_test, user) {
+  int count = 0;
+  {
+    Env env("user", std::unique_ptr<Allocator>(
+                        new UserAllocator(&CountingAlloc, &count)));
+    env.OpenLibs();
+    ChurnScript(env);
+  }
+  EXPECT_GT(count, 0);
+}
+
+TEST (allocator_test, limit) {
+  Env env("limited",
+          std::unique_ptr<Allocator>(new PoolAllocator(1024 * 1024)));
+  env.OpenLibs();
+
+  auto ret = env.DoString("local t = {} for i = 1, 1e7 do t[i] = i end");
+  EXPECT_EQ(ret, HKLUA_ERRMEM);
+  EXPECT_GT(env.allocator()->failure_count(), 0u);
+  EXPECT_LE(env.allocator()->peak_bytes(), env.allocator()->limit());
+  env.StackPop();
+
+  /* The Env is still usable after the memory error */
+  env.GcCollect();
+  EXPECT_EQ(env.DoString("x = 1"), HKLUA_OK);
+  EXPECT_EQ(env.GetGlobalR<int>("x"), 1);
+}
@@ -0,0 +1,101 @@
+#include "hklua/batch.h"
+#include "hklua/env.h"
+
+#include <vector>
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static void SetupHandler(Env &env)
+{
+  env.DoString(
+    "sum = 0\n"
+    "function handle(v) sum = sum + v return v * 2 end\n"
+    "function handle_batch(vs)\n"
+    "  local rets = {}\n"
+    "  for i = 1, #vs do local v = vs[i] sum = sum + v rets[i] = v * 2 end\n"
+    "  return rets\n"
+    "end\n");
+}
+
+static std::vector<Number> MakeEvents(size_t n)
+{
+  std::vector<Number> events(n);
+  for (size_t i = 0; i < n; ++i)
+    events[i] = (Number)i * 0.5;
+  return events;
+}
+
+/* One CallFunction() per event: global lookup, lua_pcall and tuple conversion */
+static void BM_Batch_CallFunction(benchmark::State &state)
+{
+  Env env;
+  SetupHandler(env);
+  auto events = MakeEvents(state.range(0));
+  std::vector<Number> rets;
+
+  for (auto _ : state) {
+    rets.clear();
+    for (auto e : events) {
+      bool success;
+      auto ret = env.CallFunction<Number>("handle", 0, &success, true, e);
+      rets.push_back(std::get<0>(ret));
+    }
+    benchmark::DoNotOptimize(rets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+static void BM_Batch_TryCallFunctionRef(benchmark::State &state)
+{
+  Env env;
+  SetupHandler(env);
+  auto func = env.GetFunctionRef("handle");
+  auto events = MakeEvents(state.range(0));
+  std::vector<Number> rets;
+
+  for (auto _ : state) {
+    rets.clear();
+    for (auto e : events) {
+      auto ret = env.TryCallFunction<Number>(func, e);
+      rets.push_back(std::get<0>(*ret));
+    }
+    benchmark::DoNotOptimize(rets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+static void BM_Batch_TryCallEach(benchmark::State &state)
+{
+  Env env;
+  SetupHandler(env);
+  auto events = MakeEvents(state.range(0));
+  std::vector<Number> rets;
+
+  for (auto _ : state) {
+    rets.clear();
+    env.TryCallEach("handle", events, rets);
+    benchmark::DoNotOptimize(rets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+static void BM_Batch_TryCallBatch(benchmark::State &state)
+{
+  Env env;
+  SetupHandler(env);
+  auto events = MakeEvents(state.range(0));
+  std::vector<Number> rets;
+
+  for (auto _ : state) {
+    rets.clear();
+    env.TryCallBatch("handle_batch", events, rets);
+    benchmark::DoNotOptimize(rets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+
+BENCHMARK(BM_Batch_CallFunction)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_Batch_TryCallFunctionRef)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_Batch_TryCallEach)->Arg(1)->Arg(16)->Arg(256);
+BENCHMARK(BM_Batch_TryCallBatch)->Arg(1)->Arg(16)->Arg(256);
@@ -0,0 +1,79 @@
+#include "hklua/batch.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (batch_test, each) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(R"(
+    count = 0
+    function handle(id, name)
+      count = count + 1
+      return id * 2, name .. "!"
+    end
+    function fail(id)
+      if id == 3 then error("bad event") end
+      return id
+    end
+  )"));
+
+  std::vector<std::tuple<Integer, std::string>> events{
+    std::make_tuple(1, "a"), std::make_tuple(2, "b"), std::make_tuple(3, "c")
+  };
+  std::vector<std::tuple<Integer, std::string>> rets;
+  auto ret = env.TryCallEach("handle", events, rets);
+  ASSERT_TRUE(ret) << ret.error().message();
+  ASSERT_EQ(rets.size(), 3);
+  EXPECT_EQ(std::get<0>(rets[2]), 6);
+  EXPECT_EQ(std::get<1>(rets[1]), "b!");
+  EXPECT_EQ(env.StackSize(), 0);
+
+  /* Discard the results */
+  auto func = env.GetFunctionRef("handle");
+  ASSERT_TRUE(TryCallEach(func, events));
+  EXPECT_EQ(env.GetGlobalR<Integer>("count"), 6);
+
+  /* Stop at the first failure */
+  std::vector<Integer> ids{ 1, 2, 3, 4 };
+  std::vector<Integer> out;
+  ret = env.TryCallEach("fail", ids, out);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRRUN);
+  EXPECT_NE(ret.error().message().find("call 2: "), std::string::npos);
+  EXPECT_NE(ret.error().message().find("bad event"), std::string::npos);
+  EXPECT_EQ(out.size(), 2);
+  EXPECT_EQ(env.StackSize(), 0);
+
+  EXPECT_EQ(env.TryCallEach("nonexistent", ids).code(), HKLUA_ERRTYPE);
+}
+
+TEST (batch_test, batch) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(R"(
+    function square(xs)
+      local ys = {}
+      for i, x in ipairs(xs) do ys[i] = x * x end
+      return ys
+    end
+    function count(xs) n = #xs end
+    function bad(xs) return 1 end
+  )"));
+
+  std::vector<Integer> xs{ 1, 2, 3, 4 };
+  std::vector<Integer> ys;
+  auto ret = env.TryCallBatch("square", xs, ys);
+  ASSERT_TRUE(ret) << ret.error().message();
+  EXPECT_EQ(ys, (std::vector<Integer>{ 1, 4, 9, 16 }));
+
+  ASSERT_TRUE(env.TryCallBatch("count", xs));
+  EXPECT_EQ(env.GetGlobalR<Integer>("n"), 4);
+
+  ret = env.TryCallBatch("bad", xs, ys);
+  EXPECT_EQ(ret.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(env.StackSize(), 0);
+}
@@ -0,0 +1,443 @@
+/*
+ * The overhead of the binding layer.
+ * Each hklua path is paired with the equivalent raw Lua C API code,
+ * i.e. BM_Raw_X vs BM_HK_X.
+ */
+#include "hklua/env.h"
+#include "hklua/table.h"
+#include "hklua/variant.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+/*--------------------------------------------------*/
+/* Env creation                                     */
+/*--------------------------------------------------*/
+
+static void BM_Raw_EnvCreate(benchmark::State &state)
+{
+  for (auto _ : state) {
+    auto env = luaL_newstate();
+    benchmark::DoNotOptimize(env);
+    lua_close(env);
+  }
+}
+
+static void BM_HK_EnvCreate(benchmark::State &state)
+{
+  for (auto _ : state) {
+    Env env;
+    benchmark::DoNotOptimize(env.env());
+  }
+}
+
+BENCHMARK(BM_Raw_EnvCreate);
+BENCHMARK(BM_HK_EnvCreate);
+
+/*--------------------------------------------------*/
+/* Function call                                    */
+/*--------------------------------------------------*/
+
+static void SetupFunction(Env &env)
+{
+  env.DoString("function add(a, b) return a + b end");
+}
+
+static void BM_Raw_CallFunction(benchmark::State &state)
+{
+  Env env;
+  SetupFunction(env);
+  auto L = env.env();
+  Integer ret = 0;
+
+  for (auto _ : state) {
+    lua_getglobal(L, "add");
+    lua_pushinteger(L, ret);
+    lua_pushinteger(L, 1);
+    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+      state.SkipWithError("lua_pcall() failed");
+      break;
+    }
+    ret = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+  }
+  benchmark::DoNotOptimize(ret);
+}
+
+static void BM_HK_CallFunction(benchmark::State &state)
+{
+  Env env;
+  SetupFunction(env);
+  Integer ret = 0;
+  bool success = true;
+
+  for (auto _ : state) {
+    std::tie(ret) =
+        env.CallFunction<Integer>("add", 0, &success, true, ret, 1);
+    if (!success) {
+      state.SkipWithError("CallFunction() failed");
+      break;
+    }
+  }
+  benchmark::DoNotOptimize(ret);
+}
+
+BENCHMARK(BM_Raw_CallFunction);
+BENCHMARK(BM_HK_CallFunction);
+
+/*--------------------------------------------------*/
+/* Global variable                                  */
+/*--------------------------------------------------*/
+
+static void BM_Raw_GetGlobal(benchmark::State &state)
+{
+  Env env;
+  env.DoString("x = 1");
+  auto L = env.env();
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    lua_getglobal(L, "x");
+    int isnum;
+    sum += lua_tointegerx(L, -1, &isnum);
+    lua_pop(L, 1);
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_HK_GetGlobal(benchmark::State &state)
+{
+  Env env;
+  env.DoString("x = 1");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    Integer x;
+    env.GetGlobal("x", x);
+    sum += x;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_Raw_SetGlobal(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  Integer i = 0;
+
+  for (auto _ : state) {
+    lua_pushinteger(L, ++i);
+    lua_setglobal(L, "x");
+  }
+}
+
+static void BM_HK_SetGlobal(benchmark::State &state)
+{
+  Env env;
+  Integer i = 0;
+
+  for (auto _ : state) {
+    env.SetGlobal("x", ++i);
+  }
+}
+
+BENCHMARK(BM_Raw_GetGlobal);
+BENCHMARK(BM_HK_GetGlobal);
+BENCHMARK(BM_Raw_SetGlobal);
+BENCHMARK(BM_HK_SetGlobal);
+
+/*--------------------------------------------------*/
+/* Table field                                      */
+/*--------------------------------------------------*/
+
+static void SetupTable(Env &env)
+{
+  env.DoString("t = { x = 1, [1] = 1 }");
+}
+
+static void BM_Raw_GetStringField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto L = env.env();
+  lua_getglobal(L, "t");
+  const int t = lua_gettop(L);
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    lua_getfield(L, t, "x");
+    sum += lua_tointeger(L, -1);
+    lua_pop(L, 1);
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_HK_GetStringField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    Integer x;
+    t.GetField("x", x);
+    sum += x;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_Raw_GetGenericField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto L = env.env();
+  lua_getglobal(L, "t");
+  const int t = lua_gettop(L);
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    lua_pushinteger(L, 1);
+    lua_gettable(L, t);
+    sum += lua_tointeger(L, -1);
+    lua_pop(L, 1);
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_HK_GetGenericField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    Integer x;
+    t.GetField(Integer(1), x);
+    sum += x;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_Raw_SetStringField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto L = env.env();
+  lua_getglobal(L, "t");
+  const int t = lua_gettop(L);
+  Integer i = 0;
+
+  for (auto _ : state) {
+    lua_pushinteger(L, ++i);
+    lua_setfield(L, t, "x");
+  }
+}
+
+static void BM_HK_SetStringField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto t = env.GetGlobalTableR("t");
+  Integer i = 0;
+
+  for (auto _ : state) {
+    t.SetField("x", ++i);
+  }
+}
+
+static void BM_Raw_SetGenericField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto L = env.env();
+  lua_getglobal(L, "t");
+  const int t = lua_gettop(L);
+  Integer i = 0;
+
+  for (auto _ : state) {
+    lua_pushinteger(L, 1);
+    lua_pushinteger(L, ++i);
+    lua_settable(L, t);
+  }
+}
+
+static void BM_HK_SetGenericField(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto t = env.GetGlobalTableR("t");
+  Integer i = 0;
+
+  for (auto _ : state) {
+    t.SetField(Integer(1), ++i);
+  }
+}
+
+BENCHMARK(BM_Raw_GetStringField);
+BENCHMARK(BM_HK_GetStringField);
+BENCHMARK(BM_Raw_GetGenericField);
+BENCHMARK(BM_HK_GetGenericField);
+BENCHMARK(BM_Raw_SetStringField);
+BENCHMARK(BM_HK_SetStringField);
+BENCHMARK(BM_Raw_SetGenericField);
+BENCHMARK(BM_HK_SetGenericField);
+
+/*--------------------------------------------------*/
+/* Table::operator[]                                */
+/*--------------------------------------------------*/
+
+static void BM_Raw_IndexReadWrite(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto L = env.env();
+  lua_getglobal(L, "t");
+  const int t = lua_gettop(L);
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    lua_getfield(L, t, "x");
+    sum += lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    lua_pushinteger(L, sum & 0xff);
+    lua_setfield(L, t, "x");
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_HK_IndexReadWrite(benchmark::State &state)
+{
+  Env env;
+  SetupTable(env);
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    sum += t["x"].As<Integer>();
+    t["x"] = sum & 0xff;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+BENCHMARK(BM_Raw_IndexReadWrite);
+BENCHMARK(BM_HK_IndexReadWrite);
+
+/*--------------------------------------------------*/
+/* Variant                                          */
+/*--------------------------------------------------*/
+
+static void BM_Raw_VariantPush(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+
+  for (auto _ : state) {
+    lua_pushinteger(L, 1);
+    lua_pushnumber(L, 2.5);
+    lua_pushboolean(L, 1);
+    lua_pushstring(L, "variant");
+    lua_settop(L, 0);
+  }
+}
+
+static void BM_HK_VariantPush(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  Variant values[] = { Variant(Integer(1)), Variant(2.5), Variant(true),
+                       Variant("variant") };
+
+  for (auto _ : state) {
+    for (auto &value : values)
+      StackPush(L, value);
+    lua_settop(L, 0);
+  }
+}
+
+static void PushConvValues(lua_State *L)
+{
+  lua_pushinteger(L, 1);
+  lua_pushnumber(L, 2.5);
+  lua_pushboolean(L, 1);
+  lua_pushstring(L, "variant");
+}
+
+static void BM_Raw_VariantConv(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  PushConvValues(L);
+  size_t n = 0;
+
+  for (auto _ : state) {
+    for (int i = 1; i <= 4; ++i) {
+      switch (lua_type(L, i)) {
+        case LUA_TNUMBER:
+          n += lua_isinteger(L, i) ? (size_t)lua_tointeger(L, i)
+                                   : (size_t)lua_tonumber(L, i);
+          break;
+        case LUA_TBOOLEAN:
+          n += lua_toboolean(L, i);
+          break;
+        case LUA_TSTRING:
+          n += (size_t)lua_tostring(L, i)[0];
+          break;
+      }
+    }
+  }
+  benchmark::DoNotOptimize(n);
+}
+
+static void BM_HK_VariantConv(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  PushConvValues(L);
+  Variant var;
+
+  for (auto _ : state) {
+    for (int i = 1; i <= 4; ++i) {
+      StackConv(L, i, var);
+      benchmark::DoNotOptimize(var);
+    }
+  }
+}
+
+/*
+ * Long string(heap) conversion, StackConvBorrowed() doesn't copy
+ */
+static void BM_HK_VariantStringConv(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  StackPush(L, std::string(state.range(0), 'x'));
+  Variant var;
+
+  for (auto _ : state) {
+    StackConv(L, 1, var);
+    benchmark::DoNotOptimize(var);
+  }
+}
+
+static void BM_HK_VariantStringConvBorrowed(benchmark::State &state)
+{
+  Env env;
+  auto L = env.env();
+  StackPush(L, std::string(state.range(0), 'x'));
+  Variant var;
+
+  for (auto _ : state) {
+    StackConvBorrowed(L, 1, var);
+    benchmark::DoNotOptimize(var);
+  }
+}
+
+BENCHMARK(BM_Raw_VariantPush);
+BENCHMARK(BM_HK_VariantPush);
+BENCHMARK(BM_Raw_VariantConv);
+BENCHMARK(BM_HK_VariantConv);
+BENCHMARK(BM_HK_VariantStringConv)->Arg(8)->Arg(64)->Arg(1024);
+BENCHMARK(BM_HK_VariantStringConvBorrowed)->Arg(8)->Arg(64)->Arg(1024);
@@ -0,0 +1,110 @@
+#include "hklua/buffer.h"
+#include "hklua/env.h"
+
+#include <string>
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+/*
+ * The payload is passed to a script which reads the header and the length,
+ * like a handler dispatching by the first bytes.
+ * The argument is the size of the payload in MB.
+ */
+static char const kHandler[] =
+  "function handle(payload)\n"
+  "  local a, b = payload:byte(1, 2)\n"
+  "  return #payload + a + b\n"
+  "end\n";
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString(kHandler);
+}
+
+static void BM_Push_String(benchmark::State &state)
+{
+  Env env;
+  std::string payload((size_t)state.range(0) << 20, 'p');
+
+  for (auto _ : state) {
+    StackPush(env.env(), payload);
+    lua_pop(env.env(), 1);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+static void BM_Push_Buffer(benchmark::State &state)
+{
+  Env env;
+  std::string payload((size_t)state.range(0) << 20, 'p');
+
+  for (auto _ : state) {
+    PushBuffer(env.env(), payload);
+    lua_pop(env.env(), 1);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+static void BM_Call_String(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  std::string payload((size_t)state.range(0) << 20, 'p');
+
+  for (auto _ : state) {
+    auto ret = env.TryCallFunction<Integer>("handle", payload);
+    benchmark::DoNotOptimize(ret);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+static void BM_Call_Buffer(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  std::string payload((size_t)state.range(0) << 20, 'p');
+
+  for (auto _ : state) {
+    auto ret = env.TryCallFunction<Integer>("handle", BufferView(payload));
+    benchmark::DoNotOptimize(ret);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+/* The payload created by Lua is read by C++ */
+static void BM_Conv_String(benchmark::State &state)
+{
+  Env env;
+  std::string payload((size_t)state.range(0) << 20, 'p');
+  StackPush(env.env(), payload);
+  std::string str;
+
+  for (auto _ : state) {
+    StackConv(env.env(), -1, str);
+    benchmark::DoNotOptimize(str.data());
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+static void BM_Conv_StringView(benchmark::State &state)
+{
+  Env env;
+  std::string payload((size_t)state.range(0) << 20, 'p');
+  StackPush(env.env(), payload);
+  StringView view;
+
+  for (auto _ : state) {
+    StackConv(env.env(), -1, view);
+    benchmark::DoNotOptimize(view.data);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size());
+}
+
+BENCHMARK(BM_Push_String)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_Push_Buffer)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_Call_String)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_Call_Buffer)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_Conv_String)->RangeMultiplier(4)->Range(1, 64);
+BENCHMARK(BM_Conv_StringView)->RangeMultiplier(4)->Range(1, 64);
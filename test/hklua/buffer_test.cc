@@ -0,0 +1,118 @@
+#include "hklua/buffer.h"
+
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (buffer_test, methods) {
+  Env env;
+  env.OpenLibs();
+  std::string payload("hello\0world", 11);
+  env.SetGlobal("s", payload);
+  env.SetGlobal("b", BufferView(payload));
+
+  /* The same results as the string */
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(#b == #s and b:len() == #s)\n"
+    "assert(b:byte() == s:byte())\n"
+    "local cases = { {1}, {3, 7}, {-3}, {-20, 4}, {0, -1}, {5, 2}, {12}, {1, 100} }\n"
+    "for _, c in ipairs(cases) do\n"
+    "  assert(b:sub(c[1], c[2]):tostring() == s:sub(c[1], c[2]))\n"
+    "  assert(select('#', b:byte(c[1], c[2])) == select('#', s:byte(c[1], c[2])))\n"
+    "  assert(table.concat({ b:byte(c[1], c[2]) }, ',') ==\n"
+    "         table.concat({ s:byte(c[1], c[2]) }, ','))\n"
+    "end\n"
+    "assert(tostring(b) == s)\n"
+    "assert(b:sub(7):sub(2, 3):tostring() == 'or')\n"));
+
+  auto ret = env.TryDoString("return b.sub(1, 2)");
+  ASSERT_FALSE(ret);
+  EXPECT_NE(ret.error().message().find("buffer expected"), std::string::npos);
+
+  /* The slice borrows the bytes too */
+  env.DoString("slice = b:sub(7)");
+  StringView view;
+  env.GetGlobal("slice", view);
+  EXPECT_EQ(view.data, payload.data() + 6);
+  EXPECT_EQ(view, StringView("world"));
+}
+
+TEST (buffer_test, owned) {
+  Env env;
+  std::string payload(1 << 20, 'x');
+  auto data = payload.data();
+  PushBuffer(env.env(), std::move(payload));
+  lua_setglobal(env.env(), "b");
+
+  /* The slices keep the owner alive */
+  ASSERT_EQ(HKLUA_OK, env.DoString("slice = b:sub(-3):sub(2); b = nil"));
+  env.GcCollect();
+  env.GcCollect();
+  StringView view;
+  ASSERT_TRUE(env.GetGlobal("slice", view));
+  EXPECT_EQ(view.data, data + (1 << 20) - 2);
+  EXPECT_EQ(view, StringView("xx"));
+
+  /* The finalizer called by the script */
+  env.OpenLibs();
+  PushBuffer(env.env(), std::string(4096, 'A'));
+  lua_setglobal(env.env(), "owned");
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(getmetatable(owned) == 'buffer')\n"
+    "local s = owned:sub(1)\n"
+    "local gc = debug.getmetatable(owned).__gc\n"
+    "gc(1)\n"
+    "gc(owned)\n"
+    "gc(owned)\n"
+    "assert(#owned == 0 and owned:tostring() == '')\n"
+    "assert(#s == 0 and s:sub(2):tostring() == '')\n"));
+
+  /* Short string in the userdata */
+  PushBuffer(env.env(), std::string("abc"));
+  ASSERT_TRUE(IsBuffer(env.env(), -1));
+  ASSERT_TRUE(ToBuffer(env.env(), -1, view));
+  EXPECT_EQ(view, StringView("abc"));
+  lua_pop(env.env(), 1);
+}
+
+TEST (buffer_test, string_view) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString("s = 'a\\0b'; n = 12; t = {}"));
+
+  StringView view;
+  ASSERT_TRUE(env.GetGlobal("s", view, false));
+  EXPECT_EQ(view, StringView("a\0b", 3));
+  /* Borrowed */
+  EXPECT_EQ(view.data, lua_tostring(env.env(), -1));
+  lua_pop(env.env(), 1);
+
+  ASSERT_TRUE(env.GetGlobal("n", view));
+  EXPECT_EQ(view, StringView("12"));
+  ASSERT_FALSE(env.GetGlobal("t", view, false));
+  EXPECT_FALSE(IsBuffer(env.env(), -1));
+  lua_pop(env.env(), 1);
+
+  env.SetGlobal("c", StringView("x\0y", 3));
+  ASSERT_EQ(HKLUA_OK, env.DoString("assert(c == 'x\\0y')"));
+
+  /* The functions taking StringView read the strings and the buffers */
+  std::string payload(4096, 'p');
+  size_t size = 0;
+  char const *data = nullptr;
+  env.Register("consume", [&](StringView v) {
+    size = v.size;
+    data = v.data;
+    return BufferView(StringView(v.data, 1));
+  });
+  env.SetGlobal("payload", BufferView(payload));
+  ASSERT_EQ(HKLUA_OK, env.DoString("r = consume(payload)"));
+  EXPECT_EQ(size, payload.size());
+  EXPECT_EQ(data, payload.data());
+  ASSERT_EQ(HKLUA_OK, env.DoString("assert(#r == 1 and r:byte() == 112)"));
+  ASSERT_EQ(HKLUA_OK, env.DoString("consume('abc')"));
+  EXPECT_EQ(size, 3u);
+}
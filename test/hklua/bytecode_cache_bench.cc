@@ -0,0 +1,71 @@
+#include "hklua/bytecode_cache.h"
+#include "hklua/env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kEnvNum = 64;
+static constexpr int kScriptNum = 32;
+static constexpr int kFunctionNum = 200;
+
+/* Generate the script set only once */
+static std::vector<std::string> const &Scripts()
+{
+  static std::vector<std::string> scripts;
+  if (!scripts.empty()) return scripts;
+
+  char dir[] = "/tmp/hklua_bytecode_bench_XXXXXX";
+  if (!mkdtemp(dir)) abort();
+
+  for (int i = 0; i < kScriptNum; ++i) {
+    auto path = std::string(dir) + "/script" + std::to_string(i) + ".lua";
+    auto fp = fopen(path.c_str(), "w");
+    if (!fp) abort();
+    fprintf(fp, "local M = {}\n");
+    for (int j = 0; j < kFunctionNum; ++j) {
+      fprintf(fp,
+              "function M.f%d(a, b)\n"
+              "  local t = { x = a, y = b, name = 'f%d' }\n"
+              "  if t.x > t.y then return t.x - t.y else return t.y * 2 end\n"
+              "end\n",
+              j, j);
+    }
+    fprintf(fp, "module%d = M\n", i);
+    fclose(fp);
+    scripts.push_back(std::move(path));
+  }
+  return scripts;
+}
+
+static void BM_WarmEnvs_NoCache(benchmark::State &state)
+{
+  auto &scripts = Scripts();
+  for (auto _ : state) {
+    for (int i = 0; i < kEnvNum; ++i) {
+      Env env;
+      for (auto &script : scripts)
+        env.DoFile(script.c_str());
+    }
+  }
+}
+
+static void BM_WarmEnvs_Cache(benchmark::State &state)
+{
+  auto &scripts = Scripts();
+  BytecodeCache cache;
+  for (auto _ : state) {
+    for (int i = 0; i < kEnvNum; ++i) {
+      Env env;
+      for (auto &script : scripts)
+        env.DoFile(script.c_str(), cache);
+    }
+  }
+}
+
+BENCHMARK(BM_WarmEnvs_NoCache)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_WarmEnvs_Cache)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,106 @@
+#include "hklua/bytecode_cache.h"
+#include "hklua/env.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+static std::string MakeTempDir()
+{
+  char dir[] = "/tmp/hklua_bytecode_XXXXXX";
+  EXPECT_NE(mkdtemp(dir), nullptr);
+  return dir;
+}
+
+static void WriteFile(std::string const &path, char const *content)
+{
+  auto fp = fopen(path.c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs(content, fp);
+  fclose(fp);
+}
+
+TEST (bytecode_cache_test, load) {
+  const auto dir = MakeTempDir();
+  const auto script = dir + "/script.lua";
+  WriteFile(script, "function f(x) return x * 2 end");
+
+  BytecodeCache cache;
+  for (int i = 0; i < 4; ++i) {
+    Env env;
+    ASSERT_EQ(HKLUA_OK, env.DoFile(script.c_str(), cache));
+    int ret;
+    std::tie(ret) = env.CallFunction<int>("f", 0, nullptr, true, i);
+    EXPECT_EQ(ret, i * 2);
+  }
+  EXPECT_EQ(cache.misses(), 1u);
+  EXPECT_EQ(cache.hits(), 3u);
+  EXPECT_EQ(cache.size(), 1u);
+
+  /* Modified file must be compiled again */
+  WriteFile(script, "function f(x) return x * 3 end -- modified");
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoFile(script.c_str(), cache));
+  int ret;
+  std::tie(ret) = env.CallFunction<int>("f", 0, nullptr, true, 2);
+  EXPECT_EQ(ret, 6);
+  EXPECT_EQ(cache.misses(), 2u);
+
+  /* The error is same as luaL_loadfile() */
+  EXPECT_EQ(HKLUA_ERRFILE, env.LoadFile((dir + "/none.lua").c_str(), cache));
+  env.StackPop();
+  WriteFile(script, "function f(");
+  EXPECT_EQ(HKLUA_ERRSYNTAX, env.LoadFile(script.c_str(), cache));
+  env.StackPop();
+
+  unlink(script.c_str());
+  rmdir(dir.c_str());
+}
+
+TEST (bytecode_cache_test, persist) {
+  const auto dir = MakeTempDir();
+  const auto script = dir + "/script.lua";
+  WriteFile(script, "x = 100");
+
+  {
+    BytecodeCache cache(dir);
+    Env env;
+    ASSERT_EQ(HKLUA_OK, env.DoFile(script.c_str(), cache));
+    EXPECT_EQ(cache.misses(), 1u);
+  }
+
+  /* A new cache(e.g. in new process) reuses the persisted bytecode */
+  BytecodeCache cache(dir);
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoFile(script.c_str(), cache));
+  EXPECT_EQ(cache.misses(), 0u);
+  EXPECT_EQ(cache.hits(), 1u);
+  EXPECT_EQ(env.GetGlobalR<int>("x"), 100);
+
+  /* The corrupted bytecode is dropped and the file is compiled again */
+  auto persisted = popen(("ls " + dir + "/*.luac").c_str(), "r");
+  ASSERT_NE(persisted, nullptr);
+  char path[256] = {};
+  ASSERT_NE(fgets(path, sizeof path, persisted), nullptr);
+  pclose(persisted);
+  path[strcspn(path, "\n")] = '\0';
+  struct stat st;
+  ASSERT_EQ(0, stat(path, &st));
+  ASSERT_EQ(0, truncate(path, st.st_size - 8));
+
+  for (int i = 0; i < 2; ++i) {
+    BytecodeCache cache(dir);
+    Env env;
+    ASSERT_EQ(HKLUA_OK, env.DoFile(script.c_str(), cache));
+    EXPECT_EQ(env.GetGlobalR<int>("x"), 100);
+    /* The bytecode is persisted again */
+    EXPECT_EQ(cache.misses(), i == 0 ? 1u : 0u);
+  }
+
+  system(("rm -rf " + dir).c_str());
+}
@@ -0,0 +1,79 @@
+#include "hklua/class.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kCallNum = 1000000;
+
+struct Counter {
+  void Add(Integer n) { count += n; }
+
+  Integer count = 0;
+};
+
+/* Hand-written C glue */
+static int CounterNew(lua_State *env)
+{
+  new (lua_newuserdatauv(env, sizeof(Counter), 0)) Counter();
+  luaL_setmetatable(env, "Counter");
+  return 1;
+}
+
+static int CounterAdd(lua_State *env)
+{
+  auto counter = static_cast<Counter *>(luaL_checkudata(env, 1, "Counter"));
+  counter->Add(luaL_checkinteger(env, 2));
+  return 0;
+}
+
+static void RunLoop(benchmark::State &state, Env &env)
+{
+  env.DoString("c = Counter.new()");
+  env.LoadString("for i = 1, 1000000 do c:add(1) end");
+  auto loop = FunctionRef(env.env(), -1);
+  env.StackPop();
+
+  for (auto _ : state) {
+    loop.Call<>(0, nullptr, true);
+  }
+  state.SetItemsProcessed(state.iterations() * kCallNum);
+}
+
+static void BM_Class_HandWritten(benchmark::State &state)
+{
+  Env env;
+  luaL_newmetatable(env.env(), "Counter");
+  lua_newtable(env.env());
+  lua_pushcfunction(env.env(), &CounterAdd);
+  lua_setfield(env.env(), -2, "add");
+  lua_setfield(env.env(), -2, "__index");
+  env.StackPop();
+
+  lua_newtable(env.env());
+  lua_pushcfunction(env.env(), &CounterNew);
+  lua_setfield(env.env(), -2, "new");
+  lua_setglobal(env.env(), "Counter");
+
+  RunLoop(state, env);
+}
+
+static void BM_Class_Method(benchmark::State &state)
+{
+  Env env;
+  Class<Counter>(env, "Counter").Constructor<>().Method("add", &Counter::Add);
+  RunLoop(state, env);
+}
+
+static void BM_Class_ConstMethod(benchmark::State &state)
+{
+  Env env;
+  Class<Counter>(env, "Counter")
+      .Constructor<>()
+      .Method<decltype(&Counter::Add), &Counter::Add>("add");
+  RunLoop(state, env);
+}
+
+BENCHMARK(BM_Class_HandWritten)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Class_Method)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Class_ConstMethod)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,111 @@
+#include "hklua/class.h"
+
+#include <math.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+static int point_count = 0;
+
+struct Point {
+  Point(double x_, double y_)
+    : x(x_)
+    , y(y_)
+  {
+    ++point_count;
+  }
+
+  Point(Point const &other)
+    : x(other.x)
+    , y(other.y)
+  {
+    ++point_count;
+  }
+
+  ~Point() { --point_count; }
+
+  double Length() const { return sqrt(x * x + y * y); }
+
+  void Scale(double factor)
+  {
+    x *= factor;
+    y *= factor;
+  }
+
+  std::string GetName() const { return name; }
+  void SetName(std::string const &n) { name = n; }
+
+  std::tuple<double, double> Coord() const { return std::make_tuple(x, y); }
+
+  void Throw() { throw std::runtime_error("Point::Throw"); }
+
+  double x;
+  double y;
+  std::string name;
+};
+
+TEST (class_test, bind) {
+  {
+    Env env;
+    env.OpenLibs();
+    Class<Point>(env, "Point")
+        .Constructor<double, double>()
+        .Method("length", &Point::Length)
+        .Method<decltype(&Point::Scale), &Point::Scale>("scale")
+        .Method("coord", &Point::Coord)
+        .Method("throw", &Point::Throw)
+        .Property("x", &Point::x)
+        .Property("name", &Point::GetName, &Point::SetName)
+        .Property("readonly_name", &Point::GetName);
+    EXPECT_TRUE(env.StackEmpty());
+
+    ASSERT_EQ(HKLUA_OK, env.DoString(
+      "p = Point.new(3, 4)\n"
+      "assert(p:length() == 5)\n"
+      "p:scale(2)\n"
+      "assert(p.x == 6)\n"
+      "p.x = 0\n"
+      "local x, y = p:coord()\n"
+      "assert(x == 0 and y == 8)\n"
+      "p.name = 'origin'\n"
+      "assert(p.name == 'origin' and p.readonly_name == 'origin')\n"));
+
+    auto p = Class<Point>::To(env.env(), (env.GetGlobal("p"), -1));
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(p->y, 8);
+    EXPECT_EQ(p->name, "origin");
+    env.StackPop();
+
+    /* Errors */
+    EXPECT_EQ(HKLUA_ERRRUN, env.DoString("p:scale('x')"));
+    EXPECT_TRUE(strstr(env.ToCString(), "bad argument") != nullptr);
+    env.StackPop();
+    EXPECT_EQ(HKLUA_ERRRUN, env.DoString("p.length({})"));
+    EXPECT_TRUE(strstr(env.ToCString(), "bad self") != nullptr);
+    env.StackPop();
+    EXPECT_EQ(HKLUA_ERRRUN, env.DoString("p:throw()"));
+    EXPECT_TRUE(strstr(env.ToCString(), "Point::Throw") != nullptr);
+    env.StackPop();
+    EXPECT_EQ(HKLUA_ERRRUN, env.DoString("p.readonly_name = 'x'"));
+    env.StackPop();
+
+    /* The finalizer called by the script */
+    ASSERT_EQ(HKLUA_OK, env.DoString(
+      "assert(getmetatable(p) == 'Point')\n"
+      "local gc = debug.getmetatable(p).__gc\n"
+      "gc(1)\n"
+      "local r = Point.new(1, 2)\n"
+      "gc(r)\n"
+      "gc(r)\n"
+      "assert(not pcall(function() return r:length() end))\n"));
+
+    /* Push C++ object */
+    Class<Point>::Push(env.env(), Point(1, 1));
+    lua_setglobal(env.env(), "q");
+    ASSERT_EQ(HKLUA_OK, env.DoString("assert(q.x == 1)"));
+  }
+
+  /* All objects are destroyed by __gc */
+  EXPECT_EQ(point_count, 0);
+}
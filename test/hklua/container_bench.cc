@@ -0,0 +1,74 @@
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static std::vector<double> MakeVector(size_t n)
+{
+  std::vector<double> vec(n);
+  for (size_t i = 0; i < n; ++i)
+    vec[i] = i * 0.5;
+  return vec;
+}
+
+static void BM_Container_PushBySetField(benchmark::State &state)
+{
+  Env env;
+  const auto vec = MakeVector(state.range(0));
+
+  for (auto _ : state) {
+    auto tb = env.CreateTable();
+    for (size_t i = 0; i < vec.size(); ++i)
+      tb.SetField((Integer)i + 1, vec[i]);
+    env.StackPop();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Container_PushVector(benchmark::State &state)
+{
+  Env env;
+  const auto vec = MakeVector(state.range(0));
+
+  for (auto _ : state) {
+    env.StackPush(vec);
+    env.StackPop();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Container_ConvByGetField(benchmark::State &state)
+{
+  Env env;
+  env.StackPush(MakeVector(state.range(0)));
+  Table tb(env, env.StackGetTop());
+  std::vector<double> out;
+
+  for (auto _ : state) {
+    const auto n = tb.len();
+    out.resize(n);
+    for (Integer i = 1; i <= n; ++i)
+      tb.GetField(i, out[i - 1]);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Container_ConvVector(benchmark::State &state)
+{
+  Env env;
+  env.StackPush(MakeVector(state.range(0)));
+  std::vector<double> out;
+
+  for (auto _ : state) {
+    env.StackTo(-1, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_Container_PushBySetField)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_Container_PushVector)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_Container_ConvByGetField)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_Container_ConvVector)->Range(1 << 10, 1 << 20);
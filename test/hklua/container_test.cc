@@ -0,0 +1,101 @@
+#include "hklua/env.h"
+#include "hklua/table.h"
+
+#include <functional>
+
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+TEST (container_test, vector) {
+  Env env;
+  std::vector<double> vec{ 1.5, 2.5, 3.5 };
+  env.SetGlobal("vec", vec);
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "sum = 0 for i = 1, #vec do sum = sum + vec[i] end "
+    "nested = { {1, 2}, {3}, {} }"));
+  EXPECT_DOUBLE_EQ(env.GetGlobalR<double>("sum"), 7.5);
+
+  std::vector<double> out;
+  EXPECT_TRUE(env.GetGlobal("vec", out));
+  EXPECT_EQ(out, vec);
+
+  std::vector<std::vector<int>> nested;
+  EXPECT_TRUE(env.GetGlobal("nested", nested));
+  EXPECT_EQ(nested, (std::vector<std::vector<int>>{ { 1, 2 }, { 3 }, {} }));
+
+  std::vector<int> ints;
+  EXPECT_FALSE(env.GetGlobal("nested", ints));
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (container_test, array_and_span) {
+  Env env;
+  std::array<int, 3> arr{ { 1, 2, 3 } };
+  env.SetGlobal("arr", arr);
+
+  std::array<int, 3> arr_out;
+  EXPECT_TRUE(env.GetGlobal("arr", arr_out));
+  EXPECT_EQ(arr_out, arr);
+
+  std::array<int, 2> short_arr;
+  EXPECT_FALSE(env.GetGlobal("arr", short_arr));
+
+  float buf[] = { 0.5f, 1.5f };
+  env.SetGlobal("span", MakeSpan(buf, 2));
+  env.DoString("span[1] = 10");
+
+  float buf_out[2];
+  Span<float> span_out(buf_out);
+  EXPECT_TRUE(env.GetGlobal("span", span_out));
+  EXPECT_EQ(buf_out[0], 10.0f);
+  EXPECT_EQ(buf_out[1], 1.5f);
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (container_test, unordered_map) {
+  Env env;
+  std::unordered_map<std::string, Integer> map{ { "a", 1 }, { "b", 2 } };
+  env.SetGlobal("map", map);
+  ASSERT_EQ(HKLUA_OK, env.DoString("map.c = map.a + map.b"));
+
+  std::unordered_map<std::string, Integer> out;
+  EXPECT_TRUE(env.GetGlobal("map", out));
+  EXPECT_EQ(out.size(), 3u);
+  EXPECT_EQ(out["c"], 3);
+
+  /* The number key is not accepted by the string key */
+  env.DoString("map[1] = 1");
+  EXPECT_FALSE(env.GetGlobal("map", out));
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (container_test, string_view_key) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString("t = { 1, 2, 3, x = 4 }"));
+
+  /* The number keys are skipped instead of converted in place */
+  auto t = env.GetGlobalTableR("t");
+  TableGuard g(t);
+  int count = 0;
+  for (auto &kv : t.Pairs<StringView, Integer>()) {
+    EXPECT_EQ(kv.first, StringView("x"));
+    EXPECT_EQ(kv.second, 4);
+    ++count;
+  }
+  EXPECT_EQ(count, 1);
+
+  struct Hash {
+    size_t operator()(StringView v) const noexcept
+    {
+      return std::hash<std::string>()(std::string(v.data, v.size));
+    }
+  };
+  std::unordered_map<StringView, Integer, Hash> map;
+  EXPECT_FALSE(env.GetGlobal("t", map));
+  ASSERT_EQ(HKLUA_OK, env.DoString("t = { x = 4, y = 5 }"));
+  EXPECT_TRUE(env.GetGlobal("t", map, false));
+  EXPECT_EQ(map.size(), 2u);
+  EXPECT_EQ(map[StringView("y")], 5);
+  lua_pop(env.env(), 1);
+}
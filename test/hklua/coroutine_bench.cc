@@ -0,0 +1,77 @@
+#include "hklua/coroutine.h"
+#include "hklua/scheduler.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString("function loop() local x = 0 while true do "
+               "x = x + coroutine.yield(x) end end\n"
+               "function task() sleep(0) coroutine.yield() end");
+}
+
+/*
+ * One resume/yield round trip
+ */
+static void BM_Raw_ResumeYield(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  auto L = env.env();
+  auto co = lua_newthread(L);
+  lua_getglobal(co, "loop");
+  int nres = 0;
+
+  for (auto _ : state) {
+    lua_pop(co, nres);
+    lua_pushinteger(co, 1);
+    if (lua_resume(co, L, 1, &nres) != LUA_YIELD) {
+      state.SkipWithError("lua_resume() failed");
+      break;
+    }
+    benchmark::DoNotOptimize(lua_tointeger(co, -1));
+  }
+}
+
+static void BM_HK_ResumeYield(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  auto co = env.CreateCoroutine();
+  co.SetFunction("loop");
+
+  for (auto _ : state) {
+    if (co.Resume(Integer(1)) != HKLUA_YIELD) {
+      state.SkipWithError("Resume() failed");
+      break;
+    }
+    benchmark::DoNotOptimize(std::get<0>(co.Results<Integer>()));
+  }
+}
+
+BENCHMARK(BM_Raw_ResumeYield);
+BENCHMARK(BM_HK_ResumeYield);
+
+/*
+ * Spawn N tasks, each sleeps and yields once
+ */
+static void BM_Scheduler_Tasks(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  Scheduler sched(env);
+  const auto n = state.range(0);
+
+  for (auto _ : state) {
+    for (Integer i = 0; i < n; ++i)
+      sched.Spawn("task");
+    sched.Run();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_Scheduler_Tasks)->Arg(100)->Arg(10000);
@@ -0,0 +1,170 @@
+#include "hklua/coroutine.h"
+#include "hklua/scheduler.h"
+
+#include <math.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (coroutine_test, resume_yield) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function gen(n)\n"
+    "  for i = 1, n do coroutine.yield(i) end\n"
+    "  return 'done'\n"
+    "end\n"));
+
+  auto co = env.CreateCoroutine();
+  ASSERT_TRUE(co.SetFunction("gen"));
+
+  Integer expect = 1;
+  HKLuaError status;
+  while ((status = co.Resume(Integer(3))) == HKLUA_YIELD) {
+    bool success;
+    Integer i;
+    std::tie(i) = co.Results<Integer>(&success);
+    ASSERT_TRUE(success);
+    EXPECT_EQ(i, expect++);
+  }
+
+  EXPECT_EQ(status, HKLUA_OK);
+  EXPECT_EQ(expect, 4);
+  EXPECT_TRUE(co.IsDone());
+  EXPECT_EQ(std::get<0>(co.Results<std::string>()), "done");
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (coroutine_test, native_yield) {
+  Env env;
+  env.Register("wait", [](Integer id) { return MakeYield(id); });
+  env.Register("recv", [](Integer fd) {
+    std::string prefix("fd");
+    return MakeYieldThen(
+        [prefix, fd](std::string data) {
+          return prefix + std::to_string(fd) + ":" + data;
+        },
+        fd);
+  });
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function f() return wait(7) * 2 end\n"
+    "function g() return recv(3) end\n"));
+
+  auto co = env.CreateCoroutine();
+  ASSERT_TRUE(co.SetFunction("f"));
+  ASSERT_EQ(co.Resume(), HKLUA_YIELD);
+  EXPECT_EQ(std::get<0>(co.Results<Integer>()), 7);
+  /* The arguments of resume are the results of wait() */
+  ASSERT_EQ(co.Resume(Integer(5)), HKLUA_OK);
+  EXPECT_EQ(std::get<0>(co.Results<Integer>()), 10);
+
+  /* The continuation is called with the arguments of resume */
+  co.Reset();
+  ASSERT_TRUE(co.SetFunction("g"));
+  ASSERT_EQ(co.Resume(), HKLUA_YIELD);
+  EXPECT_EQ(std::get<0>(co.Results<Integer>()), 3);
+  ASSERT_EQ(co.Resume(std::string("data")), HKLUA_OK);
+  EXPECT_EQ(std::get<0>(co.Results<std::string>()), "fd3:data");
+}
+
+TEST (coroutine_test, error) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function bad() coroutine.yield() error('boom') end\n"
+    "function good() return 1 end\n"));
+
+  auto co = env.CreateCoroutine();
+  ASSERT_TRUE(co.SetFunction("bad"));
+  EXPECT_EQ(co.Resume(), HKLUA_YIELD);
+  EXPECT_EQ(co.Resume(), HKLUA_ERRRUN);
+  EXPECT_TRUE(co.IsDone());
+  EXPECT_TRUE(strstr(co.ErrorMessage(), "boom") != nullptr);
+
+  /* Reuse the thread */
+  co.Reset();
+  EXPECT_FALSE(co.SetFunction("not_exists"));
+  ASSERT_TRUE(co.SetFunction("good"));
+  EXPECT_EQ(co.Resume(), HKLUA_OK);
+  EXPECT_EQ(std::get<0>(co.Results<Integer>()), 1);
+}
+
+TEST (coroutine_test, scheduler) {
+  static constexpr Integer kTaskNum = 100000;
+
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "done = 0\n"
+    "function task(i)\n"
+    "  sleep(0.01)\n"
+    "  coroutine.yield()\n"
+    "  sleep(0)\n"
+    "  done = done + 1\n"
+    "  return i\n"
+    "end\n"
+    "function bad() sleep(0) error('boom') end\n"));
+
+  Scheduler sched(env);
+  Integer sum = 0;
+  size_t errors = 0;
+  sched.SetDoneCallback([&](Scheduler::TaskId id, Coroutine &co) {
+    if (co.status() != HKLUA_OK) {
+      ++errors;
+      return;
+    }
+    sum += std::get<0>(co.Results<Integer>());
+  });
+
+  EXPECT_EQ(sched.Spawn("not_exists"), Scheduler::kInvalidTask);
+  EXPECT_NE(sched.Spawn("bad"), Scheduler::kInvalidTask);
+  for (Integer i = 1; i <= kTaskNum; ++i) {
+    ASSERT_NE(sched.Spawn("task", i), Scheduler::kInvalidTask);
+  }
+  EXPECT_EQ(sched.task_num(), (size_t)kTaskNum + 1);
+
+  /* All tasks are sleeping concurrently after the first round */
+  EXPECT_EQ(sched.RunOnce(), (size_t)kTaskNum + 1);
+  EXPECT_EQ(sched.sleeping_num(), (size_t)kTaskNum + 1);
+
+  sched.Run();
+  EXPECT_EQ(sched.task_num(), 0u);
+  EXPECT_EQ(errors, 1u);
+  EXPECT_EQ(sum, kTaskNum * (kTaskNum + 1) / 2);
+  EXPECT_EQ(env.GetGlobalR<Integer>("done"), kTaskNum);
+  EXPECT_TRUE(env.StackEmpty());
+
+  /* sleep() out of the task */
+  EXPECT_NE(env.DoString("sleep(0)"), HKLUA_OK);
+}
+
+TEST (coroutine_test, scheduler_sleep_range) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function task(s) sleep(s) end\n"));
+
+  Scheduler sched(env);
+  std::string error;
+  sched.SetDoneCallback([&](Scheduler::TaskId id, Coroutine &co) {
+    if (co.status() != HKLUA_OK) error = lua_tostring(co.thread(), -1);
+  });
+
+  /* NaN is rejected */
+  sched.Spawn("task", NAN);
+  EXPECT_EQ(sched.RunOnce(), 1u);
+  EXPECT_NE(error.find("bad argument #1 to 'sleep'"), std::string::npos);
+
+  /* The timer doesn't overflow */
+  sched.Spawn("task", HUGE_VAL);
+  sched.Spawn("task", 1e300);
+  sched.Spawn("task", -HUGE_VAL);
+  EXPECT_EQ(sched.RunOnce(), 3u);
+  EXPECT_EQ(sched.sleeping_num(), 3u);
+  EXPECT_EQ(sched.RunOnce(), 1u);
+  EXPECT_EQ(sched.sleeping_num(), 2u);
+  EXPECT_EQ(sched.NextWakeup(), Scheduler::Clock::time_point::max());
+}
@@ -0,0 +1,78 @@
+#include "hklua/env_pool.h"
+
+#include <thread>
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString("function handle(x) return x + 1 end");
+}
+
+TEST (env_pool_test, lease) {
+  EnvPool pool(2, &SetupEnv, 2);
+  EXPECT_EQ(pool.size(), 2u);
+  EXPECT_EQ(pool.available(), 2u);
+
+  {
+    auto l1 = pool.Acquire();
+    auto l2 = pool.TryAcquire();
+    ASSERT_TRUE(l1);
+    ASSERT_TRUE(l2);
+    EXPECT_NE(&*l1, &*l2);
+    EXPECT_EQ(pool.available(), 0u);
+
+    auto l3 = pool.TryAcquire();
+    EXPECT_FALSE(l3);
+    l3 = pool.AcquireFor(std::chrono::milliseconds(1));
+    EXPECT_FALSE(l3);
+
+    /* Leave garbage in the stack */
+    l1->StackPush(1);
+    l1->StackPush("garbage");
+  }
+
+  EXPECT_EQ(pool.available(), 2u);
+  auto l = pool.Acquire();
+  EXPECT_TRUE(l->StackEmpty());
+
+  auto stats = pool.GetStats();
+  EXPECT_EQ(stats.checkouts, 3u);
+  EXPECT_EQ(stats.timeouts, 2u);
+  EXPECT_EQ(stats.waits, 1u);
+}
+
+TEST (env_pool_test, multithread) {
+  static constexpr int kThreadNum = 8;
+  static constexpr int kCallNum = 10000;
+
+  EnvPool pool(4, &SetupEnv);
+  std::vector<std::thread> threads;
+  std::atomic<int> failures(0);
+
+  for (int i = 0; i < kThreadNum; ++i) {
+    threads.emplace_back([&pool, &failures]() {
+      for (int j = 0; j < kCallNum; ++j) {
+        auto env = pool.Acquire();
+        bool success;
+        int ret;
+        std::tie(ret) =
+            env->CallFunction<int>("handle", 0, &success, true, j);
+        if (!success || ret != j + 1) ++failures;
+      }
+    });
+  }
+
+  for (auto &th : threads)
+    th.join();
+
+  EXPECT_EQ(failures.load(), 0);
+  EXPECT_EQ(pool.available(), pool.size());
+
+  auto stats = pool.GetStats();
+  EXPECT_EQ(stats.checkouts, uint64_t(kThreadNum * kCallNum));
+  EXPECT_LE(stats.waits, stats.checkouts);
+  EXPECT_LE(stats.LatencyPercentile(0.5), stats.LatencyPercentile(0.99));
+}
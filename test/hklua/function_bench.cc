@@ -0,0 +1,41 @@
+#include "hklua/function.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kCallNum = 1000000;
+
+static void SetupEnv(Env &env)
+{
+  env.DoString("function add(a, b) return a + b end");
+}
+
+static void BM_CallFunctionByName(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  int ret = 0;
+
+  for (auto _ : state) {
+    std::tie(ret) = env.CallFunction<int>("add", 0, nullptr, true, ret, 1);
+  }
+  benchmark::DoNotOptimize(ret);
+}
+
+static void BM_CallFunctionByRef(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  auto add = env.GetFunctionRef("add");
+  int ret = 0;
+
+  for (auto _ : state) {
+    std::tie(ret) = add.Call<int>(0, nullptr, true, ret, 1);
+  }
+  benchmark::DoNotOptimize(ret);
+}
+
+BENCHMARK(BM_CallFunctionByName)->Iterations(kCallNum);
+BENCHMARK(BM_CallFunctionByRef)->Iterations(kCallNum);
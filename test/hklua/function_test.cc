@@ -46,3 +46,36 @@ TEST (function_test, simple) {
   env.StackDump();
   CHECK_LEAKS();
 }
+
+TEST (function_test, function_ref) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString("function add(a, b) return a + b end"));
+
+  bool success;
+  auto add = env.GetFunctionRef("add", &success);
+  ASSERT_TRUE(success);
+  EXPECT_TRUE(add.IsValid());
+  EXPECT_TRUE(env.StackEmpty());
+
+  for (int i = 0; i < 100; ++i) {
+    int ret;
+    std::tie(ret) = add.Call<int>(0, &success, true, i, 1);
+    EXPECT_TRUE(success);
+    EXPECT_EQ(ret, i + 1);
+  }
+  EXPECT_TRUE(env.StackEmpty());
+
+  /* The reference is still valid even though the global is reset */
+  env.SetGlobal("add", lua_nil);
+  int ret;
+  std::tie(ret) = add.Call<int>(0, &success, true, 2, 3);
+  EXPECT_TRUE(success);
+  EXPECT_EQ(ret, 5);
+
+  auto none = env.GetFunctionRef("add", &success);
+  EXPECT_FALSE(success);
+  EXPECT_FALSE(none.IsValid());
+  none.Call<int>(0, &success, true);
+  EXPECT_FALSE(success);
+  EXPECT_TRUE(env.StackEmpty());
+}
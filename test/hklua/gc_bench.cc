@@ -0,0 +1,133 @@
+#include "hklua/gc.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace hklua;
+using namespace std::chrono;
+
+/*
+ * A frame allocates short-lived garbage while a large heap is live,
+ * so a full collection(or a long step) is expensive.
+ * The counters are the p99 and the max of the frame time(including
+ * the GC work in it).
+ */
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString(
+    "live = {}\n"
+    "for i = 1, 200000 do live[i] = { id = i, name = 'live' .. i } end\n"
+    "function frame()\n"
+    "  for i = 1, 500 do local t = { i, tostring(i) } end\n"
+    "end\n");
+}
+
+static void ReportFrames(benchmark::State &state,
+                         std::vector<nanoseconds> &frames)
+{
+  if (frames.empty()) return;
+  std::sort(frames.begin(), frames.end());
+  auto p99 = frames[(frames.size() * 99 - 1) / 100];
+  state.counters["p99_us"] = p99.count() / 1000.0;
+  state.counters["max_us"] = frames.back().count() / 1000.0;
+}
+
+template <typename F>
+static void RunFrames(benchmark::State &state, Env &env, F after_frame)
+{
+  std::vector<nanoseconds> frames;
+  frames.reserve(1 << 16);
+  for (auto _ : state) {
+    const auto start = steady_clock::now();
+    env.CallFunction<>("frame", 0, nullptr, true);
+    after_frame();
+    frames.push_back(duration_cast<nanoseconds>(steady_clock::now() - start));
+  }
+  ReportFrames(state, frames);
+}
+
+static void BM_Frame_AutoIncremental(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.GcIncrementalModeOn();
+  RunFrames(state, env, [] {});
+}
+
+static void BM_Frame_AutoGenerational(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.GcGenerationalModeOn();
+  RunFrames(state, env, [] {});
+}
+
+/*
+ * The arguments are the target of p99 pause in microseconds, and
+ * the initial mode(1 is generational)
+ */
+static void BM_Frame_Controller(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  GcController gc(env, microseconds(state.range(0)),
+                  state.range(1) ? GcController::kGenerational
+                                 : GcController::kIncremental);
+  RunFrames(state, env, [&gc] { gc.Step(); });
+  state.counters["step_p99_us"] = gc.p99().count() / 1000.0;
+  state.counters["step_size"] = gc.step_size();
+  state.counters["pause"] = gc.pause();
+  state.counters["generational"] = gc.mode() == GcController::kGenerational;
+}
+
+/*
+ * The frames are the requests, and the collection is done in the idle
+ * gap after each one(not counted in the frame time).
+ * The argument is the budget of the gap in microseconds.
+ */
+static void BM_Frame_IdleGc(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  IdleGc gc(env, microseconds(state.range(0)), 64 * 1024 * 1024);
+  std::vector<nanoseconds> frames;
+  frames.reserve(1 << 16);
+  nanoseconds idle(0);
+  for (auto _ : state) {
+    auto start = steady_clock::now();
+    env.CallFunction<>("frame", 0, nullptr, true);
+    const auto end = steady_clock::now();
+    frames.push_back(duration_cast<nanoseconds>(end - start));
+
+    gc.OnIdle();
+    if (gc.overdue()) gc.Force();
+    idle += duration_cast<nanoseconds>(steady_clock::now() - end);
+  }
+  ReportFrames(state, frames);
+  state.counters["idle_us"] = idle.count() / 1000.0 / frames.size();
+  state.counters["cycles"] = gc.cycle_num();
+}
+
+/* The overhead of the accounting */
+static void BM_GcStatistics(benchmark::State &state)
+{
+  Env env("stats", std::unique_ptr<Allocator>(new SystemAllocator()));
+  for (auto _ : state) {
+    auto stats = env.GcStatistics();
+    benchmark::DoNotOptimize(stats);
+  }
+}
+
+BENCHMARK(BM_Frame_AutoIncremental);
+BENCHMARK(BM_Frame_AutoGenerational);
+BENCHMARK(BM_Frame_Controller)
+  ->Args({ 100, 1 })
+  ->Args({ 1000, 1 })
+  ->Args({ 1000, 0 })
+  ->Args({ 5000, 0 });
+BENCHMARK(BM_Frame_IdleGc)->Arg(100)->Arg(1000);
+BENCHMARK(BM_GcStatistics);
@@ -0,0 +1,276 @@
+#include "hklua/gc.h"
+#include "hklua/env.h"
+#include "hklua/scheduler.h"
+
+#include <gtest/gtest.h>
+
+using namespace hklua;
+using namespace std::chrono;
+
+/* A full cycle takes many basic steps */
+static char const kLive[] =
+  "live = {}\n"
+  "for i = 1, 50000 do live[i] = { i } end\n";
+
+static char const kGarbage[] =
+  "for i = 1, 2000 do\n"
+  "  local t = { name = 'item' .. i, value = i }\n"
+  "end\n";
+
+TEST (gc_test, statistics) {
+  Env env("gc", std::unique_ptr<Allocator>(new SystemAllocator()));
+  env.OpenLibs();
+
+  EXPECT_GT(env.GcCount(), 0);
+  auto bytes = env.GcCountBytes();
+  EXPECT_GE(bytes, (size_t)env.GcCount() * 1024);
+  EXPECT_LT(bytes, (size_t)env.GcCount() * 1024 + 1024);
+
+  env.GcStop();
+  auto cycles = env.GcStatistics().cycles;
+  ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  auto stats = env.GcStatistics();
+  EXPECT_EQ(stats.cycles, cycles);
+  EXPECT_GT(stats.allocated_bytes, 2000u * 32);
+  EXPECT_EQ(stats.heap_bytes, env.GcCountBytes());
+
+  env.GcCollect();
+  auto after = env.GcStatistics();
+  EXPECT_GT(after.cycles, cycles);
+  EXPECT_EQ(after.collect_num, 1u);
+  EXPECT_GT(after.collect_time.count(), 0);
+  EXPECT_EQ(after.max_collect_time, after.collect_time);
+  EXPECT_LT(after.allocated_bytes, stats.allocated_bytes);
+  EXPECT_LT(after.heap_bytes, stats.heap_bytes);
+}
+
+TEST (gc_test, automatic_cycles) {
+  Env env;
+  env.OpenLibs();
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  }
+
+  auto stats = env.GcStatistics();
+  EXPECT_GT(stats.cycles, 0u);
+  EXPECT_EQ(stats.collect_num, 0u);
+  /* No allocator */
+  EXPECT_EQ(stats.allocated_bytes, 0u);
+
+  env.GcGenerationalModeOn();
+  auto cycles = env.GcStatistics().cycles;
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  }
+  EXPECT_GT(env.GcStatistics().cycles, cycles);
+}
+
+TEST (gc_test, step) {
+  Env env;
+  env.OpenLibs();
+  env.GcStop();
+  ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+
+  int steps = 0;
+  while (!env.GcStep(16)) ++steps;
+  ++steps;
+
+  auto stats = env.GcStatistics();
+  EXPECT_EQ(stats.step_num, (uint64_t)steps);
+  EXPECT_GE(stats.cycles, 1u);
+  EXPECT_GE(stats.step_time, stats.max_step_time);
+  EXPECT_FALSE(env.GcIsRunning());
+
+  /* The stats is moved with the Env */
+  Env moved(std::move(env));
+  EXPECT_EQ(moved.GcStatistics().step_num, (uint64_t)steps);
+}
+
+TEST (gc_test, controller_generational) {
+  Env env;
+  env.OpenLibs();
+  {
+    GcController gc(env, seconds(10));
+    EXPECT_FALSE(env.GcIsRunning());
+    EXPECT_EQ(gc.mode(), GcController::kGenerational);
+
+    size_t max_heap = 0;
+    int collections = 0;
+    for (int i = 0; i < 2 * GcController::kAdaptInterval; ++i) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+      if (gc.Step()) ++collections;
+      max_heap = std::max(max_heap, env.GcCountBytes());
+    }
+    EXPECT_EQ(gc.mode(), GcController::kGenerational);
+    EXPECT_EQ(gc.step_num(), 2u * GcController::kAdaptInterval);
+    EXPECT_GT(collections, 0);
+    EXPECT_GT(gc.max_pause().count(), 0);
+    /* The garbage is collected by the steps */
+    EXPECT_LT(max_heap, 4u * 1024 * 1024);
+  }
+  EXPECT_TRUE(env.GcIsRunning());
+}
+
+TEST (gc_test, controller_trial) {
+  Env env;
+  env.OpenLibs();
+  /* Any step misses the target */
+  GcController gc(env, nanoseconds(1));
+  for (int i = 0; i < GcController::kWindow; ++i) {
+    ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+    gc.Step();
+  }
+  EXPECT_EQ(gc.mode(), GcController::kIncremental);
+
+  /* Back to generational mode if the p99 is worse, then no more switch */
+  for (int i = 0; i < GcController::kWindow; ++i) gc.Step();
+  auto mode = gc.mode();
+  for (int i = 0; i < 2 * GcController::kWindow; ++i) gc.Step();
+  EXPECT_EQ(gc.mode(), mode);
+}
+
+TEST (gc_test, controller_incremental) {
+  Env env;
+  env.OpenLibs();
+  env.GcStop();
+  {
+    GcController gc(env, nanoseconds(1), GcController::kIncremental);
+    EXPECT_EQ(gc.step_size(), GcController::kDefaultStepSize);
+    EXPECT_EQ(gc.pause(), GcController::kMaxPause);
+
+    size_t max_heap = 0;
+    for (int i = 0; i < 10 * GcController::kAdaptInterval; ++i) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+      gc.Step();
+      max_heap = std::max(max_heap, env.GcCountBytes());
+    }
+    EXPECT_EQ(gc.mode(), GcController::kIncremental);
+    EXPECT_EQ(gc.step_size(), GcController::kMinStepSize);
+    EXPECT_EQ(gc.pause(), GcController::kMinPause);
+    /* Even a basic step per Step() keeps up with the garbage */
+    EXPECT_LT(max_heap, 16u * 1024 * 1024);
+  }
+  EXPECT_FALSE(env.GcIsRunning());
+
+  {
+    /* Any step meets the target */
+    GcController gc(env, seconds(10), GcController::kIncremental);
+    for (int i = 0; i < 2 * GcController::kAdaptInterval; ++i) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+      EXPECT_FALSE(env.GcIsRunning());
+      gc.Step();
+    }
+    EXPECT_EQ(gc.step_size(), GcController::kDefaultStepSize + 2);
+    EXPECT_EQ(gc.pause(), GcController::kMaxPause);
+  }
+}
+
+TEST (gc_test, step_for) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(env.DoString(kLive), HKLUA_OK);
+  env.GcStop();
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  }
+
+  /* A basic step is done at least */
+  auto cycles = env.GcStatistics().cycles;
+  EXPECT_FALSE(env.GcStepFor(nanoseconds(1)));
+  EXPECT_EQ(env.GcStatistics().step_num, 1u);
+
+  int calls = 1;
+  while (!env.GcStepFor(microseconds(100))) ++calls;
+  EXPECT_GT(calls, 1);
+  EXPECT_EQ(env.GcStatistics().cycles, cycles + 1);
+  EXPECT_FALSE(env.GcIsRunning());
+
+  /* A large budget finishes the cycle in a call */
+  ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  EXPECT_TRUE(env.GcStepFor(seconds(10)));
+
+  /* A minor collection in generational mode */
+  env.GcGenerationalModeOn();
+  env.GcStop();
+  ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+  EXPECT_TRUE(env.GcStepFor(seconds(10)));
+}
+
+TEST (gc_test, idle_gc) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(env.DoString(kLive), HKLUA_OK);
+  env.GcGenerationalModeOn();
+  {
+    IdleGc gc(env, microseconds(100), 1024 * 1024);
+    EXPECT_FALSE(env.GcIsRunning());
+    EXPECT_EQ(gc.debt(), 0u);
+    EXPECT_FALSE(gc.pending());
+    EXPECT_EQ(gc.PollTimeout(1000), 1000);
+    EXPECT_FALSE(gc.OnIdle());
+
+    /* No collection in the busy time */
+    auto cycles = env.GcStatistics().cycles;
+    while (!gc.overdue()) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+    }
+    EXPECT_EQ(env.GcStatistics().cycles, cycles);
+    EXPECT_GT(gc.debt(), gc.max_debt());
+    EXPECT_TRUE(gc.pending());
+    EXPECT_EQ(gc.PollTimeout(1000), 0);
+
+    /* The cycle is split into the idle gaps */
+    int gaps = 1;
+    while (!gc.OnIdle()) {
+      ASSERT_TRUE(gc.pending());
+      ++gaps;
+    }
+    EXPECT_GT(gaps, 1);
+    EXPECT_EQ(gc.cycle_num(), 1u);
+    EXPECT_EQ(env.GcStatistics().cycles, cycles + 1);
+    EXPECT_FALSE(gc.pending());
+    EXPECT_FALSE(gc.overdue());
+
+    /* Force() finishes the running cycle */
+    while (!gc.pending()) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+    }
+    EXPECT_FALSE(gc.OnIdle(nanoseconds(1)));
+    gc.Force();
+    EXPECT_EQ(gc.cycle_num(), 2u);
+    EXPECT_EQ(env.GcStatistics().cycles, cycles + 2);
+    EXPECT_EQ(gc.debt(), 0u);
+
+    /* The running cycle is finished by GcCollect() */
+    while (!gc.pending()) {
+      ASSERT_EQ(env.DoString(kGarbage), HKLUA_OK);
+    }
+    EXPECT_FALSE(gc.OnIdle(nanoseconds(1)));
+    env.GcCollect();
+    EXPECT_FALSE(gc.OnIdle());
+    EXPECT_EQ(gc.cycle_num(), 3u);
+    EXPECT_FALSE(gc.pending());
+  }
+  EXPECT_TRUE(env.GcIsRunning());
+  EXPECT_EQ(lua_gc(env.env(), LUA_GCGEN, 0, 0), LUA_GCGEN);
+}
+
+TEST (gc_test, scheduler_idle_gc) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(env.DoString(
+    "function task()\n"
+    "  for i = 1, 20 do\n"
+    "    for j = 1, 1000 do local t = { j, tostring(j) } end\n"
+    "    sleep(0.005)\n"
+    "  end\n"
+    "end\n"), HKLUA_OK);
+
+  IdleGc gc(env, microseconds(100));
+  Scheduler sched(env);
+  sched.SetIdleGc(&gc);
+  sched.Spawn("task");
+  sched.Run();
+  EXPECT_GT(gc.cycle_num(), 0u);
+  EXPECT_FALSE(env.GcIsRunning());
+}
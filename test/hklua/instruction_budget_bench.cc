@@ -0,0 +1,116 @@
+#include "hklua/instruction_budget.h"
+#include "hklua/scheduler.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+/* The instructions of each iteration is about 4 * kLoopNum */
+static constexpr Integer kLoopNum = 100000;
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString("function sum(n) local s = 0 for i = 1, n do s = s + i end "
+               "return s end\n"
+               "function spin() while true do end end");
+}
+
+/*
+ * The baseline, the budget has been destroyed before the loop,
+ * so the hook must be free
+ */
+static void BM_Loop_NoHook(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  { InstructionBudget budget(env, 1000); }
+
+  for (auto _ : state) {
+    bool success;
+    auto s = env.CallFunction<Integer>("sum", 0, &success, true, kLoopNum);
+    benchmark::DoNotOptimize(s);
+  }
+}
+
+/*
+ * The count hook is armed, the argument is the granularity
+ */
+static void BM_Loop_Budget(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  InstructionBudget budget(env, UINT64_MAX, (int)state.range(0));
+
+  for (auto _ : state) {
+    bool success;
+    auto s = env.CallFunction<Integer>("sum", 0, &success, true, kLoopNum);
+    benchmark::DoNotOptimize(s);
+  }
+}
+
+/*
+ * The cost of interrupting the runaway script
+ */
+static void BM_Budget_Exceeded(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  InstructionBudget budget(env, (uint64_t)state.range(0));
+
+  for (auto _ : state) {
+    budget.Reset();
+    if (env.DoString("spin()") != HKLUA_ERRRUN) {
+      state.SkipWithError("The budget is not exceeded");
+      break;
+    }
+    env.StackPop();
+  }
+}
+
+/*
+ * Run the loop in a coroutine, the argument is the time slice,
+ * 0 indicates no preemption
+ */
+static void BM_Loop_TimeSlice(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  auto co = env.CreateCoroutine();
+  co.SetTimeSlice((int)state.range(0));
+
+  for (auto _ : state) {
+    co.Reset();
+    co.SetFunction("sum");
+    auto status = co.Resume(kLoopNum);
+    while (status == HKLUA_YIELD)
+      status = co.Resume();
+    benchmark::DoNotOptimize(co.nresults());
+  }
+}
+
+/*
+ * Round-robin 64 tasks, each runs the loop
+ */
+static void BM_Scheduler_TimeSlice(benchmark::State &state)
+{
+  static constexpr int kTaskNum = 64;
+  Env env;
+  SetupEnv(env);
+  Scheduler sched(env, nullptr);
+  sched.SetTimeSlice((int)state.range(0));
+
+  for (auto _ : state) {
+    for (int i = 0; i < kTaskNum; ++i)
+      sched.Spawn("sum", kLoopNum);
+    sched.Run();
+  }
+  state.SetItemsProcessed(state.iterations() * kTaskNum);
+}
+
+BENCHMARK(BM_Loop_NoHook);
+BENCHMARK(BM_Loop_Budget)->Arg(100)->Arg(1000)->Arg(10000);
+BENCHMARK(BM_Budget_Exceeded)->Arg(10000)->Arg(1000000);
+BENCHMARK(BM_Loop_TimeSlice)->Arg(0)->Arg(1000)->Arg(10000);
+BENCHMARK(BM_Scheduler_TimeSlice)->Arg(0)->Arg(1000)->Arg(10000);
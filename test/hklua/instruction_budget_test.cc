@@ -0,0 +1,244 @@
+#include "hklua/instruction_budget.h"
+#include "hklua/profiler.h"
+#include "hklua/scheduler.h"
+
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (instruction_budget_test, limit) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function spin() while true do end end\n"
+    "function sum(n) local s = 0 for i = 1, n do s = s + i end return s end\n"));
+
+  {
+    InstructionBudget budget(env, 100000);
+    EXPECT_TRUE(lua_gethook(env.env()) != nullptr);
+
+    bool success;
+    auto s = std::get<0>(
+        env.CallFunction<Integer>("sum", 0, &success, true, Integer(100)));
+    EXPECT_TRUE(success);
+    EXPECT_EQ(s, 5050);
+    EXPECT_FALSE(budget.exceeded());
+
+    EXPECT_EQ(env.DoString("spin()"), HKLUA_ERRRUN);
+    EXPECT_TRUE(budget.exceeded());
+    EXPECT_GT(budget.used(), budget.limit());
+    EXPECT_TRUE(strstr(env.ToCString(), "instruction limit exceeded"));
+    env.StackPop();
+
+    budget.Reset();
+    EXPECT_FALSE(budget.exceeded());
+    EXPECT_EQ(budget.used(), 0u);
+
+    /* The error caught by pcall() is raised again in the caller */
+    EXPECT_EQ(env.DoString("while true do pcall(spin) end"), HKLUA_ERRRUN);
+    EXPECT_TRUE(budget.exceeded());
+    env.StackPop();
+    budget.Reset();
+    EXPECT_EQ(HKLUA_OK, env.DoString("sum(100)"));
+  }
+
+  /* The hook is removed out of the scope */
+  EXPECT_TRUE(lua_gethook(env.env()) == nullptr);
+  EXPECT_EQ(HKLUA_OK, env.DoString("sum(1000000)"));
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (instruction_budget_test, nested) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString("function spin() while true do end end"));
+
+  InstructionBudget outer(env, 1000000000);
+  {
+    InstructionBudget inner(env, 10000, 100);
+    EXPECT_EQ(env.DoString("spin()"), HKLUA_ERRRUN);
+    env.StackPop();
+    EXPECT_TRUE(inner.exceeded());
+    EXPECT_FALSE(outer.exceeded());
+  }
+
+  /* The outer budget is restored */
+  EXPECT_EQ(HKLUA_OK, env.DoString("for i = 1, 10000 do end"));
+  EXPECT_GT(outer.used(), 0u);
+}
+
+TEST (instruction_budget_test, coroutine_inherit) {
+  Env env;
+  env.OpenLibs();
+
+  {
+    InstructionBudget budget(env, 10000);
+    /* The coroutine created in Lua inherits the hook */
+    EXPECT_EQ(env.DoString(
+      "local co = coroutine.wrap(function() while true do end end)\n"
+      "co()\n"), HKLUA_ERRRUN);
+    env.StackPop();
+    EXPECT_TRUE(budget.exceeded());
+    /* Raised in every instruction until reset */
+    EXPECT_EQ(env.DoString("local x = 1"), HKLUA_ERRRUN);
+    env.StackPop();
+
+    budget.Reset();
+    ASSERT_EQ(HKLUA_OK, env.DoString(
+      "leaked = coroutine.create(function() for i = 1, 100000 do end end)"));
+  }
+
+  /* The coroutine outliving the budget removes the inherited hook */
+  EXPECT_EQ(HKLUA_OK, env.DoString("assert(coroutine.resume(leaked))"));
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (instruction_budget_test, time_slice) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function count(n)\n"
+    "  local x = 0\n"
+    "  for i = 1, n do x = x + 1 end\n"
+    "  coroutine.yield()\n"
+    "  return x\n"
+    "end\n"
+    "function nested()\n"
+    "  local co = coroutine.create(function()\n"
+    "    for i = 1, 100000 do end\n"
+    "    return 'inner'\n"
+    "  end)\n"
+    "  local ok, v = coroutine.resume(co)\n"
+    "  return v\n"
+    "end\n"));
+
+  auto co = env.CreateCoroutine();
+  co.SetTimeSlice(1000);
+  EXPECT_EQ(co.time_slice(), 1000);
+  ASSERT_TRUE(co.SetFunction("count"));
+
+  int preempted = 0;
+  HKLuaError status = co.Resume(Integer(100000));
+  while (status == HKLUA_YIELD && co.IsPreempted()) {
+    ++preempted;
+    status = co.Resume();
+  }
+  EXPECT_GT(preempted, 10);
+
+  /* coroutine.yield() is not preemption */
+  ASSERT_EQ(status, HKLUA_YIELD);
+  EXPECT_FALSE(co.IsPreempted());
+  ASSERT_EQ(co.Resume(), HKLUA_OK);
+  EXPECT_EQ(std::get<0>(co.Results<Integer>()), 100000);
+
+  /* The coroutine created by the body is not preempted */
+  co.Reset();
+  ASSERT_TRUE(co.SetFunction("nested"));
+  while ((status = co.Resume()) == HKLUA_YIELD) {
+    EXPECT_TRUE(co.IsPreempted());
+  }
+  ASSERT_EQ(status, HKLUA_OK);
+  EXPECT_EQ(std::get<0>(co.Results<std::string>()), "inner");
+
+  co.SetTimeSlice(0);
+  EXPECT_TRUE(lua_gethook(co.thread()) == nullptr);
+  co.Reset();
+  ASSERT_TRUE(co.SetFunction("count"));
+  EXPECT_EQ(co.Resume(Integer(100000)), HKLUA_YIELD);
+  EXPECT_FALSE(co.IsPreempted());
+}
+
+TEST (instruction_budget_test, round_robin) {
+  static constexpr int kTaskNum = 8;
+
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "counters = {}\n"
+    "function spin(id)\n"
+    "  counters[id] = 0\n"
+    "  while true do counters[id] = counters[id] + 1 end\n"
+    "end\n"));
+
+  {
+    Scheduler sched(env, nullptr);
+    sched.SetTimeSlice(1000);
+    for (Integer i = 1; i <= kTaskNum; ++i) {
+      ASSERT_NE(sched.Spawn("spin", i), Scheduler::kInvalidTask);
+    }
+
+    /* The tasks never yield but none starves */
+    for (int i = 0; i < 100; ++i) {
+      EXPECT_EQ(sched.RunOnce(), (size_t)kTaskNum);
+    }
+    EXPECT_EQ(sched.preemption_num(), 100u * kTaskNum);
+  }
+
+  Integer min = -1, max = 0;
+  for (Integer i = 1; i <= kTaskNum; ++i) {
+    Integer c = 0;
+    ASSERT_EQ(HKLUA_OK, env.DoString(
+        ("return counters[" + std::to_string(i) + "]").c_str()));
+    ASSERT_TRUE(env.StackTo(-1, c));
+    env.StackPop();
+    if (min < 0 || c < min) min = c;
+    if (c > max) max = c;
+  }
+  EXPECT_GT(min, 0);
+  /* Every task runs the same instructions in each round */
+  EXPECT_LE(max - min, 1);
+}
+
+TEST (instruction_budget_test, with_time_slice) {
+  static constexpr int kTaskNum = 8;
+
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function spin() while true do end end\n"
+    "function noop() end\n"));
+
+  Scheduler sched(env, nullptr);
+  size_t errors = 0;
+  sched.SetDoneCallback([&](Scheduler::TaskId id, Coroutine &co) {
+    if (co.status() != HKLUA_OK &&
+        strstr(lua_tostring(co.thread(), -1), "instruction limit exceeded"))
+      ++errors;
+  });
+
+  /* The threads of the free list are created before the budget */
+  sched.SetTimeSlice(1000);
+  for (int i = 0; i < kTaskNum; ++i) {
+    ASSERT_NE(sched.Spawn("noop"), Scheduler::kInvalidTask);
+  }
+  sched.RunOnce();
+  ASSERT_EQ(sched.task_num(), 0u);
+
+  InstructionBudget budget(env, 1000000);
+  /* The profiler doesn't turn off the budget */
+  Profiler profiler(env, 1000);
+  ASSERT_TRUE(profiler.Start());
+  for (int i = 0; i < kTaskNum; ++i) {
+    ASSERT_NE(sched.Spawn("spin"), Scheduler::kInvalidTask);
+  }
+
+  /* The preempted tasks run out of the budget */
+  for (int i = 0; i < 10000 && sched.task_num() != 0; ++i) {
+    sched.RunOnce();
+  }
+  EXPECT_EQ(sched.task_num(), 0u);
+  EXPECT_EQ(errors, (size_t)kTaskNum);
+  EXPECT_TRUE(budget.exceeded());
+  EXPECT_GT(sched.preemption_num(), 0u);
+  EXPECT_GT(profiler.sample_num(), 0u);
+
+  /* The budget is kept after the profiler is stopped */
+  profiler.Stop();
+  EXPECT_EQ(env.DoString("spin()"), HKLUA_ERRRUN);
+  env.StackPop();
+  budget.Reset();
+  EXPECT_EQ(HKLUA_OK, env.DoString("noop()"));
+}
@@ -0,0 +1,161 @@
+#include "hklua/key.h"
+#include "hklua/env.h"
+
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kLookupNum = 1000000;
+
+static void SetupPoint(Env &env)
+{
+  env.DoString("point = { x = 1, y = 2, z = 3, name = 'p' }");
+}
+
+static void BM_Key_GetFieldString(benchmark::State &state)
+{
+  Env env;
+  SetupPoint(env);
+  auto point = env.GetGlobalTableR("point");
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (int i = 0; i < kLookupNum; ++i) {
+      Integer value;
+      point.GetField("x", value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+/* The key is not at a fixed address, e.g. built at runtime */
+static void BM_Key_GetFieldStdString(benchmark::State &state)
+{
+  Env env;
+  SetupPoint(env);
+  auto point = env.GetGlobalTableR("point");
+  std::string const key = "x";
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (int i = 0; i < kLookupNum; ++i) {
+      Integer value;
+      point.GetField(key, value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+static void BM_Key_GetFieldKey(benchmark::State &state)
+{
+  Env env;
+  SetupPoint(env);
+  auto point = env.GetGlobalTableR("point");
+  auto key = env.CreateKey("x");
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (int i = 0; i < kLookupNum; ++i) {
+      Integer value;
+      point.GetField(key, value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+/*
+ * The API caches the strings by the address of C string, but the cache
+ * is small, the keys out of it are hashed and looked up on every call.
+ */
+static constexpr int kKeyNum = 1024;
+
+static void SetupRecord(Env &env)
+{
+  env.DoString("record = {}\n"
+               "for i = 1, 1024 do record['field' .. i] = i end\n");
+}
+
+static void BM_Key_GetFieldStringMany(benchmark::State &state)
+{
+  Env env;
+  SetupRecord(env);
+  auto record = env.GetGlobalTableR("record");
+  std::vector<std::string> keys;
+  for (int i = 1; i <= kKeyNum; ++i)
+    keys.push_back("field" + std::to_string(i));
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (int i = 0; i < kLookupNum; ++i) {
+      Integer value;
+      record.GetField(keys[i % kKeyNum], value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+static void BM_Key_GetFieldKeyMany(benchmark::State &state)
+{
+  Env env;
+  SetupRecord(env);
+  auto record = env.GetGlobalTableR("record");
+  std::vector<Key> keys;
+  for (int i = 1; i <= kKeyNum; ++i)
+    keys.push_back(env.CreateKey("field" + std::to_string(i)));
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (int i = 0; i < kLookupNum; ++i) {
+      Integer value;
+      record.GetField(keys[i % kKeyNum], value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+static void BM_Key_SetFieldString(benchmark::State &state)
+{
+  Env env;
+  SetupPoint(env);
+  auto point = env.GetGlobalTableR("point");
+
+  for (auto _ : state) {
+    for (int i = 0; i < kLookupNum; ++i)
+      point.SetField("x", Integer(i));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+static void BM_Key_SetFieldKey(benchmark::State &state)
+{
+  Env env;
+  SetupPoint(env);
+  auto point = env.GetGlobalTableR("point");
+  auto key = env.CreateKey("x");
+
+  for (auto _ : state) {
+    for (int i = 0; i < kLookupNum; ++i)
+      point.SetField(key, Integer(i));
+  }
+  state.SetItemsProcessed(state.iterations() * kLookupNum);
+}
+
+BENCHMARK(BM_Key_GetFieldString)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_GetFieldStdString)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_GetFieldKey)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_GetFieldStringMany)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_GetFieldKeyMany)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_SetFieldString)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Key_SetFieldKey)->Unit(benchmark::kMillisecond);
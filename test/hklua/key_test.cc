@@ -0,0 +1,93 @@
+#include "hklua/key.h"
+
+#include <string.h>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (key_test, field) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString("t = { x = 1, name = 'point', sub = { y = 2 } }"));
+
+  auto x = env.CreateKey("x");
+  auto name = env.CreateKey(std::string("name"));
+  auto sub = env.CreateKey("sub");
+  ASSERT_TRUE(x.IsValid());
+  EXPECT_STREQ(x.name(), "x");
+  EXPECT_EQ(name.size(), 4);
+
+  auto t = env.GetGlobalTableR("t");
+  {
+    TableGuard tg(t);
+    Integer value = 0;
+    ASSERT_TRUE(t.GetField(x, value));
+    EXPECT_EQ(value, 1);
+
+    std::string str;
+    ASSERT_TRUE(t.GetField(name, str));
+    EXPECT_EQ(str, "point");
+
+    t.SetField(x, Integer(3));
+    ASSERT_TRUE(t.GetField("x", value));
+    EXPECT_EQ(value, 3);
+
+    auto s = t.GetFieldTableR(sub);
+    {
+      TableGuard sg(s);
+      EXPECT_EQ(s.GetFieldR<Integer>("y"), 2);
+    }
+
+    auto r = t.TryGetField<Integer>(name);
+    ASSERT_FALSE(r);
+    EXPECT_EQ(r.code(), HKLUA_ERRTYPE);
+    EXPECT_NE(r.error().message().find("name"), std::string::npos);
+  }
+  EXPECT_EQ(env.StackSize(), 0);
+}
+
+TEST (key_test, raw) {
+  Env env;
+  env.OpenLibs();
+  /* The metamethods are not called */
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "t = setmetatable({}, { __index = function() return 1 end })"));
+
+  auto x = env.CreateKey("x");
+  auto t = env.GetGlobalTableR("t");
+  TableGuard tg(t);
+  Integer value = 0;
+  EXPECT_FALSE(t.GetField(x, value));
+  EXPECT_TRUE(t.GetField("x", value));
+  EXPECT_EQ(value, 1);
+}
+
+TEST (key_test, move) {
+  Env env;
+  auto x = env.CreateKey("x");
+  auto ref = x.ref();
+  Key y(std::move(x));
+  EXPECT_FALSE(x.IsValid());
+  EXPECT_EQ(y.ref(), ref);
+
+  /* The key can be pushed as any value */
+  env.SetGlobal("k", y);
+  std::string k;
+  ASSERT_TRUE(env.GetGlobal("k", k));
+  EXPECT_EQ(k, "x");
+}
+
+TEST (key_test, relative_index) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString("t = { x = 1 }"));
+  auto x = env.CreateKey("x");
+  env.GetGlobalTableR("t");
+
+  Table t(env, -1);
+  t.SetField(x, Integer(2));
+  Integer value = 0;
+  ASSERT_TRUE(t.GetField(x, value));
+  EXPECT_EQ(value, 2);
+  lua_pop(env.env(), 1);
+}
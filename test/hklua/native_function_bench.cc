@@ -0,0 +1,57 @@
+#include "hklua/native_function.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kCallNum = 1000000;
+
+/* Hand-written C glue */
+static int AddHandWritten(lua_State *env)
+{
+  const auto a = luaL_checkinteger(env, 1);
+  const auto b = luaL_checkinteger(env, 2);
+  lua_pushinteger(env, a + b);
+  return 1;
+}
+
+static Integer Add(Integer a, Integer b) { return a + b; }
+
+static void RunLoop(benchmark::State &state, Env &env)
+{
+  env.LoadString("local x = 0 for i = 1, 1000000 do x = add(x, 1) end");
+  auto loop = FunctionRef(env.env(), -1);
+  env.StackPop();
+
+  for (auto _ : state) {
+    loop.Call<>(0, nullptr, true);
+  }
+  state.SetItemsProcessed(state.iterations() * kCallNum);
+}
+
+static void BM_Native_HandWritten(benchmark::State &state)
+{
+  Env env;
+  lua_register(env.env(), "add", &AddHandWritten);
+  RunLoop(state, env);
+}
+
+static void BM_Native_FunctionPointer(benchmark::State &state)
+{
+  Env env;
+  env.Register("add", &Add);
+  RunLoop(state, env);
+}
+
+static void BM_Native_Lambda(benchmark::State &state)
+{
+  Env env;
+  Integer base = 0;
+  env.Register("add", [&base](Integer a, Integer b) { return base + a + b; });
+  RunLoop(state, env);
+}
+
+BENCHMARK(BM_Native_HandWritten)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Native_FunctionPointer)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Native_Lambda)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,101 @@
+#include "hklua/native_function.h"
+
+#include <memory>
+#include <stdexcept>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+static Integer Add(Integer a, Integer b) { return a + b; }
+
+static std::tuple<Integer, Integer> DivMod(Integer a, Integer b)
+{
+  return std::make_tuple(a / b, a % b);
+}
+
+struct Accumulator {
+  void Add(Integer n) { sum += n; }
+  Integer Get() const { return sum; }
+
+  Integer sum = 0;
+};
+
+TEST (native_function_test, free_function) {
+  Env env;
+  env.Register("add", &Add);
+  env.Register("divmod", DivMod);
+
+  ASSERT_EQ(HKLUA_OK, env.DoString("x = add(1, 2) "
+                                   "q, r = divmod(17, 5)"));
+  EXPECT_EQ(3, env.GetGlobalR<Integer>("x"));
+  EXPECT_EQ(3, env.GetGlobalR<Integer>("q"));
+  EXPECT_EQ(2, env.GetGlobalR<Integer>("r"));
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (native_function_test, lambda) {
+  Env env;
+  Integer sum = 0;
+  env.Register("accumulate", [&sum](Integer n) { sum += n; });
+  env.Register("concat", [](std::string const &a, std::string b) {
+    return a + b;
+  });
+
+  ASSERT_EQ(HKLUA_OK, env.DoString("for i = 1, 10 do accumulate(i) end "
+                                   "s = concat('abc', 'def')"));
+  EXPECT_EQ(55, sum);
+  EXPECT_EQ("abcdef", env.GetGlobalR<std::string>("s"));
+}
+
+TEST (native_function_test, capture_destroyed) {
+  auto counter = std::make_shared<int>(0);
+  {
+    Env env;
+    env.Register("inc", [counter]() { return ++*counter; });
+    EXPECT_EQ(2, counter.use_count());
+    ASSERT_EQ(HKLUA_OK, env.DoString("inc() inc()"));
+    EXPECT_EQ(2, *counter);
+
+    /* Replace the function, the capture is collected */
+    ASSERT_EQ(HKLUA_OK, env.DoString("inc = nil"));
+    env.GcCollect();
+    EXPECT_EQ(1, counter.use_count());
+
+    env.Register("inc", [counter]() { return ++*counter; });
+  }
+  EXPECT_EQ(1, counter.use_count());
+}
+
+TEST (native_function_test, member_function) {
+  Env env;
+  Accumulator acc;
+  env.Register("add", &Accumulator::Add, &acc);
+  env.Register("get", &Accumulator::Get, &acc);
+
+  ASSERT_EQ(HKLUA_OK, env.DoString("add(1) add(2) x = get()"));
+  EXPECT_EQ(3, acc.sum);
+  EXPECT_EQ(3, env.GetGlobalR<Integer>("x"));
+}
+
+TEST (native_function_test, error) {
+  Env env;
+  env.Register("add", &Add);
+  env.Register("fail", []() { throw std::runtime_error("native failure"); });
+
+  ASSERT_NE(HKLUA_OK, env.DoString("add(1, {})"));
+  EXPECT_NE(std::string::npos,
+            env.ToString().find("bad argument #2 (got table)"));
+  env.StackPop();
+
+  ASSERT_NE(HKLUA_OK, env.DoString("fail()"));
+  EXPECT_NE(std::string::npos, env.ToString().find("native failure"));
+  env.StackPop();
+
+  /* Catch by pcall */
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString("ok = pcall(fail)"));
+  EXPECT_FALSE(env.GetGlobalR<bool>("ok"));
+  EXPECT_TRUE(env.StackEmpty());
+}
@@ -0,0 +1,69 @@
+#include "hklua/profiler.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString("function fib(n) if n < 2 then return n end "
+               "return fib(n - 1) + fib(n - 2) end");
+}
+
+/*
+ * The baseline, no hook
+ */
+static void BM_Fib_NoProfiler(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+
+  for (auto _ : state) {
+    bool success;
+    auto n = env.CallFunction<Integer>("fib", 0, &success, true, Integer(20));
+    benchmark::DoNotOptimize(n);
+  }
+}
+
+/*
+ * The argument is the sample period(instructions)
+ */
+static void BM_Fib_Profiler(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  Profiler profiler(env, (int)state.range(0));
+  profiler.Start();
+
+  for (auto _ : state) {
+    bool success;
+    auto n = env.CallFunction<Integer>("fib", 0, &success, true, Integer(20));
+    benchmark::DoNotOptimize(n);
+  }
+  state.counters["samples"] = (double)profiler.sample_num();
+}
+
+/*
+ * The cost of folding the stacks
+ */
+static void BM_Profiler_Fold(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  Profiler profiler(env, 100);
+  profiler.Start();
+  bool success;
+  env.CallFunction<Integer>("fib", 0, &success, true, Integer(20));
+  profiler.Stop();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(profiler.FoldedStacks());
+  }
+  state.counters["stacks"] = (double)profiler.stack_num();
+}
+
+BENCHMARK(BM_Fib_NoProfiler);
+BENCHMARK(BM_Fib_Profiler)->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_Profiler_Fold);
@@ -0,0 +1,130 @@
+#include "hklua/profiler.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+static uint64_t SamplesOf(std::string const &folded, std::string const &frame)
+{
+  uint64_t ret = 0;
+  size_t begin = 0;
+  while (begin < folded.size()) {
+    auto end = folded.find('\n', begin);
+    auto line = folded.substr(begin, end - begin);
+    auto space = line.rfind(' ');
+    if (line.find(frame) != std::string::npos)
+      ret += std::stoull(line.substr(space + 1));
+    begin = end + 1;
+  }
+  return ret;
+}
+
+TEST (profiler_test, folded) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function hot(n) local s = 0 for i = 1, n do s = s + i end return s end\n"
+    "function cold(n) local s = 0 for i = 1, n do s = s + i end return s end\n"
+    "function run()\n"
+    "  pcall(function() hot(1000000) end)\n"
+    "  cold(100000)\n"
+    "end\n"));
+
+  Profiler profiler(env, 1000);
+  ASSERT_TRUE(profiler.Start());
+  EXPECT_TRUE(profiler.IsRunning());
+  /* Only one profiler can run in an Env */
+  Profiler other(env);
+  EXPECT_FALSE(other.Start());
+
+  ASSERT_EQ(HKLUA_OK, env.DoString("run()"));
+  profiler.Stop();
+  EXPECT_TRUE(lua_gethook(env.env()) == nullptr);
+
+  auto folded = profiler.FoldedStacks();
+  EXPECT_GT(profiler.sample_num(), 0u);
+  EXPECT_GT(profiler.stack_num(), 0u);
+
+  /* The frames are from the root to the innermost, C frames included */
+  EXPECT_NE(folded.find("main chunk"), std::string::npos);
+  EXPECT_NE(folded.find("run ("), std::string::npos);
+  EXPECT_NE(folded.find("pcall [C];"), std::string::npos);
+
+  const auto hot = SamplesOf(folded, "hot (");
+  const auto cold = SamplesOf(folded, "cold (");
+  EXPECT_GT(hot, cold);
+  EXPECT_GT(cold, 0u);
+  EXPECT_EQ(SamplesOf(folded, "main chunk"), profiler.sample_num());
+
+  /* Stopped profiler doesn't sample */
+  const auto n = profiler.sample_num();
+  ASSERT_EQ(HKLUA_OK, env.DoString("run()"));
+  EXPECT_EQ(profiler.sample_num(), n);
+
+  profiler.Clear();
+  EXPECT_EQ(profiler.sample_num(), 0u);
+  EXPECT_TRUE(profiler.FoldedStacks().empty());
+  EXPECT_TRUE(other.Start());
+  other.Stop();
+
+  /* The frames of the collected functions are not reused */
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "hot, cold = nil, nil\n"
+    "collectgarbage()\n"
+    "function warm(n) local s = 0 for i = 1, n do s = s + i end return s end\n"));
+  ASSERT_TRUE(profiler.Start());
+  ASSERT_EQ(HKLUA_OK, env.DoString("warm(1000000)"));
+  profiler.Stop();
+  folded = profiler.FoldedStacks();
+  EXPECT_GT(SamplesOf(folded, "warm ("), 0u);
+  EXPECT_EQ(SamplesOf(folded, "hot ("), 0u);
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (profiler_test, max_depth) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "function deep(n)\n"
+    "  if n == 0 then local s = 0 for i = 1, 100000 do s = s + i end "
+    "return s end\n"
+    "  return deep(n - 1) + 1\n"
+    "end\n"));
+
+  Profiler profiler(env, 1000);
+  ASSERT_TRUE(profiler.Start());
+  ASSERT_EQ(HKLUA_OK, env.DoString("deep(100)"));
+  profiler.Stop();
+
+  auto folded = profiler.FoldedStacks();
+  EXPECT_EQ(folded.compare(0, 4, "...;"), 0);
+}
+
+TEST (profiler_test, collected_chunks) {
+  static constexpr int kChunkNum = 200;
+
+  Env env;
+  env.OpenLibs();
+  Profiler profiler(env, 100);
+  ASSERT_TRUE(profiler.Start());
+
+  /* The source and name strings of the collected chunks are freed in the
+   * session, their addresses may be reused by the later ones */
+  for (int i = 0; i < kChunkNum; ++i) {
+    const auto name = "f" + std::to_string(i);
+    const auto chunk = "local function " + name +
+                       "() for i = 1, 10000 do end end " + name + "()";
+    ASSERT_EQ(HKLUA_OK, env.DoString(chunk.c_str()));
+    env.GcCollect();
+  }
+  profiler.Stop();
+
+  const auto folded = profiler.FoldedStacks();
+  for (int i = 0; i < kChunkNum; ++i) {
+    const auto name = "f" + std::to_string(i);
+    EXPECT_GT(SamplesOf(folded, name + " ([string \"local function " + name),
+              0u) << name;
+  }
+}
@@ -0,0 +1,92 @@
+#include "hklua/result.h"
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static void SetupEnv(Env &env)
+{
+  env.OpenLibs();
+  env.DoString("function add(a, b) return a + b end\n"
+               "function fail() error('boom') end\n"
+               "function deep(n) if n == 0 then fail() end "
+               "return deep(n - 1) end");
+}
+
+/*
+ * The success path of bool version and Result version,
+ * Result must not allocate
+ */
+static void BM_CallFunction(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+
+  for (auto _ : state) {
+    bool success;
+    auto ret = env.CallFunction<Integer>("add", 0, &success, true, 1, 2);
+    benchmark::DoNotOptimize(ret);
+  }
+}
+
+static void BM_TryCallFunction(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.SetTraceback(state.range(0) != 0);
+
+  for (auto _ : state) {
+    auto ret = env.TryCallFunction<Integer>("add", 1, 2);
+    benchmark::DoNotOptimize(ret);
+  }
+}
+
+/*
+ * The failure path, the argument indicates whether the traceback
+ * is enabled
+ */
+static void BM_TryCallFunction_Error(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.SetTraceback(state.range(0) != 0);
+
+  for (auto _ : state) {
+    auto ret = env.TryCallFunction<>("deep", 10);
+    benchmark::DoNotOptimize(ret);
+  }
+}
+
+static void BM_GetField(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.DoString("t = { x = 1 }");
+  auto t = env.GetGlobalTableR("t");
+
+  for (auto _ : state) {
+    Integer x;
+    t.GetField("x", x);
+    benchmark::DoNotOptimize(x);
+  }
+}
+
+static void BM_TryGetField(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.DoString("t = { x = 1 }");
+  auto t = env.GetGlobalTableR("t");
+
+  for (auto _ : state) {
+    auto x = t.TryGetField<Integer>("x");
+    benchmark::DoNotOptimize(x);
+  }
+}
+
+BENCHMARK(BM_CallFunction);
+BENCHMARK(BM_TryCallFunction)->Arg(0)->Arg(1);
+BENCHMARK(BM_TryCallFunction_Error)->Arg(0)->Arg(1);
+BENCHMARK(BM_GetField);
+BENCHMARK(BM_TryGetField);
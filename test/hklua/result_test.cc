@@ -0,0 +1,144 @@
+#include "hklua/result.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (result_test, error) {
+  Error ok;
+  EXPECT_TRUE(ok.ok());
+  EXPECT_TRUE(ok.message().empty());
+  EXPECT_TRUE(ok.ToString().empty());
+
+  Error err(HKLUA_ERRRUN, "msg", "stack traceback:\n\t[C]: in ?");
+  EXPECT_FALSE(err.ok());
+  EXPECT_EQ(err.ToString(), "msg\nstack traceback:\n\t[C]: in ?");
+
+  Error copy(err);
+  EXPECT_EQ(copy.code(), HKLUA_ERRRUN);
+  EXPECT_EQ(copy.message(), "msg");
+  copy = ok;
+  EXPECT_TRUE(copy.ok());
+  EXPECT_TRUE(copy.traceback().empty());
+
+  Result<int> r(1);
+  EXPECT_TRUE(r);
+  EXPECT_EQ(*r, 1);
+  Result<int> e(err);
+  EXPECT_FALSE(e);
+  EXPECT_EQ(e.value_or(2), 2);
+  EXPECT_EQ(e.code(), HKLUA_ERRRUN);
+}
+
+TEST (result_test, do_string) {
+  Env env;
+  env.OpenLibs();
+
+  auto ret = env.TryDoString("x = 1 return 1, 2, 3");
+  EXPECT_TRUE(ret);
+  EXPECT_TRUE(env.StackEmpty());
+
+  ret = env.TryDoString("x = ");
+  EXPECT_EQ(ret.code(), HKLUA_ERRSYNTAX);
+  EXPECT_FALSE(ret.error().message().empty());
+  EXPECT_TRUE(env.StackEmpty());
+
+  ret = env.TryDoString("error('boom')");
+  EXPECT_EQ(ret.code(), HKLUA_ERRRUN);
+  EXPECT_NE(ret.error().message().find("boom"), std::string::npos);
+  EXPECT_TRUE(ret.error().traceback().empty());
+  EXPECT_TRUE(env.StackEmpty());
+
+  ret = env.TryDoString("error({})");
+  EXPECT_EQ(ret.error().message(), "(error object is a table value)");
+
+  ret = env.TryDoFile("/not/exists.lua");
+  EXPECT_EQ(ret.code(), HKLUA_ERRFILE);
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (result_test, call_function) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_TRUE(env.TryDoString(
+    "function add(a, b) return a + b end\n"
+    "function fail() local t = nil return t.x end\n"
+    "function outer() return fail() + 1 end\n"));
+
+  /* The stack is restored whether success or not */
+  env.StackPush(Integer(42));
+
+  auto sum = env.TryCallFunction<Integer>("add", 1, 2);
+  ASSERT_TRUE(sum);
+  EXPECT_EQ(std::get<0>(*sum), 3);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  auto bad = env.TryCallFunction<Integer>("add", 1, "x");
+  EXPECT_EQ(bad.code(), HKLUA_ERRRUN);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  auto conv = env.TryCallFunction<Integer>("add", 1.5, 1.0);
+  EXPECT_EQ(conv.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  auto missing = env.TryCallFunction<>("not_exists");
+  EXPECT_EQ(missing.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(missing.error().message(), "global 'not_exists' is not a function");
+  EXPECT_EQ(env.StackSize(), 1);
+
+  env.SetTraceback(true);
+  auto tb = env.TryCallFunction<Integer>("outer");
+  EXPECT_EQ(tb.code(), HKLUA_ERRRUN);
+  EXPECT_EQ(tb.error().message().find("stack traceback:"), std::string::npos);
+  EXPECT_EQ(tb.error().traceback().compare(0, 16, "stack traceback:"), 0);
+  EXPECT_NE(tb.error().traceback().find("outer"), std::string::npos);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  /* The message handler is removed if success */
+  auto ref = env.GetFunctionRef("add");
+  sum = env.TryCallFunction<Integer>(ref, 2, 3);
+  ASSERT_TRUE(sum);
+  EXPECT_EQ(std::get<0>(*sum), 5);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  sum = TryCall<Integer>(ref, 3, 4);
+  ASSERT_TRUE(sum);
+  EXPECT_EQ(std::get<0>(*sum), 7);
+  EXPECT_EQ(env.StackSize(), 1);
+
+  env.StackPop();
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (result_test, field) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_TRUE(env.TryDoString("t = { x = 1, name = 'hk', [1] = 2.5 }"));
+
+  auto x = env.TryGetGlobal<Integer>("x");
+  EXPECT_EQ(x.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(x.error().message(), "global 'x' can't be converted(nil value)");
+  EXPECT_TRUE(env.StackEmpty());
+
+  auto t = env.GetGlobalTableR("t");
+  auto tx = t.TryGetField<Integer>("x");
+  ASSERT_TRUE(tx);
+  EXPECT_EQ(*tx, 1);
+  EXPECT_EQ(t.TryGetField<std::string>("name").value(), "hk");
+  EXPECT_EQ(t.TryGetField<Number>(Integer(1)).value(), 2.5);
+
+  auto bad = t.TryGetField<Integer>("name");
+  EXPECT_EQ(bad.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(bad.error().message(),
+            "field 'name' can't be converted(string value)");
+  EXPECT_EQ(env.StackSize(), 1);
+
+  /* CheckError() doesn't pop but PopError() does */
+  EXPECT_EQ(env.DoString("error('e')"), HKLUA_ERRRUN);
+  EXPECT_NE(env.CheckError().message().find("e"), std::string::npos);
+  EXPECT_EQ(env.StackSize(), 2);
+  EXPECT_EQ(env.PopError().code(), HKLUA_ERRRUN);
+  EXPECT_EQ(env.StackSize(), 1);
+}
@@ -0,0 +1,67 @@
+#include "hklua/sandbox.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+/* The cost of a tenant: the creation and the memory of the Env */
+static void BM_Env_OpenLibs(benchmark::State &state)
+{
+  size_t bytes = 0;
+  for (auto _ : state) {
+    Env env("tenant", std::unique_ptr<Allocator>(new SystemAllocator()));
+    env.OpenLibs();
+    bytes = env.allocator()->bytes();
+  }
+  state.counters["bytes"] = (double)bytes;
+}
+
+static void BM_Sandbox_Create(benchmark::State &state)
+{
+  SandboxOptions options;
+  options.memory_limit = 16 * 1024 * 1024;
+  options.instruction_limit = 1000000;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    Sandbox sandbox(options, "tenant");
+    bytes = sandbox.memory_used();
+  }
+  state.counters["bytes"] = (double)bytes;
+}
+
+static char const kHandler[] =
+  "function handle(n)\n"
+  "  local s = 0\n"
+  "  for i = 1, n do s = s + i end\n"
+  "  return s\n"
+  "end\n";
+
+/* The overhead of the limits in a run */
+static void BM_Env_Call(benchmark::State &state)
+{
+  Env env;
+  env.OpenLibs();
+  env.DoString(kHandler);
+  for (auto _ : state) {
+    auto ret = env.TryCallFunction<Integer>("handle", state.range(0));
+    benchmark::DoNotOptimize(ret);
+  }
+}
+
+static void BM_Sandbox_Call(benchmark::State &state)
+{
+  SandboxOptions options;
+  options.memory_limit = 16 * 1024 * 1024;
+  options.instruction_limit = 1000000000;
+  Sandbox sandbox(options);
+  sandbox.env().DoString(kHandler);
+  for (auto _ : state) {
+    auto ret = sandbox.TryCallFunction<Integer>("handle", state.range(0));
+    benchmark::DoNotOptimize(ret);
+  }
+}
+
+BENCHMARK(BM_Env_OpenLibs);
+BENCHMARK(BM_Sandbox_Create);
+BENCHMARK(BM_Env_Call)->Arg(10)->Arg(10000);
+BENCHMARK(BM_Sandbox_Call)->Arg(10)->Arg(10000);
@@ -0,0 +1,161 @@
+#include "hklua/sandbox.h"
+
+#include <gtest/gtest.h>
+
+using namespace hklua;
+
+TEST (sandbox_test, open_libs) {
+  Env env;
+  env.OpenLibs(HKLUA_LIB_BASE | HKLUA_LIB_STRING);
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(string.rep('a', 2) == 'aa' and ('a'):upper() == 'A')\n"
+    "assert(table == nil and io == nil and os == nil)\n"));
+
+  Sandbox sandbox;
+  ASSERT_TRUE(sandbox.TryDoString(
+    "assert(io == nil and os == nil and debug == nil and require == nil)\n"
+    "assert(load == nil and loadfile == nil and dofile == nil)\n"
+    "assert(pcall and table.concat and math.max and utf8.char and\n"
+    "       coroutine.wrap)\n"));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+  EXPECT_GT(sandbox.memory_used(), 0u);
+}
+
+TEST (sandbox_test, strip) {
+  SandboxOptions options;
+  options.libs |= HKLUA_LIB_OS | HKLUA_LIB_PACKAGE;
+  Sandbox sandbox(options);
+  ASSERT_EQ(HKLUA_OK, sandbox.env().DoString(
+    "package.preload.config = function() return { port = 80 } end"));
+
+  auto ret = sandbox.TryDoString(
+    "assert(os.time() and os.clock() and os.date and os.difftime)\n"
+    "assert(os.execute == nil and os.exit == nil and os.getenv == nil and\n"
+    "       os.remove == nil and os.rename == nil and os.tmpname == nil)\n"
+    "assert(package.loadlib == nil and #package.searchers == 1)\n"
+    "assert(require('config').port == 80)\n"
+    "assert(not pcall(require, 'string_not_preloaded'))\n");
+  ASSERT_TRUE(ret) << ret.error().message();
+
+  options.strip_load = false;
+  options.strip_os = false;
+  Sandbox loose(options);
+  ASSERT_TRUE(loose.TryDoString(
+    "assert(load and os.getenv and #package.searchers == 4)"));
+}
+
+TEST (sandbox_test, memory_limit) {
+  SandboxOptions options;
+  options.memory_limit = 1024 * 1024;
+  Sandbox sandbox(options);
+
+  auto ret = sandbox.TryDoString(
+    "local t = {}\n"
+    "for i = 1, 1e7 do t[i] = 'item' .. i end\n");
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRMEM);
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kMemoryLimit);
+  EXPECT_LE(sandbox.memory_used(), options.memory_limit);
+
+  /* The garbage is collected, the sandbox is still usable */
+  ASSERT_TRUE(sandbox.TryDoString("x = 1"));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+
+  /* Caught and raised again as a string */
+  ret = sandbox.TryDoString(
+    "local ok, err = pcall(function()\n"
+    "  local t = {}\n"
+    "  for i = 1, 1e7 do t[i] = {} end\n"
+    "end)\n"
+    "error(tostring(err))\n");
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRRUN);
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kMemoryLimit);
+
+  /* A script error is not a limit */
+  ASSERT_FALSE(sandbox.TryDoString("error('bad')"));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+
+  options.memory_limit = 1024;
+  EXPECT_THROW(Sandbox small(options), EnvException);
+}
+
+TEST (sandbox_test, instruction_limit) {
+  SandboxOptions options;
+  options.instruction_limit = 100000;
+  Sandbox sandbox(options);
+  ASSERT_EQ(HKLUA_OK, sandbox.env().DoString(
+    "function spin(n) local x = 0 for i = 1, n do x = x + i end return x end"));
+
+  auto ret = sandbox.TryCallFunction<Integer>("spin", 100);
+  ASSERT_TRUE(ret);
+  EXPECT_EQ(std::get<0>(*ret), 5050);
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+
+  ret = sandbox.TryCallFunction<Integer>("spin", 10000000);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kInstructionLimit);
+  EXPECT_GT(sandbox.instructions_used(), options.instruction_limit);
+
+  /* pcall() can't escape the limit */
+  ASSERT_FALSE(sandbox.TryDoString(
+    "while true do pcall(function() while true do end end) end"));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kInstructionLimit);
+
+  /* Tripped in a nested coroutine, the other coroutines catch it */
+  ASSERT_EQ(HKLUA_OK, sandbox.env().DoString(
+    "function spin_forever() while true do end end"));
+  ASSERT_FALSE(sandbox.TryDoString(
+    "coroutine.wrap(function()\n"
+    "  coroutine.resume(coroutine.create(function()\n"
+    "    while true do pcall(spin_forever) end\n"
+    "  end))\n"
+    "  while true do pcall(spin_forever) end\n"
+    "end)()\n"));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kInstructionLimit);
+
+  /* The budget is per run */
+  ASSERT_TRUE(sandbox.TryCallFunction<Integer>("spin", 1000));
+  EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+
+  /* Both limits, the first one tripped is reported */
+  options.memory_limit = 1024 * 1024;
+  Sandbox both(options);
+  ASSERT_FALSE(both.TryDoString("local s = 'x' while true do s = s .. s end"));
+  EXPECT_EQ(both.tripped(), Sandbox::kMemoryLimit);
+  ASSERT_FALSE(both.TryDoString("while true do end"));
+  EXPECT_EQ(both.tripped(), Sandbox::kInstructionLimit);
+}
+
+TEST (sandbox_test, finalizer) {
+  SandboxOptions options;
+  options.instruction_limit = 100000;
+  {
+    /* The finalizer runs without the hooks, so it is rejected */
+    Sandbox sandbox(options);
+    auto ret = sandbox.TryDoString(
+      "setmetatable({}, { __gc = function() while true do end end })\n"
+      "collectgarbage()\n");
+    ASSERT_FALSE(ret);
+    EXPECT_NE(ret.error().message().find("__gc"), std::string::npos);
+    EXPECT_EQ(sandbox.tripped(), Sandbox::kNoLimit);
+
+    /* The field assigned after setmetatable() is not the finalizer */
+    ASSERT_FALSE(sandbox.TryDoString(
+      "setmetatable({}, { __gc = true })"));
+    ASSERT_TRUE(sandbox.TryDoString(
+      "local mt = {}\n"
+      "local t = setmetatable({}, mt)\n"
+      "assert(getmetatable(t) == mt)\n"
+      "mt.__gc = function() while true do end end\n"
+      "t = nil\n"
+      "collectgarbage()\n"));
+  }
+  /* Destroyed without hang */
+
+  options.instruction_limit = 0;
+  Sandbox unlimited(options);
+  ASSERT_TRUE(unlimited.TryDoString(
+    "setmetatable({}, { __gc = function() end })\n"
+    "collectgarbage()\n"));
+}
@@ -0,0 +1,241 @@
+#include "hklua/serializer.h"
+#include "hklua/env.h"
+
+#include <algorithm>
+#include <string>
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+/* About 70 bytes per record */
+static void SetupState(Env &env, int n)
+{
+  env.OpenLibs();
+  auto const chunk =
+    "state = {}\n"
+    "for i = 1, " + std::to_string(n) + " do\n"
+    "  state[i] = { id = i, name = 'item' .. i, score = i * 0.25,\n"
+    "               tags = { 'a', 'bb', 'ccc' }, pos = { x = i / 3, y = -i } }\n"
+    "end\n";
+  env.DoString(chunk.c_str());
+  lua_getglobal(env.env(), "state");
+}
+
+static void BM_Serializer_Serialize(benchmark::State &state)
+{
+  Env env;
+  SetupState(env, (int)state.range(0));
+  std::string buffer;
+
+  for (auto _ : state) {
+    buffer.clear();
+    Serialize(env.env(), -1, buffer);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+  state.counters["bytes"] = (double)buffer.size();
+}
+
+static void BM_Serializer_Deserialize(benchmark::State &state)
+{
+  Env env;
+  SetupState(env, (int)state.range(0));
+  std::string buffer;
+  Serialize(env.env(), -1, buffer);
+
+  for (auto _ : state) {
+    Deserialize(env.env(), buffer);
+    lua_pop(env.env(), 1);
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+/* The data arrives in 64KB chunks */
+static void BM_Serializer_DeserializeStream(benchmark::State &state)
+{
+  static constexpr size_t kChunkSize = 64 * 1024;
+  Env env;
+  SetupState(env, (int)state.range(0));
+  /* One value per record, like a snapshot stream */
+  Serializer serializer(env);
+  auto n = (lua_Integer)lua_rawlen(env.env(), -1);
+  for (lua_Integer i = 1; i <= n; ++i) {
+    lua_rawgeti(env.env(), -1, i);
+    serializer.Write(-1);
+    lua_pop(env.env(), 1);
+  }
+  auto const &buffer = serializer.buffer();
+
+  for (auto _ : state) {
+    Deserializer deserializer(env);
+    for (size_t offset = 0; offset < buffer.size(); offset += kChunkSize) {
+      deserializer.Feed(buffer.data() + offset,
+                        std::min(kChunkSize, buffer.size() - offset));
+      while (*deserializer.Read()) lua_pop(env.env(), 1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+/* One large value arrives in 4KB chunks and Read() is called per chunk */
+static void BM_Serializer_DeserializeChunked(benchmark::State &state)
+{
+  static constexpr size_t kChunkSize = 4 * 1024;
+  Env env;
+  SetupState(env, (int)state.range(0));
+  std::string buffer;
+  Serialize(env.env(), -1, buffer);
+
+  for (auto _ : state) {
+    Deserializer deserializer(env);
+    for (size_t offset = 0; offset < buffer.size(); offset += kChunkSize) {
+      deserializer.Feed(buffer.data() + offset,
+                        std::min(kChunkSize, buffer.size() - offset));
+      if (*deserializer.Read()) lua_pop(env.env(), 1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+/* The payload is transferred from a producer Env to a worker Env */
+static void SetupArray(Env &env, int n)
+{
+  env.OpenLibs();
+  auto const chunk = "array = {} for i = 1, " + std::to_string(n) +
+                     " do array[i] = i * 0.5 end";
+  env.DoString(chunk.c_str());
+  lua_getglobal(env.env(), "array");
+}
+
+static void CopyBench(benchmark::State &state, void (*setup)(Env &, int))
+{
+  Env producer;
+  Env worker;
+  setup(producer, (int)state.range(0));
+
+  for (auto _ : state) {
+    CopyValue(producer, -1, worker);
+    lua_pop(worker.env(), 1);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void RoundTripBench(benchmark::State &state, void (*setup)(Env &, int))
+{
+  Env producer;
+  Env worker;
+  setup(producer, (int)state.range(0));
+  std::string buffer;
+
+  for (auto _ : state) {
+    buffer.clear();
+    Serialize(producer.env(), -1, buffer);
+    Deserialize(worker.env(), buffer);
+    lua_pop(worker.env(), 1);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_Serializer_CopyRecords(benchmark::State &state)
+{
+  CopyBench(state, &SetupState);
+}
+
+static void BM_Serializer_RoundTripRecords(benchmark::State &state)
+{
+  RoundTripBench(state, &SetupState);
+}
+
+static void BM_Serializer_CopyArray(benchmark::State &state)
+{
+  CopyBench(state, &SetupArray);
+}
+
+static void BM_Serializer_RoundTripArray(benchmark::State &state)
+{
+  RoundTripBench(state, &SetupArray);
+}
+
+/*
+ * The Lua-side round trip: encode to the Lua literal by table.concat()
+ * and decode by load()
+ */
+static char const kLuaEncoder[] = R"(
+local function encode(v, out)
+  local t = type(v)
+  if t == "table" then
+    out[#out + 1] = "{"
+    for k, x in pairs(v) do
+      out[#out + 1] = "["
+      encode(k, out)
+      out[#out + 1] = "]="
+      encode(x, out)
+      out[#out + 1] = ","
+    end
+    out[#out + 1] = "}"
+  elseif t == "string" then
+    out[#out + 1] = string.format("%q", v)
+  else
+    out[#out + 1] = tostring(v)
+  end
+end
+
+function lua_encode(v)
+  local out = {}
+  encode(v, out)
+  return table.concat(out)
+end
+
+function lua_decode(s)
+  return load("return " .. s)()
+end
+)";
+
+static void BM_Serializer_LuaEncode(benchmark::State &state)
+{
+  Env env;
+  SetupState(env, (int)state.range(0));
+  env.DoString(kLuaEncoder);
+  size_t bytes = 0;
+
+  for (auto _ : state) {
+    lua_getglobal(env.env(), "lua_encode");
+    lua_pushvalue(env.env(), 1);
+    lua_call(env.env(), 1, 1);
+    bytes = lua_rawlen(env.env(), -1);
+    lua_pop(env.env(), 1);
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+  state.counters["bytes"] = (double)bytes;
+}
+
+static void BM_Serializer_LuaDecode(benchmark::State &state)
+{
+  Env env;
+  SetupState(env, (int)state.range(0));
+  env.DoString(kLuaEncoder);
+  env.DoString("encoded = lua_encode(state)");
+  lua_getglobal(env.env(), "encoded");
+  auto bytes = lua_rawlen(env.env(), -1);
+  lua_pop(env.env(), 1);
+
+  for (auto _ : state) {
+    lua_getglobal(env.env(), "lua_decode");
+    lua_getglobal(env.env(), "encoded");
+    lua_call(env.env(), 1, 1);
+    lua_pop(env.env(), 1);
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+/* 10K records is about 0.7MB, 100K is about 7MB */
+BENCHMARK(BM_Serializer_Serialize)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_Deserialize)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_DeserializeStream)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_DeserializeChunked)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_LuaEncode)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_LuaDecode)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_CopyRecords)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_RoundTripRecords)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_CopyArray)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Serializer_RoundTripArray)->Arg(1000000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,198 @@
+#include "hklua/serializer.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (serializer_test, round_trip) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(R"(
+    state = {
+      name = "player\0one",
+      level = 42,
+      hp = -1000,
+      big = math.maxinteger,
+      small = math.mininteger,
+      ratio = 0.1,
+      half = 0.5,
+      alive = true,
+      dead = false,
+      items = { 1, 2, 3, "four", { x = 1.5 } },
+      empty = {},
+      [1] = "mixed",
+      [2.5] = 300,
+      long = string.rep("x", 70000),
+    }
+  )"));
+
+  lua_getglobal(env.env(), "state");
+  std::string buffer;
+  auto ret = Serialize(env.env(), -1, buffer);
+  ASSERT_TRUE(ret) << ret.error().message();
+  env.StackSetTop(0);
+
+  ret = Deserialize(env.env(), buffer);
+  ASSERT_TRUE(ret) << ret.error().message();
+  lua_setglobal(env.env(), "copy");
+  EXPECT_EQ(env.StackSize(), 0);
+
+  ASSERT_EQ(HKLUA_OK, env.DoString(R"(
+    local function equal(a, b)
+      if type(a) ~= type(b) then return false end
+      if type(a) ~= "table" then
+        return a == b and math.type(a) == math.type(b)
+      end
+      for k, v in pairs(a) do
+        if not equal(v, b[k]) then return false end
+      end
+      for k in pairs(b) do
+        if a[k] == nil then return false end
+      end
+      return true
+    end
+    assert(equal(state, copy))
+    assert(#copy.items == 5)
+  )"));
+}
+
+TEST (serializer_test, error) {
+  Env env;
+  env.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, env.DoString(R"(
+    cyclic = { a = { b = {} } }
+    cyclic.a.b.c = cyclic
+    func = { list = { 1, print } }
+    shared = {}
+    dag = { shared, shared }
+  )"));
+
+  Serializer serializer(env);
+  lua_getglobal(env.env(), "cyclic");
+  auto ret = serializer.Write(-1);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(ret.error().message(), "table is in a cycle(at a.b.c)");
+
+  lua_getglobal(env.env(), "func");
+  ret = serializer.Write(-1);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.error().message(), "function value can't be serialized(at list[2])");
+  EXPECT_TRUE(serializer.buffer().empty());
+  EXPECT_EQ(env.StackSize(), 2);
+
+  /* Shared but not cyclic */
+  lua_getglobal(env.env(), "dag");
+  EXPECT_TRUE(serializer.Write(-1));
+  env.StackSetTop(0);
+
+  /* Truncated, malformed, extra bytes */
+  auto buffer = serializer.Release();
+  EXPECT_EQ(Deserialize(env.env(), buffer.data(), buffer.size() - 1).code(),
+            HKLUA_ERRSYNTAX);
+  EXPECT_EQ(Deserialize(env.env(), "\xc1", 1).code(), HKLUA_ERRSYNTAX);
+  EXPECT_EQ(Deserialize(env.env(), buffer + "\xc0").code(), HKLUA_ERRSYNTAX);
+  /* nil key */
+  EXPECT_EQ(Deserialize(env.env(), "\x81\xc0\x01", 3).code(), HKLUA_ERRSYNTAX);
+  EXPECT_EQ(env.StackSize(), 0);
+}
+
+TEST (serializer_test, stream) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString("a = { 1, 2, 3 } b = { x = 'y' }"));
+
+  Serializer serializer(env);
+  lua_getglobal(env.env(), "a");
+  lua_getglobal(env.env(), "b");
+  ASSERT_TRUE(serializer.Write(-2));
+  ASSERT_TRUE(serializer.Write(-1));
+  env.StackSetTop(0);
+
+  /* Feed byte by byte */
+  auto const &buffer = serializer.buffer();
+  Deserializer deserializer(env);
+  int n = 0;
+  for (auto c : buffer) {
+    deserializer.Feed(&c, 1);
+    auto ret = deserializer.Read();
+    ASSERT_TRUE(ret);
+    if (*ret) ++n;
+  }
+  EXPECT_EQ(n, 2);
+  EXPECT_EQ(deserializer.pending(), 0);
+  ASSERT_EQ(env.StackSize(), 2);
+
+  Table b(env, 2);
+  EXPECT_EQ(b.GetFieldR<std::string>("x"), "y");
+  Table a(env, 1);
+  EXPECT_EQ(a.len(), 3);
+
+  deserializer.Feed("\xc1", 1);
+  EXPECT_EQ(deserializer.Read().code(), HKLUA_ERRSYNTAX);
+  EXPECT_EQ(deserializer.pending(), 0);
+
+  /* The malformed element is found before the array is complete */
+  deserializer.Feed("\x93\x01\xc1", 3);
+  EXPECT_EQ(deserializer.Read().code(), HKLUA_ERRSYNTAX);
+  EXPECT_EQ(deserializer.pending(), 0);
+}
+
+TEST (serializer_test, copy_value) {
+  Env producer;
+  Env worker;
+  producer.OpenLibs();
+  worker.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, producer.DoString(R"(
+    shared = { 1, 2 }
+    payload = { a = shared, b = shared, list = { 1.5, "two", true, shared },
+                [10] = "sparse", [0.5] = 1 }
+    payload.self = payload
+  )"));
+
+  lua_getglobal(producer.env(), "payload");
+  auto ret = CopyValue(producer, -1, worker);
+  ASSERT_TRUE(ret) << ret.error().message();
+  EXPECT_EQ(producer.StackSize(), 1);
+  ASSERT_EQ(worker.StackSize(), 1);
+  lua_setglobal(worker.env(), "payload");
+
+  ASSERT_EQ(HKLUA_OK, worker.DoString(R"(
+    assert(payload.a == payload.b and payload.list[4] == payload.a)
+    assert(payload.self == payload)
+    assert(payload.a[2] == 2 and payload.list[2] == "two")
+    assert(payload[10] == "sparse" and payload[0.5] == 1)
+    assert(math.type(payload.list[1]) == "float")
+  )"));
+
+  /* Copy in the same Env */
+  ret = CopyValue(producer, 1, producer);
+  ASSERT_TRUE(ret);
+  ASSERT_EQ(producer.StackSize(), 2);
+  EXPECT_FALSE(lua_rawequal(producer.env(), 1, 2));
+  producer.StackSetTop(0);
+
+  ASSERT_EQ(HKLUA_OK, producer.DoString("bad = { x = { coroutine.create(print) } }"));
+  lua_getglobal(producer.env(), "bad");
+  ret = CopyValue(producer, -1, worker);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(ret.error().message(), "thread value can't be copied(at x[1])");
+  EXPECT_EQ(producer.StackSize(), 1);
+  EXPECT_EQ(worker.StackSize(), 0);
+}
+
+TEST (serializer_test, copy_value_memory_limit) {
+  Env producer;
+  producer.OpenLibs();
+  ASSERT_EQ(HKLUA_OK, producer.DoString(
+    "big = {} for i = 1, 100000 do big[i] = string.rep('x', 100) .. i end"));
+
+  Env worker("limited", std::unique_ptr<Allocator>(new SystemAllocator(1024 * 1024)));
+  lua_getglobal(producer.env(), "big");
+  auto ret = CopyValue(producer, -1, worker);
+  ASSERT_FALSE(ret);
+  EXPECT_EQ(ret.code(), HKLUA_ERRMEM);
+  EXPECT_EQ(worker.StackSize(), 0);
+}
@@ -0,0 +1,114 @@
+#include "hklua/stack_scope.h"
+
+#include <string.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (stack_scope_test, restore) {
+  Env env;
+  env.StackPush(Integer(1));
+
+  {
+    StackScope scope(env);
+    EXPECT_EQ(scope.top(), 1);
+    ASSERT_EQ(HKLUA_OK, env.DoString("t = { x = 1 }"));
+    auto t = env.GetGlobalTableR("t");
+    Integer x;
+    /* Forget to pop */
+    ASSERT_TRUE(t.GetField("x", x, false));
+    EXPECT_EQ(scope.delta(), 2);
+  }
+  EXPECT_EQ(env.StackSize(), 1);
+
+  {
+    StackScope scope(env);
+    env.StackPush(Integer(2));
+    env.StackPush(Integer(3));
+    scope.Keep(1);
+  }
+  ASSERT_EQ(env.StackSize(), 2);
+  Integer top = 0;
+  ASSERT_TRUE(env.StackTo(-1, top));
+  EXPECT_EQ(top, 2);
+}
+
+#ifdef HKLUA_STACK_CHECK
+
+static std::vector<StackViolation> g_violations;
+
+static void RecordViolation(StackViolation const &violation)
+{
+  g_violations.push_back(violation);
+}
+
+/* Declare pushing nothing but push a value */
+HKLUA_STACK_CHECKED
+static void LeakyApi(lua_State *env)
+{
+  HKLUA_STACK_CONTRACT(env, 0);
+  lua_pushnil(env);
+}
+
+/* The call site, the value after the call keeps it from the tail call */
+__attribute__((noinline)) static int CallLeakyApi(lua_State *env)
+{
+  LeakyApi(env);
+  return lua_gettop(env);
+}
+
+TEST (stack_scope_test, contract) {
+  SetStackViolationHandler(&RecordViolation);
+  g_violations.clear();
+
+  Env env;
+  env.OpenLibs();
+  EXPECT_EQ(CallLeakyApi(env.env()), 1);
+  ASSERT_EQ(g_violations.size(), 1u);
+  EXPECT_TRUE(strstr(g_violations[0].func, "LeakyApi"));
+  EXPECT_EQ(g_violations[0].expected, 0);
+  EXPECT_EQ(g_violations[0].actual, 1);
+  /* The return address is in the body of the call site
+   * rather than its caller */
+  auto const site = reinterpret_cast<char const *>(&CallLeakyApi);
+  auto const caller = static_cast<char const *>(g_violations[0].caller);
+  EXPECT_GT(caller, site);
+  EXPECT_LT(caller, site + 256);
+  env.StackPop();
+  g_violations.clear();
+
+  /* The APIs keep their contracts */
+  {
+    StackScope scope(env);
+    ASSERT_TRUE(env.TryDoString("t = { x = 1, s = 'a' } function f() end"));
+    env.SetGlobal("g", Integer(1));
+    Integer g;
+    env.GetGlobal("g", g);
+    env.GetGlobal("g", g, false);
+    auto t = env.GetGlobalTableR("t");
+    Integer x;
+    t.GetField("x", x);
+    t.GetField("x", x, false);
+    t.GetField(std::string("s"), x);
+    t.SetField("y", Integer(2));
+    t.SetField(Integer(1), Integer(2));
+    t.GetField(Integer(1), x);
+    (void)t.TryGetField<Integer>("s");
+    (void)env.TryGetGlobal<Integer>("t");
+    (void)env.TryCallFunction<>("f");
+    (void)env.TryCallFunction<>("not_exists");
+    env.Register("h", [](Integer i) { return i; });
+    auto ref = env.GetFunctionRef("h");
+    env.CreateTable();
+    EXPECT_EQ(env.GetLen(-1), 0);
+  }
+  EXPECT_TRUE(env.StackEmpty());
+  EXPECT_TRUE(g_violations.empty());
+
+  SetStackViolationHandler(nullptr);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "hklua/env.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+struct Server {
+  std::string host;
+  int port;
+  Number weight;
+  bool enabled;
+};
+
+HKLUA_STRUCT(Server, host, port, weight, enabled)
+
+static void SetupEnv(Env &env)
+{
+  env.DoString("server = { host = 'localhost', port = 8080, weight = 0.5, "
+               "enabled = true }");
+}
+
+/*
+ * Fill the struct field by field with GetFieldR()
+ */
+static void BM_Struct_GetFieldR(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  auto tb = env.GetGlobalTableR("server");
+
+  for (auto _ : state) {
+    Server server;
+    server.host = tb.GetFieldR<std::string>("host");
+    server.port = tb.GetFieldR<int>("port");
+    server.weight = tb.GetFieldR<Number>("weight");
+    server.enabled = tb.GetFieldR<bool>("enabled");
+    benchmark::DoNotOptimize(server);
+  }
+}
+
+static void BM_Struct_StackConv(benchmark::State &state)
+{
+  Env env;
+  SetupEnv(env);
+  env.GetGlobal("server");
+
+  for (auto _ : state) {
+    Server server;
+    StackConv(env.env(), -1, server);
+    benchmark::DoNotOptimize(server);
+  }
+}
+
+static void BM_Struct_SetField(benchmark::State &state)
+{
+  Env env;
+  Server server{ "localhost", 8080, 0.5, true };
+
+  for (auto _ : state) {
+    auto tb = env.CreateTable();
+    tb.SetField("host", server.host);
+    tb.SetField("port", server.port);
+    tb.SetField("weight", server.weight);
+    tb.SetField("enabled", server.enabled);
+    env.StackPop();
+  }
+}
+
+static void BM_Struct_StackPush(benchmark::State &state)
+{
+  Env env;
+  Server server{ "localhost", 8080, 0.5, true };
+
+  for (auto _ : state) {
+    StackPush(env.env(), server);
+    env.StackPop();
+  }
+}
+
+/*
+ * The argument is the number of elements
+ */
+static void BM_Struct_VectorConv(benchmark::State &state)
+{
+  Env env;
+  std::vector<Server> servers(state.range(0),
+                              Server{ "localhost", 8080, 0.5, true });
+  StackPush(env.env(), servers);
+
+  for (auto _ : state) {
+    StackConv(env.env(), -1, servers);
+    benchmark::DoNotOptimize(servers);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_Struct_GetFieldR);
+BENCHMARK(BM_Struct_StackConv);
+BENCHMARK(BM_Struct_SetField);
+BENCHMARK(BM_Struct_StackPush);
+BENCHMARK(BM_Struct_VectorConv)->Arg(16)->Arg(1024);
@@ -0,0 +1,134 @@
+#include "hklua/stack.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+namespace app {
+
+struct Server {
+  std::string host;
+  int port = 0;
+};
+
+HKLUA_STRUCT(Server, host, port)
+
+struct Config {
+  std::string name;
+  double ratio = 0;
+  bool debug = false;
+  std::vector<Server> servers;
+  std::vector<int> weights;
+  VI<Integer> timeout;
+  Server admin;
+};
+
+HKLUA_STRUCT(Config, name, ratio, debug, servers, weights, timeout, admin)
+
+} // namespace app
+
+/* The struct in the global namespace */
+struct Point {
+  Number x;
+  Number y;
+};
+
+HKLUA_STRUCT(Point, x, y)
+
+TEST (struct_test, round_trip) {
+  Env env;
+  env.OpenLibs();
+
+  app::Config config;
+  config.name = "hk";
+  config.ratio = 0.5;
+  config.debug = true;
+  config.servers = { { "a", 1 }, { "b", 2 } };
+  config.weights = { 3, 4, 5 };
+  config.timeout.is_nil = true;
+  config.admin = { "admin", 8080 };
+
+  env.SetGlobal("config", config);
+  EXPECT_TRUE(env.StackEmpty());
+
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(config.name == 'hk' and config.ratio == 0.5 and config.debug)\n"
+    "assert(#config.servers == 2 and config.servers[2].host == 'b')\n"
+    "assert(config.weights[3] == 5 and config.admin.port == 8080)\n"
+    "assert(config.timeout == nil)\n"
+    "config.timeout = 30\n"));
+
+  app::Config copy;
+  ASSERT_TRUE(env.GetGlobal("config", copy));
+  EXPECT_EQ(copy.name, "hk");
+  EXPECT_EQ(copy.ratio, 0.5);
+  EXPECT_TRUE(copy.debug);
+  ASSERT_EQ(copy.servers.size(), 2u);
+  EXPECT_EQ(copy.servers[1].host, "b");
+  EXPECT_EQ(copy.servers[1].port, 2);
+  EXPECT_EQ(copy.weights, config.weights);
+  EXPECT_FALSE(copy.timeout.is_nil);
+  EXPECT_EQ(copy.timeout.data, 30);
+  EXPECT_EQ(copy.admin.host, "admin");
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (struct_test, mismatch_path) {
+  Env env;
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "config = { name = 'hk', ratio = 1, debug = false, weights = {},\n"
+    "  admin = { host = 'admin', port = 1 },\n"
+    "  servers = { { host = 'a', port = 1 }, { host = 'b', port = 'x' } } }\n"));
+
+  std::string path;
+  app::Config config;
+  env.GetGlobal("config");
+  EXPECT_FALSE(StackConvStruct(env.env(), -1, config, &path));
+  EXPECT_EQ(path, "servers[2].port");
+  EXPECT_FALSE(StackConv(env.env(), -1, config));
+  env.StackPop();
+
+  auto ret = env.TryGetGlobal<app::Config>("config");
+  EXPECT_EQ(ret.code(), HKLUA_ERRTYPE);
+  EXPECT_EQ(ret.error().message(),
+            "global 'config' can't be converted(at servers[2].port)");
+
+  /* Missing field */
+  ASSERT_EQ(HKLUA_OK, env.DoString("config.servers = {} config.admin = nil"));
+  env.GetGlobal("config");
+  EXPECT_FALSE(StackConvStruct(env.env(), -1, config, &path));
+  EXPECT_EQ(path, "admin");
+  env.StackPop();
+
+  /* Not a table */
+  env.StackPush(Integer(1));
+  EXPECT_FALSE(StackConvStruct(env.env(), -1, config, &path));
+  EXPECT_TRUE(path.empty());
+  env.StackPop();
+  EXPECT_TRUE(env.StackEmpty());
+}
+
+TEST (struct_test, container_and_function) {
+  Env env;
+  env.OpenLibs();
+
+  std::vector<Point> points = { { 1, 2 }, { 3, 4 } };
+  env.SetGlobal("points", points);
+  env.Register("norm1", [](Point p) { return p.x + p.y; });
+  env.Register("mid", [](Point a, Point b) {
+    return Point{ (a.x + b.x) / 2, (a.y + b.y) / 2 };
+  });
+
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(norm1(points[2]) == 7)\n"
+    "local m = mid(points[1], points[2])\n"
+    "assert(m.x == 2 and m.y == 3)\n"));
+
+  std::vector<Point> copy;
+  ASSERT_TRUE(env.GetGlobal("points", copy));
+  ASSERT_EQ(copy.size(), 2u);
+  EXPECT_EQ(copy[1].y, 4);
+  EXPECT_TRUE(env.StackEmpty());
+}
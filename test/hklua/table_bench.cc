@@ -0,0 +1,150 @@
+#include "hklua/table.h"
+#include "hklua/env.h"
+#include "hklua/variant.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace hklua;
+
+static constexpr int kEntryNum = 50000;
+
+static void SetupConfig(Env &env)
+{
+  env.DoString(
+    "config = {}\n"
+    "for i = 1, 50000 do config['key' .. i] = i * 0.5 end\n"
+    "array = {}\n"
+    "for i = 1, 50000 do array[i] = i end\n");
+}
+
+static void BM_Table_GetFieldPerKey(benchmark::State &state)
+{
+  Env env;
+  SetupConfig(env);
+  auto config = env.GetGlobalTableR("config");
+  std::vector<std::string> keys;
+  for (int i = 1; i <= kEntryNum; ++i)
+    keys.push_back("key" + std::to_string(i));
+
+  for (auto _ : state) {
+    double sum = 0;
+    for (auto &key : keys) {
+      double value;
+      config.GetField(key, value);
+      sum += value;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kEntryNum);
+}
+
+static void BM_Table_Pairs(benchmark::State &state)
+{
+  Env env;
+  SetupConfig(env);
+  auto config = env.GetGlobalTableR("config");
+
+  for (auto _ : state) {
+    double sum = 0;
+    for (auto &kv : config.Pairs<char const *, double>())
+      sum += kv.second;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kEntryNum);
+}
+
+static void BM_Table_PairsVariant(benchmark::State &state)
+{
+  Env env;
+  SetupConfig(env);
+  auto config = env.GetGlobalTableR("config");
+
+  for (auto _ : state) {
+    double sum = 0;
+    for (auto &kv : config)
+      sum += const_cast<Variant &>(kv.second).ToNumber();
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kEntryNum);
+}
+
+static void BM_Table_IPairs(benchmark::State &state)
+{
+  Env env;
+  SetupConfig(env);
+  auto array = env.GetGlobalTableR("array");
+
+  for (auto _ : state) {
+    Integer sum = 0;
+    for (auto &kv : array.IPairs<Integer>())
+      sum += kv.second;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * kEntryNum);
+}
+
+BENCHMARK(BM_Table_GetFieldPerKey);
+BENCHMARK(BM_Table_Pairs);
+BENCHMARK(BM_Table_PairsVariant);
+BENCHMARK(BM_Table_IPairs);
+
+/*
+ * The previous implementation of Table::operator[]:
+ * read: GetField() into Variant and construct std::pair<Variant, Variant>
+ * write: SetField() then GetField() to refresh the cached value
+ */
+static void BM_Table_IndexOperatorLegacy(benchmark::State &state)
+{
+  Env env;
+  env.DoString("t = { x = 1 }");
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    /* auto x = t["x"]; */
+    Variant x;
+    t.GetField("x", x);
+    std::pair<Variant, Variant> kv(Variant("x"), std::move(x));
+    sum += kv.second.ToInteger();
+
+    /* t["x"] = sum; */
+    Variant key("x");
+    Variant value;
+    t.GetField("x", value);
+    std::pair<Variant, Variant> kv2(key, std::move(value));
+    t.SetField(kv2.first, sum & 0xff);
+    t.GetField(kv2.first, kv2.second);
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_Table_IndexOperator(benchmark::State &state)
+{
+  Env env;
+  env.DoString("t = { x = 1 }");
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    sum += t["x"].As<Integer>();
+    t["x"] = sum & 0xff;
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+static void BM_Table_IndexOperatorChain(benchmark::State &state)
+{
+  Env env;
+  env.DoString("t = { a = { b = { c = 1 } } }");
+  auto t = env.GetGlobalTableR("t");
+  Integer sum = 0;
+
+  for (auto _ : state) {
+    sum += t["a"]["b"]["c"].As<Integer>();
+  }
+  benchmark::DoNotOptimize(sum);
+}
+
+BENCHMARK(BM_Table_IndexOperatorLegacy);
+BENCHMARK(BM_Table_IndexOperator);
+BENCHMARK(BM_Table_IndexOperatorChain);
@@ -122,3 +122,81 @@ TEST (hklua_table, full) {
 
   assert(env.StackEmpty());
 }
+
+TEST (hklua_table, iteration) {
+  Env env;
+  env.DoString("t = { 10, 20, 30, x = 1.5, y = 2.5, name = 'hklua' }");
+
+  auto t = env.GetGlobalTableR("t");
+  TableGuard g(t);
+  const auto top = env.StackGetTop();
+
+  int count = 0;
+  for (auto &kv : t) {
+    (void)kv;
+    ++count;
+  }
+  EXPECT_EQ(count, 6);
+  EXPECT_EQ(env.StackGetTop(), top);
+
+  /* Only string -> number entries */
+  double sum = 0;
+  count = 0;
+  for (auto &kv : t.Pairs<std::string, double>()) {
+    EXPECT_TRUE(kv.first == "x" || kv.first == "y");
+    sum += kv.second;
+    ++count;
+  }
+  EXPECT_EQ(count, 2);
+  EXPECT_DOUBLE_EQ(sum, 4.0);
+  EXPECT_EQ(env.StackGetTop(), top);
+
+  Integer expect_index = 1;
+  for (auto &kv : t.IPairs<Integer>()) {
+    EXPECT_EQ(kv.first, expect_index);
+    EXPECT_EQ(kv.second, expect_index * 10);
+    ++expect_index;
+  }
+  EXPECT_EQ(expect_index, 4);
+  EXPECT_EQ(env.StackGetTop(), top);
+
+  /* Break from the loop also keep the stack balanced */
+  for (auto &kv : t.Pairs<Variant, Variant>()) {
+    (void)kv;
+    break;
+  }
+  EXPECT_EQ(env.StackGetTop(), top);
+}
+
+TEST (hklua_table, index_operator_chain) {
+  Env env;
+  env.OpenLibs();
+  env.DoString("t = { a = { b = { c = 1 } }, x = 1.5 }");
+
+  auto t = env.GetGlobalTableR("t");
+  TableGuard g(t);
+  const auto top = env.StackGetTop();
+
+  int c = t["a"]["b"]["c"];
+  EXPECT_EQ(c, 1);
+  EXPECT_DOUBLE_EQ(t["x"].As<double>(), 1.5);
+
+  t["a"]["b"]["c"] = 2;
+  t["a"]["d"] = "D";
+  t["y"] = t["x"];
+  EXPECT_EQ(env.StackGetTop(), top);
+
+  ASSERT_EQ(HKLUA_OK, env.DoString(
+    "assert(t.a.b.c == 2) assert(t.a.d == 'D') assert(t.y == 1.5)"));
+
+  /* The intermediate value is not a table */
+  EXPECT_TRUE(t["none"]["b"].IsNil());
+  EXPECT_FALSE(t["none"]["b"].Set(1));
+  bool success;
+  t["x"]["b"].As<int>(&success);
+  EXPECT_FALSE(success);
+
+  t[1] = 10;
+  EXPECT_EQ(t[1].As<Integer>(), 10);
+  EXPECT_EQ(env.StackGetTop(), top);
+}
@@ -0,0 +1,94 @@
+#include "hklua/variant.h"
+
+#include <gtest/gtest.h>
+
+#include "hklua/env.h"
+
+using namespace hklua;
+
+TEST (variant_test, push_conv) {
+  Env env;
+  Variant values[] = { Variant(Integer(1)), Variant(2.5), Variant(true),
+                       Variant(false), Variant(std::string("abc")),
+                       Variant(Nil{}) };
+
+  for (auto &value : values) {
+    StackPush(env.env(), value);
+    ASSERT_EQ(1, env.StackSize());
+
+    Variant var;
+    ASSERT_TRUE(StackConv(env.env(), -1, var));
+    EXPECT_EQ(value.type(), var.type());
+    env.StackPop();
+  }
+
+  StackPush(env.env(), true);
+  EXPECT_TRUE(lua_toboolean(env.env(), -1));
+  env.StackPop();
+
+  VI<int> vi;
+  vi.is_nil = false;
+  vi.data = 3;
+  StackPush(env.env(), vi);
+  EXPECT_EQ(3, lua_tointeger(env.env(), -1));
+  env.StackPop();
+}
+
+TEST (variant_test, string) {
+  Env env;
+  env.OpenLibs();
+
+  /* small, full small, heap, embedded '\0' */
+  std::string strs[] = { "", "abc", std::string(Variant::kSmallStringCapacity, 'x'),
+                         std::string(64, 'y'), std::string("a\0b", 3) };
+  HKStringMode modes[] = { HK_STRING_SMALL, HK_STRING_SMALL, HK_STRING_SMALL,
+                           HK_STRING_HEAP, HK_STRING_SMALL };
+
+  for (size_t i = 0; i < sizeof strs / sizeof strs[0]; ++i) {
+    StackPush(env.env(), strs[i]);
+    Variant var;
+    ASSERT_TRUE(StackConv(env.env(), -1, var));
+    env.StackPop();
+    ASSERT_EQ(var.type(), HK_STRING);
+    EXPECT_EQ(var.string_mode(), modes[i]);
+
+    /* The string is owned, so it is valid after the value is collected */
+    env.GcCollect();
+    EXPECT_EQ(var.ToString(), strs[i]);
+
+    Variant copy(var);
+    Variant moved(std::move(var));
+    EXPECT_EQ(copy.ToStringView(), StringView(strs[i]));
+    EXPECT_EQ(moved.ToStringView(), StringView(strs[i]));
+
+    StackPush(env.env(), copy);
+    size_t len;
+    auto str = lua_tolstring(env.env(), -1, &len);
+    EXPECT_EQ(std::string(str, len), strs[i]);
+    env.StackPop();
+  }
+}
+
+TEST (variant_test, borrowed_string) {
+  Env env;
+  std::string long_str(64, 'z');
+  StackPush(env.env(), long_str);
+
+  Variant var;
+  ASSERT_TRUE(StackConvBorrowed(env.env(), -1, var));
+  EXPECT_EQ(var.string_mode(), HK_STRING_BORROWED);
+  EXPECT_EQ(var.ToCString(), lua_tostring(env.env(), -1));
+  EXPECT_EQ(var.ToString(), long_str);
+
+  /* Non-string is same as StackConv() */
+  StackPush(env.env(), Integer(1));
+  ASSERT_TRUE(StackConvBorrowed(env.env(), -1, var));
+  EXPECT_EQ(var.ToInteger(), 1);
+  env.StackPop(2);
+
+  var = std::string(long_str);
+  EXPECT_EQ(var.string_mode(), HK_STRING_HEAP);
+  var = StringView(long_str);
+  EXPECT_EQ(var.string_mode(), HK_STRING_BORROWED);
+  EXPECT_EQ(var.ToCString(), long_str.c_str());
+}